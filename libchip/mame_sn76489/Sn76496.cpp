@@ -115,6 +115,7 @@
 ***************************************************************************/
 
 #include <windows.h>
+#include <math.h>
 
 typedef int INT32;
 typedef unsigned int UINT32;
@@ -155,6 +156,8 @@ struct _sn76496_state
 	UINT32 MuteMask;	/* to mute channels separately */
 	float SampleDiv;
 	INT32 VolReg[4];
+	INT32 EventStep;	/* render by jumping between counter expiries */
+	INT32 Native;		/* one output per divided clock, no rate conversion */
 };
 
 
@@ -234,9 +237,38 @@ void segapsg_write_register(void *chip,unsigned char data)
 
 
 
-void segapsg_render(void *chip,int *buffer,int samples,bool add)
+/* clock the noise LFSR once */
+static inline void segapsg_noise_step(sn76496_state *R)
+{
+	// if noisemode is 1, both taps are enabled
+	// if noisemode is 0, the lower tap, whitenoisetap2, is held at 0
+	if (((R->RNG & R->WhitenoiseTap1)?1:0) ^ ((((R->RNG & R->WhitenoiseTap2)?1:0))*(NOISEMODE)))
+	{
+		R->RNG >>= 1;
+		R->RNG |= R->FeedbackMask;
+	}
+	else
+	{
+		R->RNG >>= 1;
+	}
+	R->Output[3] = R->RNG & 1;
+}
+
+
+
+/* sum of the channel outputs enabled in the low four bits of mask */
+static inline int segapsg_level(sn76496_state *R,UINT32 mask)
+{
+	return (((mask&0x01)&&R->Output[0])?R->Volume[0]:0)
+		+ (((mask&0x02)&&R->Output[1])?R->Volume[1]:0)
+		+ (((mask&0x04)&&R->Output[2])?R->Volume[2]:0)
+		+ (((mask&0x08)&&R->Output[3])?R->Volume[3]:0);
+}
+
+
+
+static void segapsg_render_clocked(sn76496_state *R,int *buffer,int samples,bool add)
 {
-	sn76496_state *R=(sn76496_state*)chip;
 	int i;
 	int out = 0;
 	int out2 = 0;
@@ -281,32 +313,166 @@ void segapsg_render(void *chip,int *buffer,int samples,bool add)
 				R->Count[3]--;
 				if (R->Count[3] <= 0)
 				{
-				// if noisemode is 1, both taps are enabled
-				// if noisemode is 0, the lower tap, whitenoisetap2, is held at 0
-					if (((R->RNG & R->WhitenoiseTap1)?1:0) ^ ((((R->RNG & R->WhitenoiseTap2)?1:0))*(NOISEMODE)))
-					{
-						R->RNG >>= 1;
-						R->RNG |= R->FeedbackMask;
-					}
-					else
-					{
-						R->RNG >>= 1;
-					}
-					R->Output[3] = R->RNG & 1;
-
+					segapsg_noise_step(R);
 					R->Count[3] = R->Period[3];
 				}
 			}
 
-			out += (((mask&0x10)&&R->Output[0])?R->Volume[0]:0)
-				+ (((mask&0x20)&&R->Output[1])?R->Volume[1]:0)
-				+ (((mask&0x40)&&R->Output[2])?R->Volume[2]:0)
-				+ (((mask&0x80)&&R->Output[3])?R->Volume[3]:0);
+			out += segapsg_level(R,mask>>4);
+			out2 += segapsg_level(R,mask);
+		}
+
+		out=(int)(((float)out)/cnt);
+		out2=(int)(((float)out2)/cnt);
+
+		cnt-=R->SampleDiv;
+
+		if(R->Negate) { out = -out; out2 = -out2; }
+
+		if(add)
+		{
+			*buffer+++=out;
+			*buffer+++=out2;
+		}
+		else
+		{
+			*buffer++=out;
+			*buffer++=out2;
+		}
+
+		samples--;
+	}
+}
+
+
+
+/* Bring the counters of muted channels that ran past zero back to where
+   the clocked renderer would have reloaded them on the way, flipping the
+   tone outputs as often. The noise shift register is left as it is */
+static void segapsg_wrap_muted(sn76496_state *R,UINT32 live)
+{
+	int i, over, flips;
+
+	for (i = 0;i < 4;i++)
+	{
+		if ((live&(1<<i)) || R->Count[i] > 0) continue;
+		over=-R->Count[i];
+		if (R->Period[i] > 0)
+		{
+			flips=1+over/R->Period[i];
+			R->Count[i]=R->Period[i]-over%R->Period[i];
+		}
+		else
+		{
+			/* a zero period reloads on every clock */
+			flips=1+over;
+			R->Count[i]=0;
+		}
+		if (i < 3) R->Output[i]^=flips&1;
+	}
+}
+
+
+
+/* Same output as segapsg_render_clocked, but instead of running every clock
+   it works out how many divided clocks are left until the next channel
+   counter expires and jumps straight there. The outputs are constant in
+   between, so the per clock sum of a sample is each level times the number
+   of clocks it was held. The cost follows the number of counter expiries
+   rather than the chip clock. Muted channels are left out of the search,
+   their counters are only wrapped to where the clocked renderer would
+   have them. */
+static void segapsg_render_event(sn76496_state *R,int *buffer,int samples,bool add)
+{
+	int i;
+	int out = 0;
+	int out2 = 0;
+	int level, level2, ticks, next, at, clocks;
+	UINT32 mask, live;
+	float cnt = 0;
+
+	mask=R->MuteMask&R->StereoMask;
+	/* only channels muted by segapsg_set_mute, a channel panned off both
+	   sides by the stereo register still runs to stay in phase */
+	live=(R->MuteMask|(R->MuteMask>>4))&0x0f;
+
+	level=segapsg_level(R,mask>>4);
+	level2=segapsg_level(R,mask);
+
+	while (samples > 0)
+	{
+		/* input clocks that make up this sample */
+		ticks=0;
+		if (cnt<R->SampleDiv)
+		{
+			ticks=(int)ceilf(R->SampleDiv-cnt);
+			cnt+=(float)ticks;
+		}
+
+		out=0;
+		out2=0;
+
+		while (ticks > 0)
+		{
+			/* divided clocks until the first counter expires */
+			next=0x7fffffff;
+			for (i = 0;i < 4;i++)
+			{
+				if (!(live&(1<<i))) continue;
+				if (R->Count[i] < next) next=(R->Count[i] > 1)?R->Count[i]:1;
+			}
+			/* input clock that divided clock lands on */
+			at=(next==0x7fffffff)?ticks:R->CurrentClock+(next-1)*R->ClockDivider;
+
+			if (at >= ticks)
+			{
+				/* nothing expires in this sample, run the counters down */
+				out+=level*ticks;
+				out2+=level2*ticks;
+				if (R->CurrentClock < ticks)
+				{
+					clocks=1+(ticks-1-R->CurrentClock)/R->ClockDivider;
+					for (i = 0;i < 4;i++) R->Count[i]-=clocks;
+					R->CyclestoREADY=(R->CyclestoREADY > clocks)?R->CyclestoREADY-clocks:0;
+					R->CurrentClock=R->ClockDivider-1-(ticks-1-R->CurrentClock-(clocks-1)*R->ClockDivider);
+					segapsg_wrap_muted(R,live);
+				}
+				else
+				{
+					R->CurrentClock-=ticks;
+				}
+				break;
+			}
+
+			out+=level*at;
+			out2+=level2*at;
 
-			out2 +=(((mask&0x01)&&R->Output[0])?R->Volume[0]:0)
-				+ (((mask&0x02)&&R->Output[1])?R->Volume[1]:0)
-				+ (((mask&0x04)&&R->Output[2])?R->Volume[2]:0)
-				+ (((mask&0x08)&&R->Output[3])?R->Volume[3]:0);
+			R->CyclestoREADY=(R->CyclestoREADY > next)?R->CyclestoREADY-next:0;
+			for (i = 0;i < 3;i++)
+			{
+				R->Count[i]-=next;
+				if (R->Count[i] <= 0 && (live&(1<<i)))
+				{
+					R->Output[i] ^= 1;
+					R->Count[i] = R->Period[i];
+				}
+			}
+			R->Count[3]-=next;
+			if (R->Count[3] <= 0 && (live&0x08))
+			{
+				segapsg_noise_step(R);
+				R->Count[3] = R->Period[3];
+			}
+			segapsg_wrap_muted(R,live);
+
+			/* the clock that expired plays the new level */
+			level=segapsg_level(R,mask>>4);
+			level2=segapsg_level(R,mask);
+			out+=level;
+			out2+=level2;
+
+			R->CurrentClock=R->ClockDivider-1;
+			ticks-=at+1;
 		}
 
 		out=(int)(((float)out)/cnt);
@@ -333,6 +499,81 @@ void segapsg_render(void *chip,int *buffer,int samples,bool add)
 
 
 
+/* At an output rate of base_clock/16 every sample is exactly one divided
+   clock, so there is nothing to average and the rate conversion of the
+   other renderers is bypassed. Each sample ticks the counters once and
+   plays the level that follows. */
+static void segapsg_render_native(sn76496_state *R,int *buffer,int samples,bool add)
+{
+	int i;
+	int out, out2;
+	UINT32 mask, live;
+
+	mask=R->MuteMask&R->StereoMask;
+	live=(R->MuteMask|(R->MuteMask>>4))&0x0f;
+
+	while (samples > 0)
+	{
+		if (R->CyclestoREADY > 0) R->CyclestoREADY--;
+
+		for (i = 0;i < 3;i++)
+		{
+			R->Count[i]--;
+			if (R->Count[i] <= 0 && (live&(1<<i)))
+			{
+				R->Output[i] ^= 1;
+				R->Count[i] = R->Period[i];
+			}
+		}
+		R->Count[3]--;
+		if (R->Count[3] <= 0 && (live&0x08))
+		{
+			segapsg_noise_step(R);
+			R->Count[3] = R->Period[3];
+		}
+		if (live != 0x0f) segapsg_wrap_muted(R,live);
+
+		out=segapsg_level(R,mask>>4);
+		out2=segapsg_level(R,mask);
+
+		if(R->Negate) { out = -out; out2 = -out2; }
+
+		if(add)
+		{
+			*buffer+++=out;
+			*buffer+++=out2;
+		}
+		else
+		{
+			*buffer++=out;
+			*buffer++=out2;
+		}
+
+		samples--;
+	}
+}
+
+
+
+void segapsg_render(void *chip,int *buffer,int samples,bool add)
+{
+	sn76496_state *R=(sn76496_state*)chip;
+
+	if (!R->EventStep) segapsg_render_clocked(R,buffer,samples,add);
+	else if (R->Native) segapsg_render_native(R,buffer,samples,add);
+	else segapsg_render_event(R,buffer,samples,add);
+}
+
+
+
+void segapsg_set_event(void *chip,bool enable)
+{
+	sn76496_state *R=(sn76496_state*)chip;
+	R->EventStep=enable?1:0;
+}
+
+
+
 void segapsg_set_gain(void *chip,int gain)
 {
 	sn76496_state *R=(sn76496_state*)chip;
@@ -391,6 +632,8 @@ void* segapsg_init(int base_clock,int rate,bool neg)
 
 	/* Default is SN76489A */
 	R->ClockDivider = 16/4;
+	/* one output per divided clock, the rate players run the chip at */
+	R->Native = (rate == base_clock/4/R->ClockDivider) ? 1 : 0;
 	R->FeedbackMask = 0x8000;     /* mask for feedback */
 	R->WhitenoiseTap1 = 0x01;   /* mask for white noise tap 1*/
 	R->WhitenoiseTap2 = 0x08;   /* mask for white noise tap 2*/
@@ -403,6 +646,7 @@ void* segapsg_init(int base_clock,int rate,bool neg)
 	R->Output[3] = R->RNG & 1;
 
 	R->MuteMask=0xff;
+	R->EventStep=1;
 
 	return R;
 }
@@ -3,9 +3,14 @@
 void segapsg_write_stereo(void* chip, unsigned char data);
 void segapsg_write_register(void* chip, unsigned char data);
 void segapsg_render(void* chip, int* buffer, int samples, bool add);
+// jump between counter expiries (default) or run the chip clock by clock, at
+// the native rate the default renders one counter tick per output instead
+void segapsg_set_event(void* chip, bool enable);
 void segapsg_set_gain(void* chip, int gain);
+// a rate of base_clock/16 renders one output per counter tick with no rate conversion
 void* segapsg_init(int base_clock, int rate, bool neg);
 void segapsg_shutdown(void* chip);
+// bit n set enables channel n (default 0x0f), the event renderer skips muted channels
 void segapsg_set_mute(void* chip, int mask);
 float segapsg_get_channel_volume(void* chip, int channel);
 const char* segapsg_about(void);
@@ -0,0 +1,1482 @@
+/*
+**
+** File: fm2151.c -- software implementation of Yamaha YM2151 FM Operator Type-M (OPM)
+**
+** Copyright Jarek Burczynski (bujar at mame dot net)
+** Copyright Tatsuyuki Satoh , MultiArcadeMachineEmulator development
+**
+** Version 2.150 final beta (MAME ym2151.c), reworked to the operator layout
+** of fm2612.c so both chips share the SIMD operator kernel
+**
+*/
+
+/*
+** History:
+**
+**  - the envelope generator, LFO and noise generator follow the MAME core,
+**    which was verified on the real chip
+**  - instance based like fm2612.c, the frequency and detune tables are per
+**    chip since they depend on the clock and output rate
+**  - phase and EG output are kept as one row of eight channels per operator,
+**    which is the lane layout of the SIMD operator kernel
+**  - the noise LFO waveform is a shift register rather than the capture of
+**    the real chip MAME plays back
+**  - timers, IRQs, CSM and the CT output pins are not emulated, a vgm log
+**    does not need them
+*/
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* static so these do not collide with the inline helpers of fm2612.c */
+#define INLINE static inline
+
+#include "Fm2151.h"
+
+
+/* globals */
+#define FREQ_SH			16  /* 16.16 fixed point (frequency calculations) */
+#define EG_SH			16  /* 16.16 fixed point (envelope generator timing) */
+#define LFO_SH			10  /* 22.10 fixed point (LFO calculations)       */
+
+#define FREQ_MASK		((1<<FREQ_SH)-1)
+
+/* envelope generator */
+#define ENV_BITS		10
+#define ENV_LEN			(1<<ENV_BITS)
+#define ENV_STEP		(128.0/ENV_LEN)
+
+#define MAX_ATT_INDEX	(ENV_LEN-1) /* 1023 */
+#define MIN_ATT_INDEX	(0)			/* 0 */
+
+#define EG_ATT			4
+#define EG_DEC			3
+#define EG_SUS			2
+#define EG_REL			1
+#define EG_OFF			0
+
+/* operator unit */
+#define SIN_BITS		10
+#define SIN_LEN			(1<<SIN_BITS)
+#define SIN_MASK		(SIN_LEN-1)
+
+#define TL_RES_LEN		(256) /* 8 bits addressing (real chip) */
+
+/*  TL_TAB_LEN is calculated as:
+*   13 - sinus amplitude bits     (Y axis)
+*   2  - sinus sign bit           (Y axis)
+*   TL_RES_LEN - sinus resolution (X axis)
+*/
+#define TL_TAB_LEN (13*2*TL_RES_LEN)
+
+#define ENV_QUIET		(TL_TAB_LEN>>3)
+
+/* decay 1 level table (3dB per step) */
+/* 0 - 15: 0, 3, 6, 9,12,15,18,21,24,27,30,33,36,39,42,93 (dB)*/
+#define SC(db) (UINT32) ( db * (4.0/ENV_STEP) )
+static const UINT32 d1l_tab[16]={
+ SC( 0),SC( 1),SC( 2),SC(3 ),SC(4 ),SC(5 ),SC(6 ),SC( 7),
+ SC( 8),SC( 9),SC(10),SC(11),SC(12),SC(13),SC(14),SC(31)
+};
+#undef SC
+
+
+#define RATE_STEPS (8)
+static const UINT8 eg_inc[19*RATE_STEPS]={
+
+/*cycle:0 1  2 3  4 5  6 7*/
+
+/* 0 */ 0,1, 0,1, 0,1, 0,1, /* rates 00..11 0 (increment by 0 or 1) */
+/* 1 */ 0,1, 0,1, 1,1, 0,1, /* rates 00..11 1 */
+/* 2 */ 0,1, 1,1, 0,1, 1,1, /* rates 00..11 2 */
+/* 3 */ 0,1, 1,1, 1,1, 1,1, /* rates 00..11 3 */
+
+/* 4 */ 1,1, 1,1, 1,1, 1,1, /* rate 12 0 (increment by 1) */
+/* 5 */ 1,1, 1,2, 1,1, 1,2, /* rate 12 1 */
+/* 6 */ 1,2, 1,2, 1,2, 1,2, /* rate 12 2 */
+/* 7 */ 1,2, 2,2, 1,2, 2,2, /* rate 12 3 */
+
+/* 8 */ 2,2, 2,2, 2,2, 2,2, /* rate 13 0 (increment by 2) */
+/* 9 */ 2,2, 2,4, 2,2, 2,4, /* rate 13 1 */
+/*10 */ 2,4, 2,4, 2,4, 2,4, /* rate 13 2 */
+/*11 */ 2,4, 4,4, 2,4, 4,4, /* rate 13 3 */
+
+/*12 */ 4,4, 4,4, 4,4, 4,4, /* rate 14 0 (increment by 4) */
+/*13 */ 4,4, 4,8, 4,4, 4,8, /* rate 14 1 */
+/*14 */ 4,8, 4,8, 4,8, 4,8, /* rate 14 2 */
+/*15 */ 4,8, 8,8, 4,8, 8,8, /* rate 14 3 */
+
+/*16 */ 8,8, 8,8, 8,8, 8,8, /* rates 15 0, 15 1, 15 2, 15 3 (increment by 8) */
+/*17 */ 16,16,16,16,16,16,16,16, /* rates 15 2, 15 3 for attack */
+/*18 */ 0,0, 0,0, 0,0, 0,0, /* infinity rates for attack and decay(s) */
+};
+
+
+#define O(a) (a*RATE_STEPS)
+
+/*note that there is no O(17) in this table - it's directly in the code */
+static const UINT8 eg_rate_select[32+64+32]={	/* Envelope Generator rates (32 + 64 rates + 32 RKS) */
+/* 32 infinite time rates */
+O(18),O(18),O(18),O(18),O(18),O(18),O(18),O(18),
+O(18),O(18),O(18),O(18),O(18),O(18),O(18),O(18),
+O(18),O(18),O(18),O(18),O(18),O(18),O(18),O(18),
+O(18),O(18),O(18),O(18),O(18),O(18),O(18),O(18),
+
+/* rates 00-11 */
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+O( 0),O( 1),O( 2),O( 3),
+
+/* rate 12 */
+O( 4),O( 5),O( 6),O( 7),
+
+/* rate 13 */
+O( 8),O( 9),O(10),O(11),
+
+/* rate 14 */
+O(12),O(13),O(14),O(15),
+
+/* rate 15 */
+O(16),O(16),O(16),O(16),
+
+/* 32 dummy rates (same as 15 3) */
+O(16),O(16),O(16),O(16),O(16),O(16),O(16),O(16),
+O(16),O(16),O(16),O(16),O(16),O(16),O(16),O(16),
+O(16),O(16),O(16),O(16),O(16),O(16),O(16),O(16),
+O(16),O(16),O(16),O(16),O(16),O(16),O(16),O(16)
+
+};
+#undef O
+
+/*rate  0,    1,    2,   3,   4,   5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15*/
+/*shift 11,   10,   9,   8,   7,   6,  5,  4,  3,  2, 1,  0,  0,  0,  0,  0 */
+/*mask  2047, 1023, 511, 255, 127, 63, 31, 15, 7,  3, 1,  0,  0,  0,  0,  0 */
+
+#define O(a) (a*1)
+static const UINT8 eg_rate_shift[32+64+32]={	/* Envelope Generator counter shifts (32 + 64 rates + 32 RKS) */
+/* 32 infinite time rates */
+O(0),O(0),O(0),O(0),O(0),O(0),O(0),O(0),
+O(0),O(0),O(0),O(0),O(0),O(0),O(0),O(0),
+O(0),O(0),O(0),O(0),O(0),O(0),O(0),O(0),
+O(0),O(0),O(0),O(0),O(0),O(0),O(0),O(0),
+
+/* rates 00-11 */
+O(11),O(11),O(11),O(11),
+O(10),O(10),O(10),O(10),
+O( 9),O( 9),O( 9),O( 9),
+O( 8),O( 8),O( 8),O( 8),
+O( 7),O( 7),O( 7),O( 7),
+O( 6),O( 6),O( 6),O( 6),
+O( 5),O( 5),O( 5),O( 5),
+O( 4),O( 4),O( 4),O( 4),
+O( 3),O( 3),O( 3),O( 3),
+O( 2),O( 2),O( 2),O( 2),
+O( 1),O( 1),O( 1),O( 1),
+O( 0),O( 0),O( 0),O( 0),
+
+/* rate 12 */
+O( 0),O( 0),O( 0),O( 0),
+
+/* rate 13 */
+O( 0),O( 0),O( 0),O( 0),
+
+/* rate 14 */
+O( 0),O( 0),O( 0),O( 0),
+
+/* rate 15 */
+O( 0),O( 0),O( 0),O( 0),
+
+/* 32 dummy rates (same as 15 3) */
+O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),
+O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),
+O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),
+O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),O( 0),O( 0)
+
+};
+#undef O
+
+/*  DT2 defines offset in cents from base note
+*
+*   This table defines offset in frequency-deltas table.
+*   User's Manual page 22
+*
+*   Values below were calculated using formula: value =  orig.val / 1.5625
+*
+*   DT2=0 DT2=1 DT2=2 DT2=3
+*   0     600   781   950
+*/
+static const UINT32 dt2_tab[4] = { 0, 384, 500, 608 };
+
+/*  DT1 defines offset in Hertz from base note
+*   This table is converted while initialization...
+*   Detune table shown in YM2151 User's Manual is wrong (verified on the real chip)
+*/
+static const UINT8 dt1_tab[4*32]={ /* 4*32 DT1 values */
+/* DT1=0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* DT1=1 */
+	0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2,
+	2, 3, 3, 3, 4, 4, 4, 5, 5, 6, 6, 7, 8, 8, 8, 8,
+/* DT1=2 */
+	1, 1, 1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5,
+	5, 6, 6, 7, 8, 8, 9,10,11,12,13,14,16,16,16,16,
+/* DT1=3 */
+	2, 2, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5, 5, 6, 6, 7,
+	8, 8, 9,10,11,12,13,14,16,17,19,20,22,22,22,22
+};
+
+
+/* tl_tab and sin_tab are the OPN ones, generated at build time by
+   ../mame_ym2612/gen/Fm2612Tables.cpp, the OPM has no use for lfo_pm_table */
+#include "Fm2612Tables.inc"
+
+/* register number to channel number , slot offset */
+#define OPM_CHAN(N) (N&7)
+#define OPM_SLOT(N) ((N>>3)&3)
+
+/* slot number, in register order M1, M2, C1, C2 */
+#define SLOT1 0
+#define SLOT2 2
+#define SLOT3 1
+#define SLOT4 3
+
+
+
+/* struct describing a single operator (SLOT), the phase and EG output read
+   every sample live in the YM2151 lanes below */
+typedef struct
+{
+	UINT32	dt1_i;		/* DT1 row in dt1_freq: DT1*32 */
+	INT32	dt1;		/* DT1 phase offset at the current key code */
+	UINT32	dt2;		/* DT2 offset in freq: dt2_tab[DT2] */
+	UINT32	mul;		/* multiple        :MUL*2, 1 for MUL=0 */
+	UINT8	ks;			/* key scale       :5-KS */
+	UINT32	ar;			/* attack rate  */
+	UINT32	d1r;		/* decay rate   */
+	UINT32	d2r;		/* sustain rate */
+	UINT32	rr;			/* release rate */
+
+	/* Envelope Generator */
+	UINT8	state;		/* phase type */
+	UINT32	tl;			/* total level: TL << 3 */
+	INT32	volume;		/* envelope counter */
+	UINT32	d1l;		/* decay 1 level:d1l_tab[D1L] */
+
+	UINT8	eg_sh_ar;	/*  (attack state) */
+	UINT8	eg_sel_ar;	/*  (attack state) */
+	UINT8	eg_sh_d1r;	/*  (decay state) */
+	UINT8	eg_sel_d1r;	/*  (decay state) */
+	UINT8	eg_sh_d2r;	/*  (sustain state) */
+	UINT8	eg_sel_d2r;	/*  (sustain state) */
+	UINT8	eg_sh_rr;	/*  (release state) */
+	UINT8	eg_sel_rr;	/*  (release state) */
+
+	UINT8	key;		/* 0=last key was KEY OFF, 1=KEY ON */
+
+	/* LFO */
+	UINT32	AMmask;		/* AM enable flag */
+
+} OPM_SLOT;
+
+typedef struct
+{
+	OPM_SLOT SLOT[4];	/* four SLOTs (operators) */
+
+	UINT8	ALGO;		/* algorithm */
+	UINT8	FB;			/* feedback shift */
+	INT32	op1_out[2];	/* op1 output for feedback */
+
+	INT32	*connect1;	/* SLOT1 output pointer */
+	INT32	*connect3;	/* SLOT3 output pointer */
+	INT32	*connect2;	/* SLOT2 output pointer */
+	INT32	*connect4;	/* SLOT4 output pointer */
+
+	INT32	*mem_connect;/* where to put the delayed sample (MEM) */
+	INT32	mem_value;	/* delayed sample (MEM) value */
+
+	UINT8	pms;		/* channel PMS */
+	UINT8	ams;		/* channel AMS */
+
+	UINT8	kc;			/* key code register: octave, note */
+	UINT32	kc_i;		/* key code and key fraction as an index in freq */
+} OPM_CH;
+
+/* here's the virtual YM2151 */
+typedef struct
+{
+	UINT8		REGS[256];			/* registers            */
+	OPM_CH		CH[8];				/* channel state        */
+
+	/* operator state read every sample, one row of eight channels per SLOT
+	   so that each row is a set of SIMD lanes */
+	UINT32		phase[4][8];		/* phase counter */
+	UINT32		Incr[4][8];			/* phase step without LFO PM */
+	UINT32		vol_out[4][8];		/* current output from EG circuit (without AM from LFO) */
+
+	UINT32		clock;				/* master clock  (Hz)   */
+	UINT32		rate;				/* sampling rate (Hz)   */
+	UINT8		test;				/* test register        */
+	unsigned int pan[8*2];			/* fm channels output masks (0xffffffff = enable) */
+
+	UINT32		eg_cnt;				/* global envelope generator counter */
+	UINT32		eg_timer;			/* global envelope generator counter works at frequency = chipclock/64/3 */
+	UINT32		eg_timer_add;		/* step of eg_timer */
+	UINT32		eg_timer_overflow;	/* envelope generator timer overlfows every 3 samples (on real chip) */
+
+	/* LFO */
+	UINT32		lfo_phase;			/* accumulated LFO phase (0 to 255) */
+	UINT32		lfo_timer;			/* LFO timer */
+	UINT32		lfo_timer_add;		/* step of lfo_timer */
+	UINT32		lfo_overflow;		/* LFO generates new output when lfo_timer reaches this value */
+	UINT32		lfo_counter;		/* LFO phase increment counter */
+	UINT32		lfo_counter_add;	/* step of lfo_counter */
+	UINT8		lfo_wsel;			/* LFO waveform (0-saw, 1-square, 2-triangle, 3-random noise) */
+	UINT8		amd;				/* LFO Amplitude Modulation Depth */
+	INT8		pmd;				/* LFO Phase Modulation Depth */
+	UINT32		lfa;				/* LFO current AM output */
+	INT32		lfp;				/* LFO current PM output */
+	UINT32		lfo_rng;			/* shift register of the noise LFO waveform */
+
+	/* noise generator */
+	UINT32		noise;				/* noise enable/period register (bit 7 - noise enable, bits 4-0 - noise period */
+	UINT32		noise_rng;			/* 17 bit noise shift register */
+	UINT32		noise_p;			/* current noise 'phase' */
+	UINT32		noise_f;			/* current noise period */
+
+	INT32		m2,c1,c2;			/* Phase Modulation input for operators 2,3,4 */
+	INT32		mem;				/* one sample delay memory */
+	INT32		out_fm[8];			/* outputs of working channels */
+
+	/* local tables, they depend on the clock and rate */
+	UINT32		freq[11*768];		/* 11 octaves, 768 key code steps each */
+	INT32		dt1_freq[8*32];		/* 8 DT1 levels, 32 KC values */
+	UINT32		noise_tab[32];		/* 17bit Noise Generator periods */
+
+	int mute;
+	int simd;						/* render with the SIMD operator kernel */
+} YM2151;
+
+
+/* initialize the tables that depend on the clock and output rate */
+static void init_tables(YM2151 *F)
+{
+	double scaler = (F->rate) ? ((double)F->clock / 64.0) / F->rate : 0;
+	int i,j;
+
+	/* at the native rate of one sample per 64 clocks the tables are used
+	   unscaled, rounding the rate down must not detune the chip */
+	if (F->rate && F->clock / 64 == F->rate)
+		scaler = 1.0;
+
+	for (i = 0; i < 768; i++)
+	{
+		/* phase increment of octave 2 in 10.10 fixed point. the real chip
+		   reads these from a rom of 64 steps per semitone starting at C#,
+		   here they follow the tempered scale that has KC 0x4a (A4) at 440Hz
+		   with a 3.58MHz clock */
+		double phaseinc = floor(1299.0 * pow(2.0, i / 768.0) + 0.5) * scaler;
+
+		/* octave 2 - reference octave */
+		F->freq[768 + 2*768 + i] = ((UINT32)(phaseinc * (1<<(FREQ_SH-10)))) & 0xffffffc0;
+
+		/* octave 0 and octave 1 */
+		for (j = 0; j < 2; j++)
+			F->freq[768 + j*768 + i] = (F->freq[768 + 2*768 + i] >> (2-j)) & 0xffffffc0;
+
+		/* octave 3 to 7 */
+		for (j = 3; j < 8; j++)
+			F->freq[768 + j*768 + i] = F->freq[768 + 2*768 + i] << (j-2);
+	}
+
+	/* octave -1 (all equal to: oct 0, KC 00, KF 00), reached by LFO PM */
+	for (i = 0; i < 768; i++)
+		F->freq[i] = F->freq[768];
+
+	/* octave 8 and 9 (all equal to: oct 7, KC 14, KF 63), reached by DT2 and LFO PM */
+	for (j = 8; j < 10; j++)
+		for (i = 0; i < 768; i++)
+			F->freq[768 + j*768 + i] = F->freq[768 + 8*768 - 1];
+
+	/* DeTune table */
+	for (j = 0; j < 4; j++)
+	{
+		for (i = 0; i < 32; i++)
+		{
+			F->dt1_freq[(j+0)*32 + i] = (INT32)(dt1_tab[j*32 + i] * scaler * (1<<(FREQ_SH-10)));
+			F->dt1_freq[(j+4)*32 + i] = -F->dt1_freq[j*32 + i];
+		}
+	}
+
+	/* noise periods, in 16.16 shifts of the shift register per sample */
+	for (i = 0; i < 32; i++)
+	{
+		j = (i != 31 ? i : 30);				/* rate 30 and 31 are the same */
+		j = 32 - j;
+		j = (int)(65536.0 / (double)(j*32.0));	/* number of samples per one shift of the shift register */
+		F->noise_tab[i] = (UINT32)(j * 64 * scaler);
+	}
+
+	/* EG is updated every 3 samples */
+	F->eg_timer_add      = (UINT32)((1<<EG_SH) * scaler);
+	F->eg_timer_overflow = ( 3 ) * (1<<EG_SH);
+
+	/* LFO timer increment (every samples) */
+	F->lfo_timer_add = (UINT32)((1<<LFO_SH) * scaler);
+}
+
+
+#define volume_calc(F,c,s,AM) ((F)->vol_out[s][c] + ((AM) & (F)->CH[c].SLOT[s].AMmask))
+
+INLINE void update_vol_out(YM2151 *F, int c, int s)
+{
+	F->vol_out[s][c] = (UINT32)F->CH[c].SLOT[s].volume + F->CH[c].SLOT[s].tl;
+}
+
+INLINE void FM_KEYON(YM2151 *F, int c, int s)
+{
+	OPM_SLOT *SLOT = &F->CH[c].SLOT[s];
+
+	if( !SLOT->key )
+	{
+		/* restart Phase Generator */
+		F->phase[s][c] = 0;
+
+		/* KEY ON = attack */
+		SLOT->state = EG_ATT;
+		SLOT->volume += (~SLOT->volume * (eg_inc[SLOT->eg_sel_ar + ((F->eg_cnt>>SLOT->eg_sh_ar)&7)]))>>4;
+		if (SLOT->volume <= MIN_ATT_INDEX)
+		{
+			SLOT->volume = MIN_ATT_INDEX;
+			SLOT->state = EG_DEC;
+		}
+		update_vol_out(F, c, s);
+	}
+	SLOT->key = 1;
+}
+
+INLINE void FM_KEYOFF(YM2151 *F, int c, int s)
+{
+	OPM_SLOT *SLOT = &F->CH[c].SLOT[s];
+
+	if( SLOT->key )
+	{
+		SLOT->key = 0;
+
+		if (SLOT->state>EG_REL)
+			SLOT->state = EG_REL; /* phase -> Release */
+	}
+}
+
+/* set algorithm connection */
+static void setup_connection( YM2151 *F, OPM_CH *CH, int ch )
+{
+	INT32 *carrier = &F->out_fm[ch];
+
+	/* SLOT4 (C2) always goes to the output */
+	CH->connect4 = carrier;
+
+	switch( CH->ALGO )
+	{
+	case 0:
+		/* M1---C1---MEM---M2---C2---OUT */
+		CH->connect1 = &F->c1;
+		CH->connect2 = &F->mem;
+		CH->connect3 = &F->c2;
+		CH->mem_connect = &F->m2;
+		break;
+	case 1:
+		/* M1------+-MEM---M2---C2---OUT */
+		/*      C1-+                     */
+		CH->connect1 = &F->mem;
+		CH->connect2 = &F->mem;
+		CH->connect3 = &F->c2;
+		CH->mem_connect = &F->m2;
+		break;
+	case 2:
+		/* M1-----------------+-C2---OUT */
+		/*      C1---MEM---M2-+          */
+		CH->connect1 = &F->c2;
+		CH->connect2 = &F->mem;
+		CH->connect3 = &F->c2;
+		CH->mem_connect = &F->m2;
+		break;
+	case 3:
+		/* M1---C1---MEM------+-C2---OUT */
+		/*                 M2-+          */
+		CH->connect1 = &F->c1;
+		CH->connect2 = &F->mem;
+		CH->connect3 = &F->c2;
+		CH->mem_connect = &F->c2;
+		break;
+	case 4:
+		/* M1---C1-+-OUT */
+		/* M2---C2-+     */
+		/* MEM: not used */
+		CH->connect1 = &F->c1;
+		CH->connect2 = carrier;
+		CH->connect3 = &F->c2;
+		CH->mem_connect = &F->mem;
+		break;
+	case 5:
+		/*    +----C1----+     */
+		/* M1-+-MEM---M2-+-OUT */
+		/*    +----C2----+     */
+		CH->connect1 = 0;	/* special mark */
+		CH->connect2 = carrier;
+		CH->connect3 = carrier;
+		CH->mem_connect = &F->m2;
+		break;
+	case 6:
+		/* M1---C1-+     */
+		/*      M2-+-OUT */
+		/*      C2-+     */
+		/* MEM: not used */
+		CH->connect1 = &F->c1;
+		CH->connect2 = carrier;
+		CH->connect3 = carrier;
+		CH->mem_connect = &F->mem;
+		break;
+	case 7:
+		/* M1-+     */
+		/* C1-+-OUT */
+		/* M2-+     */
+		/* C2-+     */
+		/* MEM: not used*/
+		CH->connect1 = carrier;
+		CH->connect2 = carrier;
+		CH->connect3 = carrier;
+		CH->mem_connect = &F->mem;
+		break;
+	}
+}
+
+/* update the EG rates of a slot after a key code or rate change */
+static void refresh_eg_slot(OPM_CH *CH, OPM_SLOT *SLOT)
+{
+	/* v = 32 + 2*RATE + RKS = max 126 */
+	UINT32 v = CH->kc >> SLOT->ks;
+
+	if ((SLOT->ar + v) < 32+62)
+	{
+		SLOT->eg_sh_ar  = eg_rate_shift [SLOT->ar + v];
+		SLOT->eg_sel_ar = eg_rate_select[SLOT->ar + v];
+	}
+	else
+	{
+		SLOT->eg_sh_ar  = 0;
+		SLOT->eg_sel_ar = 17*RATE_STEPS;
+	}
+
+	SLOT->eg_sh_d1r = eg_rate_shift [SLOT->d1r + v];
+	SLOT->eg_sh_d2r = eg_rate_shift [SLOT->d2r + v];
+	SLOT->eg_sh_rr  = eg_rate_shift [SLOT->rr  + v];
+
+	SLOT->eg_sel_d1r= eg_rate_select[SLOT->d1r + v];
+	SLOT->eg_sel_d2r= eg_rate_select[SLOT->d2r + v];
+	SLOT->eg_sel_rr = eg_rate_select[SLOT->rr  + v];
+}
+
+/* update the phase increments of a channel after a KC, KF, DT1, MUL or DT2 change */
+static void refresh_fc_chan(YM2151 *F, int c)
+{
+	OPM_CH *CH = &F->CH[c];
+	int s;
+
+	for (s = 0; s < 4; s++)
+	{
+		OPM_SLOT *SLOT = &CH->SLOT[s];
+
+		SLOT->dt1 = F->dt1_freq[SLOT->dt1_i + (CH->kc>>2)];
+		F->Incr[s][c] = ((F->freq[CH->kc_i + SLOT->dt2] + SLOT->dt1) * SLOT->mul) >> 1;
+	}
+}
+
+/* advance the envelope generator of every operator */
+static void advance_eg(YM2151 *F)
+{
+	int c, s;
+
+	F->eg_timer += F->eg_timer_add;
+	while (F->eg_timer >= F->eg_timer_overflow)
+	{
+		F->eg_timer -= F->eg_timer_overflow;
+		F->eg_cnt++;
+
+		for (c = 0; c < 8; c++)
+		{
+			for (s = 0; s < 4; s++)
+			{
+				OPM_SLOT *SLOT = &F->CH[c].SLOT[s];
+
+				switch(SLOT->state)
+				{
+				case EG_ATT:	/* attack phase */
+					if (!(F->eg_cnt & ((1<<SLOT->eg_sh_ar)-1)))
+					{
+						SLOT->volume += (~SLOT->volume * (eg_inc[SLOT->eg_sel_ar + ((F->eg_cnt>>SLOT->eg_sh_ar)&7)]))>>4;
+
+						if (SLOT->volume <= MIN_ATT_INDEX)
+						{
+							SLOT->volume = MIN_ATT_INDEX;
+							SLOT->state = EG_DEC;
+						}
+					}
+					break;
+
+				case EG_DEC:	/* decay phase */
+					if (!(F->eg_cnt & ((1<<SLOT->eg_sh_d1r)-1)))
+					{
+						SLOT->volume += eg_inc[SLOT->eg_sel_d1r + ((F->eg_cnt>>SLOT->eg_sh_d1r)&7)];
+
+						if (SLOT->volume >= (INT32)(SLOT->d1l))
+							SLOT->state = EG_SUS;
+					}
+					break;
+
+				case EG_SUS:	/* sustain phase */
+					if (!(F->eg_cnt & ((1<<SLOT->eg_sh_d2r)-1)))
+					{
+						SLOT->volume += eg_inc[SLOT->eg_sel_d2r + ((F->eg_cnt>>SLOT->eg_sh_d2r)&7)];
+
+						if (SLOT->volume >= MAX_ATT_INDEX)
+						{
+							SLOT->volume = MAX_ATT_INDEX;
+							SLOT->state = EG_OFF;
+						}
+					}
+					break;
+
+				case EG_REL:	/* release phase */
+					if (!(F->eg_cnt & ((1<<SLOT->eg_sh_rr)-1)))
+					{
+						SLOT->volume += eg_inc[SLOT->eg_sel_rr + ((F->eg_cnt>>SLOT->eg_sh_rr)&7)];
+
+						if (SLOT->volume >= MAX_ATT_INDEX)
+						{
+							SLOT->volume = MAX_ATT_INDEX;
+							SLOT->state = EG_OFF;
+						}
+					}
+					break;
+				}
+
+				update_vol_out(F, c, s);
+			}
+		}
+	}
+}
+
+/* the noise waveform of the real LFO is not known, MAME plays back a capture
+   of it. a byte of a 17 bit shift register, clocked eight times for each
+   LFO step, stands in for it here */
+INLINE void advance_lfo_noise(YM2151 *F)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+	{
+		UINT32 j = ((F->lfo_rng ^ (F->lfo_rng>>3)) & 1) ^ 1;
+		F->lfo_rng = (j<<16) | (F->lfo_rng>>1);
+	}
+}
+
+/* advance the LFO and work out its AM and PM outputs */
+INLINE void advance_lfo(YM2151 *F)
+{
+	INT32 a, p;
+	UINT32 i;
+
+	if (F->test & 2)
+		F->lfo_phase = 0;
+	else
+	{
+		F->lfo_timer += F->lfo_timer_add;
+		if (F->lfo_timer >= F->lfo_overflow)
+		{
+			F->lfo_timer   -= F->lfo_overflow;
+			F->lfo_counter += F->lfo_counter_add;
+			if (F->lfo_counter >> 4)
+				advance_lfo_noise(F);
+			F->lfo_phase   += (F->lfo_counter>>4);
+			F->lfo_phase   &= 255;
+			F->lfo_counter &= 15;
+		}
+	}
+
+	i = F->lfo_phase;
+	/* calculate LFO AM and PM waveform value (all verified on real chip, except for noise algorithm which is impossible to analyse)*/
+	switch (F->lfo_wsel)
+	{
+	case 0:
+		/* saw */
+		/* AM: 255 down to 0 */
+		/* PM: 0 to 127, -127 to 0 (at PMD=127: LFP = 0 to 126, -126 to 0) */
+		a = 255 - i;
+		if (i<128)
+			p = i;
+		else
+			p = i - 255;
+		break;
+	case 1:
+		/* square */
+		/* AM: 255, 0 */
+		/* PM: 128,-128 (LFP = exactly +PMD, -PMD) */
+		if (i<128)
+		{
+			a = 255;
+			p = 128;
+		}
+		else
+		{
+			a = 0;
+			p = -128;
+		}
+		break;
+	case 2:
+		/* triangle */
+		/* AM: 255 down to 1 step 2, 0 up to 254 step 2 */
+		/* PM: 0 to 126 step 2, 127 to 1 step 2, 0 to -126 step 2, -127 to -1 step 2*/
+		if (i<128)
+			a = 255 - (i*2);
+		else
+			a = (i*2) - 256;
+
+		if (i<64)							/* i = 0..63 */
+			p = i*2;						/* 0 to 126 step 2 */
+		else if (i<128)						/* i = 64..127 */
+			p = 255 - i*2;					/* 127 to 1 step 2 */
+		else if (i<192)						/* i = 128..191 */
+			p = 256 - i*2;					/* 0 to -126 step 2*/
+		else								/* i = 192..255 */
+			p = i*2 - 511;					/*-127 to -1 step 2*/
+		break;
+	case 3:
+	default:	/*keep the compiler happy*/
+		/* random */
+		/* AM: range 0 to 255    */
+		/* PM: range -128 to 127 */
+		a = F->lfo_rng & 255;
+		p = a-128;
+		break;
+	}
+	F->lfa = a * F->amd / 128;
+	F->lfp = p * F->pmd / 128;
+}
+
+/*  The Noise Generator of the YM2151 is 17-bit shift register.
+*   Input to the bit16 is negated (bit0 XOR bit3) (EXNOR).
+*   Output of the register is negated (bit0 XOR bit3).
+*   Simply use bit16 as the noise output.
+*/
+INLINE void advance_noise(YM2151 *F)
+{
+	UINT32 i;
+
+	F->noise_p += F->noise_f;
+	i = (F->noise_p>>16);		/* number of events (shifts of the shift register) */
+	F->noise_p &= 0xffff;
+	while (i)
+	{
+		UINT32 j = ((F->noise_rng ^ (F->noise_rng>>3)) & 1) ^ 1;
+		F->noise_rng = (j<<16) | (F->noise_rng>>1);
+		i--;
+	}
+}
+
+/* channel AM from the LFO */
+INLINE UINT32 chan_am(YM2151 *F, OPM_CH *CH)
+{
+	return CH->ams ? F->lfa << (CH->ams-1) : 0;
+}
+
+INLINE signed int op_calc(UINT32 phase, unsigned int env, signed int pm)
+{
+  UINT32 p;
+
+  p = (env<<3) + sin_tab[ ( ((signed int)((phase & ~FREQ_MASK) + (pm<<15))) >> FREQ_SH ) & SIN_MASK ];
+
+  if (p >= TL_TAB_LEN)
+    return 0;
+  return tl_tab[p];
+}
+
+INLINE signed int op_calc1(UINT32 phase, unsigned int env, signed int pm)
+{
+  UINT32 p;
+
+  p = (env<<3) + sin_tab[ ( ((signed int)((phase & ~FREQ_MASK) + pm      )) >> FREQ_SH ) & SIN_MASK ];
+
+  if (p >= TL_TAB_LEN)
+    return 0;
+  return tl_tab[p];
+}
+
+/* SLOT4 of channel 8 when it plays the noise generator, the range of the
+   YM2151 noise output is -2044 to 2040 */
+INLINE signed int noise_calc(YM2151 *F, unsigned int env)
+{
+  signed int out = (env < 0x3ff) ? (signed int)(env ^ 0x3ff) * 2 : 0;
+
+  return (F->noise_rng & 0x10000) ? out : -out;
+}
+
+INLINE void chan_calc(YM2151 *F, int c)
+{
+  OPM_CH *CH = &F->CH[c];
+  UINT32 AM = chan_am(F, CH);
+
+  F->m2 = F->c1 = F->c2 = F->mem = 0;
+
+  *CH->mem_connect = CH->mem_value;  /* restore delayed sample (MEM) value to m2 or c2 */
+
+  unsigned int eg_out = volume_calc(F, c, SLOT1, AM);
+  {
+    INT32 out = CH->op1_out[0] + CH->op1_out[1];
+    CH->op1_out[0] = CH->op1_out[1];
+
+    if( !CH->connect1 )
+    {
+      /* algorithm 5  */
+      F->mem = F->c1 = F->c2 = CH->op1_out[0];
+    }
+    else
+    {
+      /* other algorithms */
+      *CH->connect1 += CH->op1_out[0];
+    }
+
+
+    CH->op1_out[1] = 0;
+    if( eg_out < ENV_QUIET )  /* SLOT 1 */
+    {
+      if (!CH->FB)
+        out=0;
+
+      CH->op1_out[1] = op_calc1(F->phase[SLOT1][c], eg_out, (out<<CH->FB) );
+    }
+  }
+
+  eg_out = volume_calc(F, c, SLOT3, AM);
+  if( eg_out < ENV_QUIET )    /* SLOT 3 */
+    *CH->connect3 += op_calc(F->phase[SLOT3][c], eg_out, F->m2);
+
+  eg_out = volume_calc(F, c, SLOT2, AM);
+  if( eg_out < ENV_QUIET )    /* SLOT 2 */
+    *CH->connect2 += op_calc(F->phase[SLOT2][c], eg_out, F->c1);
+
+  eg_out = volume_calc(F, c, SLOT4, AM);
+  if( c == 7 && (F->noise & 0x80) )    /* SLOT 4 plays noise */
+    *CH->connect4 += noise_calc(F, eg_out);
+  else if( eg_out < ENV_QUIET )    /* SLOT 4 */
+    *CH->connect4 += op_calc(F->phase[SLOT4][c], eg_out, F->c2);
+
+
+  /* store current MEM */
+  CH->mem_value = F->mem;
+}
+
+/* update phase counters AFTER output calculations, with the new LFO PM */
+INLINE void chan_update_phase(YM2151 *F, int c)
+{
+  OPM_CH *CH = &F->CH[c];
+  INT32 mod_ind = 0;
+  int s;
+
+  if (CH->pms)	/* only when phase modulation from LFO is enabled for this channel */
+  {
+    mod_ind = F->lfp;		/* -128..+127 (8bits signed) */
+    if (CH->pms < 6)
+      mod_ind >>= (6 - CH->pms);
+    else
+      mod_ind <<= (CH->pms - 5);
+  }
+
+  if (mod_ind)
+  {
+    UINT32 kc_channel = CH->kc_i + mod_ind;
+
+    for (s = 0; s < 4; s++)
+      F->phase[s][c] += ((F->freq[kc_channel + CH->SLOT[s].dt2] + CH->SLOT[s].dt1) * CH->SLOT[s].mul) >> 1;
+  }
+  else		/* phase modulation from LFO is equal to zero */
+  {
+    for (s = 0; s < 4; s++)
+      F->phase[s][c] += F->Incr[s][c];
+  }
+}
+
+/* SIMD operator kernel
+ *
+ * the same kernel as fm2612.c: one operator stage (SLOT1, SLOT3, SLOT2,
+ * SLOT4) is evaluated for all channels at once, the sin_tab/tl_tab lookups
+ * are AVX2 gathers and the connection routing becomes per lane masks, so the
+ * output is bit-exact with chan_calc(). the OPM has eight channels so every
+ * lane is used, and the phase and EG output rows load straight into lanes.
+ */
+#if defined(__AVX2__)
+#define FM_SIMD 1
+#include <immintrin.h>
+#else
+#define FM_SIMD 0
+#endif
+
+#if FM_SIMD
+
+#define FM_LANES 8
+
+/* eight 32 bit lanes, lane n holds channel n */
+typedef struct { __m256i v; } FM_VEC;
+
+INLINE FM_VEC fm_v(__m256i v) { FM_VEC r; r.v = v; return r; }
+INLINE FM_VEC fm_set1(INT32 x) { return fm_v(_mm256_set1_epi32(x)); }
+INLINE FM_VEC fm_load(const void *p) { return fm_v(_mm256_loadu_si256((const __m256i*)p)); }
+INLINE void fm_store(void *p, FM_VEC a) { _mm256_storeu_si256((__m256i*)p, a.v); }
+INLINE FM_VEC fm_add(FM_VEC a, FM_VEC b) { return fm_v(_mm256_add_epi32(a.v, b.v)); }
+INLINE FM_VEC fm_and(FM_VEC a, FM_VEC b) { return fm_v(_mm256_and_si256(a.v, b.v)); }
+INLINE FM_VEC fm_cmplt(FM_VEC a, FM_VEC b) { return fm_v(_mm256_cmpgt_epi32(b.v, a.v)); }
+INLINE FM_VEC fm_mul(FM_VEC a, FM_VEC b) { return fm_v(_mm256_mullo_epi32(a.v, b.v)); }
+INLINE FM_VEC fm_sllv(FM_VEC a, FM_VEC n) { return fm_v(_mm256_sllv_epi32(a.v, n.v)); }
+#define fm_slli(a, n) fm_v(_mm256_slli_epi32((a).v, n))
+#define fm_srli(a, n) fm_v(_mm256_srli_epi32((a).v, n))
+
+/* base[idx[n]] for each lane, the tables are 16 bit and padded by one entry
+   so the 32 bit load at the last index stays inside them */
+INLINE FM_VEC fm_gather_s16(const INT16 *base, FM_VEC idx)
+{
+	__m256i v = _mm256_i32gather_epi32((const int*)base, idx.v, 2);
+	return fm_v(_mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16));
+}
+INLINE FM_VEC fm_gather_u16(const UINT16 *base, FM_VEC idx)
+{
+	__m256i v = _mm256_i32gather_epi32((const int*)base, idx.v, 2);
+	return fm_v(_mm256_and_si256(v, _mm256_set1_epi32(0xffff)));
+}
+
+/* where an operator output goes, see setup_connection() */
+#define FM_TO_M2	0x01
+#define FM_TO_C1	0x02
+#define FM_TO_C2	0x04
+#define FM_TO_MEM	0x08
+#define FM_TO_OUT	0x10
+
+/* operator state of all channels laid out as lanes, valid for one ym2151_render() call */
+typedef struct
+{
+	int		pm;					/* some channel has LFO PM enabled */
+	int		noise;				/* SLOT4 of channel 8 plays the noise generator */
+	FM_VEC	ams_sh;				/* channel AMS-1 */
+	FM_VEC	am_mask[4];			/* AM enable flag per operator, clear when AMS is 0 */
+	FM_VEC	fb_mul;				/* 1<<FB, or 0 when feedback is off */
+	FM_VEC	op1_out[2];			/* op1 output for feedback */
+	FM_VEC	mem_value;			/* delayed sample (MEM) value */
+
+	/* connection routing masks, one per source and destination */
+	FM_VEC	op1_m[4];			/* SLOT1 to c1, c2, mem, out */
+	FM_VEC	op3_m[2];			/* SLOT3 to c2, out */
+	FM_VEC	op2_m[2];			/* SLOT2 to mem, out */
+	FM_VEC	mem_m[3];			/* MEM to m2, c2, mem */
+	FM_VEC	op4_m;				/* SLOT4 to out, clear in the noise lane */
+} FM_LANES_STATE;
+
+static unsigned fm_route(YM2151 *F, const INT32 *p, int c)
+{
+	if (!p)                      return FM_TO_C1 | FM_TO_C2 | FM_TO_MEM; /* algorithm 5 */
+	if (p == &F->m2)             return FM_TO_M2;
+	if (p == &F->c1)             return FM_TO_C1;
+	if (p == &F->c2)             return FM_TO_C2;
+	if (p == &F->mem)            return FM_TO_MEM;
+	if (p == &F->out_fm[c])      return FM_TO_OUT;
+	return 0;
+}
+
+/* load the per channel state that does not change while rendering */
+static void chan_lanes_load(YM2151 *F, FM_LANES_STATE *L)
+{
+	INT32 m[12][FM_LANES];
+	INT32 am[4][FM_LANES], sh[FM_LANES], fb[FM_LANES], op1[2][FM_LANES], mem[FM_LANES];
+	int c, s;
+
+	L->pm    = 0;
+	L->noise = (F->noise & 0x80) != 0;
+	for (c = 0; c < FM_LANES; c++)
+	{
+		OPM_CH *CH = &F->CH[c];
+		unsigned r1 = fm_route(F, CH->connect1, c);
+		unsigned r3 = fm_route(F, CH->connect3, c);
+		unsigned r2 = fm_route(F, CH->connect2, c);
+		unsigned rm = fm_route(F, CH->mem_connect, c);
+
+		m[0][c]  = (r1 & FM_TO_C1)  ? ~0 : 0;
+		m[1][c]  = (r1 & FM_TO_C2)  ? ~0 : 0;
+		m[2][c]  = (r1 & FM_TO_MEM) ? ~0 : 0;
+		m[3][c]  = (r1 & FM_TO_OUT) ? ~0 : 0;
+		m[4][c]  = (r3 & FM_TO_C2)  ? ~0 : 0;
+		m[5][c]  = (r3 & FM_TO_OUT) ? ~0 : 0;
+		m[6][c]  = (r2 & FM_TO_MEM) ? ~0 : 0;
+		m[7][c]  = (r2 & FM_TO_OUT) ? ~0 : 0;
+		m[8][c]  = (rm & FM_TO_M2)  ? ~0 : 0;
+		m[9][c]  = (rm & FM_TO_C2)  ? ~0 : 0;
+		m[10][c] = (rm & FM_TO_MEM) ? ~0 : 0;
+		m[11][c] = (c == 7 && L->noise) ? 0 : ~0;
+
+		sh[c]     = CH->ams ? CH->ams - 1 : 0;
+		fb[c]     = CH->FB ? (1 << CH->FB) : 0;
+		op1[0][c] = CH->op1_out[0];
+		op1[1][c] = CH->op1_out[1];
+		mem[c]    = CH->mem_value;
+		for (s = 0; s < 4; s++)
+			am[s][c] = CH->ams ? CH->SLOT[s].AMmask : 0;
+
+		L->pm |= CH->pms;
+	}
+
+	L->ams_sh = fm_load(sh);
+	for (s = 0; s < 4; s++) L->am_mask[s] = fm_load(am[s]);
+	L->fb_mul     = fm_load(fb);
+	L->op1_out[0] = fm_load(op1[0]);
+	L->op1_out[1] = fm_load(op1[1]);
+	L->mem_value  = fm_load(mem);
+	for (s = 0; s < 4; s++) L->op1_m[s] = fm_load(m[s]);
+	for (s = 0; s < 2; s++) L->op3_m[s] = fm_load(m[4+s]);
+	for (s = 0; s < 2; s++) L->op2_m[s] = fm_load(m[6+s]);
+	for (s = 0; s < 3; s++) L->mem_m[s] = fm_load(m[8+s]);
+	L->op4_m = fm_load(m[11]);
+}
+
+/* write back the state chan_calc() keeps between samples */
+static void chan_lanes_store(YM2151 *F, FM_LANES_STATE *L)
+{
+	INT32 op1[2][FM_LANES], mem[FM_LANES];
+	int c;
+
+	fm_store(op1[0], L->op1_out[0]);
+	fm_store(op1[1], L->op1_out[1]);
+	fm_store(mem, L->mem_value);
+	for (c = 0; c < FM_LANES; c++)
+	{
+		F->CH[c].op1_out[0] = op1[0][c];
+		F->CH[c].op1_out[1] = op1[1][c];
+		F->CH[c].mem_value  = mem[c];
+	}
+}
+
+/* op_calc() for all lanes, pm is the phase modulation already in phase units */
+INLINE FM_VEC op_calc_lanes(FM_VEC phase, FM_VEC env, FM_VEC pm)
+{
+	FM_VEC idx   = fm_and(fm_srli(fm_add(fm_and(phase, fm_set1(~FREQ_MASK)), pm), FREQ_SH), fm_set1(SIN_MASK));
+	FM_VEC p     = fm_add(fm_slli(env, 3), fm_gather_u16(sin_tab, idx));
+	FM_VEC valid = fm_and(fm_cmplt(env, fm_set1(ENV_QUIET)), fm_cmplt(p, fm_set1(TL_TAB_LEN)));
+
+	return fm_and(fm_gather_s16(tl_tab, fm_and(p, valid)), valid);
+}
+
+/* chan_calc() for all channels, outputs land in F->out_fm */
+INLINE void chan_calc_lanes(YM2151 *F, FM_LANES_STATE *L)
+{
+	FM_VEC AM, eg, o, m2, c1, c2, mem, out;
+
+	AM = fm_sllv(fm_set1((INT32)F->lfa), L->ams_sh);
+
+	/* restore delayed sample (MEM) value to m2 or c2 */
+	m2  = fm_and(L->mem_value, L->mem_m[0]);
+	c2  = fm_and(L->mem_value, L->mem_m[1]);
+	mem = fm_and(L->mem_value, L->mem_m[2]);
+
+	/* SLOT 1 */
+	eg = fm_add(fm_load(F->vol_out[SLOT1]), fm_and(AM, L->am_mask[SLOT1]));
+	o  = fm_mul(fm_add(L->op1_out[0], L->op1_out[1]), L->fb_mul);
+	L->op1_out[0] = L->op1_out[1];
+	c1  = fm_and(L->op1_out[0], L->op1_m[0]);
+	c2  = fm_add(c2,  fm_and(L->op1_out[0], L->op1_m[1]));
+	mem = fm_add(mem, fm_and(L->op1_out[0], L->op1_m[2]));
+	out = fm_and(L->op1_out[0], L->op1_m[3]);
+	L->op1_out[1] = op_calc_lanes(fm_load(F->phase[SLOT1]), eg, o);
+
+	/* SLOT 3 */
+	eg  = fm_add(fm_load(F->vol_out[SLOT3]), fm_and(AM, L->am_mask[SLOT3]));
+	o   = op_calc_lanes(fm_load(F->phase[SLOT3]), eg, fm_slli(m2, 15));
+	c2  = fm_add(c2,  fm_and(o, L->op3_m[0]));
+	out = fm_add(out, fm_and(o, L->op3_m[1]));
+
+	/* SLOT 2 */
+	eg  = fm_add(fm_load(F->vol_out[SLOT2]), fm_and(AM, L->am_mask[SLOT2]));
+	o   = op_calc_lanes(fm_load(F->phase[SLOT2]), eg, fm_slli(c1, 15));
+	mem = fm_add(mem, fm_and(o, L->op2_m[0]));
+	out = fm_add(out, fm_and(o, L->op2_m[1]));
+
+	/* SLOT 4 */
+	eg  = fm_add(fm_load(F->vol_out[SLOT4]), fm_and(AM, L->am_mask[SLOT4]));
+	o   = op_calc_lanes(fm_load(F->phase[SLOT4]), eg, fm_slli(c2, 15));
+	out = fm_add(out, fm_and(o, L->op4_m));
+
+	/* store current MEM */
+	L->mem_value = mem;
+	fm_store(F->out_fm, out);
+
+	if (L->noise)
+		F->out_fm[7] += noise_calc(F, volume_calc(F, 7, SLOT4, chan_am(F, &F->CH[7])));
+}
+
+/* chan_update_phase() for all channels */
+INLINE void update_phase_lanes(YM2151 *F, FM_LANES_STATE *L)
+{
+	int s;
+
+	if (L->pm && F->lfp)
+	{
+		for (s = 0; s < 8; s++)
+			chan_update_phase(F, s);
+		return;
+	}
+	for (s = 0; s < 4; s++)
+		fm_store(F->phase[s], fm_add(fm_load(F->phase[s]), fm_load(F->Incr[s])));
+}
+
+#endif /* FM_SIMD */
+
+
+/* write a OPM register */
+static void OPMWriteReg(YM2151 *F, int r, int v)
+{
+	int c = OPM_CHAN(r);
+	int s = OPM_SLOT(r);
+	OPM_CH *CH = &F->CH[c];
+	OPM_SLOT *SLOT = &CH->SLOT[s];
+
+	switch( r & 0xe0 )
+	{
+	case 0x00:
+		switch( r )
+		{
+		case 0x01:	/* LFO reset(bit 1), Test Register (other bits) */
+			F->test = v;
+			if (v & 2)
+				F->lfo_phase = 0;
+			break;
+
+		case 0x08:	/* key on / off */
+			c = v & 7;
+			if(v&0x08) FM_KEYON(F,c,SLOT1); else FM_KEYOFF(F,c,SLOT1);
+			if(v&0x10) FM_KEYON(F,c,SLOT2); else FM_KEYOFF(F,c,SLOT2);
+			if(v&0x20) FM_KEYON(F,c,SLOT3); else FM_KEYOFF(F,c,SLOT3);
+			if(v&0x40) FM_KEYON(F,c,SLOT4); else FM_KEYOFF(F,c,SLOT4);
+			break;
+
+		case 0x0f:	/* noise mode enable, noise period */
+			F->noise = v;
+			F->noise_f = F->noise_tab[ v & 0x1f ];
+			break;
+
+		case 0x18:	/* LFO frequency */
+			F->lfo_overflow    = ( 1 << ((15-(v>>4))+3) ) * (1<<LFO_SH);
+			F->lfo_counter_add = 0x10 + (v & 0x0f);
+			break;
+
+		case 0x19:	/* PMD (bit 7==1) or AMD (bit 7==0) */
+			if (v & 0x80)
+				F->pmd = v & 0x7f;
+			else
+				F->amd = v & 0x7f;
+			break;
+
+		case 0x1b:	/* CT2, CT1, LFO waveform */
+			F->lfo_wsel = v & 3;
+			break;
+
+		default:	/* timers, CSM and IRQs are not emulated */
+			break;
+		}
+		break;
+
+	case 0x20:
+		switch( r & 0x18 )
+		{
+		case 0x00:	/* RL enable, Feedback, Connection */
+			{
+				int feedback = (v>>3)&7;
+				CH->ALGO = v&7;
+				CH->FB   = feedback ? feedback+6 : 0;
+				F->pan[ c*2   ] = (v & 0x40) ? ~0 : 0;
+				F->pan[ c*2+1 ] = (v & 0x80) ? ~0 : 0;
+				setup_connection( F, CH, c );
+			}
+			break;
+
+		case 0x08:	/* Key Code */
+			v &= 0x7f;
+			if (v != CH->kc)
+			{
+				CH->kc   = v;
+				/* the note field skips every fourth value, 12 notes per octave */
+				CH->kc_i = ((v - (v>>2))*64 + 768) | (CH->kc_i & 63);
+				for (s = 0; s < 4; s++)
+					refresh_eg_slot(CH, &CH->SLOT[s]);
+				refresh_fc_chan(F, c);
+			}
+			break;
+
+		case 0x10:	/* Key Fraction */
+			CH->kc_i = (CH->kc_i & ~63) | (v >> 2);
+			refresh_fc_chan(F, c);
+			break;
+
+		case 0x18:	/* PMS, AMS */
+			CH->pms = (v>>4) & 7;
+			CH->ams = (v & 3);
+			break;
+		}
+		break;
+
+	case 0x40:	/* DT1, MUL */
+		SLOT->dt1_i = (v&0x70)<<1;
+		SLOT->mul   = (v&0x0f) ? (v&0x0f)<<1 : 1;
+		refresh_fc_chan(F, c);
+		break;
+
+	case 0x60:	/* TL */
+		SLOT->tl = (v&0x7f)<<(ENV_BITS-7); /* 7bit TL */
+		update_vol_out(F, c, s);
+		break;
+
+	case 0x80:	/* KS, AR */
+		SLOT->ks = 5-(v>>6);
+		SLOT->ar = (v&0x1f) ? 32 + ((v&0x1f)<<1) : 0;
+		refresh_eg_slot(CH, SLOT);
+		break;
+
+	case 0xa0:	/* LFO AM enable, D1R */
+		SLOT->AMmask = (v&0x80) ? ~0 : 0;
+		SLOT->d1r    = (v&0x1f) ? 32 + ((v&0x1f)<<1) : 0;
+		refresh_eg_slot(CH, SLOT);
+		break;
+
+	case 0xc0:	/* DT2, D2R */
+		SLOT->dt2 = dt2_tab[ v>>6 ];
+		SLOT->d2r = (v&0x1f) ? 32 + ((v&0x1f)<<1) : 0;
+		refresh_eg_slot(CH, SLOT);
+		refresh_fc_chan(F, c);
+		break;
+
+	case 0xe0:	/* D1L, RR */
+		SLOT->d1l = d1l_tab[ v>>4 ];
+		SLOT->rr  = 34 + ((v&0x0f)<<2);
+		refresh_eg_slot(CH, SLOT);
+		break;
+	}
+}
+
+/*******************************************************************************/
+/*      YM2151 local section                                                   */
+/*******************************************************************************/
+
+/* Generate samples for one of the YM2151s */
+void ym2151_render(void *chip, int *buffer, int length, bool add)
+{
+	YM2151 *F = (YM2151 *)chip;
+	INT32 *out_fm = F->out_fm;
+	int i, c;
+	int lt,rt;
+	int mute;
+	int *out=buffer;
+
+	mute=F->mute;
+#if FM_SIMD
+	/* a local copy, the kernel writes through F. it runs all eight
+	   channels, with any muted the scalar path is cheaper as it skips them */
+	int simd=F->simd && (mute&0xff)==0xff;
+	FM_LANES_STATE lanes;
+
+	if( simd )
+		chan_lanes_load( F, &lanes );
+#endif
+
+	/* buffering */
+	for(i=0; i < length ; i++)
+	{
+		/* advance envelope generator, the OPM does so before the output calculations */
+		advance_eg(F);
+
+		/* clear outputs */
+		memset(out_fm, 0, sizeof(F->out_fm));
+
+		/* calculate FM */
+#if FM_SIMD
+		if( simd )
+			chan_calc_lanes(F, &lanes);
+		else
+#endif
+		{
+			/* muted channels are not calculated, their phase still runs on */
+			for (c = 0; c < 8; c++)
+				if(mute&(1<<c))
+					chan_calc(F, c);
+		}
+
+		/* 8-channels mixing  */
+
+		if(add)
+		{
+			lt=out[0];
+			rt=out[1];
+		}
+		else
+		{
+			lt=0;
+			rt=0;
+		}
+
+		for (c = 0; c < 8; c++)
+		{
+			if(mute&(1<<c))
+			{
+				lt += (out_fm[c] & F->pan[c*2  ]);
+				rt += (out_fm[c] & F->pan[c*2+1]);
+			}
+		}
+
+		/* buffering */
+		*out++ = lt;
+		*out++ = rt;
+
+		/* advance LFO and noise, the phase generator uses the new LFO PM */
+		advance_lfo(F);
+		advance_noise(F);
+#if FM_SIMD
+		if( simd )
+			update_phase_lanes(F, &lanes);
+		else
+#endif
+		{
+			for (c = 0; c < 8; c++)
+				chan_update_phase(F, c);
+		}
+	}
+
+#if FM_SIMD
+	if( simd )
+		chan_lanes_store( F, &lanes );
+#endif
+}
+
+/* initialize YM2151 emulator(s) */
+void * ym2151_init(int clock, int rate)
+{
+	YM2151 *F;
+
+	/* allocate extend state space */
+	F = (YM2151*)malloc(sizeof(YM2151));
+	memset(F,0,sizeof(YM2151));
+
+	F->clock = clock;
+	F->rate = rate;
+	F->mute=0xff;
+	F->simd=FM_SIMD != 0;
+
+	init_tables(F);
+	ym2151_reset(F);
+
+	return F;
+}
+
+/* shut down emulator */
+void ym2151_shutdown(void *chip)
+{
+	YM2151 *F = (YM2151 *)chip;
+
+	free(F);
+}
+
+/* reset one of chip */
+void ym2151_reset(void *chip)
+{
+	int i,c,s;
+	YM2151 *F = (YM2151 *)chip;
+
+	/* initialize hardware registers */
+	memset(F->CH, 0, sizeof(F->CH));
+	memset(F->phase, 0, sizeof(F->phase));
+	memset(F->Incr, 0, sizeof(F->Incr));
+	for (c = 0; c < 8; c++)
+	{
+		F->CH[c].kc_i = 768; /* min kc_i value */
+		for (s = 0; s < 4; s++)
+		{
+			F->CH[c].SLOT[s].state  = EG_OFF;
+			F->CH[c].SLOT[s].volume = MAX_ATT_INDEX;
+			update_vol_out(F, c, s);
+		}
+	}
+	memset(F->REGS, 0, sizeof(F->REGS));
+
+	F->eg_timer = 0;
+	F->eg_cnt   = 0;
+
+	F->lfo_timer   = 0;
+	F->lfo_counter = 0;
+	F->lfo_phase   = 0;
+	F->lfo_wsel    = 0;
+	F->pmd         = 0;
+	F->amd         = 0;
+	F->lfa         = 0;
+	F->lfp         = 0;
+	F->lfo_rng     = 0;
+
+	F->test = 0;
+
+	F->noise     = 0;
+	F->noise_rng = 0;
+	F->noise_p   = 0;
+	F->noise_f   = F->noise_tab[0];
+
+	OPMWriteReg(F, 0x1b, 0);
+	OPMWriteReg(F, 0x18, 0);	/* set LFO frequency */
+	for (i = 0x20; i < 0x100; i++)	/* set the operators */
+		OPMWriteReg(F, i, 0);
+}
+
+void ym2151_write(void *chip, int r, UINT8 v)
+{
+	YM2151 *F = (YM2151 *)chip;
+
+	r &= 0xff;
+	F->REGS[r] = v;
+	OPMWriteReg(F, r, v);
+}
+
+void ym2151_set_mute(void *chip,int mute)
+{
+	YM2151 *F=(YM2151*)chip;
+	F->mute=mute;
+}
+
+void ym2151_set_simd(void *chip,bool enable)
+{
+	YM2151 *F=(YM2151*)chip;
+	F->simd=(FM_SIMD != 0) && enable;
+}
+
+float ym2151_get_channel_volume(void *chip,int chn)
+{
+	YM2151 *F=(YM2151*)chip;
+
+	return (float)abs(F->out_fm[chn])/8192.0f;
+}
+
+
+
+const char* ym2151_about(void)
+{
+	return "YM2151 emulation code is from MAME\n(c)1997-2008 Jarek Burczynski, Tatsuyuki Satoh";
+}
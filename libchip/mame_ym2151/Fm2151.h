@@ -0,0 +1,16 @@
+#pragma once
+
+#include "../mame_ym2612/Fm.h"
+
+void* ym2151_init(int baseclock, int rate);
+void ym2151_shutdown(void* chip);
+void ym2151_reset(void* chip);
+void ym2151_render(void* chip, int* buffer, int length, bool add);
+// write register r, a vgm log gives the register and data together
+void ym2151_write(void* chip, int r, UINT8 v);
+// bit n set enables channel n (default 0xff), muted channels are not calculated
+void ym2151_set_mute(void* chip, int mute);
+// use the SIMD operator kernel (default in AVX2 builds) or the scalar one
+void ym2151_set_simd(void* chip, bool enable);
+float ym2151_get_channel_volume(void* chip, int chn);
+const char* ym2151_about(void);
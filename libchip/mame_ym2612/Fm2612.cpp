@@ -196,13 +196,9 @@ typedef unsigned char UINT8;
 *   TL_RES_LEN - sinus resolution (X axis)
 */
 #define TL_TAB_LEN (13*2*TL_RES_LEN)
-static signed int tl_tab[TL_TAB_LEN];
 
 #define ENV_QUIET		(TL_TAB_LEN>>3)
 
-/* sin waveform table in 'decibel' scale */
-static unsigned int sin_tab[SIN_LEN];
-
 /* sustain level table (3dB per step) */
 /* bit0, bit1, bit2, bit3, bit4, bit5, bit6 */
 /* 1,    2,    4,    8,    16,   32,   64   (value)*/
@@ -401,101 +397,19 @@ static const UINT8 lfo_ams_depth_shift[4] = {8, 3, 1, 0};
 
 
 
-/*There are 8 different LFO PM depths available, they are:
-  0, 3.4, 6.7, 10, 14, 20, 40, 80 (cents)
-
-  Modulation level at each depth depends on F-NUMBER bits: 4,5,6,7,8,9,10
-  (bits 8,9,10 = FNUM MSB from OCT/FNUM register)
-
-  Here we store only first quarter (positive one) of full waveform.
-  Full table (lfo_pm_table) containing all 128 waveforms is build
-  at run (init) time.
-
-  One value in table below represents 4 (four) basic LFO steps
-  (1 PM step = 4 AM steps).
+/* tl_tab, sin_tab and lfo_pm_table are generated at build time by
+   gen/Fm2612Tables.cpp, which documents how they are built */
+#include "Fm2612Tables.inc"
 
-  For example:
-   at LFO SPEED=0 (which is 108 samples per basic LFO step)
-   one value from "lfo_pm_output" table lasts for 432 consecutive
-   samples (4*108=432) and one full LFO waveform cycle lasts for 13824
-   samples (32*432=13824; 32 because we store only a quarter of whole
-            waveform in the table below)
-*/
-static const UINT8 lfo_pm_output[7*8][8]={ /* 7 bits meaningful (of F-NUMBER), 8 LFO output levels per one depth (out of 32), 8 LFO depths */
-/* FNUM BIT 4: 000 0001xxxx */
-/* DEPTH 0 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 1 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 2 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 3 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 4 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 5 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 6 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 7 */ {0,   0,   0,   0,   1,   1,   1,   1},
-
-/* FNUM BIT 5: 000 0010xxxx */
-/* DEPTH 0 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 1 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 2 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 3 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 4 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 5 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 6 */ {0,   0,   0,   0,   1,   1,   1,   1},
-/* DEPTH 7 */ {0,   0,   1,   1,   2,   2,   2,   3},
-
-/* FNUM BIT 6: 000 0100xxxx */
-/* DEPTH 0 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 1 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 2 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 3 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 4 */ {0,   0,   0,   0,   0,   0,   0,   1},
-/* DEPTH 5 */ {0,   0,   0,   0,   1,   1,   1,   1},
-/* DEPTH 6 */ {0,   0,   1,   1,   2,   2,   2,   3},
-/* DEPTH 7 */ {0,   0,   2,   3,   4,   4,   5,   6},
-
-/* FNUM BIT 7: 000 1000xxxx */
-/* DEPTH 0 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 1 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 2 */ {0,   0,   0,   0,   0,   0,   1,   1},
-/* DEPTH 3 */ {0,   0,   0,   0,   1,   1,   1,   1},
-/* DEPTH 4 */ {0,   0,   0,   1,   1,   1,   1,   2},
-/* DEPTH 5 */ {0,   0,   1,   1,   2,   2,   2,   3},
-/* DEPTH 6 */ {0,   0,   2,   3,   4,   4,   5,   6},
-/* DEPTH 7 */ {0,   0,   4,   6,   8,   8, 0xa, 0xc},
-
-/* FNUM BIT 8: 001 0000xxxx */
-/* DEPTH 0 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 1 */ {0,   0,   0,   0,   1,   1,   1,   1},
-/* DEPTH 2 */ {0,   0,   0,   1,   1,   1,   2,   2},
-/* DEPTH 3 */ {0,   0,   1,   1,   2,   2,   3,   3},
-/* DEPTH 4 */ {0,   0,   1,   2,   2,   2,   3,   4},
-/* DEPTH 5 */ {0,   0,   2,   3,   4,   4,   5,   6},
-/* DEPTH 6 */ {0,   0,   4,   6,   8,   8, 0xa, 0xc},
-/* DEPTH 7 */ {0,   0,   8, 0xc,0x10,0x10,0x14,0x18},
-
-/* FNUM BIT 9: 010 0000xxxx */
-/* DEPTH 0 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 1 */ {0,   0,   0,   0,   2,   2,   2,   2},
-/* DEPTH 2 */ {0,   0,   0,   2,   2,   2,   4,   4},
-/* DEPTH 3 */ {0,   0,   2,   2,   4,   4,   6,   6},
-/* DEPTH 4 */ {0,   0,   2,   4,   4,   4,   6,   8},
-/* DEPTH 5 */ {0,   0,   4,   6,   8,   8, 0xa, 0xc},
-/* DEPTH 6 */ {0,   0,   8, 0xc,0x10,0x10,0x14,0x18},
-/* DEPTH 7 */ {0,   0,0x10,0x18,0x20,0x20,0x28,0x30},
-
-/* FNUM BIT10: 100 0000xxxx */
-/* DEPTH 0 */ {0,   0,   0,   0,   0,   0,   0,   0},
-/* DEPTH 1 */ {0,   0,   0,   0,   4,   4,   4,   4},
-/* DEPTH 2 */ {0,   0,   0,   4,   4,   4,   8,   8},
-/* DEPTH 3 */ {0,   0,   4,   4,   8,   8, 0xc, 0xc},
-/* DEPTH 4 */ {0,   0,   4,   8,   8,   8, 0xc,0x10},
-/* DEPTH 5 */ {0,   0,   8, 0xc,0x10,0x10,0x14,0x18},
-/* DEPTH 6 */ {0,   0,0x10,0x18,0x20,0x20,0x28,0x30},
-/* DEPTH 7 */ {0,   0,0x20,0x30,0x40,0x40,0x50,0x60},
-
-};
+/* LFO PM offset of a channel, lfo_pm_table holds the first quarter of each waveform:
+   steps 8-15 mirror it and steps 16-31 are the negated copy */
+INLINE INT32 lfo_pm_offset(UINT32 block_fnum, INT32 pms, UINT32 lfo_pm)
+{
+	UINT32 step  = (lfo_pm & 8) ? (lfo_pm & 7) ^ 7 : (lfo_pm & 7);
+	INT32  value = lfo_pm_table[ ((block_fnum & 0x7f0) >> 4) * 8 * 8 + (pms >> 5) * 8 + step ];
 
-/* all 128 LFO PM waveforms */
-static INT32 lfo_pm_table[128*8*32]; /* 128 combinations of 7 bits meaningful (of F-NUMBER), 8 LFO depths, 32 LFO output levels per one depth */
+	return (lfo_pm & 16) ? -value : value;
+}
 
 /* register number to channel number , slot offset */
 #define OPN_CHAN(N) (N&3)
@@ -665,6 +579,7 @@ typedef struct
 	INT32		dacout;
 
 	int mute;
+	int simd;						/* render with the SIMD operator kernel */
 } YM2612;
 
 /* log output level */
@@ -1376,8 +1291,7 @@ static void update_ssg_eg_channel(FM_SLOT *SLOT)
 
 INLINE void update_phase_lfo_slot(FM_OPN *OPN, FM_SLOT *SLOT, INT32 pms, UINT32 block_fnum)
 {
-	UINT32 fnum_lfo   = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
-	INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + pms + OPN->LFO_PM ];
+	INT32  lfo_fn_table_index_offset = lfo_pm_offset( block_fnum, pms, OPN->LFO_PM );
 
 	block_fnum = block_fnum*2 + lfo_fn_table_index_offset;
 
@@ -1408,8 +1322,7 @@ INLINE void update_phase_lfo_channel(FM_OPN *OPN, FM_CH *CH)
 {
 	UINT32 block_fnum = CH->block_fnum;
 
-	UINT32 fnum_lfo  = ((block_fnum & 0x7f0) >> 4) * 32 * 8;
-	INT32  lfo_fn_table_index_offset = lfo_pm_table[ fnum_lfo + CH->pms + OPN->LFO_PM ];
+	INT32  lfo_fn_table_index_offset = lfo_pm_offset( block_fnum, CH->pms, OPN->LFO_PM );
 
 	block_fnum = block_fnum*2 + lfo_fn_table_index_offset;
 
@@ -1528,6 +1441,8 @@ INLINE signed int op_calc1(UINT32 phase, unsigned int env, signed int pm)
   return tl_tab[p];
 }
 
+INLINE void chan_update_phase(YM2612 *F2612, FM_OPN *OPN, FM_CH *CH);
+
 INLINE void chan_calc(YM2612 *F2612, FM_OPN *OPN, FM_CH *CH)
 {
   UINT32 AM = OPN->LFO_AM >> CH->ams;
@@ -1580,6 +1495,11 @@ INLINE void chan_calc(YM2612 *F2612, FM_OPN *OPN, FM_CH *CH)
   CH->mem_value = OPN->mem;
 
   /* update phase counters AFTER output calculations */
+  chan_update_phase(F2612, OPN, CH);
+}
+
+INLINE void chan_update_phase(YM2612 *F2612, FM_OPN *OPN, FM_CH *CH)
+{
   if(CH->pms)
   {
     /* add support for 3 slot mode */
@@ -1601,6 +1521,235 @@ INLINE void chan_calc(YM2612 *F2612, FM_OPN *OPN, FM_CH *CH)
   }
 }
 
+/* SIMD operator kernel
+ *
+ * chan_calc() walks the four operators of one channel at a time. the kernel
+ * below instead evaluates one operator stage (SLOT1, SLOT3, SLOT2, SLOT4) for
+ * all six channels at once, with operator state held as structure-of-arrays
+ * lanes. the sin_tab/tl_tab lookups are AVX2 gathers and the connection
+ * routing set up by setup_connection() becomes a set of per lane masks, so the
+ * output is bit-exact with chan_calc(). without hardware gathers the lookups
+ * cost more than the scalar path saves, so only AVX2 builds get the kernel.
+ */
+#if defined(__AVX2__)
+#define FM_SIMD 1
+#include <immintrin.h>
+#else
+#define FM_SIMD 0
+#endif
+
+#if FM_SIMD
+
+#define FM_LANES 8
+
+/* eight 32 bit lanes, lane n holds channel n, lanes 6 and 7 are unused */
+typedef struct { __m256i v; } FM_VEC;
+
+INLINE FM_VEC fm_v(__m256i v) { FM_VEC r; r.v = v; return r; }
+INLINE FM_VEC fm_set1(INT32 x) { return fm_v(_mm256_set1_epi32(x)); }
+INLINE FM_VEC fm_load(const INT32 *p) { return fm_v(_mm256_loadu_si256((const __m256i*)p)); }
+INLINE void fm_store(INT32 *p, FM_VEC a) { _mm256_storeu_si256((__m256i*)p, a.v); }
+INLINE FM_VEC fm_add(FM_VEC a, FM_VEC b) { return fm_v(_mm256_add_epi32(a.v, b.v)); }
+INLINE FM_VEC fm_and(FM_VEC a, FM_VEC b) { return fm_v(_mm256_and_si256(a.v, b.v)); }
+INLINE FM_VEC fm_cmplt(FM_VEC a, FM_VEC b) { return fm_v(_mm256_cmpgt_epi32(b.v, a.v)); }
+INLINE FM_VEC fm_mul(FM_VEC a, FM_VEC b) { return fm_v(_mm256_mullo_epi32(a.v, b.v)); }
+#define fm_slli(a, n) fm_v(_mm256_slli_epi32((a).v, n))
+#define fm_srli(a, n) fm_v(_mm256_srli_epi32((a).v, n))
+
+/* base[idx[n]] for each lane, the tables are 16 bit and padded by one entry
+   so the 32 bit load at the last index stays inside them */
+INLINE FM_VEC fm_gather_s16(const INT16 *base, FM_VEC idx)
+{
+	__m256i v = _mm256_i32gather_epi32((const int*)base, idx.v, 2);
+	return fm_v(_mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16));
+}
+INLINE FM_VEC fm_gather_u16(const UINT16 *base, FM_VEC idx)
+{
+	__m256i v = _mm256_i32gather_epi32((const int*)base, idx.v, 2);
+	return fm_v(_mm256_and_si256(v, _mm256_set1_epi32(0xffff)));
+}
+
+/* one operator field of each channel */
+#define FM_SLOT_LANES(CH, s, f) fm_v(_mm256_setr_epi32( \
+	(CH)[0].SLOT[s].f, (CH)[1].SLOT[s].f, (CH)[2].SLOT[s].f, (CH)[3].SLOT[s].f, \
+	(CH)[4].SLOT[s].f, (CH)[5].SLOT[s].f, 0, 0))
+
+/* where an operator output goes, see setup_connection() */
+#define FM_TO_M2	0x01
+#define FM_TO_C1	0x02
+#define FM_TO_C2	0x04
+#define FM_TO_MEM	0x08
+#define FM_TO_OUT	0x10
+
+/* operator state of all channels laid out as lanes, valid for one ym2612_render() call */
+typedef struct
+{
+	int		count;				/* channels evaluated, 5 when channel 6 plays the DAC */
+	INT32	ams[FM_LANES];		/* channel AMS shift */
+	FM_VEC	am_mask[4];			/* AM enable flag per operator */
+	FM_VEC	fb_mul;				/* 1<<FB, or 0 when feedback is off */
+	FM_VEC	op1_out[2];			/* op1 output for feedback */
+	FM_VEC	mem_value;			/* delayed sample (MEM) value */
+
+	/* connection routing masks, one per source and destination */
+	FM_VEC	op1_m[4];			/* SLOT1 to c1, c2, mem, out */
+	FM_VEC	op3_m[2];			/* SLOT3 to c2, out */
+	FM_VEC	op2_m[2];			/* SLOT2 to mem, out */
+	FM_VEC	mem_m[3];			/* MEM to m2, c2, mem */
+	FM_VEC	op4_m;				/* SLOT4 to out, clear in lanes not evaluated */
+} FM_LANES_STATE;
+
+static unsigned fm_route(FM_OPN *OPN, const INT32 *p, int c)
+{
+	if (!p)                      return FM_TO_C1 | FM_TO_C2 | FM_TO_MEM; /* algorithm 5 */
+	if (p == &OPN->m2)           return FM_TO_M2;
+	if (p == &OPN->c1)           return FM_TO_C1;
+	if (p == &OPN->c2)           return FM_TO_C2;
+	if (p == &OPN->mem)          return FM_TO_MEM;
+	if (p == &OPN->out_fm[c])    return FM_TO_OUT;
+	return 0;
+}
+
+/* load the per channel state that does not change while rendering */
+static void chan_lanes_load(YM2612 *F2612, FM_LANES_STATE *L)
+{
+	FM_OPN *OPN = &F2612->OPN;
+	INT32 m[12][FM_LANES];
+	INT32 am[4][FM_LANES], fb[FM_LANES], op1[2][FM_LANES], mem[FM_LANES];
+	int c, s;
+
+	memset(m, 0, sizeof(m));
+	memset(am, 0, sizeof(am));
+	memset(fb, 0, sizeof(fb));
+	memset(op1, 0, sizeof(op1));
+	memset(mem, 0, sizeof(mem));
+	memset(L->ams, 0, sizeof(L->ams));
+
+	L->count = F2612->dacen ? 5 : 6;
+	for (c = 0; c < L->count; c++)
+	{
+		FM_CH *CH = &F2612->CH[c];
+		unsigned r1 = fm_route(OPN, CH->connect1, c);
+		unsigned r3 = fm_route(OPN, CH->connect3, c);
+		unsigned r2 = fm_route(OPN, CH->connect2, c);
+		unsigned rm = fm_route(OPN, CH->mem_connect, c);
+
+		m[0][c]  = (r1 & FM_TO_C1)  ? ~0 : 0;
+		m[1][c]  = (r1 & FM_TO_C2)  ? ~0 : 0;
+		m[2][c]  = (r1 & FM_TO_MEM) ? ~0 : 0;
+		m[3][c]  = (r1 & FM_TO_OUT) ? ~0 : 0;
+		m[4][c]  = (r3 & FM_TO_C2)  ? ~0 : 0;
+		m[5][c]  = (r3 & FM_TO_OUT) ? ~0 : 0;
+		m[6][c]  = (r2 & FM_TO_MEM) ? ~0 : 0;
+		m[7][c]  = (r2 & FM_TO_OUT) ? ~0 : 0;
+		m[8][c]  = (rm & FM_TO_M2)  ? ~0 : 0;
+		m[9][c]  = (rm & FM_TO_C2)  ? ~0 : 0;
+		m[10][c] = (rm & FM_TO_MEM) ? ~0 : 0;
+		m[11][c] = ~0;
+
+		L->ams[c] = CH->ams;
+		fb[c]     = CH->FB ? (1 << CH->FB) : 0;
+		op1[0][c] = CH->op1_out[0];
+		op1[1][c] = CH->op1_out[1];
+		mem[c]    = CH->mem_value;
+		for (s = 0; s < 4; s++)
+			am[s][c] = CH->SLOT[s].AMmask;
+	}
+
+	for (s = 0; s < 4; s++) L->am_mask[s] = fm_load(am[s]);
+	L->fb_mul     = fm_load(fb);
+	L->op1_out[0] = fm_load(op1[0]);
+	L->op1_out[1] = fm_load(op1[1]);
+	L->mem_value  = fm_load(mem);
+	for (s = 0; s < 4; s++) L->op1_m[s] = fm_load(m[s]);
+	for (s = 0; s < 2; s++) L->op3_m[s] = fm_load(m[4+s]);
+	for (s = 0; s < 2; s++) L->op2_m[s] = fm_load(m[6+s]);
+	for (s = 0; s < 3; s++) L->mem_m[s] = fm_load(m[8+s]);
+	L->op4_m = fm_load(m[11]);
+}
+
+/* write back the state chan_calc() keeps between samples */
+static void chan_lanes_store(YM2612 *F2612, FM_LANES_STATE *L)
+{
+	INT32 op1[2][FM_LANES], mem[FM_LANES];
+	int c;
+
+	fm_store(op1[0], L->op1_out[0]);
+	fm_store(op1[1], L->op1_out[1]);
+	fm_store(mem, L->mem_value);
+	for (c = 0; c < L->count; c++)
+	{
+		F2612->CH[c].op1_out[0] = op1[0][c];
+		F2612->CH[c].op1_out[1] = op1[1][c];
+		F2612->CH[c].mem_value  = mem[c];
+	}
+}
+
+/* op_calc() for all lanes, pm is the phase modulation already in phase units */
+INLINE FM_VEC op_calc_lanes(FM_VEC phase, FM_VEC env, FM_VEC pm)
+{
+	FM_VEC idx   = fm_and(fm_srli(fm_add(fm_and(phase, fm_set1(~FREQ_MASK)), pm), FREQ_SH), fm_set1(SIN_MASK));
+	FM_VEC p     = fm_add(fm_slli(env, 3), fm_gather_u16(sin_tab, idx));
+	FM_VEC valid = fm_and(fm_cmplt(env, fm_set1(ENV_QUIET)), fm_cmplt(p, fm_set1(TL_TAB_LEN)));
+
+	return fm_and(fm_gather_s16(tl_tab, fm_and(p, valid)), valid);
+}
+
+/* chan_calc() for all channels, outputs land in OPN->out_fm */
+INLINE void chan_calc_lanes(YM2612 *F2612, FM_OPN *OPN, FM_LANES_STATE *L)
+{
+	const FM_CH *CH = F2612->CH;
+	INT32 am[FM_LANES];
+	FM_VEC AM, eg, o, m2, c1, c2, mem, out;
+	int c;
+
+	for (c = 0; c < FM_LANES; c++)
+		am[c] = (INT32)(OPN->LFO_AM >> L->ams[c]);
+	AM = fm_load(am);
+
+	/* restore delayed sample (MEM) value to m2 or c2 */
+	m2  = fm_and(L->mem_value, L->mem_m[0]);
+	c2  = fm_and(L->mem_value, L->mem_m[1]);
+	mem = fm_and(L->mem_value, L->mem_m[2]);
+
+	/* SLOT 1 */
+	eg = fm_add(FM_SLOT_LANES(CH, SLOT1, vol_out), fm_and(AM, L->am_mask[SLOT1]));
+	o  = fm_mul(fm_add(L->op1_out[0], L->op1_out[1]), L->fb_mul);
+	L->op1_out[0] = L->op1_out[1];
+	c1  = fm_and(L->op1_out[0], L->op1_m[0]);
+	c2  = fm_add(c2,  fm_and(L->op1_out[0], L->op1_m[1]));
+	mem = fm_add(mem, fm_and(L->op1_out[0], L->op1_m[2]));
+	out = fm_and(L->op1_out[0], L->op1_m[3]);
+	L->op1_out[1] = op_calc_lanes(FM_SLOT_LANES(CH, SLOT1, phase), eg, o);
+
+	/* SLOT 3 */
+	eg  = fm_add(FM_SLOT_LANES(CH, SLOT3, vol_out), fm_and(AM, L->am_mask[SLOT3]));
+	o   = op_calc_lanes(FM_SLOT_LANES(CH, SLOT3, phase), eg, fm_slli(m2, 15));
+	c2  = fm_add(c2,  fm_and(o, L->op3_m[0]));
+	out = fm_add(out, fm_and(o, L->op3_m[1]));
+
+	/* SLOT 2 */
+	eg  = fm_add(FM_SLOT_LANES(CH, SLOT2, vol_out), fm_and(AM, L->am_mask[SLOT2]));
+	o   = op_calc_lanes(FM_SLOT_LANES(CH, SLOT2, phase), eg, fm_slli(c1, 15));
+	mem = fm_add(mem, fm_and(o, L->op2_m[0]));
+	out = fm_add(out, fm_and(o, L->op2_m[1]));
+
+	/* SLOT 4 */
+	eg  = fm_add(FM_SLOT_LANES(CH, SLOT4, vol_out), fm_and(AM, L->am_mask[SLOT4]));
+	o   = op_calc_lanes(FM_SLOT_LANES(CH, SLOT4, phase), eg, fm_slli(c2, 15));
+	out = fm_add(out, fm_and(o, L->op4_m));
+
+	/* store current MEM */
+	L->mem_value = mem;
+	fm_store(OPN->out_fm, out);
+
+	/* update phase counters AFTER output calculations */
+	for (c = 0; c < L->count; c++)
+		chan_update_phase(F2612, OPN, &F2612->CH[c]);
+}
+
+#endif /* FM_SIMD */
+
 static void FMCloseTable( void )
 {
 }
@@ -1862,7 +2011,7 @@ static void OPNWriteReg(FM_OPN *OPN, int r, int v)
 			if( OPN->type & TYPE_LFOPAN)
 			{
 				/* b0-2 PMS */
-				CH->pms = (v & 7) * 32; /* CH->pms = PM depth * 32 (index in lfo_pm_table) */
+				CH->pms = (v & 7) * 32; /* CH->pms = PM depth * 32 */
 
 				/* b4-5 AMS */
 				CH->ams = lfo_ams_depth_shift[(v>>4) & 0x03];
@@ -1918,6 +2067,10 @@ static void OPNSetPres(FM_OPN *OPN, int pres, int timer_prescaler, int SSGpres)
 {
 	/* frequency base */
 	OPN->ST.freqbase = (OPN->ST.rate) ? ((double)OPN->ST.clock / OPN->ST.rate) / pres : 0;
+	/* at the native rate of one sample per prescaled clock the tables are
+	   used unscaled, rounding the rate down must not detune the chip */
+	if (OPN->ST.rate && OPN->ST.clock / pres == OPN->ST.rate)
+		OPN->ST.freqbase = 1.0;
 
 	/* EG is updated every 3 samples */
 	OPN->eg_timer_add  = (UINT32)((1<<EG_SH) * OPN->ST.freqbase);
@@ -1952,105 +2105,6 @@ static void reset_channels( FM_ST *ST , FM_CH *CH , int num )
 }
 
 /* initialize generic tables */
-static void init_tables(void)
-{
-	signed int i,x;
-	signed int n;
-	double o,m;
-
-	/* build Linear Power Table */
-	for (x=0; x<TL_RES_LEN; x++)
-	{
-		m = (1<<16) / pow(2, (x+1) * (ENV_STEP/4.0) / 8.0);
-		m = floor(m);
-
-		/* we never reach (1<<16) here due to the (x+1) */
-		/* result fits within 16 bits at maximum */
-
-		n = (int)m;		/* 16 bits here */
-		n >>= 4;		/* 12 bits here */
-		if (n&1)		/* round to nearest */
-			n = (n>>1)+1;
-		else
-			n = n>>1;
-						/* 11 bits here (rounded) */
-		n <<= 2;		/* 13 bits here (as in real chip) */
-
-
-		/* 14 bits (with sign bit) */
-		tl_tab[ x*2 + 0 ] = n;
-		tl_tab[ x*2 + 1 ] = -tl_tab[ x*2 + 0 ];
-
-		/* one entry in the 'Power' table use the following format, xxxxxyyyyyyyys with:            */
-		/*        s = sign bit                                                                      */
-		/* yyyyyyyy = 8-bits decimal part (0-TL_RES_LEN)                                            */
-		/* xxxxx    = 5-bits integer 'shift' value (0-31) but, since Power table output is 13 bits, */
-		/*            any value above 13 (included) would be discarded.                             */
-		for (i=1; i<13; i++)
-		{
-			tl_tab[ x*2+0 + i*2*TL_RES_LEN ] =  tl_tab[ x*2+0 ]>>i;
-			tl_tab[ x*2+1 + i*2*TL_RES_LEN ] = -tl_tab[ x*2+0 + i*2*TL_RES_LEN ];
-		}
-	}
-
-	/* build Logarithmic Sinus table */
-	for (i=0; i<SIN_LEN; i++)
-	{
-		/* non-standard sinus */
-		m = sin( ((i*2)+1) * M_PI / SIN_LEN ); /* checked against the real chip */
-		/* we never reach zero here due to ((i*2)+1) */
-
-		if (m>0.0)
-			o = 8*log(1.0/m)/log(2.0);	/* convert to 'decibels' */
-		else
-			o = 8*log(-1.0/m)/log(2.0);	/* convert to 'decibels' */
-
-		o = o / (ENV_STEP/4);
-
-		n = (int)(2.0*o);
-		if (n&1)    		/* round to nearest */
-			n = (n>>1)+1;
-		else
-			n = n>>1;
-
-		/* 13-bits (8.5) value is formatted for above 'Power' table */
-		sin_tab[ i ] = n*2 + (m>=0.0? 0: 1 );
-	}
-
-	/* build LFO PM modulation table */
-	for(i = 0; i < 8; i++) /* 8 PM depths */
-	{
-		UINT8 fnum;
-		for (fnum=0; fnum<128; fnum++) /* 7 bits meaningful of F-NUMBER */
-		{
-			UINT8 value;
-			UINT8 step;
-			UINT32 offset_depth = i;
-			UINT32 offset_fnum_bit;
-			UINT32 bit_tmp;
-
-			for (step=0; step<8; step++)
-			{
-				value = 0;
-				for (bit_tmp=0; bit_tmp<7; bit_tmp++) /* 7 bits */
-				{
-					if (fnum & (1<<bit_tmp)) /* only if bit "bit_tmp" is set */
-					{
-						offset_fnum_bit = bit_tmp * 8;
-						value += lfo_pm_output[offset_fnum_bit + offset_depth][step];
-					}
-				}
-				/* 32 steps for LFO PM (sinus) */
-				lfo_pm_table[(fnum*32*8) + (i*32) + step   + 0] = value;
-				lfo_pm_table[(fnum*32*8) + (i*32) +(step^7)+ 8] = value;
-				lfo_pm_table[(fnum*32*8) + (i*32) + step   +16] = -value;
-				lfo_pm_table[(fnum*32*8) + (i*32) +(step^7)+24] = -value;
-			}
-
-		}
-	}
-}
-
 /*******************************************************************************/
 /*      YM2612 local section                                                   */
 /*******************************************************************************/
@@ -2065,7 +2119,12 @@ void ym2612_render(void *chip, int *buffer, int length, bool add)
 	FM_CH	*cch[6];
 	int lt,rt;
 	int mute;
+	int c;
 	int *out=buffer;
+#if FM_SIMD
+	int simd;
+	FM_LANES_STATE lanes;
+#endif
 
 	cch[0]   = &F2612->CH[0];
 	cch[1]   = &F2612->CH[1];
@@ -2075,6 +2134,11 @@ void ym2612_render(void *chip, int *buffer, int length, bool add)
 	cch[5]   = &F2612->CH[5];
 
 	mute=F2612->mute;
+#if FM_SIMD
+	/* the kernel runs all six channels, with any muted the scalar path
+	   is cheaper as it skips them */
+	simd=F2612->simd && (mute&0x3f)==0x3f;
+#endif
 
 	/* refresh PG and EG */
 	refresh_fc_eg_chan( OPN, cch[0] );
@@ -2094,6 +2158,11 @@ void ym2612_render(void *chip, int *buffer, int length, bool add)
 	refresh_fc_eg_chan( OPN, cch[4] );
 	refresh_fc_eg_chan( OPN, cch[5] );
 
+#if FM_SIMD
+	if( simd )
+		chan_lanes_load( F2612, &lanes );
+#endif
+
 	/* buffering */
 	for(i=0; i < length ; i++)
 	{
@@ -2114,15 +2183,31 @@ void ym2612_render(void *chip, int *buffer, int length, bool add)
 		update_ssg_eg_channel(&cch[5]->SLOT[SLOT1]);
 
 		/* calculate FM */
-		chan_calc(F2612, OPN, cch[0]);
-		chan_calc(F2612, OPN, cch[1]);
-		chan_calc(F2612, OPN, cch[2]);
-		chan_calc(F2612, OPN, cch[3]);
-		chan_calc(F2612, OPN, cch[4]);
-		if( F2612->dacen )
-			*cch[5]->connect4 += F2612->dacout;
+#if FM_SIMD
+		if( simd )
+		{
+			chan_calc_lanes(F2612, OPN, &lanes);
+			if( F2612->dacen )
+				*cch[5]->connect4 += F2612->dacout;
+		}
 		else
-			chan_calc(F2612, OPN, cch[5]);
+#endif
+		{
+			/* muted channels are not calculated, only their phase runs on */
+			for(c=0; c < 5; c++)
+			{
+				if( mute&(1<<c) )
+					chan_calc(F2612, OPN, cch[c]);
+				else
+					chan_update_phase(F2612, OPN, cch[c]);
+			}
+			if( F2612->dacen )
+				*cch[5]->connect4 += F2612->dacout;
+			else if( mute&0x20 )
+				chan_calc(F2612, OPN, cch[5]);
+			else
+				chan_update_phase(F2612, OPN, cch[5]);
+		}
 
 		/* advance LFO */
 		advance_lfo(OPN);
@@ -2218,6 +2303,11 @@ void ym2612_render(void *chip, int *buffer, int length, bool add)
 		FM_KEYOFF_CSM(cch[2],SLOT4);
 		OPN->SL3.key_csm = 0;
 	}
+
+#if FM_SIMD
+	if( simd )
+		chan_lanes_store( F2612, &lanes );
+#endif
 }
 
 /* initialize YM2612 emulator(s) */
@@ -2229,14 +2319,12 @@ void * ym2612_init(int clock, int rate)
 	F2612 = (YM2612*)malloc(sizeof(YM2612));//auto_alloc_clear(device->machine(), YM2612);
 	memset(F2612,0,sizeof(YM2612));
 
-	/* allocate total level table (128kb space) */
-	init_tables();
-
 	F2612->OPN.type = TYPE_YM2612;
 	F2612->OPN.P_CH = F2612->CH;
 	F2612->OPN.ST.clock = clock;
 	F2612->OPN.ST.rate = rate;
 	F2612->mute=0xff;
+	F2612->simd=FM_SIMD != 0;
 
 	ym2612_reset(F2612);
 
@@ -2390,6 +2478,12 @@ void ym2612_set_mute(void *chip,int mute)
 
 
 
+void ym2612_set_simd(void *chip,bool enable)
+{
+	YM2612 *F2612=(YM2612*)chip;
+	F2612->simd=(FM_SIMD != 0) && enable;
+}
+
 float ym2612_get_channel_volume(void *chip,int chn)
 {
 	YM2612 *F2612=(YM2612*)chip;
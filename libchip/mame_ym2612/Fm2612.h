@@ -7,7 +7,10 @@ void ym2612_shutdown(void* chip);
 void ym2612_reset(void* chip);
 void ym2612_render(void* chip, int* buffer, int length, bool add);
 int ym2612_write(void *chip, int a, UINT8 v);
+// bit n set enables channel n (default 0xff), muted channels are not calculated
 void ym2612_set_mute(void* chip, int mute);
+// use the SIMD operator kernel (default in AVX2 builds) or the scalar one
+void ym2612_set_simd(void* chip, bool enable);
 float ym2612_get_channel_volume(void* chip, int chn);
 const char* ym2612_about(void);
 int ym2612_write(void* chip, int port, int a, UINT8 v);
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "resample.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define RESAMPLE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+// taps per output sample period, sets the steepness of the filter
+static const uint32_t TAPS_PER_ZERO = 32;
+// cutoff as a fraction of the nyquist rate, leaves room for the transition
+static const double CUTOFF = 0.9;
+static const double PI = 3.14159265358979323846;
+
+double _sinc(double x)
+{
+    return (x == 0.0) ? 1.0 : sin(PI * x) / (PI * x);
+}
+
+// blackman window over [-half, +half]
+double _blackman(double x, double half)
+{
+    if (x <= -half || x >= half) {
+        return 0.0;
+    }
+    const double t = x / half;
+    return 0.42 + 0.5 * cos(PI * t) + 0.08 * cos(2.0 * PI * t);
+}
+
+float _dot(const float* a, const float* b, uint32_t count)
+{
+#if RESAMPLE_SSE
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i + 0), _mm_loadu_ps(b + i + 0)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    for (; i < count; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    acc0 = _mm_add_ps(acc0, acc1);
+    // horizontal sum
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 0x55));
+    return _mm_cvtss_f32(acc0);
+#else
+    float acc[4] = { 0.f, 0.f, 0.f, 0.f };
+    for (uint32_t i = 0; i < count; i += 4) {
+        acc[0] += a[i + 0] * b[i + 0];
+        acc[1] += a[i + 1] * b[i + 1];
+        acc[2] += a[i + 2] * b[i + 2];
+        acc[3] += a[i + 3] * b[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+float _to_float(int32_t x)
+{
+    return float(x);
+}
+
+float _to_float(float x)
+{
+    return x;
+}
+
+void _mix(int32_t& dst, float x)
+{
+    dst += int32_t(x < 0.f ? x - .5f : x + .5f);
+}
+
+void _mix(float& dst, float x)
+{
+    dst += x;
+}
+
+} // namespace {}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+resample_t::resample_t(uint32_t rate_in, uint32_t rate_out, uint32_t channels)
+    : _rate_in(rate_in)
+    , _rate_out(rate_out)
+    , _channels(channels)
+    , _taps(0)
+    , _step(0)
+    , _pos(0)
+    , _fill(0)
+{
+    assert(rate_in && rate_out && channels);
+    _step = (uint64_t(rate_in) << 32) / rate_out;
+
+    // widen the filter when decimating so the cutoff can drop below the
+    // output nyquist rate without shortening the filter in time
+    const double ratio = std::max(1.0, double(rate_in) / double(rate_out));
+    _taps = uint32_t(ceil(TAPS_PER_ZERO * ratio));
+    _taps = (_taps + 3) & ~3u;
+
+    // cutoff in cycles per input sample
+    const double cutoff = 0.5 * CUTOFF / ratio;
+    const double half = double(_taps / 2);
+
+    _kernel.resize(PHASES * _taps);
+    for (uint32_t p = 0; p < PHASES; ++p) {
+        float* row = &_kernel[p * _taps];
+        const double frac = double(p) / PHASES;
+        double sum = 0.0;
+        for (uint32_t k = 0; k < _taps; ++k) {
+            // distance from this tap to the output sample
+            const double x = double(k) - half - frac;
+            const double h = 2.0 * cutoff * _sinc(2.0 * cutoff * x) * _blackman(x, half);
+            row[k] = float(h);
+            sum += h;
+        }
+        // unity gain at dc for every phase
+        for (uint32_t k = 0; k < _taps; ++k) {
+            row[k] = float(row[k] / sum);
+        }
+    }
+
+    _history.resize(_channels);
+    reset();
+}
+
+void resample_t::reset()
+{
+    // prime with half a filter of silence so output frame 0 lines up with
+    // input frame 0
+    _fill = _taps / 2;
+    _pos = 0;
+    for (std::vector<float>& h : _history) {
+        h.assign(_fill, 0.f);
+    }
+}
+
+uint32_t resample_t::input_frames(uint32_t frames) const
+{
+    if (frames == 0) {
+        return 0;
+    }
+    const uint64_t need = ((_pos + (frames - 1) * _step) >> 32) + _taps;
+    return (need > _fill) ? uint32_t(need - _fill) : 0;
+}
+
+uint32_t resample_t::input_offset(uint32_t frame) const
+{
+    // the newest tap of the filter for this frame, every bus then sees its
+    // writes with the same fixed latency of half a filter
+    const uint64_t tail = ((_pos + frame * _step) >> 32) + _taps;
+    return (tail > _fill) ? uint32_t(tail - _fill) : 0;
+}
+
+void resample_t::write(const int32_t* src, uint32_t frames)
+{
+    _write(src, frames);
+}
+
+void resample_t::write(const float* src, uint32_t frames)
+{
+    _write(src, frames);
+}
+
+void resample_t::read(int32_t* dst, uint32_t frames)
+{
+    _read(dst, frames);
+}
+
+void resample_t::read(float* dst, uint32_t frames)
+{
+    _read(dst, frames);
+}
+
+template <typename type_t>
+void resample_t::_write(const type_t* src, uint32_t frames)
+{
+    for (uint32_t c = 0; c < _channels; ++c) {
+        std::vector<float>& h = _history[c];
+        h.resize(_fill + frames);
+        float* out = &h[_fill];
+        const type_t* in = src + c;
+        for (uint32_t i = 0; i < frames; ++i, in += _channels) {
+            out[i] = _to_float(*in);
+        }
+    }
+    _fill += frames;
+}
+
+template <typename type_t>
+void resample_t::_read(type_t* dst, uint32_t frames)
+{
+    // the caller must have written input_frames() beforehand
+    assert(input_frames(frames) == 0);
+    for (uint32_t c = 0; c < _channels; ++c) {
+        const float* h = _history[c].data();
+        uint64_t pos = _pos;
+        type_t* out = dst + c;
+        for (uint32_t i = 0; i < frames; ++i, out += _channels) {
+            const uint32_t index = uint32_t(pos >> 32);
+            const uint32_t phase = uint32_t(pos >> 24) & (PHASES - 1);
+            _mix(*out, _dot(h + index, &_kernel[phase * _taps], _taps));
+            pos += _step;
+        }
+    }
+    _pos += frames * _step;
+    _compact();
+}
+
+void resample_t::_compact()
+{
+    const uint32_t drop = std::min<uint32_t>(uint32_t(_pos >> 32), _fill);
+    if (drop == 0) {
+        return;
+    }
+    for (std::vector<float>& h : _history) {
+        h.erase(h.begin(), h.begin() + drop);
+    }
+    _fill -= drop;
+    _pos -= uint64_t(drop) << 32;
+}
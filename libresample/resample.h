@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// polyphase windowed sinc sample rate converter
+//
+// a chip renders at its own native rate into the resampler with write() and
+// the mixer pulls frames at the device rate with read(). the filter cutoff
+// tracks the lower of the two rates so any ratio can be used, up or down.
+struct resample_t {
+
+    resample_t(uint32_t rate_in, uint32_t rate_out, uint32_t channels);
+
+    // native frames that must be written before read() can produce frames
+    uint32_t input_frames(uint32_t frames) const;
+
+    // native frame offset, within the next write, lining up with a given
+    // output frame of the next read
+    uint32_t input_offset(uint32_t frame) const;
+
+    // append interleaved native frames
+    void write(const int32_t* src, uint32_t frames);
+    void write(const float* src, uint32_t frames);
+
+    // mix interleaved frames at the output rate into dst
+    void read(int32_t* dst, uint32_t frames);
+    void read(float* dst, uint32_t frames);
+
+    // drop all history and start from silence
+    void reset();
+
+    uint32_t rate_in() const
+    {
+        return _rate_in;
+    }
+
+    uint32_t rate_out() const
+    {
+        return _rate_out;
+    }
+
+protected:
+    template <typename type_t>
+    void _write(const type_t* src, uint32_t frames);
+
+    template <typename type_t>
+    void _read(type_t* dst, uint32_t frames);
+
+    // discard history no longer reachable by the filter
+    void _compact();
+
+    // filter phases per input sample
+    static const uint32_t PHASES = 256;
+
+    uint32_t _rate_in;
+    uint32_t _rate_out;
+    uint32_t _channels;
+    // filter taps per phase, multiple of 4
+    uint32_t _taps;
+    // 32.32 fixed point input frames per output frame
+    uint64_t _step;
+    // 32.32 fixed point position of the next output frame in the history
+    uint64_t _pos;
+    // frames of history held per channel
+    uint32_t _fill;
+    // PHASES rows of _taps coefficients
+    std::vector<float> _kernel;
+    // planar input history, one vector per channel
+    std::vector<std::vector<float>> _history;
+};
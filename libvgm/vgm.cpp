@@ -6,6 +6,8 @@
 #include <cstring>
 
 #include "vgm.h"
+#include "vgm_stats.h"
+#include "vgm_trace.h"
 
 #ifndef MIN
 #define MIN(A, B) (((A) < (B)) ? (A) : (B))
@@ -36,11 +38,13 @@ void vgm_t::_vgm_data_block(
 }
 
 static void _vgm_chip_write(
+    uint32_t stat,
     struct vgm_chip_t* chip,
     uint32_t port,
     uint32_t reg,
     uint32_t data)
 {
+    VGM_STAT(vgm_stats_t::get().add_write(stat));
     if (chip) {
         chip->write(port, reg, data);
     }
@@ -62,6 +66,9 @@ void vgm_t::mute()
     _vgm_chip_mute(_chips.nes_apu);
     _vgm_chip_mute(_chips.gb_dmg);
     _vgm_chip_mute(_chips.pokey);
+    _vgm_chip_mute(_chips.ym2413);
+    _vgm_chip_mute(_chips.ym2151);
+    _vgm_chip_mute(_chips.ay8910);
 }
 
 // parse a single item from the data stream
@@ -71,35 +78,49 @@ bool vgm_t::_vgm_parse_single(uint32_t* delay)
     // parse this vgm opcode
     const uint8_t opcode = _stream->read8();
 
-    printf("%02x\n", opcode);
+    VGM_STAT_OPCODE(opcode);
 
     switch (opcode) {
     case (0x4f):
     case (0x50): {
         // write to sn76489
         const uint8_t data1 = _stream->read8();
-        _vgm_chip_write(_chips.sn76489, 0, 0, data1);
+        _vgm_chip_write(VGM_STAT_SN76489, _chips.sn76489, 0, 0, data1);
+        break;
+    }
+    case (0x51): {
+        // write to YM2413
+        const uint8_t data1 = _stream->read8();
+        const uint8_t data2 = _stream->read8();
+        _vgm_chip_write(VGM_STAT_YM2413, _chips.ym2413, 0, data1, data2);
         break;
     }
     case (0x52): {
         // write to YM2612 PORT 1
         const uint8_t data1 = _stream->read8();
         const uint8_t data2 = _stream->read8();
-        _vgm_chip_write(_chips.ym2612, 0, data1, data2);
+        _vgm_chip_write(VGM_STAT_YM2612, _chips.ym2612, 0, data1, data2);
         break;
     }
     case (0x53): {
         // write to YM2612 PORT 2
         const uint8_t data1 = _stream->read8();
         const uint8_t data2 = _stream->read8();
-        _vgm_chip_write(_chips.ym2612, 1, data1, data2);
+        _vgm_chip_write(VGM_STAT_YM2612, _chips.ym2612, 1, data1, data2);
+        break;
+    }
+    case (0x54): {
+        // write to YM2151
+        const uint8_t data1 = _stream->read8();
+        const uint8_t data2 = _stream->read8();
+        _vgm_chip_write(VGM_STAT_YM2151, _chips.ym2151, 0, data1, data2);
         break;
     }
     case (0x5A): {
         // write to ADLIB
         const uint8_t data1 = _stream->read8();
         const uint8_t data2 = _stream->read8();
-        _vgm_chip_write(_chips.ym3812, 0, data1, data2);
+        _vgm_chip_write(VGM_STAT_YM3812, _chips.ym3812, 0, data1, data2);
         break;
     }
     case (0x61): {
@@ -130,25 +151,32 @@ bool vgm_t::_vgm_parse_single(uint32_t* delay)
         _vgm_data_block(tt, ss);
         break;
     }
+    case (0xA0): {
+        // write to the AY8910
+        const uint8_t data1 = _stream->read8();
+        const uint8_t data2 = _stream->read8();
+        _vgm_chip_write(VGM_STAT_AY8910, _chips.ay8910, 0, data1, data2);
+        break;
+    }
     case (0xB4): {
         // write to the NES APU
         const uint8_t data1 = _stream->read8();
         const uint8_t data2 = _stream->read8();
-        _vgm_chip_write(_chips.nes_apu, 0, data1, data2);
+        _vgm_chip_write(VGM_STAT_NES_APU, _chips.nes_apu, 0, data1, data2);
         break;
     }
     case (0xB3): {
         // write to the GameBoy DMG
         const uint8_t data1 = _stream->read8();
         const uint8_t data2 = _stream->read8();
-        _vgm_chip_write(_chips.gb_dmg, 0, data1, data2);
+        _vgm_chip_write(VGM_STAT_GB_DMG, _chips.gb_dmg, 0, data1, data2);
         break;
     }
     case (0xBB): {
         // write to the atari pokey
         const uint8_t data1 = _stream->read8();
         const uint8_t data2 = _stream->read8();
-        _vgm_chip_write(_chips.pokey, 0, data1, data2);
+        _vgm_chip_write(VGM_STAT_POKEY, _chips.pokey, 0, data1, data2);
         break;
     }
     case (0xE0): {
@@ -207,11 +235,6 @@ bool vgm_t::_vgm_parse_single(uint32_t* delay)
                 break;
             }
         }
-        // misc
-        if (opcode == 0xa0) {
-            _stream->skip(4);
-            break;
-        }
         // unknown opcode
         {
             debug_msg("unknown opcode: 0x%02x", (int)opcode);
@@ -224,41 +247,105 @@ bool vgm_t::_vgm_parse_single(uint32_t* delay)
     return true;
 }
 
-bool vgm_t::init(
+// logs before 1.10 have no ym2612 or ym2151 clock, those chips share the
+// ym2413 one. give it to the fm chips the stream writes, leaving the stream
+// rewound
+static void _vgm_map_old_clocks(
     struct vgm_stream_t* stream,
-    struct vgm_chip_bank_t* chips)
+    struct vgm_header_t* header,
+    uint32_t data_start)
 {
-    assert(stream && chips);
-    _stream = stream;
-    _chips = *chips;
-    _finished = false;
-    _delay = 0;
-    memset(&_header, 0, sizeof(_header));
+    if (header->version >= 0x110 || header->clock_ym2413 == 0) {
+        return;
+    }
+    bool ym2413 = false, ym2612 = false, ym2151 = false;
+    const uint32_t end = header->offset_eof + 4;
+    stream->skip(data_start);
+    for (uint32_t pos = data_start; pos < end;) {
+        const uint8_t opcode = stream->read8();
+        ym2413 |= (opcode == 0x51);
+        ym2612 |= (opcode == 0x52 || opcode == 0x53);
+        ym2151 |= (opcode == 0x54);
+        uint32_t operands = 0;
+        if (opcode == 0x4f || opcode == 0x50) {
+            operands = 1;
+        } else if ((opcode >= 0x51 && opcode <= 0x5f) || opcode == 0x61) {
+            operands = 2;
+        } else if (opcode != 0x62 && opcode != 0x63 && (opcode & 0xf0) != 0x70) {
+            // end of the data, or an opcode newer than the log
+            break;
+        }
+        stream->skip(operands);
+        pos += 1 + operands;
+    }
+    stream->rewind();
+
+    if (ym2612) {
+        header->clock_ym2612 = header->clock_ym2413;
+    }
+    if (ym2151) {
+        header->clock_ym2151 = header->clock_ym2413;
+    }
+    // the ym2413 keeps the clock only if it is written to as well
+    if ((ym2612 || ym2151) && !ym2413) {
+        header->clock_ym2413 = 0;
+    }
+}
+
+bool vgm_read_header(
+    struct vgm_stream_t* stream,
+    struct vgm_header_t* header,
+    uint32_t* data_start)
+{
+    assert(stream && header);
+    memset(header, 0, sizeof(*header));
     // copy over the vgm header
     const size_t vgm_hdr_size = sizeof(struct vgm_header_t);
-    _stream->read(&(_header), vgm_hdr_size);
-    _stream->rewind();
+    stream->read(header, vgm_hdr_size);
+    stream->rewind();
     uint32_t to_skip = 0;
     // check VGM header
-    if (memcmp(&(_header.vgm_ident), "Vgm ", 4) != 0) {
+    if (memcmp(&(header->vgm_ident), "Vgm ", 4) != 0) {
         return false;
     }
 
     // find start of music data
-    if (_header.version < 150) {
+    if (header->version < 0x150) {
+        // the header is 64 bytes, the rest of it is vgm data
         to_skip = 0x40;
+        memset(((uint8_t*)header) + 0x40, 0, sizeof(*header) - 0x40);
     } else {
-        if (_header.offset_vgmdata == 0) {
-            to_skip = sizeof(_header);
+        if (header->offset_vgmdata == 0) {
+            to_skip = sizeof(*header);
         } else {
-            const uint32_t start = 0x34 + _header.offset_vgmdata;
+            const uint32_t start = 0x34 + header->offset_vgmdata;
             to_skip = start;
             if (start < 0x100) {
-                size_t size = sizeof(_header) - start;
-                memset(((uint8_t*)&_header) + start, 0, size);
+                size_t size = sizeof(*header) - start;
+                memset(((uint8_t*)header) + start, 0, size);
             }
         }
     }
+    _vgm_map_old_clocks(stream, header, to_skip);
+    if (data_start) {
+        *data_start = to_skip;
+    }
+    return true;
+}
+
+bool vgm_t::init(
+    struct vgm_stream_t* stream,
+    struct vgm_chip_bank_t* chips)
+{
+    assert(stream && chips);
+    _stream = stream;
+    _chips = *chips;
+    _finished = false;
+    _delay = 0;
+    uint32_t to_skip = 0;
+    if (!vgm_read_header(_stream, &_header, &to_skip)) {
+        return false;
+    }
 
     // skip to start of vgm stream
     if (to_skip) {
@@ -282,6 +369,8 @@ bool vgm_t::advance()
 #else
     _delay = 0;
 #endif
+    VGM_STAT_SCOPE(add_parse);
+    VGM_TRACE_SCOPE("advance");
     uint32_t samples = 0;
     uint32_t watchdog = 1000;
     // while we have no new samples keep parsing
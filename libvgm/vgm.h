@@ -13,6 +13,19 @@ struct vgm_chip_t {
     virtual void render(int16_t* dst, uint32_t samples){};
     virtual void render(int32_t* dst, uint32_t samples){};
     virtual void mute(){};
+
+    // number of channels set_mute can address, 0 if the chip has no mask
+    virtual uint32_t channels() const { return 0; };
+    // bit n set mutes channel n. a muted channel is not computed at all
+    // rather than computed and then dropped from the mix
+    virtual void set_mute(uint32_t mask){};
+
+    // mute every channel but those set in mask
+    void set_solo(uint32_t mask)
+    {
+        const uint32_t n = channels();
+        set_mute(~mask & (n < 32 ? (1u << n) - 1 : ~0u));
+    }
 };
 
 struct vgm_chip_bank_t {
@@ -24,6 +37,9 @@ struct vgm_chip_bank_t {
         , nes_apu(nullptr)
         , gb_dmg(nullptr)
         , pokey(nullptr)
+        , ym2413(nullptr)
+        , ym2151(nullptr)
+        , ay8910(nullptr)
     {
     }
 
@@ -33,6 +49,9 @@ struct vgm_chip_bank_t {
     struct vgm_chip_t* nes_apu;
     struct vgm_chip_t* gb_dmg;
     struct vgm_chip_t* pokey;
+    struct vgm_chip_t* ym2413;
+    struct vgm_chip_t* ym2151;
+    struct vgm_chip_t* ay8910;
 };
 
 struct vgm_stream_t {
@@ -47,6 +66,15 @@ struct vgm_stream_t {
     virtual void rewind() = 0;
 };
 
+// read the header of a vgm stream, leaving the stream rewound. fields past
+// the start of the vgm data are zeroed and data_start receives that offset.
+// before 1.10 the ym2413 clock moves to the fm chips the stream writes.
+// returns false if it is not a vgm stream
+bool vgm_read_header(
+    struct vgm_stream_t* stream,
+    struct vgm_header_t* header,
+    uint32_t* data_start = nullptr);
+
 struct vgm_t {
 
     vgm_t()
@@ -79,6 +107,11 @@ struct vgm_t {
       return _chips;
     }
 
+    // return vgm stream header
+    const vgm_header_t &header() const {
+      return _header;
+    }
+
 protected:
     bool _vgm_parse_single(uint32_t*);
     void _vgm_data_block(uint8_t type, uint32_t size);
@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "vgm.h"
+
+// records register writes stamped with a sample offset into the current
+// render block, then replays each write at exactly that offset while the
+// wrapped chip renders the block.
+struct vgm_deferred_t : public vgm_chip_t {
+
+    vgm_deferred_t(vgm_chip_t* chip, uint32_t channels)
+        : _chip(chip)
+        , _channels(channels)
+        , _time(0)
+    {
+        // avoid growing the queue inside the render loop
+        _queue.reserve(256);
+    }
+
+    ~vgm_deferred_t() override
+    {
+        delete _chip;
+    }
+
+    // set the frame offset that following writes will be stamped with
+    void set_time(uint32_t offset)
+    {
+        _time = offset;
+    }
+
+    void set_clock(uint32_t clock) override
+    {
+        _chip->set_clock(clock);
+    }
+
+    void write(uint32_t port, uint32_t reg, uint32_t data) override
+    {
+        const write_t w = { _time, uint8_t(port), uint16_t(reg), uint8_t(data) };
+        _queue.push_back(w);
+    }
+
+    void render(int16_t* dst, uint32_t samples) override
+    {
+        _render(dst, samples);
+    }
+
+    void render(int32_t* dst, uint32_t samples) override
+    {
+        _render(dst, samples);
+    }
+
+    void mute() override
+    {
+        _chip->mute();
+    }
+
+    uint32_t channels() const override
+    {
+        return _chip->channels();
+    }
+
+    void set_mute(uint32_t mask) override
+    {
+        _chip->set_mute(mask);
+    }
+
+protected:
+    struct write_t {
+        uint32_t offset;
+        uint8_t port;
+        uint16_t reg;
+        uint8_t data;
+    };
+
+    // render a block splitting it only where a write lands
+    template <typename type_t>
+    void _render(type_t* dst, uint32_t samples)
+    {
+        uint32_t done = 0;
+        for (const write_t& w : _queue) {
+            const uint32_t at = std::min<uint32_t>(w.offset * _channels, samples);
+            if (at > done) {
+                _chip->render(dst + done, at - done);
+                done = at;
+            }
+            _chip->write(w.port, w.reg, w.data);
+        }
+        if (samples > done) {
+            _chip->render(dst + done, samples - done);
+        }
+        _queue.clear();
+        _time = 0;
+    }
+
+    // the chip being driven
+    vgm_chip_t* _chip;
+    // interleaved output channels per frame
+    uint32_t _channels;
+    // frame offset for the next write
+    uint32_t _time;
+    // writes pending for the current block
+    std::vector<write_t> _queue;
+};
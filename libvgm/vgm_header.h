@@ -33,8 +33,8 @@ struct vgm_header_t {
             // lfsr feedback pattern
             uint16_t feedback_sn76489;
             // lfsr width
-            // - 15 sms2,gg,smd
-            //- 16 bbcmicro,segacomputer3000
+            // - 16 sms2,gg,smd
+            // - 15 bbcmicro,segacomputer3000
             uint8_t width_sn76489;
 
             /* [VGM 1.51 additions:] */
@@ -59,6 +59,26 @@ struct vgm_header_t {
             /* [VGM 1.51 additions:] */
 
             uint32_t clock_sega_pcm;
+            uint32_t interface_sega_pcm;
+            uint32_t clock_rf5c68;
+            uint32_t clock_ym2203;
+            uint32_t clock_ym2608;
+            uint32_t clock_ym2610;
+            uint32_t clock_ym3812;
+            uint32_t clock_ym3526;
+            uint32_t clock_y8950;
+            uint32_t clock_ymf262;
+            uint32_t clock_ymf278b;
+            uint32_t clock_ymf271;
+            uint32_t clock_ymz280b;
+            uint32_t clock_rf5c164;
+            uint32_t clock_pwm;
+            uint32_t clock_ay8910;
+            // 0x00 AY8910 .. 0x03 AY8930, 0x10 YM2149 .. 0x13 YMZ294
+            uint8_t type_ay8910;
+            uint8_t flags_ay8910;
+            uint8_t flags_ym2203_ay8910;
+            uint8_t flags_ym2608_ay8910;
         };
     };
 };
@@ -0,0 +1,68 @@
+#pragma once
+#include <cassert>
+#include <cstring>
+
+#include "vgm.h"
+
+// vgm stream reading from a buffer already in memory, such as a
+// decompressed .vgz file. the buffer is not owned by the stream.
+struct vgm_mstream_t : public vgm_stream_t {
+
+    vgm_mstream_t(const uint8_t* data, uint32_t size)
+        : _data(data)
+        , _size(size)
+        , _pos(0)
+    {
+    }
+
+    bool valid() const
+    {
+        return _data != nullptr;
+    }
+
+    uint8_t read8() override
+    {
+        uint8_t out = 0;
+        read(&out, 1);
+        return out;
+    }
+
+    uint16_t read16() override
+    {
+        uint16_t out = 0;
+        read(&out, 2);
+        return out;
+    }
+
+    uint32_t read32() override
+    {
+        uint32_t out = 0;
+        read(&out, 4);
+        return out;
+    }
+
+    void read(void* dst, uint32_t size) override
+    {
+        assert(_data);
+        // reads past the end are zero filled
+        const uint32_t todo = (size < _size - _pos) ? size : _size - _pos;
+        memcpy(dst, _data + _pos, todo);
+        memset((uint8_t*)dst + todo, 0, size - todo);
+        _pos += todo;
+    }
+
+    void skip(uint32_t size) override
+    {
+        _pos = (size < _size - _pos) ? _pos + size : _size;
+    }
+
+    void rewind() override
+    {
+        _pos = 0;
+    }
+
+protected:
+    const uint8_t* _data;
+    uint32_t _size;
+    uint32_t _pos;
+};
@@ -0,0 +1,145 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// lock free single producer, single consumer ring of audio samples
+//
+// the producer (render thread) only ever calls write() and the consumer
+// (audio callback) only ever calls read(), neither side blocks or allocates.
+template <typename type_t>
+struct vgm_ring_t {
+
+    vgm_ring_t(uint32_t capacity)
+        : _mask(0)
+        , _head(0)
+        , _tail(0)
+        , _underruns(0)
+        , _overruns(0)
+        , _closed(false)
+    {
+        // round capacity up to a power of two so we can mask indices
+        uint32_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _data.resize(size);
+        _mask = size - 1;
+    }
+
+    // total number of samples the ring can hold
+    uint32_t capacity() const
+    {
+        return _mask + 1;
+    }
+
+    // number of samples available to read
+    uint32_t size() const
+    {
+        const uint32_t head = _head.load(std::memory_order_acquire);
+        const uint32_t tail = _tail.load(std::memory_order_acquire);
+        return head - tail;
+    }
+
+    // number of samples that can be written
+    uint32_t space() const
+    {
+        return capacity() - size();
+    }
+
+    // producer: true when the ring already holds limit samples and the
+    // producer should wait for the device to catch up
+    bool full(uint32_t limit) const
+    {
+        return size() >= limit;
+    }
+
+    // producer: the stream has ended, reads that run dry from now on are
+    // the ring draining rather than the producer falling behind
+    void close()
+    {
+        _closed.store(true, std::memory_order_release);
+    }
+
+    // producer: write up to count samples, returns number written
+    uint32_t write(const type_t* src, uint32_t count)
+    {
+        const uint32_t head = _head.load(std::memory_order_relaxed);
+        const uint32_t tail = _tail.load(std::memory_order_acquire);
+        const uint32_t free = capacity() - (head - tail);
+        if (count > free) {
+            // the ring is full so the producer is running too far ahead
+            _overruns.fetch_add(1, std::memory_order_relaxed);
+            count = free;
+        }
+        _copy_in(head, src, count);
+        _head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // consumer: read count samples, padding with silence if we run dry
+    uint32_t read(type_t* dst, uint32_t count)
+    {
+        const uint32_t tail = _tail.load(std::memory_order_relaxed);
+        const uint32_t head = _head.load(std::memory_order_acquire);
+        const uint32_t avail = head - tail;
+        uint32_t todo = count;
+        if (todo > avail) {
+            // the producer could not keep up with the device
+            if (!_closed.load(std::memory_order_acquire)) {
+                _underruns.fetch_add(1, std::memory_order_relaxed);
+            }
+            memset(dst + avail, 0, (todo - avail) * sizeof(type_t));
+            todo = avail;
+        }
+        _copy_out(tail, dst, todo);
+        _tail.store(tail + todo, std::memory_order_release);
+        return todo;
+    }
+
+    // number of reads that had to be padded with silence before the
+    // stream ended
+    uint32_t underruns() const
+    {
+        return _underruns.load(std::memory_order_relaxed);
+    }
+
+    // number of writes that did not fit and had samples dropped
+    uint32_t overruns() const
+    {
+        return _overruns.load(std::memory_order_relaxed);
+    }
+
+protected:
+    void _copy_in(uint32_t head, const type_t* src, uint32_t count)
+    {
+        const uint32_t index = head & _mask;
+        const uint32_t first = std::min<uint32_t>(count, capacity() - index);
+        memcpy(&_data[index], src, first * sizeof(type_t));
+        memcpy(&_data[0], src + first, (count - first) * sizeof(type_t));
+    }
+
+    void _copy_out(uint32_t tail, type_t* dst, uint32_t count) const
+    {
+        const uint32_t index = tail & _mask;
+        const uint32_t first = std::min<uint32_t>(count, capacity() - index);
+        memcpy(dst, &_data[index], first * sizeof(type_t));
+        memcpy(dst + first, &_data[0], (count - first) * sizeof(type_t));
+    }
+
+    // sample storage
+    std::vector<type_t> _data;
+    // capacity - 1
+    uint32_t _mask;
+    // total samples written, only modified by the producer
+    std::atomic<uint32_t> _head;
+    // total samples read, only modified by the consumer
+    std::atomic<uint32_t> _tail;
+    // diagnostic counters
+    std::atomic<uint32_t> _underruns;
+    std::atomic<uint32_t> _overruns;
+    // set by the producer once the stream has ended
+    std::atomic<bool> _closed;
+};
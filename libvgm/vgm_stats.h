@@ -0,0 +1,395 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+// hot path instrumentation
+//
+// counters are only updated when built with VGM_STATS defined, otherwise the
+// VGM_STAT_* macros compile away and every snapshot reads as zero. updates are
+// relaxed atomic adds so any thread may take a snapshot at any time without
+// stalling the render thread or the audio callback. a snapshot is consistent
+// per counter but not across counters.
+//
+// defining VGM_TRACE_OPCODES as well prints every parsed vgm opcode.
+
+enum {
+    VGM_STAT_SN76489,
+    VGM_STAT_YM2612,
+    VGM_STAT_YM3812,
+    VGM_STAT_NES_APU,
+    VGM_STAT_GB_DMG,
+    VGM_STAT_POKEY,
+    VGM_STAT_YM2413,
+    VGM_STAT_YM2151,
+    VGM_STAT_AY8910,
+    VGM_STAT_CHIP_COUNT,
+};
+
+// name of a VGM_STAT_* chip
+inline const char* vgm_stat_chip_name(uint32_t chip)
+{
+    static const char* names[VGM_STAT_CHIP_COUNT] = {
+        "sn76489", "ym2612", "ym3812", "nes_apu", "gb_dmg", "pokey", "ym2413", "ym2151", "ay8910",
+    };
+    return (chip < VGM_STAT_CHIP_COUNT) ? names[chip] : "unknown";
+}
+
+// audio callback durations, bucket n counts callbacks taking under 2^n us
+static const uint32_t VGM_STAT_CALLBACK_BUCKETS = 16;
+
+// plain copy of the counters at one point in time
+struct vgm_stats_snapshot_t {
+
+    struct chip_t {
+        // register writes parsed for the chip
+        uint64_t writes;
+        // time spent in the chip render and the frames it produced
+        uint64_t render_ns;
+        uint64_t render_frames;
+    };
+
+    // time since the counters were created
+    uint64_t time_ns;
+
+    chip_t chip[VGM_STAT_CHIP_COUNT];
+
+    // time spent parsing the vgm stream and the opcodes parsed
+    uint64_t parse_ns;
+    uint64_t opcodes;
+
+    // time spent mixing chips down to the output format
+    uint64_t mixdown_ns;
+    uint64_t mixdown_frames;
+
+    // audio callback duration histogram
+    uint64_t callbacks;
+    uint64_t callback_ns;
+    uint64_t callback_hist[VGM_STAT_CALLBACK_BUCKETS];
+
+    // ring buffer fill level in samples at the last callback, and the lowest
+    // level seen since the counters were created
+    uint64_t ring_fill;
+    uint64_t ring_fill_min;
+    uint64_t ring_capacity;
+};
+
+struct vgm_stats_t {
+
+    typedef std::chrono::steady_clock steady_t;
+
+    // the process wide counters
+    static vgm_stats_t& get()
+    {
+        static vgm_stats_t stats;
+        return stats;
+    }
+
+    void add_write(uint32_t chip)
+    {
+        _add(_chip[chip].writes, 1);
+    }
+
+    void add_render(uint32_t chip, uint64_t ns, uint64_t frames)
+    {
+        _add(_chip[chip].render_ns, ns);
+        _add(_chip[chip].render_frames, frames);
+    }
+
+    void add_parse(uint64_t ns)
+    {
+        _add(_parse_ns, ns);
+    }
+
+    void add_opcode()
+    {
+        _add(_opcodes, 1);
+    }
+
+    void add_mixdown(uint64_t ns, uint64_t frames)
+    {
+        _add(_mixdown_ns, ns);
+        _add(_mixdown_frames, frames);
+    }
+
+    void add_callback(uint64_t ns)
+    {
+        uint32_t bucket = 0;
+        for (uint64_t us = ns / 1000; us && bucket < VGM_STAT_CALLBACK_BUCKETS - 1; us >>= 1) {
+            ++bucket;
+        }
+        _add(_callbacks, 1);
+        _add(_callback_ns, ns);
+        _add(_callback_hist[bucket], 1);
+    }
+
+    // only called from the audio callback so the minimum needs no cas loop
+    void set_ring(uint32_t fill, uint32_t capacity)
+    {
+        _ring_fill.store(fill, std::memory_order_relaxed);
+        _ring_capacity.store(capacity, std::memory_order_relaxed);
+        if (fill < _ring_fill_min.load(std::memory_order_relaxed)) {
+            _ring_fill_min.store(fill, std::memory_order_relaxed);
+        }
+    }
+
+    vgm_stats_snapshot_t snapshot() const
+    {
+        vgm_stats_snapshot_t out;
+        out.time_ns = elapsed_ns(_start);
+        for (uint32_t i = 0; i < VGM_STAT_CHIP_COUNT; ++i) {
+            out.chip[i].writes = _load(_chip[i].writes);
+            out.chip[i].render_ns = _load(_chip[i].render_ns);
+            out.chip[i].render_frames = _load(_chip[i].render_frames);
+        }
+        out.parse_ns = _load(_parse_ns);
+        out.opcodes = _load(_opcodes);
+        out.mixdown_ns = _load(_mixdown_ns);
+        out.mixdown_frames = _load(_mixdown_frames);
+        out.callbacks = _load(_callbacks);
+        out.callback_ns = _load(_callback_ns);
+        for (uint32_t i = 0; i < VGM_STAT_CALLBACK_BUCKETS; ++i) {
+            out.callback_hist[i] = _load(_callback_hist[i]);
+        }
+        out.ring_fill = _load(_ring_fill);
+        out.ring_capacity = _load(_ring_capacity);
+        // still at its initial value if no callback has run
+        out.ring_fill_min = out.callbacks ? _load(_ring_fill_min) : 0;
+        return out;
+    }
+
+    static uint64_t elapsed_ns(const steady_t::time_point& start)
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(steady_t::now() - start).count());
+    }
+
+protected:
+    struct counter_t {
+        std::atomic<uint64_t> writes;
+        std::atomic<uint64_t> render_ns;
+        std::atomic<uint64_t> render_frames;
+    };
+
+    vgm_stats_t()
+        : _start(steady_t::now())
+    {
+        for (uint32_t i = 0; i < VGM_STAT_CHIP_COUNT; ++i) {
+            _chip[i].writes = 0;
+            _chip[i].render_ns = 0;
+            _chip[i].render_frames = 0;
+        }
+        _parse_ns = 0;
+        _opcodes = 0;
+        _mixdown_ns = 0;
+        _mixdown_frames = 0;
+        _callbacks = 0;
+        _callback_ns = 0;
+        for (uint32_t i = 0; i < VGM_STAT_CALLBACK_BUCKETS; ++i) {
+            _callback_hist[i] = 0;
+        }
+        _ring_fill = 0;
+        _ring_fill_min = UINT64_MAX;
+        _ring_capacity = 0;
+    }
+
+    static void _add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static uint64_t _load(const std::atomic<uint64_t>& counter)
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+    const steady_t::time_point _start;
+    counter_t _chip[VGM_STAT_CHIP_COUNT];
+    std::atomic<uint64_t> _parse_ns;
+    std::atomic<uint64_t> _opcodes;
+    std::atomic<uint64_t> _mixdown_ns;
+    std::atomic<uint64_t> _mixdown_frames;
+    std::atomic<uint64_t> _callbacks;
+    std::atomic<uint64_t> _callback_ns;
+    std::atomic<uint64_t> _callback_hist[VGM_STAT_CALLBACK_BUCKETS];
+    std::atomic<uint64_t> _ring_fill;
+    std::atomic<uint64_t> _ring_fill_min;
+    std::atomic<uint64_t> _ring_capacity;
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// times a scope and hands the duration to a vgm_stats_t member
+struct vgm_stats_timer_t {
+
+    typedef void (vgm_stats_t::*sink_t)(uint64_t);
+
+    vgm_stats_timer_t(sink_t sink)
+        : _sink(sink)
+        , _start(vgm_stats_t::steady_t::now())
+    {
+    }
+
+    ~vgm_stats_timer_t()
+    {
+        (vgm_stats_t::get().*_sink)(vgm_stats_t::elapsed_ns(_start));
+    }
+
+protected:
+    sink_t _sink;
+    const vgm_stats_t::steady_t::time_point _start;
+};
+
+#if defined(VGM_STATS)
+#define VGM_STAT_CONCAT_(A, B) A##B
+#define VGM_STAT_CONCAT(A, B) VGM_STAT_CONCAT_(A, B)
+// time the rest of the enclosing scope into vgm_stats_t::SINK
+#define VGM_STAT_SCOPE(SINK) \
+    vgm_stats_timer_t VGM_STAT_CONCAT(_vgm_stat_, __LINE__)(&vgm_stats_t::SINK)
+// declare a start time for use in a later VGM_STAT
+#define VGM_STAT_START(NAME) \
+    const vgm_stats_t::steady_t::time_point NAME = vgm_stats_t::steady_t::now()
+// run a statement only when stats are enabled
+#define VGM_STAT(EXPR) \
+    do {               \
+        EXPR;          \
+    } while (0)
+#else
+#define VGM_STAT_SCOPE(SINK)
+#define VGM_STAT_START(NAME)
+#define VGM_STAT(EXPR) \
+    do {               \
+    } while (0)
+#endif
+
+// count a parsed opcode, printing it when tracing
+#if defined(VGM_TRACE_OPCODES)
+#define VGM_STAT_OPCODE(OP)                        \
+    do {                                           \
+        VGM_STAT(vgm_stats_t::get().add_opcode()); \
+        printf("%02x\n", (OP));                    \
+    } while (0)
+#else
+#define VGM_STAT_OPCODE(OP) VGM_STAT(vgm_stats_t::get().add_opcode())
+#endif
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// periodically appends the counters to a file as one json object per line,
+// rates are taken over the period since the previous line
+struct vgm_stats_dump_t {
+
+    vgm_stats_dump_t(const char* path, uint32_t period_ms = 1000)
+        : _fd(fopen(path, "w"))
+        , _period(period_ms)
+        , _running(_fd != nullptr)
+        , _last(vgm_stats_t::get().snapshot())
+    {
+        if (_fd) {
+            _thread = std::thread(&vgm_stats_dump_t::_run, this);
+        }
+    }
+
+    ~vgm_stats_dump_t()
+    {
+        stop();
+    }
+
+    bool valid() const
+    {
+        return _fd != nullptr;
+    }
+
+    // write a final line and close the file
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _wake.notify_one();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+        if (_fd) {
+            _dump();
+            fclose(_fd);
+            _fd = nullptr;
+        }
+    }
+
+protected:
+    void _run()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_running) {
+            _wake.wait_for(lock, std::chrono::milliseconds(_period));
+            if (_running) {
+                _dump();
+            }
+        }
+    }
+
+    static double _ms(uint64_t ns)
+    {
+        return double(ns) / 1e6;
+    }
+
+    void _dump()
+    {
+        const vgm_stats_snapshot_t now = vgm_stats_t::get().snapshot();
+        const vgm_stats_snapshot_t& old = _last;
+        const double secs = double(now.time_ns - old.time_ns) / 1e9;
+        if (secs <= 0.0) {
+            return;
+        }
+
+        fprintf(_fd, "{ \"time_ms\": %.1f, \"parse_ms\": %.3f, \"opcodes_per_second\": %.0f",
+                _ms(now.time_ns), _ms(now.parse_ns - old.parse_ns),
+                double(now.opcodes - old.opcodes) / secs);
+        fprintf(_fd, ", \"mixdown_ms\": %.3f, \"mixdown_frames\": %llu",
+                _ms(now.mixdown_ns - old.mixdown_ns),
+                (unsigned long long)(now.mixdown_frames - old.mixdown_frames));
+        fprintf(_fd, ", \"chips\": {");
+        const char* sep = " ";
+        for (uint32_t i = 0; i < VGM_STAT_CHIP_COUNT; ++i) {
+            const vgm_stats_snapshot_t::chip_t& a = old.chip[i];
+            const vgm_stats_snapshot_t::chip_t& b = now.chip[i];
+            if (b.writes == 0 && b.render_frames == 0) {
+                // never used
+                continue;
+            }
+            fprintf(_fd, "%s\"%s\": { \"writes_per_second\": %.0f, \"render_ms\": %.3f, \"render_frames\": %llu }",
+                    sep, vgm_stat_chip_name(i), double(b.writes - a.writes) / secs,
+                    _ms(b.render_ns - a.render_ns),
+                    (unsigned long long)(b.render_frames - a.render_frames));
+            sep = ", ";
+        }
+        fprintf(_fd, " }");
+        const uint64_t callbacks = now.callbacks - old.callbacks;
+        fprintf(_fd, ", \"callbacks\": %llu, \"callback_mean_us\": %.1f, \"callback_hist_us\": [",
+                (unsigned long long)callbacks,
+                callbacks ? double(now.callback_ns - old.callback_ns) / double(callbacks) / 1e3 : 0.0);
+        for (uint32_t i = 0; i < VGM_STAT_CALLBACK_BUCKETS; ++i) {
+            fprintf(_fd, "%s%llu", i ? ", " : " ",
+                    (unsigned long long)(now.callback_hist[i] - old.callback_hist[i]));
+        }
+        fprintf(_fd, " ], \"ring_fill\": %llu, \"ring_fill_min\": %llu, \"ring_capacity\": %llu }\n",
+                (unsigned long long)now.ring_fill,
+                (unsigned long long)now.ring_fill_min,
+                (unsigned long long)now.ring_capacity);
+        fflush(_fd);
+        _last = now;
+    }
+
+    FILE* _fd;
+    uint32_t _period;
+    bool _running;
+    vgm_stats_snapshot_t _last;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::thread _thread;
+};
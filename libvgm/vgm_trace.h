@@ -0,0 +1,194 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// timeline tracer writing chrome trace json (chrome://tracing, perfetto)
+//
+// only built in with VGM_TRACE defined, otherwise the VGM_TRACE_* macros
+// compile away. once open() has been called each thread records its spans into
+// its own fixed size ring, allocated the first time the thread records, so
+// recording never locks or allocates. a span is stored as one complete event
+// holding its begin and end time. when a ring wraps the oldest spans are lost.
+// the file is written when the process exits, by which time every thread that
+// recorded must have finished.
+//
+// span and thread names must be string literals, only the pointer is kept.
+struct vgm_trace_t {
+
+    typedef std::chrono::steady_clock steady_t;
+
+    // spans kept per thread, a power of two
+    static const uint32_t RING_SIZE = 1 << 16;
+
+    // the process wide tracer
+    static vgm_trace_t& get()
+    {
+        static vgm_trace_t trace;
+        return trace;
+    }
+
+    // start recording, the trace is written to path at exit
+    void open(const char* path)
+    {
+        _path = path;
+        _start = steady_t::now();
+        _enabled.store(true, std::memory_order_release);
+    }
+
+    bool enabled() const
+    {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    // nanoseconds since open()
+    uint64_t now() const
+    {
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(steady_t::now() - _start).count());
+    }
+
+    void record(const char* name, uint64_t begin, uint64_t end)
+    {
+        ring_t& ring = _ring();
+        const uint32_t head = ring.head.load(std::memory_order_relaxed);
+        event_t& e = ring.events[head & (RING_SIZE - 1)];
+        e.name = name;
+        e.begin = begin;
+        e.end = end;
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    // name the calling thread in the trace
+    void thread_name(const char* name)
+    {
+        if (enabled()) {
+            _ring().name = name;
+        }
+    }
+
+    // write all recorded spans as chrome trace json
+    bool save(const char* path)
+    {
+        FILE* fd = fopen(path, "w");
+        if (!fd) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        fprintf(fd, "{ \"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+        const char* sep = "";
+        for (const std::unique_ptr<ring_t>& ring : _rings) {
+            if (ring->name) {
+                fprintf(fd, "%s{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": { \"name\": \"%s\" } }",
+                        sep, ring->tid, ring->name);
+                sep = ",\n";
+            }
+            const uint32_t head = ring->head.load(std::memory_order_acquire);
+            const uint32_t count = (head < RING_SIZE) ? head : RING_SIZE;
+            for (uint32_t i = head - count; i != head; ++i) {
+                const event_t& e = ring->events[i & (RING_SIZE - 1)];
+                fprintf(fd, "%s{ \"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f }",
+                        sep, e.name, ring->tid, double(e.begin) / 1e3, double(e.end - e.begin) / 1e3);
+                sep = ",\n";
+            }
+        }
+        fprintf(fd, "\n] }\n");
+        fclose(fd);
+        return true;
+    }
+
+    ~vgm_trace_t()
+    {
+        if (!_path.empty()) {
+            save(_path.c_str());
+        }
+    }
+
+protected:
+    struct event_t {
+        const char* name;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    struct ring_t {
+        ring_t(uint32_t tid)
+            : tid(tid)
+            , name(nullptr)
+            , events(RING_SIZE)
+            , head(0)
+        {
+        }
+
+        const uint32_t tid;
+        const char* name;
+        std::vector<event_t> events;
+        // total spans recorded, only written by the owning thread
+        std::atomic<uint32_t> head;
+    };
+
+    vgm_trace_t()
+        : _enabled(false)
+        , _start(steady_t::now())
+    {
+    }
+
+    // ring of the calling thread, created on first use
+    ring_t& _ring()
+    {
+        static thread_local ring_t* ring = nullptr;
+        if (!ring) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _rings.emplace_back(new ring_t(uint32_t(_rings.size() + 1)));
+            ring = _rings.back().get();
+        }
+        return *ring;
+    }
+
+    std::atomic<bool> _enabled;
+    steady_t::time_point _start;
+    std::string _path;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<ring_t>> _rings;
+};
+
+// records the enclosing scope as a span
+struct vgm_trace_scope_t {
+
+    vgm_trace_scope_t(const char* name)
+        : _name(vgm_trace_t::get().enabled() ? name : nullptr)
+        , _begin(_name ? vgm_trace_t::get().now() : 0)
+    {
+    }
+
+    ~vgm_trace_scope_t()
+    {
+        if (_name) {
+            vgm_trace_t& trace = vgm_trace_t::get();
+            trace.record(_name, _begin, trace.now());
+        }
+    }
+
+protected:
+    const char* _name;
+    const uint64_t _begin;
+};
+
+#if defined(VGM_TRACE)
+#define VGM_TRACE_CONCAT_(A, B) A##B
+#define VGM_TRACE_CONCAT(A, B) VGM_TRACE_CONCAT_(A, B)
+// record the rest of the enclosing scope as a span
+#define VGM_TRACE_SCOPE(NAME) \
+    vgm_trace_scope_t VGM_TRACE_CONCAT(_vgm_trace_, __LINE__)(NAME)
+// name the calling thread
+#define VGM_TRACE_THREAD(NAME) vgm_trace_t::get().thread_name(NAME)
+#else
+#define VGM_TRACE_SCOPE(NAME)
+#define VGM_TRACE_THREAD(NAME) \
+    do {                       \
+    } while (0)
+#endif
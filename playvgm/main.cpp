@@ -1,25 +1,39 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdio>
+#include <cstddef>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <windows.h>
 
 #define _SDL_main_h
 #include <SDL.h>
 
+#include "resample.h"
 #include "serial.h"
 #include "vgm.h"
+#include "vgm_deferred.h"
 #include "vgm_fstream.h"
+#include "vgm_ring.h"
+#include "vgm_stats.h"
+#include "vgm_trace.h"
 
 #include "../libchip/mame_sn76489/Sn76496.h"
 #include "../libchip/mame_ym2612/Fm2612.h"
+#include "../libchip/mame_ym2151/Fm2151.h"
 
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
-static const uint32_t OSC_NTSC = 53693100;
-static const uint32_t OSC_PAL = 53203424;
+// device rate of the render mode
+static const uint32_t OUTPUT_RATE = 44100;
 
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
@@ -61,19 +75,33 @@ protected:
 
 struct vgm_render_t {
 
-    vgm_render_t(vgm_t& vgm)
+    // samples (not frames) the render thread tries to keep queued
+    static const uint32_t DEFAULT_FILL = 1024 * 8;
+
+    vgm_render_t(vgm_t& vgm, uint32_t rate, uint32_t target_fill = DEFAULT_FILL)
         : _vgm(vgm)
         , _delay(0)
         , _finished(false)
         , _error(0)
         , _gain(0xf000)
         , _gr_time(0)
+        , _rate(rate)
+        , _ring(target_fill * 2)
+        , _target_fill(target_fill)
+        , _running(false)
     {
     }
 
-    bool init(uint32_t rate)
+    ~vgm_render_t()
+    {
+        _stop_thread();
+        for (bus_t* bus : _buses) {
+            delete bus;
+        }
+    }
+
+    bool init()
     {
-        _rate = rate;
         SDL_Init(SDL_INIT_AUDIO);
 
         SDL_AudioSpec spec = { 0 }, spec_out = { 0 };
@@ -86,8 +114,14 @@ struct vgm_render_t {
         spec.samples = 1024 * 4;
         spec.format = AUDIO_S16LSB;
 
+        // prime the ring before the device starts pulling from it
+        _fill();
+        _running = true;
+        _thread = std::thread(&vgm_render_t::_render_thread, this);
+
         if (SDL_OpenAudio(&spec, &spec_out)) {
             // error
+            _stop_thread();
             return false;
         }
         // unpause audio
@@ -98,47 +132,130 @@ struct vgm_render_t {
     void stop()
     {
         SDL_CloseAudio();
+        _stop_thread();
         SDL_Quit();
     }
 
+    // finished once the stream has ended and the ring has drained
     bool finished() const
     {
-        return _finished;
+        return _finished && _ring.size() == 0;
+    }
+
+    // number of audio callbacks padded with silence before the stream ended
+    uint32_t underruns() const
+    {
+        return _ring.underruns();
+    }
+
+    // number of blocks the ring had no room for, samples were dropped
+    uint32_t overruns() const
+    {
+        return _ring.overruns();
+    }
+
+    // chips are rendered in the order they are added, each at its own
+    // native rate and then resampled to the device rate. stat is the
+    // VGM_STAT_* counter its render time is accounted to.
+    void add_chip(vgm_deferred_t* chip, uint32_t native_rate, uint32_t stat)
+    {
+        _buses.push_back(new bus_t(chip, native_rate, _rate, stat));
     }
 
     void run(int16_t* out, uint32_t samples)
     {
-        static const uint32_t MASK = ~0x1u;
         std::array<int32_t, 1024> mixdown;
-        mixdown.fill(0);
         // while there are samples to render
         while (samples && !_finished) {
-            // find max samples we can render
-            const uint32_t chunk = std::min<uint32_t>({ _delay, samples, mixdown.size() }) & MASK;
-            // render any needed samples
-            if (chunk > 1) {
-                _render(mixdown.data(), chunk);
-                //
-                _redux(mixdown.data(), out, chunk);
-                // track samples we have rendered
-                out += chunk;
-                samples -= chunk;
-                _delay -= chunk;
-
-                for (uint32_t i = 0; i < chunk; ++i) {
-                    mixdown[i] = 0;
-                }
+            // whole stereo frames in this block
+            const uint32_t frames = std::min<uint32_t>(samples, mixdown.size()) / 2;
+            if (frames == 0) {
+                break;
             }
-            // advance vgm stream if we need to
-            if (_delay <= 1 || chunk <= 1) {
-                _vgm.advance();
-                _finished = _vgm.finished();
-                _delay += _vgm.get_delay_samples() * 2;
+            // parse ahead to the end of the block stamping each register
+            // write with the frame it lands on
+            uint32_t pos = 0;
+            while (pos < frames && !_finished) {
+                if (_delay == 0) {
+                    _set_time(pos);
+                    _vgm.advance();
+                    _finished = _vgm.finished();
+                    _delay = _vgm.get_delay_samples();
+                    continue;
+                }
+                const uint32_t step = std::min<uint32_t>(_delay, frames - pos);
+                pos += step;
+                _delay -= step;
             }
+            // render the whole block with one call per chip
+            std::fill(mixdown.begin(), mixdown.begin() + frames * 2, 0);
+            _render(mixdown.data(), frames * 2);
+            VGM_STAT_START(start);
+            VGM_TRACE_SCOPE("mixdown");
+            _redux(mixdown.data(), out, frames * 2);
+            VGM_STAT(vgm_stats_t::get().add_mixdown(vgm_stats_t::elapsed_ns(start), frames));
+            // track samples we have rendered
+            out += frames * 2;
+            samples -= frames * 2;
         }
+        // pad out the tail of the stream with silence
+        memset(out, 0, samples * sizeof(int16_t));
     }
 
 protected:
+    // a chip running at its native rate feeding the final resampler
+    struct bus_t {
+        bus_t(vgm_deferred_t* chip, uint32_t native_rate, uint32_t rate, uint32_t stat)
+            : chip(chip)
+            , resample(native_rate, rate, 2)
+            , stat(stat)
+        {
+        }
+
+        vgm_deferred_t* chip;
+        resample_t resample;
+        // native rate output of the chip for the current block
+        std::vector<int32_t> buffer;
+        // instrumentation counter index
+        uint32_t stat;
+    };
+
+    // top up the ring to the target fill level
+    void _fill()
+    {
+        std::array<int16_t, 1024> buffer;
+        while (!_finished && !_ring.full(_target_fill)) {
+            const uint32_t todo = std::min<uint32_t>(buffer.size(), _target_fill - _ring.size()) & ~0x1u;
+            if (todo == 0) {
+                break;
+            }
+            run(buffer.data(), todo);
+            // the ring is sized at twice the target so this always fits
+            _ring.write(buffer.data(), todo);
+        }
+        if (_finished) {
+            _ring.close();
+        }
+    }
+
+    void _render_thread()
+    {
+        VGM_TRACE_THREAD("render");
+        while (_running && !_finished) {
+            _fill();
+            // wait for the device to drain some samples
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void _stop_thread()
+    {
+        _running = false;
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
     void _redux(const int32_t* src, int16_t* dst, uint32_t count)
     {
         for (; count; --count, ++src, ++dst) {
@@ -154,45 +271,85 @@ protected:
         }
     }
 
-    void _render(int32_t* out, uint32_t samples)
+    // stamp following writes with the native frame matching this output frame
+    void _set_time(uint32_t frame)
     {
-        if (const auto chip = _vgm.chips().ym2612) {
-            chip->render(out, samples);
+        for (bus_t* bus : _buses) {
+            bus->chip->set_time(bus->resample.input_offset(frame));
         }
-        if (const auto chip = _vgm.chips().sn76489) {
-            chip->render(out, samples);
+    }
+
+    void _render(int32_t* out, uint32_t samples)
+    {
+        const uint32_t frames = samples / 2;
+        for (bus_t* bus : _buses) {
+            // render just enough native frames to produce this block
+            const uint32_t native = bus->resample.input_frames(frames);
+            bus->buffer.assign(native * 2, 0);
+            VGM_STAT_START(start);
+            {
+                VGM_TRACE_SCOPE(vgm_stat_chip_name(bus->stat));
+                bus->chip->render(bus->buffer.data(), native * 2);
+            }
+            VGM_STAT(vgm_stats_t::get().add_render(bus->stat, vgm_stats_t::elapsed_ns(start), native));
+            bus->resample.write(bus->buffer.data(), native);
+            bus->resample.read(out, frames);
         }
     }
 
+    // the audio callback only copies out of the ring
     static void SDLCALL _trampoline(void* userdata, Uint8* stream, int len)
     {
+        VGM_STAT_SCOPE(add_callback);
+        VGM_TRACE_THREAD("audio");
+        VGM_TRACE_SCOPE("audio_callback");
         vgm_render_t* self = (vgm_render_t*)userdata;
         int16_t* buffer = (int16_t*)stream;
         len /= 2;
-        self->run(buffer, len);
+        VGM_STAT(vgm_stats_t::get().set_ring(self->_ring.size(), self->_ring.capacity()));
+        self->_ring.read(buffer, len);
     }
 
     int32_t _gain;
     uint32_t _gr_time;
     uint32_t _rate;
-    bool _finished;
+    std::atomic<bool> _finished;
     vgm_t& _vgm;
+    // frames before the next vgm event
     uint32_t _delay;
+    // chips queuing writes within a block
+    std::vector<bus_t*> _buses;
     uint32_t _error;
+    // rendered audio waiting for the device
+    vgm_ring_t<int16_t> _ring;
+    uint32_t _target_fill;
+    // render thread state
+    std::thread _thread;
+    std::atomic<bool> _running;
 };
 
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
 struct chip_ym2612_t : public vgm_chip_t {
 
-    chip_ym2612_t()
+    chip_ym2612_t(uint32_t clock, bool simd)
         : _inst(nullptr)
     {
-        // 7.6Mhz
-        _inst = ym2612_init(OSC_PAL / 7, 44100);
+        // running at the native rate so the core does no resampling
+        _inst = ym2612_init(clock, rate(clock));
+        ym2612_set_simd(_inst, simd);
     }
 
-    ~chip_ym2612_t() override{};
+    // one output per 144 master clocks
+    static uint32_t rate(uint32_t clock)
+    {
+        return clock / 144;
+    }
+
+    ~chip_ym2612_t() override
+    {
+        ym2612_shutdown(_inst);
+    }
 
     void set_clock(uint32_t clock) override{
         //
@@ -242,6 +399,17 @@ struct chip_ym2612_t : public vgm_chip_t {
         //
     };
 
+    uint32_t channels() const override
+    {
+        return 6;
+    }
+
+    void set_mute(uint32_t mask) override
+    {
+        // the core takes a mask of enabled channels
+        ym2612_set_mute(_inst, ~mask & 0xff);
+    }
+
 protected:
     void* _inst;
 };
@@ -250,17 +418,25 @@ protected:
 
 struct chip_sn76489_t : public vgm_chip_t {
 
-    chip_sn76489_t()
+    chip_sn76489_t(uint32_t clock, bool event)
         : _inst(nullptr)
     {
-        // 3.5Mhz
-        static const uint32_t OSC_NTSC = 53693100;
-        static const uint32_t OSC_PAL = 53203424;
-        _inst = segapsg_init(OSC_PAL / 15, 44100, false);
+        // running at the native rate so the core does no resampling
+        _inst = segapsg_init(clock, rate(clock), false);
         segapsg_set_gain(_inst, 256);
+        segapsg_set_event(_inst, event);
     }
 
-    ~chip_sn76489_t() override{};
+    // one output per 16 clocks, the tone counter rate
+    static uint32_t rate(uint32_t clock)
+    {
+        return clock / 16;
+    }
+
+    ~chip_sn76489_t() override
+    {
+        segapsg_shutdown(_inst);
+    }
 
     void set_clock(uint32_t clock) override{
         //
@@ -305,12 +481,209 @@ struct chip_sn76489_t : public vgm_chip_t {
         //
     };
 
+    uint32_t channels() const override
+    {
+        return 4;
+    }
+
+    void set_mute(uint32_t mask) override
+    {
+        // the core takes a mask of enabled channels
+        segapsg_set_mute(_inst, ~mask & 0x0f);
+    }
+
 protected:
     void* _inst;
 };
 
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
+struct chip_ym2151_t : public vgm_chip_t {
+
+    chip_ym2151_t(uint32_t clock, bool simd)
+        : _inst(nullptr)
+    {
+        // running at the native rate so the core does no resampling
+        _inst = ym2151_init(clock, rate(clock));
+        ym2151_set_simd(_inst, simd);
+    }
+
+    // one output per 64 master clocks
+    static uint32_t rate(uint32_t clock)
+    {
+        return clock / 64;
+    }
+
+    ~chip_ym2151_t() override
+    {
+        ym2151_shutdown(_inst);
+    }
+
+    void write(uint32_t port, uint32_t reg, uint32_t data) override
+    {
+        if (_inst) {
+            ym2151_write(_inst, reg, data);
+        }
+    };
+
+    void render(int32_t* dst, uint32_t samples) override
+    {
+        if (!_inst) {
+            return;
+        }
+        ym2151_render(_inst, dst, samples / 2, true);
+    }
+
+    uint32_t channels() const override
+    {
+        return 8;
+    }
+
+    void set_mute(uint32_t mask) override
+    {
+        // the core takes a mask of enabled channels
+        ym2151_set_mute(_inst, ~mask & 0xff);
+    }
+
+protected:
+    void* _inst;
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// a chip backend and the header clock that says a log uses the chip. chips
+// with more than one backend list the default first
+struct chip_factory_t {
+    const char* chip;
+    const char* backend;
+    // offset of the clock in the vgm header
+    uint32_t clock;
+    // bank slot the chip is driven through
+    vgm_chip_t* vgm_chip_bank_t::*slot;
+    // VGM_STAT_* counter its render time is accounted to
+    uint32_t stat;
+    // native rate of the chip at a clock
+    uint32_t (*rate)(uint32_t clock);
+    vgm_chip_t* (*create)(uint32_t clock);
+};
+
+static const chip_factory_t FACTORIES[] = {
+    // event stepped, or stepping every tone counter tick
+    { "sn76489", "mame", offsetof(vgm_header_t, clock_sn76489), &vgm_chip_bank_t::sn76489,
+      VGM_STAT_SN76489, chip_sn76489_t::rate,
+      [](uint32_t clock) -> vgm_chip_t* { return new chip_sn76489_t(clock, true); } },
+    { "sn76489", "mame_clocked", offsetof(vgm_header_t, clock_sn76489), &vgm_chip_bank_t::sn76489,
+      VGM_STAT_SN76489, chip_sn76489_t::rate,
+      [](uint32_t clock) -> vgm_chip_t* { return new chip_sn76489_t(clock, false); } },
+    // the SIMD operator kernel where the build has one, or the scalar one
+    { "ym2612", "mame", offsetof(vgm_header_t, clock_ym2612), &vgm_chip_bank_t::ym2612,
+      VGM_STAT_YM2612, chip_ym2612_t::rate,
+      [](uint32_t clock) -> vgm_chip_t* { return new chip_ym2612_t(clock, true); } },
+    { "ym2612", "mame_scalar", offsetof(vgm_header_t, clock_ym2612), &vgm_chip_bank_t::ym2612,
+      VGM_STAT_YM2612, chip_ym2612_t::rate,
+      [](uint32_t clock) -> vgm_chip_t* { return new chip_ym2612_t(clock, false); } },
+    { "ym2151", "mame", offsetof(vgm_header_t, clock_ym2151), &vgm_chip_bank_t::ym2151,
+      VGM_STAT_YM2151, chip_ym2151_t::rate,
+      [](uint32_t clock) -> vgm_chip_t* { return new chip_ym2151_t(clock, true); } },
+    { "ym2151", "mame_scalar", offsetof(vgm_header_t, clock_ym2151), &vgm_chip_bank_t::ym2151,
+      VGM_STAT_YM2151, chip_ym2151_t::rate,
+      [](uint32_t clock) -> vgm_chip_t* { return new chip_ym2151_t(clock, false); } },
+};
+
+// find a backend by chip and backend name, nullptr when unknown
+static const chip_factory_t* find_factory(const char* chip, const char* backend)
+{
+    for (const chip_factory_t& f : FACTORIES) {
+        if (strcmp(f.chip, chip) == 0 && strcmp(f.backend, backend) == 0) {
+            return &f;
+        }
+    }
+    return nullptr;
+}
+
+// a chip built for the render mode, writes are queued and applied at their
+// exact frame in a block
+struct chip_instance_t {
+    std::unique_ptr<vgm_deferred_t> chip;
+    const chip_factory_t* factory;
+    uint32_t clock;
+};
+
+// build every chip the header gives a clock for at that clock, before the
+// first render so nothing is constructed while parsing. chosen holds the
+// backends picked on the command line, other chips take their first one.
+static void create_chips(
+    const vgm_header_t& header,
+    const std::vector<const chip_factory_t*>& chosen,
+    vgm_chip_bank_t& bank,
+    std::vector<chip_instance_t>& out)
+{
+    for (const chip_factory_t& f : FACTORIES) {
+        uint32_t clock = 0;
+        memcpy(&clock, header._raw + f.clock, sizeof(clock));
+        // the top bits flag a second chip or a chip variant
+        clock &= 0x3fffffff;
+        if (clock == 0 || bank.*f.slot) {
+            continue;
+        }
+        const chip_factory_t* use = &f;
+        for (const chip_factory_t* c : chosen) {
+            if (strcmp(c->chip, f.chip) == 0) {
+                use = c;
+            }
+        }
+        chip_instance_t chip;
+        chip.chip.reset(new vgm_deferred_t(use->create(clock), 2));
+        chip.factory = use;
+        chip.clock = clock;
+        bank.*f.slot = chip.chip.get();
+        out.push_back(std::move(chip));
+    }
+}
+
+// a channel mask from the command line, given as <chip>:<mask>
+struct chip_mask_t {
+    std::string chip;
+    uint32_t mask;
+    bool solo;
+};
+
+static bool parse_mask(const char* arg, bool solo, std::vector<chip_mask_t>& out)
+{
+    const char* sep = strchr(arg, ':');
+    if (!sep) {
+        return false;
+    }
+    chip_mask_t m;
+    m.chip.assign(arg, sep);
+    m.mask = uint32_t(strtoul(sep + 1, nullptr, 0));
+    m.solo = solo;
+    out.push_back(m);
+    return true;
+}
+
+// apply the masks to the chips they name, chips without channel masks
+// ignore them
+static void apply_masks(
+    const std::vector<chip_mask_t>& masks,
+    std::vector<chip_instance_t>& chips)
+{
+    for (const chip_mask_t& m : masks) {
+        for (chip_instance_t& c : chips) {
+            if (m.chip != c.factory->chip) {
+                continue;
+            }
+            if (m.solo) {
+                c.chip->set_solo(m.mask);
+            } else {
+                c.chip->set_mute(m.mask);
+            }
+        }
+    }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
 struct chip_sn76489_serial_t : public vgm_chip_t {
 
     chip_sn76489_serial_t(int port)
@@ -341,8 +714,40 @@ protected:
 
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
-int main(const int argc, char** args)
+int main(int argc, char** args)
 {
+    // -stats dumps the instrumentation counters once a second
+    // -trace writes a chrome trace of the render pipeline at exit
+    // -<chip> <backend> picks a backend for the render mode, ie. -ym2612 mame_scalar
+    // -mute <chip>:<mask> and -solo <chip>:<mask> skip channels in the render mode
+    // -fill <samples> sets the samples queued ahead of the device in the render mode
+    std::unique_ptr<vgm_stats_dump_t> stats;
+    uint32_t target_fill = vgm_render_t::DEFAULT_FILL;
+    std::vector<const chip_factory_t*> chosen;
+    std::vector<chip_mask_t> masks;
+    while (argc > 2 && args[1][0] == '-') {
+        if (strcmp(args[1], "-stats") == 0) {
+            stats.reset(new vgm_stats_dump_t(args[2]));
+        } else if (strcmp(args[1], "-trace") == 0) {
+            vgm_trace_t::get().open(args[2]);
+        } else if (strcmp(args[1], "-mute") == 0 || strcmp(args[1], "-solo") == 0) {
+            if (!parse_mask(args[2], strcmp(args[1], "-solo") == 0, masks)) {
+                break;
+            }
+        } else if (strcmp(args[1], "-fill") == 0) {
+            target_fill = uint32_t(strtoul(args[2], nullptr, 0));
+            if (target_fill == 0) {
+                return 1;
+            }
+        } else if (const chip_factory_t* f = find_factory(args[1] + 1, args[2])) {
+            chosen.push_back(f);
+        } else {
+            break;
+        }
+        args += 2;
+        argc -= 2;
+    }
+
     if (argc < 2) {
         // well we need a song to play
         return 1;
@@ -371,17 +776,26 @@ int main(const int argc, char** args)
     } else {
         // render
 
+        vgm_header_t header;
+        if (!vgm_read_header(&stream, &header)) {
+            return 1;
+        }
+
         vgm_chip_bank_t bank;
-        bank.ym2612 = new chip_ym2612_t;
-        bank.sn76489 = new chip_sn76489_t;
+        std::vector<chip_instance_t> chips;
+        create_chips(header, chosen, bank, chips);
+        apply_masks(masks, chips);
 
         vgm_t vgm;
         if (!vgm.init(&stream, &bank)) {
             return 1;
         }
 
-        vgm_render_t render(vgm);
-        if (!render.init(44100)) {
+        vgm_render_t render(vgm, OUTPUT_RATE, target_fill);
+        for (chip_instance_t& chip : chips) {
+            render.add_chip(chip.chip.get(), chip.factory->rate(chip.clock), chip.factory->stat);
+        }
+        if (!render.init()) {
             return 1;
         }
         while (!render.finished()) {
@@ -389,6 +803,7 @@ int main(const int argc, char** args)
         }
 
         render.stop();
+        printf("underruns: %u, overruns: %u\n", render.underruns(), render.overruns());
     }
 
     return 0;
@@ -7,26 +7,68 @@ enum chip_type_e
     e_chip_nes_apu,
     e_chip_ym3812,
     e_chip_ym2612,
+    e_chip_gb_dmg,
+    e_chip_pokey,
+    e_chip_ym2413,
+    e_chip_ym2151,
+    e_chip_ay8910,
+    e_chip_count,
 };
 
-struct vgm_chip_t
+/* Chip interface of the player, kept apart from vgm_chip_t in libvgm so both
+** can be linked into the same tool
+**/
+struct chip_t
 {
     const chip_type_e id_;
 
-    vgm_chip_t(chip_type_e id)
+    chip_t(chip_type_e id)
         : id_(id)
     {
     }
 
-    virtual ~vgm_chip_t() {}
+    virtual ~chip_t() {}
 
     virtual void init() = 0;
     virtual void write(uint32_t reg, uint32_t data) = 0;
     virtual void render(int16_t * dst, uint32_t len) = 0;
     virtual void silence() = 0;
+
+    /* vgm data block, chips without use for one ignore it
+    **/
+    virtual void write_block(uint32_t type, const uint8_t * data, uint32_t size) {}
+
+    /* number of channels set_mute can address, 0 if the chip has no mask
+    **/
+    virtual uint32_t channels() const { return 0; }
+
+    /* bit n set mutes channel n, a muted channel is not computed at all
+    ** rather than computed and dropped from the mix
+    **/
+    virtual void set_mute(uint32_t mask) {}
+
+    /* mute every channel but those set in mask
+    **/
+    void set_solo(uint32_t mask)
+    {
+        const uint32_t n = channels();
+        set_mute(~mask & (n<32 ? (1u<<n)-1 : ~0u));
+    }
 };
 
-vgm_chip_t * chip_create_sn76489(uint32_t clock);
-vgm_chip_t * chip_create_nes_apu(uint32_t clock);
-vgm_chip_t * chip_create_ym3812 (uint32_t clock);
-vgm_chip_t * chip_create_ym2612 (uint32_t clock);
\ No newline at end of file
+/* feedback, width and flags are the sn76489 fields of the vgm header, zero
+** for the sega psg
+**/
+chip_t * chip_create_sn76489(uint32_t clock, uint16_t feedback=0, uint8_t width=0, uint8_t flags=0);
+chip_t * chip_create_nes_apu(uint32_t clock);
+chip_t * chip_create_gb_dmg (uint32_t clock);
+chip_t * chip_create_pokey  (uint32_t clock);
+chip_t * chip_create_ym3812 (uint32_t clock);
+chip_t * chip_create_ym3812_fixed(uint32_t clock);
+chip_t * chip_create_ym2612 (uint32_t clock);
+chip_t * chip_create_ym2413 (uint32_t clock);
+chip_t * chip_create_ym2151 (uint32_t clock);
+/* type is the ay8910 chip type of the vgm header, 0x10 and up are the YM2149
+** family with the finer envelope
+**/
+chip_t * chip_create_ay8910 (uint32_t clock, uint8_t type=0);
\ No newline at end of file
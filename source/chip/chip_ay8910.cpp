@@ -0,0 +1,501 @@
+#include <string.h>
+#include <math.h>
+#include <array>
+
+#include "../assert.h"
+#include "../config.h"
+#include "../sound/sound.h"
+
+#include "chip.h"
+
+namespace
+{
+
+const uint32_t C_CLOCK_AY8910 = 1789772; // 1.79MHz, MSX and Spectrum 128
+
+// 2x oversampled rate the source is rendered at
+const uint64_t C_RATE = SAMPLE_RATE*2;
+
+// gain of a channel at full level, three channels at full level peak at half
+// scale
+const float C_GAIN = .5f/3.f;
+
+// counters stepped by the source, all in ticks of clock/8
+enum
+{
+    _TONE_A,
+    _TONE_B,
+    _TONE_C,
+    _NOISE,
+    _ENV,
+    _COUNTERS,
+};
+
+// registers
+enum
+{
+    _NOISE_PERIOD = 0x06,
+    _MIXER        = 0x07,
+    _AMP_A        = 0x08,
+    _ENV_FINE     = 0x0b,
+    _ENV_COARSE   = 0x0c,
+    _ENV_SHAPE    = 0x0d,
+};
+
+// envelope shape bits
+enum
+{
+    _HOLD      = 0x01,
+    _ALTERNATE = 0x02,
+    _ATTACK    = 0x04,
+    _CONTINUE  = 0x08,
+};
+
+// amplitude register bit selecting the envelope
+const uint8_t _AMP_ENV = 0x10;
+
+/* Output levels
+ * The YM2149 dac has 32 steps of 1.5dB, which the envelope walks through. The
+ * AY8910 and the fixed amplitudes of both have 16 steps of 3dB, every other
+ * one of them.
+**/
+struct ay_levels_t
+{
+    std::array<float, 32> level_;
+
+    ay_levels_t()
+    {
+        level_[0] = 0.f;
+        for (uint32_t i = 1; i<level_.size(); ++i) {
+            level_[i] = C_GAIN*powf(2.f, float(int32_t(i)-31)/4.f);
+        }
+    }
+
+    static const ay_levels_t & get()
+    {
+        static const ay_levels_t levels;
+        return levels;
+    }
+};
+
+struct ay_counter_t
+{
+    uint64_t expire_;   // tick of the next underflow
+    uint32_t period_;   // ticks between underflows, as scheduled
+    bool     fast_;     // tone above the output rate
+};
+
+struct ay8910_t
+{
+    const ay_levels_t * levels_;
+
+    std::array<ay_counter_t, _COUNTERS> ctr_;
+    std::array<uint8_t, 16> regs_;
+
+    // tone output flip-flops
+    std::array<uint8_t, 3> tone_;
+    // 17 bit noise shift register
+    uint32_t rng_;
+
+    // envelope, step counts down from env_mask_
+    uint32_t env_mask_;     // 15 on the AY8910, 31 on the YM2149
+    int32_t  env_step_;
+    uint32_t env_attack_;   // env_mask_ when rising
+    bool     env_hold_;
+    bool     env_alternate_;
+    bool     env_holding_;
+
+    // channels the player asked to leave out of the render
+    uint32_t mute_;
+
+    uint64_t clock_;
+    // oversampled samples rendered so far, the time of register writes
+    uint64_t sample_;
+    // output level, as last written into step_
+    float    level_;
+    // source volume the steps in step_ are scaled by
+    float    volume_;
+
+    step_t   step_;
+
+    // tick at the start of the next sample to render
+    uint64_t _now() const {
+        return (sample_*clock_+C_RATE-1)/C_RATE;
+    }
+
+    // nothing can be heard until an amplitude is written
+    bool silent() const {
+        for (uint32_t i = 0; i<3; ++i) {
+            if ((regs_[_AMP_A+i]&(_AMP_ENV|0x0f)) && !(mute_&(1u<<i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // index into the level table of the current envelope step
+    uint32_t _env_index() const {
+        const uint32_t v = uint32_t(env_step_)^env_attack_;
+        return (env_mask_==31) ? v : (v ? v*2+1 : 0);
+    }
+
+    // tone counters of muted channels are not stepped, the noise and
+    // envelope only while a channel is heard
+    bool _stepped(uint32_t ix) const {
+        return (ix<_NOISE) ? !(mute_&(1u<<ix)) : (mute_&7)!=7;
+    }
+
+    float _channel_level(uint32_t ix) const {
+        if (mute_&(1u<<ix)) {
+            return 0.f;
+        }
+        const uint8_t amp = regs_[_AMP_A+ix];
+        const uint32_t index = (amp&_AMP_ENV) ?
+            _env_index() :
+            ((amp&0x0f) ? (amp&0x0f)*2+1 : 0);
+        if (index==0) {
+            return 0.f;
+        }
+        const uint8_t mixer = regs_[_MIXER];
+        // a disabled generator holds its input to the output gate high
+        if (!(mixer&(0x08<<ix)) && !(rng_&1)) {
+            return 0.f;
+        }
+        float level = levels_->level_[index];
+        if (!(mixer&(0x01<<ix))) {
+            // tones above the output rate average out to half level
+            if (ctr_[ix].fast_) {
+                level *= .5f;
+            }
+            else if (!tone_[ix]) {
+                return 0.f;
+            }
+        }
+        return level;
+    }
+
+    float level() const {
+        return _channel_level(0)+_channel_level(1)+_channel_level(2);
+    }
+
+    // write a step to the current level, phase places it within the last
+    // sample read
+    void step(float phase) {
+        const float lvl = level();
+        if (lvl!=level_) {
+            sound_step_add(step_, phase, volume_*(lvl-level_));
+            level_ = lvl;
+        }
+    }
+
+    // restart the envelope from a shape register write
+    void env_shape(uint8_t shape) {
+        env_attack_ = (shape&_ATTACK) ? env_mask_ : 0;
+        if (shape&_CONTINUE) {
+            env_hold_      = (shape&_HOLD)!=0;
+            env_alternate_ = (shape&_ALTERNATE)!=0;
+        }
+        else {
+            // without continue the shape ends held at zero, which is the
+            // same as one of the continued shapes
+            env_hold_      = true;
+            env_alternate_ = env_attack_!=0;
+        }
+        env_step_    = int32_t(env_mask_);
+        env_holding_ = false;
+    }
+
+    void env_advance() {
+        if (env_holding_) {
+            return;
+        }
+        if (--env_step_<0) {
+            if (env_hold_) {
+                if (env_alternate_) {
+                    env_attack_ ^= env_mask_;
+                }
+                env_holding_ = true;
+                env_step_ = 0;
+            }
+            else {
+                if (env_alternate_) {
+                    env_attack_ ^= env_mask_;
+                }
+                env_step_ = int32_t(env_mask_);
+            }
+        }
+    }
+
+    void noise_advance() {
+        // the input is bit 0 xor bit 3, shifted in at bit 16
+        rng_ = (rng_>>1)|(((rng_^(rng_>>3))&1)<<16);
+    }
+
+    // tick of the next underflow of any stepped counter, far enough off to
+    // never be reached when every channel is muted
+    uint64_t next() const {
+        uint64_t e = UINT64_MAX/C_RATE;
+        for (uint32_t i = 0; i<_COUNTERS; ++i) {
+            if (_stepped(i)) {
+                e = (ctr_[i].expire_<e) ? ctr_[i].expire_ : e;
+            }
+        }
+        return e;
+    }
+
+    // clock every stepped counter underflowing at tick e
+    void expire(uint64_t e) {
+        for (uint32_t i = 0; i<_COUNTERS; ++i) {
+            ay_counter_t & ctr = ctr_[i];
+            if (ctr.expire_!=e || !_stepped(i)) {
+                continue;
+            }
+            ctr.expire_ += ctr.period_;
+            if (i<_NOISE) {
+                tone_[i] ^= 1;
+            }
+            else if (i==_NOISE) {
+                noise_advance();
+            }
+            else {
+                env_advance();
+                // a held envelope has nothing more to do
+                if (env_holding_) {
+                    ctr.expire_ = UINT64_MAX;
+                }
+            }
+        }
+    }
+
+    // move every counter past tick now without output, keeping tones in
+    // phase and the envelope in step
+    void skip(uint64_t now) {
+        for (uint32_t i = 0; i<_COUNTERS; ++i) {
+            ay_counter_t & ctr = ctr_[i];
+            if (ctr.expire_>=now) {
+                continue;
+            }
+            uint64_t n = (now-ctr.expire_+ctr.period_-1)/ctr.period_;
+            ctr.expire_ += n*ctr.period_;
+            if (i<_NOISE) {
+                tone_[i] ^= uint8_t(n&1);
+            }
+            else if (i==_ENV) {
+                // the envelope repeats every two cycles or holds within one
+                const uint64_t cycle = uint64_t(env_mask_)+1;
+                n = env_hold_ ? (n<cycle ? n : cycle) : n%(cycle*2);
+                while (n--) {
+                    env_advance();
+                }
+                if (env_holding_) {
+                    ctr.expire_ = UINT64_MAX;
+                }
+            }
+            // the noise is random anyway so it is left where it was
+        }
+    }
+};
+
+/* SOUND SOURCE: AY-3-8910 / YM2149
+ * Stepped from one counter underflow to the next, the output level only
+ * changes there and is written as band limited steps.
+**/
+bool ay8910_source(float * out,
+                   size_t length,
+                   void * user,
+                   float volume)
+{
+    ay8910_t & ay = *(ay8910_t*)user;
+
+    const uint64_t end = ay.sample_+length;
+
+    // a new source volume rescales the level the steps already hold
+    if (volume!=ay.volume_) {
+        if (ay.level_!=0.f) {
+            sound_step_add(ay.step_, 0.f, (volume-ay.volume_)*ay.level_);
+        }
+        ay.volume_ = volume;
+    }
+
+    // silent so just keep the counters in step
+    if (ay.silent() && ay.level_==0.f && sound_step_settled(ay.step_)) {
+        ay.sample_ = end;
+        ay.skip(ay._now());
+        return false;
+    }
+
+    const uint64_t clock = ay.clock_;
+    uint64_t sample = ay.sample_;
+    for (;;) {
+        const uint64_t e = ay.next();
+        // time of the underflow and the sample it lands in
+        const uint64_t t  = e*C_RATE;
+        const uint64_t at = t/clock;
+        if (at>=end) {
+            sound_step_read(ay.step_, out, size_t(end-sample));
+            break;
+        }
+        if (at>=sample) {
+            const size_t count = size_t(at+1-sample);
+            sound_step_read(ay.step_, out, count);
+            out += count;
+            sample = at+1;
+        }
+        ay.expire(e);
+        ay.step(float(t%clock)/float(clock));
+    }
+    ay.sample_ = end;
+    return true;
+}
+
+struct vgm_chip_ay8910_t: public chip_t
+{
+    ay8910_t ay_;
+    uint32_t clock_;
+    bool     ym_;
+
+    sound_t  sound_;
+    std::array<source_t, 2> source_;
+
+    // schedule counter ix with a new period in ticks
+    void _period(uint32_t ix, uint32_t period)
+    {
+        // fastest underflow rate that is scheduled, one per output sample
+        const uint32_t c_min = uint32_t((ay_.clock_+C_RATE-1)/C_RATE);
+
+        ay_counter_t & ctr = ay_.ctr_[ix];
+        // a period of zero counts as one
+        period = period ? period : 1;
+        ctr.fast_   = period<c_min;
+        ctr.period_ = (period<c_min) ? c_min : period;
+        // a shorter period takes effect by the next underflow
+        const uint64_t now = ay_._now();
+        if (ctr.expire_>now+ctr.period_) {
+            ctr.expire_ = now+ctr.period_;
+        }
+    }
+
+    void _tone_period(uint32_t ch)
+    {
+        const std::array<uint8_t, 16> & regs = ay_.regs_;
+        _period(ch, regs[ch*2]|((regs[ch*2+1]&0x0f)<<8));
+    }
+
+    void _env_period()
+    {
+        const std::array<uint8_t, 16> & regs = ay_.regs_;
+        const uint32_t period = regs[_ENV_FINE]|(regs[_ENV_COARSE]<<8);
+        // the YM2149 envelope has twice the steps at twice the rate
+        _period(_ENV, ym_ ? period : period*2);
+    }
+
+    vgm_chip_ay8910_t(uint32_t clock, bool ym)
+        : chip_t(e_chip_ay8910)
+        , clock_(clock ? clock : C_CLOCK_AY8910)
+        , ym_(ym)
+    {
+        ay_.mute_ = 0;
+    }
+
+    virtual void init() override
+    {
+        sound_init(&sound_);
+
+        ay_.levels_   = &ay_levels_t::get();
+        ay_.clock_    = clock_/8;
+        ay_.sample_   = 0;
+        ay_.level_    = 0.f;
+        ay_.volume_   = 1.f;
+        ay_.step_     = step_t();
+        ay_.regs_.fill(0);
+        ay_.tone_.fill(0);
+        ay_.rng_      = 1;
+        ay_.env_mask_ = ym_ ? 31 : 15;
+        ay_.env_shape(0);
+        for (ay_counter_t & ctr : ay_.ctr_) {
+            memset(&ctr, 0, sizeof(ctr));
+        }
+        for (uint32_t i = 0; i<3; ++i) {
+            _tone_period(i);
+        }
+        _period(_NOISE, 2);
+        _env_period();
+        // tones and noise are enabled with every amplitude at zero
+        ay_.regs_[_MIXER] = 0;
+
+        source_ = {
+            source_t{ay8910_source, &ay_, true, 1.f},
+            source_t{nullptr, nullptr, false, 0.f},
+        };
+    }
+
+    virtual void write(uint32_t reg, uint32_t data) override
+    {
+        // bit 7 addresses a second chip which is not emulated, 14 and 15
+        // are the io ports
+        if (reg>_ENV_SHAPE) {
+            return;
+        }
+        // counters that are not stepped while muted are brought up to now
+        // before a period change, so they stay in step with the others
+        if (ay_.mute_ && (reg<_MIXER || reg==_ENV_FINE || reg==_ENV_COARSE)) {
+            ay_.skip(ay_._now());
+        }
+        ay_.regs_[reg] = data;
+        if (reg<_NOISE_PERIOD) {
+            _tone_period(reg>>1);
+        }
+        if (reg==_NOISE_PERIOD) {
+            // noise shifts at half the tone rate
+            _period(_NOISE, (data&0x1f)*2);
+        }
+        if (reg==_ENV_FINE || reg==_ENV_COARSE) {
+            _env_period();
+        }
+        if (reg==_ENV_SHAPE) {
+            // writing the shape restarts the envelope
+            ay_.env_shape(data);
+            _env_period();
+            ay_.ctr_[_ENV].expire_ = ay_._now()+ay_.ctr_[_ENV].period_;
+        }
+        // amplitude and mixer changes are heard straight away
+        ay_.step(0.f);
+    }
+
+    virtual void render(int16_t * dst, uint32_t len) override
+    {
+        sound_render(&sound_, dst, len, &source_[0]);
+    }
+
+    virtual void silence() override
+    {
+        for (uint32_t i = 0; i<3; ++i) {
+            ay_.regs_[_AMP_A+i] = 0;
+        }
+        ay_.step(0.f);
+    }
+
+    virtual uint32_t channels() const override
+    {
+        return 3;
+    }
+
+    virtual void set_mute(uint32_t mask) override
+    {
+        // bring every counter up to now, those that were not stepped pick
+        // up from here when their channels are unmuted
+        ay_.skip(ay_._now());
+        ay_.mute_ = mask;
+        ay_.step(0.f);
+    }
+};
+
+} // namespace {}
+
+chip_t * chip_create_ay8910(uint32_t clock, uint8_t type)
+{
+    // vgm chip types from 0x10 up are the YM2149 family
+    vgm_chip_ay8910_t * chip = new vgm_chip_ay8910_t(clock, type>=0x10);
+    chip->init();
+    return chip;
+}
@@ -0,0 +1,641 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <array>
+
+#include "../assert.h"
+#include "../config.h"
+#include "../sound/sound.h"
+
+#include "chip.h"
+
+namespace
+{
+
+const uint32_t C_CLOCK_DMG = 4194304; // 4.19MHz
+
+// 2x oversampled rate the sources are rendered at
+const float C_RATE = float(SAMPLE_RATE*2);
+
+// cpu clocks between frame sequencer steps, 512hz
+const uint32_t C_FRAME_STEP = 8192;
+
+// duty cycle lookup table
+const std::array<float, 4> g_duty = {
+    .125f, .25f, .5f, .75f
+};
+
+// cpu clocks between noise shifts for each divisor code, before the shift
+const std::array<uint8_t, 8> g_noise_divisor = {
+    8, 16, 32, 48, 64, 80, 96, 112
+};
+
+// register offsets from $FF10, as vgm command 0xB3 addresses them
+enum
+{
+    NR10 = 0x00, NR11, NR12, NR13, NR14,
+    NR20,        NR21, NR22, NR23, NR24,
+    NR30,        NR31, NR32, NR33, NR34,
+    NR40,        NR41, NR42, NR43, NR44,
+    NR50,        NR51, NR52,
+    WAVE = 0x20,
+};
+
+struct gb_reg_t
+{
+    std::array<uint8_t, 0x30> data_;
+
+    // pulse 1, pulse 2
+    uint8_t voice_duty(uint32_t voice) const {
+        assert(voice<2);
+        return (data_[voice*5+1]&0xc0)>>6;
+    }
+
+    // pulse 1, pulse 2, wave
+    uint32_t voice_freq(uint32_t voice) const {
+        assert(voice<3);
+        return data_[voice*5+3]|((data_[voice*5+4]&0x7)<<8);
+    }
+
+    // pulse 1, pulse 2, noise
+    uint8_t voice_env_volume(uint32_t voice) const {
+        assert(voice!=2);
+        return data_[voice*5+2]>>4;
+    }
+
+    bool voice_env_up(uint32_t voice) const {
+        assert(voice!=2);
+        return (data_[voice*5+2]&0x08) != 0;
+    }
+
+    uint8_t voice_env_period(uint32_t voice) const {
+        assert(voice!=2);
+        return data_[voice*5+2]&0x07;
+    }
+
+    // the dac is off when the envelope starts at zero going down
+    bool voice_dac(uint32_t voice) const {
+        if (voice==2) {
+            return (data_[NR30]&0x80) != 0;
+        }
+        return (data_[voice*5+2]&0xf8) != 0;
+    }
+
+    bool voice_length_enable(uint32_t voice) const {
+        assert(voice<4);
+        return (data_[voice*5+4]&0x40) != 0;
+    }
+
+    uint8_t sweep_period() const {
+        return (data_[NR10]&0x70)>>4;
+    }
+
+    bool sweep_neg() const {
+        return (data_[NR10]&0x08) != 0;
+    }
+
+    uint8_t sweep_shift() const {
+        return data_[NR10]&0x07;
+    }
+
+    // 0 mute, 1 full, 2 half, 3 quarter
+    uint8_t wave_level() const {
+        return (data_[NR32]&0x60)>>5;
+    }
+
+    uint8_t noise_shift() const {
+        return data_[NR43]>>4;
+    }
+
+    bool noise_short() const {
+        return (data_[NR43]&0x08) != 0;
+    }
+
+    uint8_t noise_divisor() const {
+        return data_[NR43]&0x07;
+    }
+
+    // a channel is heard if it is panned to either side
+    bool voice_panned(uint32_t voice) const {
+        return (data_[NR51]&(0x11<<voice)) != 0;
+    }
+
+    // louder of the two master volumes, 1 to 8
+    uint8_t master_volume() const {
+        const uint8_t l = (data_[NR50]>>4)&7;
+        const uint8_t r = data_[NR50]&7;
+        return ((l>r) ? l : r)+1;
+    }
+
+    bool power() const {
+        return (data_[NR52]&0x80) != 0;
+    }
+};
+
+struct gb_envelope_t
+{
+    uint8_t volume_;
+    uint8_t timer_;
+    uint8_t period_;
+    bool    up_;
+
+    // reload from register on trigger
+    void trigger(uint8_t volume, bool up, uint8_t period) {
+        volume_ = volume;
+        up_     = up;
+        period_ = period;
+        timer_  = period;
+    }
+
+    // clock from frame sequencer, a period of zero stops the envelope
+    void clock() {
+        if (period_==0 || --timer_!=0) {
+            return;
+        }
+        timer_ = period_;
+        if (up_ && volume_<15) {
+            ++volume_;
+        }
+        if (!up_ && volume_>0) {
+            --volume_;
+        }
+    }
+};
+
+struct gb_sweep_t
+{
+    uint16_t shadow_;
+    uint8_t  timer_;
+    bool     enable_;
+};
+
+/* Wave channel
+ * 32 four bit samples from wave ram played by a phase accumulator, the
+ * output level shift is baked into the table.
+**/
+struct gb_wave_t
+{
+    float accum_;   // position in the wave
+    float delta_;   // wave samples per oversampled sample
+    float volume_;
+    std::array<float, 32> table_;
+
+    void set_freq(float freq, float sample_rate) {
+        delta_ = (32.f/sample_rate) * freq;
+    }
+
+    void set_volume(float volume) {
+        volume_ = volume;
+    }
+};
+
+/* SOUND SOURCE: Game Boy Wave Channel
+**/
+bool gb_source_wave(float * out,
+                    size_t length,
+                    void * user,
+                    float attenuation)
+{
+    gb_wave_t & wave = *(gb_wave_t*)user;
+
+    float accum = wave.accum_;
+    const float delta  = wave.delta_;
+    const float volume = wave.volume_ * attenuation;
+
+    // silent so just advance the phase
+    if (volume==0.f) {
+        wave.accum_ = fmodf(accum+delta*float(length), 32.f);
+        return false;
+    }
+
+    // while there are samples to render
+    while (length--) {
+        if ((accum += delta)>=32.f) {
+            accum = fmodf(accum, 32.f);
+        }
+        *(out++) += wave.table_[size_t(accum)&0x1f] * volume;
+    }
+    wave.accum_ = accum;
+    return true;
+}
+
+// what the sources are currently set to play, a frame sequencer event only
+// needs a new render block when it changes this
+struct gb_mix_t
+{
+    std::array<uint8_t, 4>  volume_;    // pulse 1, pulse 2, wave (0 or 1), noise
+    uint16_t freq_;                     // pulse 1, moved by the sweep
+
+    bool operator != (const gb_mix_t & rhs) const {
+        return volume_!=rhs.volume_ || freq_!=rhs.freq_;
+    }
+};
+
+struct vgm_chip_gb_dmg_t: public chip_t
+{
+    gb_reg_t reg_;
+
+    // cpu clock
+    uint32_t clock_;
+
+    // time until the next frame sequencer step, in units where one cpu
+    // clock is SAMPLE_RATE and one output sample is the cpu clock
+    int64_t  frame_;
+    // the frame sequencer step
+    uint32_t frame_ix_;
+
+    gb_envelope_t env_[4];
+    gb_sweep_t    sweep_;
+
+    // channel is playing, cleared by the length counter, sweep and dac
+    std::array<bool, 4> enable_;
+    std::array<uint32_t, 4> lcounter_;
+
+    // pulse 1 frequency, the sweep changes it away from its register
+    uint16_t freq_;
+
+    sound_t   sound_;
+    blit_t    pulse_[2];
+    gb_wave_t wave_;
+    lfsr_t    lfsr_;
+    std::array<source_t, 5> source_;
+    // channels the player asked to leave out of the render
+    uint32_t mute_;
+
+    // mix the sources were last set to
+    gb_mix_t mix_;
+
+    float _pulse_freq(uint32_t freq) const
+    {
+        return float(clock_)/(32.f*float(2048-freq));
+    }
+
+    gb_mix_t _mix() const
+    {
+        gb_mix_t mix;
+        for (uint32_t i = 0; i<4; ++i) {
+            const bool on = enable_[i] && reg_.voice_panned(i);
+            if (i==2) {
+                mix.volume_[i] = (on && reg_.wave_level()) ? 1 : 0;
+            }
+            else {
+                mix.volume_[i] = on ? env_[i].volume_ : 0;
+            }
+        }
+        mix.freq_ = freq_;
+        return mix;
+    }
+
+    // set the sources up to play a mix
+    void _apply(const gb_mix_t & mix)
+    {
+        const float master = float(reg_.master_volume())/8.f;
+        for (uint32_t i = 0; i<2; ++i) {
+            pulse_[i].set_volume(master*float(mix.volume_[i])/32.f);
+        }
+        wave_.set_volume(mix.volume_[2] ? master*15.f/32.f : 0.f);
+        lfsr_.set_volume(master*float(mix.volume_[3])/32.f);
+        // a trigger resets the wave position and the shift register, so
+        // they need not be clocked while their channels are stopped
+        source_[0].enable_ = !(mute_&1);
+        source_[1].enable_ = !(mute_&2);
+        source_[2].enable_ = enable_[2] && !(mute_&4);
+        source_[3].enable_ = enable_[3] && !(mute_&8);
+        if (mix.freq_!=mix_.freq_) {
+            pulse_[0].set_freq(_pulse_freq(mix.freq_), C_RATE);
+        }
+        mix_ = mix;
+    }
+
+    // new pulse 1 frequency from the sweep, disabling it on overflow
+    uint32_t _sweep_calc()
+    {
+        const uint32_t change = sweep_.shadow_>>reg_.sweep_shift();
+        const uint32_t freq = reg_.sweep_neg() ?
+            sweep_.shadow_-change :
+            sweep_.shadow_+change;
+        if (freq>2047) {
+            enable_[0] = false;
+        }
+        return freq;
+    }
+
+    void _clock_sweep()
+    {
+        if (--sweep_.timer_!=0) {
+            return;
+        }
+        const uint8_t period = reg_.sweep_period();
+        sweep_.timer_ = period ? period : 8;
+        if (sweep_.enable_ && period) {
+            const uint32_t freq = _sweep_calc();
+            if (freq<=2047 && reg_.sweep_shift()) {
+                freq_ = sweep_.shadow_ = uint16_t(freq);
+                // checked again straight away
+                _sweep_calc();
+            }
+        }
+    }
+
+    void _clock_length()
+    {
+        for (uint32_t i = 0; i<4; ++i) {
+            if (reg_.voice_length_enable(i) && lcounter_[i]>0) {
+                if (--lcounter_[i]==0) {
+                    enable_[i] = false;
+                }
+            }
+        }
+    }
+
+    void _clock_env()
+    {
+        env_[0].clock();
+        env_[1].clock();
+        env_[3].clock();
+    }
+
+    void _frame()
+    {
+        // length every other step, sweep on 2 and 6, envelope on 7
+        static const std::array<uint8_t, 8> g_sequence = {
+            1, 0, 3, 0, 1, 0, 3, 4
+        };
+
+        const uint8_t bits = g_sequence[frame_ix_&7];
+
+        if (bits&1) {
+            _clock_length();
+        }
+
+        if (bits&2) {
+            _clock_sweep();
+        }
+
+        if (bits&4) {
+            _clock_env();
+        }
+
+        ++frame_ix_;
+    }
+
+    // rebuild the wave table from wave ram and the output level
+    void _wave_table()
+    {
+        static const std::array<uint8_t, 4> g_level_shift = {4, 0, 1, 2};
+        const uint8_t shift = g_level_shift[reg_.wave_level()];
+        // centered on the mean of the shifted range so no offset builds up
+        const float center = float(15>>shift)/2.f;
+        for (uint32_t i = 0; i<32; ++i) {
+            const uint8_t byte = reg_.data_[WAVE+i/2];
+            const uint8_t nibble = (i&1) ? (byte&0xf) : (byte>>4);
+            wave_.table_[i] = (float(nibble>>shift)-center)/15.f;
+        }
+    }
+
+    void _noise()
+    {
+        // shifts of 14 and 15 stop the clock
+        const uint32_t shift = reg_.noise_shift();
+        const float clocks = (shift<14) ?
+            float(g_noise_divisor[reg_.noise_divisor()]<<shift) :
+            float(clock_);
+        lfsr_.set_period(clocks*C_RATE/float(clock_));
+        lfsr_.set_tap(1);
+        // the short mode also writes the feedback into bit 6
+        lfsr_.set_feedback(reg_.noise_short() ? 0x4040 : 0x4000);
+    }
+
+    void _trigger(uint32_t ix)
+    {
+        enable_[ix] = reg_.voice_dac(ix);
+        if (lcounter_[ix]==0) {
+            lcounter_[ix] = (ix==2) ? 256 : 64;
+        }
+        if (ix!=2) {
+            env_[ix].trigger(reg_.voice_env_volume(ix),
+                             reg_.voice_env_up(ix),
+                             reg_.voice_env_period(ix));
+        }
+        switch (ix) {
+        case 0:
+            freq_ = uint16_t(reg_.voice_freq(0));
+            sweep_.shadow_ = freq_;
+            sweep_.timer_  = reg_.sweep_period() ? reg_.sweep_period() : 8;
+            sweep_.enable_ = reg_.sweep_period() || reg_.sweep_shift();
+            if (reg_.sweep_shift()) {
+                _sweep_calc();
+            }
+            break;
+        case 2:
+            wave_.accum_ = 0.f;
+            break;
+        case 3:
+            lfsr_.lfsr_  = 0x7fff;
+            lfsr_.accum_ = lfsr_.period_;
+            break;
+        }
+    }
+
+    void _power_off()
+    {
+        // everything but wave ram is cleared and reads as zero
+        for (uint32_t i = NR10; i<NR52; ++i) {
+            reg_.data_[i] = 0;
+        }
+        enable_.fill(false);
+        lcounter_.fill(0);
+    }
+
+    // render a block with the sources as they are
+    void _render(int16_t * dst, uint32_t len)
+    {
+        sound_render(&sound_, dst, len, &source_[0]);
+    }
+
+    vgm_chip_gb_dmg_t(uint32_t clock)
+        : chip_t(e_chip_gb_dmg)
+        , clock_(clock ? clock : C_CLOCK_DMG)
+        , mute_(0)
+    {
+    }
+
+    virtual void init() override
+    {
+        memset(&reg_, 0, sizeof(gb_reg_t));
+        memset(env_, 0, sizeof(env_));
+        memset(&sweep_, 0, sizeof(sweep_));
+        enable_.fill(false);
+        lcounter_.fill(0);
+        freq_ = 0;
+
+        frame_ix_ = 0;
+        frame_ = int64_t(C_FRAME_STEP)*SAMPLE_RATE;
+
+        sound_init(&sound_);
+        pulse_[0] = blit_t();
+        pulse_[1] = blit_t();
+        wave_ = gb_wave_t();
+        lfsr_ = lfsr_t();
+        _wave_table();
+        _noise();
+        pulse_[0].set_freq(_pulse_freq(0), C_RATE);
+        pulse_[1].set_freq(_pulse_freq(0), C_RATE);
+        wave_.set_freq(float(clock_)/(64.f*2048.f), C_RATE);
+
+        source_ = {
+            source_t{sound_source_blit, &pulse_[0], true, .6f},
+            source_t{sound_source_blit, &pulse_[1], true, .6f},
+            source_t{gb_source_wave,    &wave_,     true, .6f},
+            source_t{sound_source_lfsr, &lfsr_,     true, .3f},
+            source_t{nullptr, nullptr, false, 0.f},
+        };
+
+        mix_.volume_.fill(0);
+        mix_.freq_ = 0;
+        _apply(_mix());
+    }
+
+    virtual void write(uint32_t reg, uint32_t data) override
+    {
+        if (reg>=reg_.data_.size() || (reg>NR52 && reg<WAVE)) {
+            return;
+        }
+
+        // wave ram can always be written
+        if (reg>=WAVE) {
+            reg_.data_[reg] = data;
+            _wave_table();
+            return;
+        }
+
+        // only the power bit can be written while powered off
+        if (reg==NR52) {
+            reg_.data_[reg] = data&0x80;
+            if (!reg_.power()) {
+                _power_off();
+            }
+            _apply(_mix());
+            return;
+        }
+        if (!reg_.power()) {
+            return;
+        }
+        reg_.data_[reg] = data;
+
+        // channel and register within the channel
+        const uint32_t ix = reg/5;
+        const uint32_t nr = reg%5;
+
+        if (ix<4) {
+            switch (nr) {
+            case 1:
+                // length load, the wave channel has 8 bits of length
+                lcounter_[ix] = (ix==2) ? 256-data : 64-(data&0x3f);
+                if (ix<2) {
+                    pulse_[ix].set_duty(g_duty[reg_.voice_duty(ix)]);
+                }
+                break;
+            case 2:
+                if (ix==2) {
+                    _wave_table();
+                }
+                break;
+            case 3:
+                if (ix==3) {
+                    _noise();
+                    break;
+                }
+                // the low frequency bits changed, update it as for NRx4
+                // fall through
+            case 4:
+                if (ix==0) {
+                    // the sweep keeps its own copy until the next trigger
+                    freq_ = uint16_t(reg_.voice_freq(0));
+                }
+                else if (ix==1) {
+                    pulse_[1].set_freq(_pulse_freq(reg_.voice_freq(1)), C_RATE);
+                }
+                else if (ix==2) {
+                    // one wave sample per 2 cpu clocks of the timer
+                    const float freq = float(clock_)/(64.f*float(2048-reg_.voice_freq(2)));
+                    wave_.set_freq(freq, C_RATE);
+                }
+                if (nr==4 && (data&0x80)) {
+                    _trigger(ix);
+                }
+                break;
+            }
+            // turning the dac off stops the channel
+            if (!reg_.voice_dac(ix)) {
+                enable_[ix] = false;
+            }
+        }
+
+        _apply(_mix());
+    }
+
+    virtual void render(int16_t * dst, uint32_t len) override
+    {
+        const int64_t c_sample = clock_;
+
+        // powered off the sequencer is held and the sources are idle
+        if (!reg_.power()) {
+            _render(dst, len);
+            return;
+        }
+
+        // sequencer steps are run ahead of the audio and one block is
+        // rendered up to the first that changes what the sources play
+        int64_t next = frame_;
+        while (len) {
+            // samples that start before the next sequencer step
+            const int64_t before = (next+c_sample-1)/c_sample;
+            if (before>=int64_t(len)) {
+                _render(dst, len);
+                next -= int64_t(len)*c_sample;
+                break;
+            }
+            _frame();
+            next += int64_t(C_FRAME_STEP)*SAMPLE_RATE;
+            const gb_mix_t mix = _mix();
+            if (mix!=mix_) {
+                // the sources still hold the mix from before the step
+                if (before>0) {
+                    _render(dst, uint32_t(before));
+                    dst  += before;
+                    len  -= uint32_t(before);
+                    next -= before*c_sample;
+                }
+                _apply(mix);
+            }
+        }
+        frame_ = next;
+    }
+
+    virtual void silence() override
+    {
+        enable_.fill(false);
+        _apply(_mix());
+    }
+
+    virtual uint32_t channels() const override
+    {
+        return 4;
+    }
+
+    virtual void set_mute(uint32_t mask) override
+    {
+        mute_ = mask;
+        _apply(mix_);
+    }
+};
+
+} // namespace {}
+
+chip_t * chip_create_gb_dmg(uint32_t clock)
+{
+    vgm_chip_gb_dmg_t * chip = new vgm_chip_gb_dmg_t(clock);
+    chip->init();
+    return chip;
+}
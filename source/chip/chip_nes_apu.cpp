@@ -1,7 +1,9 @@
+#include <stdio.h>
 #include <string.h>
 #include <array>
 
 #include "../assert.h"
+#include "../config.h"
 #include "../sound/sound.h"
 
 #include "chip.h"
@@ -11,10 +13,11 @@
 namespace
 {
 
-const float C_CLOCK_NTSC = 1789773.f; // 1.79MHz
-const float C_CLOCK_PAL  = 1662607.f; // 1.66MHz
+const uint32_t C_CLOCK_NTSC = 1789773; // 1.79MHz
+const uint32_t C_CLOCK_PAL  = 1662607; // 1.66MHz
 
-const uint32_t frame_rate_ = 184;
+// 2x oversampled rate the sources are rendered at
+const float C_RATE = float(SAMPLE_RATE*2);
 
 // duty cycle lookup table
 const std::array<float, 4> g_duty = {
@@ -34,23 +37,33 @@ const std::array<uint16_t, 16> g_noise_period_ntsc = {
     4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
 };
 
-int32_t minv(int32_t a, int32_t b) {
-    return (a<b) ? a : b;
-}
+// cpu cycles between dmc output clocks
+const std::array<uint16_t, 16> g_dmc_period_pal = {
+    398, 354, 316, 298, 276, 236, 210, 198, 176, 148, 132, 118,  98,  78,  66,  50
+};
+
+const std::array<uint16_t, 16> g_dmc_period_ntsc = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106,  84,  72,  54
+};
+
+// cpu cycles between frame sequencer steps, 4 step then 5 step mode
+const std::array<uint16_t, 9> g_frame_step_ntsc = {
+    7457, 7456, 7458, 7459,
+    7457, 7456, 7458, 7458, 7453
+};
+
+const std::array<uint16_t, 9> g_frame_step_pal = {
+    8313, 8314, 8312, 8314,
+    8313, 8314, 8312, 8313, 8313
+};
+
+// gain of one dmc output level
+const float C_DMC_GAIN = .5f/64.f;
 
 struct nes_reg_t
 {
     std::array<uint8_t, 0x18> data_;
 
-    struct dirty_t {
-        bool pulse_1_ : 1;
-        bool pulse_2_ : 1;
-        bool triangle_ : 1;
-        bool noise_ : 1;
-        bool reg_4017_ : 1;
-    }
-    dirty_;
-
     uint8_t voice_duty(uint32_t voice) const {
         assert(voice<2);
         return (data_[voice*4]&0xc0)>>6;
@@ -108,6 +121,15 @@ struct nes_reg_t
         return (data_[voice*4+3]&0xf8)>>3;
     }
 
+    // triangle length halt and linear counter control
+    bool tri_control() const {
+        return (data_[0x8]&0x80) != 0;
+    }
+
+    uint8_t tri_linear() const {
+        return data_[0x8]&0x7f;
+    }
+
     uint8_t noise_period() const {
         return data_[0xe]&0x0f;
     }
@@ -116,6 +138,24 @@ struct nes_reg_t
         return (data_[0xe]&0x80) != 0;
     }
 
+    bool dmc_loop() const {
+        return (data_[0x10]&0x40) != 0;
+    }
+
+    uint8_t dmc_rate() const {
+        return data_[0x10]&0x0f;
+    }
+
+    // sample address, $C000 + A*64
+    uint16_t dmc_address() const {
+        return uint16_t(0xc000+(data_[0x12]<<6));
+    }
+
+    // sample length, L*16 + 1 bytes
+    uint16_t dmc_length() const {
+        return uint16_t((data_[0x13]<<4)+1);
+    }
+
     bool frame_mode() const {
         return (data_[0x17]&0x80)!=0;
     }
@@ -160,45 +200,246 @@ struct vgm_envelope_t
     }
 };
 
-struct vgm_chip_nes_apu_t: public vgm_chip_t
+struct vgm_sweep_t
+{
+    uint8_t divider_;
+    bool    reload_;    // set by a write to register[4001]
+};
+
+/* Delta modulation channel
+ * Plays 1 bit deltas out of the sample ram, stepping a 7 bit output level.
+ * It is rendered as band limited steps at the exact cpu cycle of each output
+ * clock, in time units where one cpu cycle is C_RATE and one oversampled
+ * sample is the cpu clock.
+**/
+struct vgm_dmc_t
+{
+    // $8000-$FFFF, written by vgm data blocks
+    const uint8_t * ram_;
+
+    uint64_t clock_;    // cpu clock
+    uint64_t period_;   // time between output clocks
+    uint64_t acc_;      // time since the last output clock
+
+    uint16_t start_;    // sample address and length to restart from
+    uint16_t length_;
+    uint16_t addr_;     // current read address
+    uint16_t remain_;   // bytes left to read
+
+    uint8_t  level_;    // 7 bit output level
+    uint8_t  shift_;    // output shift register
+    uint8_t  bits_;     // bits left in the shift register
+    uint8_t  buffer_;   // sample buffer
+    bool     full_;     // sample buffer holds a byte
+    bool     silent_;   // output cycle without a byte to play
+    bool     loop_;
+
+    step_t   step_;
+
+    // nothing left to play, the output level can only change by a write
+    bool idle() const {
+        return silent_ && !full_ && remain_==0;
+    }
+
+    void restart() {
+        addr_   = start_;
+        remain_ = length_;
+    }
+
+    // refill the sample buffer from memory
+    void fetch() {
+        if (!full_ && remain_) {
+            buffer_ = ram_[addr_&0x7fff];
+            full_   = true;
+            addr_   = (addr_==0xffff) ? 0x8000 : addr_+1;
+            if (--remain_==0 && loop_) {
+                restart();
+            }
+        }
+    }
+
+    // clock the output unit, returning the change of the output level
+    int32_t tick() {
+        int32_t delta = 0;
+        if (!silent_) {
+            if (shift_&1) {
+                delta = (level_<=125) ? 2 : 0;
+            }
+            else {
+                delta = (level_>=2) ? -2 : 0;
+            }
+            level_ = uint8_t(level_+delta);
+        }
+        shift_ >>= 1;
+        if (--bits_==0) {
+            // start a new output cycle
+            bits_   = 8;
+            silent_ = !full_;
+            shift_  = buffer_;
+            full_   = false;
+            fetch();
+        }
+        return delta;
+    }
+
+    // set the output level directly, register[4011]
+    void load(uint8_t level) {
+        sound_step_add(step_, 0.f, C_DMC_GAIN*(float(level)-float(level_)));
+        level_ = level;
+    }
+};
+
+/* SOUND SOURCE: NES Delta Modulation Channel
+**/
+bool nes_source_dmc(float * out,
+                    size_t length,
+                    void * user,
+                    float volume)
+{
+    vgm_dmc_t & dmc = *(vgm_dmc_t*)user;
+
+    // nothing playing and the last steps have leaked away
+    if (dmc.idle() && sound_step_settled(dmc.step_)) {
+        return false;
+    }
+
+    const uint64_t clock  = dmc.clock_;
+    const uint64_t period = dmc.period_;
+
+    while (length > 0) {
+        // whole samples before the one the next output clock lands in
+        const uint64_t remain = period-dmc.acc_;
+        const uint64_t before = remain/clock;
+        if (before>=length || dmc.idle()) {
+            sound_step_read(dmc.step_, out, length);
+            dmc.acc_ = (dmc.acc_+uint64_t(length)*clock)%period;
+            break;
+        }
+        const size_t count = size_t(before)+1;
+        sound_step_read(dmc.step_, out, count);
+        out += count;
+        length -= count;
+        dmc.acc_ += uint64_t(count)*clock-period;
+
+        if (const int32_t delta = dmc.tick()) {
+            const float phase = float(remain%clock)/float(clock);
+            sound_step_add(dmc.step_, phase, volume*C_DMC_GAIN*float(delta));
+        }
+    }
+    return true;
+}
+
+// what the sources are currently set to play, a frame sequencer event only
+// needs a new render block when it changes this
+struct nes_mix_t
+{
+    std::array<uint8_t, 4>  volume_;    // pulse 1, pulse 2, tri (0 or 1), noise
+    std::array<uint16_t, 3> timer_;     // pulse 1, pulse 2, tri
+
+    bool operator != (const nes_mix_t & rhs) const {
+        return volume_!=rhs.volume_ || timer_!=rhs.timer_;
+    }
+};
+
+struct vgm_chip_nes_apu_t: public chip_t
 {
     nes_reg_t     reg_;
 
-    // frame clock (when 0 a frame occurs)
-    int32_t frame_;
+    // cpu clock
+    uint32_t clock_;
+    bool     pal_;
+
+    // time until the next frame sequencer step, in units where one cpu
+    // cycle is SAMPLE_RATE and one output sample is the cpu clock
+    int64_t  frame_;
     // the frame counter
     uint32_t frame_ix_;
-    
+
     vgm_envelope_t env_[4];
+    vgm_sweep_t    sweep_[2];
 
     std::array<bool, 4> lhalt_;
     std::array<uint32_t, 4> lcounter_;
 
+    // pulse 1, pulse 2 and triangle timers, the sweep units change the
+    // pulse timers away from their registers
+    std::array<uint16_t, 3> timer_;
+
+    // triangle linear counter
+    uint8_t  linear_;
+    bool     linear_reload_;
+
+    // sample memory for the dmc
+    std::array<uint8_t, 0x8000> ram_;
+
     sound_t  sound_;
     blit_t   pulse_[2];
     nestri_t triangle_;
     lfsr_t   lfsr_;
+    vgm_dmc_t dmc_;
+    std::array<source_t, 6> source_;
+    // channels the player asked to leave out of the render
+    uint32_t mute_;
+
+    // mix the sources were last set to
+    nes_mix_t mix_;
+
+    // sweep target period of a pulse channel
+    uint32_t _sweep_target(uint32_t ix) const
+    {
+        const int32_t timer  = timer_[ix];
+        const int32_t change = timer>>reg_.voice_sweep_shift(ix);
+        if (reg_.voice_sweep_neg(ix)) {
+            // pulse 1 negates with ones complement
+            const int32_t target = timer-change-(ix==0 ? 1 : 0);
+            return (target>0) ? uint32_t(target) : 0;
+        }
+        return uint32_t(timer+change);
+    }
 
-    void _pulse_1()
+    // the sweep unit silences a pulse channel even when it is disabled
+    bool _pulse_muted(uint32_t ix) const
     {
-        pulse_[0].set_duty(g_duty[reg_.voice_duty(0)]);
-        uint32_t timer = reg_.voice_timer(0);
-        pulse_[0].set_freq(C_CLOCK_NTSC/(16.f * float(timer)), 88200);
+        return timer_[ix]<8 || _sweep_target(ix)>0x7ff;
     }
 
-    void _pulse_2()
+    uint8_t _env_volume(uint32_t ix) const
     {
-        pulse_[1].set_duty(g_duty[reg_.voice_duty(1)]);
-        uint32_t timer = reg_.voice_timer(1);
-        pulse_[1].set_freq(C_CLOCK_NTSC/(16.f * float(timer)), 88200);
+        return reg_.voice_const(ix) ? reg_.voice_volume(ix) : env_[ix].counter_;
     }
 
-    void _triangle()
+    nes_mix_t _mix() const
     {
-        uint32_t timer = reg_.voice_timer(2);
-        if (timer>0) {
-            triangle_.set_freq(C_CLOCK_NTSC/(32.f * float(timer)), 88200);
+        nes_mix_t mix;
+        for (uint32_t i = 0; i<2; ++i) {
+            const bool on = lcounter_[i]>0 && !_pulse_muted(i);
+            mix.volume_[i] = on ? _env_volume(i) : 0;
+            mix.timer_[i]  = timer_[i];
         }
+        // the triangle holds its level when stopped, ultrasonic periods are
+        // treated as silent rather than aliasing
+        mix.volume_[2] = (lcounter_[2]>0 && linear_>0 && timer_[2]>=2) ? 1 : 0;
+        mix.timer_[2]  = timer_[2];
+        mix.volume_[3] = (lcounter_[3]>0) ? _env_volume(3) : 0;
+        return mix;
+    }
+
+    // set the sources up to play a mix
+    void _apply(const nes_mix_t & mix)
+    {
+        const float clock = float(clock_);
+        for (uint32_t i = 0; i<2; ++i) {
+            pulse_[i].set_volume(float(mix.volume_[i])/32.f);
+            if (mix.timer_[i]!=mix_.timer_[i]) {
+                pulse_[i].set_freq(clock/(16.f*float(mix.timer_[i]+1)), C_RATE);
+            }
+        }
+        triangle_.set_volume(mix.volume_[2] ? .5f : 0.f);
+        if (mix.timer_[2]!=mix_.timer_[2]) {
+            triangle_.set_freq(clock/(32.f*float(mix.timer_[2]+1)), C_RATE);
+        }
+        lfsr_.set_volume(float(mix.volume_[3])/32.f);
+        mix_ = mix;
     }
 
     void _clock_env(int32_t ix)
@@ -206,93 +447,210 @@ struct vgm_chip_nes_apu_t: public vgm_chip_t
         env_[ix].clock();
     }
 
+    // the triangle linear counter takes the place of an envelope
     void _clock_env_tri()
     {
+        if (linear_reload_) {
+            linear_ = reg_.tri_linear();
+        }
+        else if (linear_>0) {
+            --linear_;
+        }
+        if (!reg_.tri_control()) {
+            linear_reload_ = false;
+        }
     }
 
-    void _clock_len_tri()
+    void _clock_length()
     {
+        for (uint32_t i = 0; i<4; ++i) {
+            lcounter_[i] -= (lcounter_[i]>0)&&(!lhalt_[i]);
+        }
     }
 
     void _clock_sweep_units()
     {
+        for (uint32_t i = 0; i<2; ++i) {
+            vgm_sweep_t & sweep = sweep_[i];
+            if (sweep.divider_==0 &&
+                reg_.voice_sweep_enable(i) &&
+                reg_.voice_sweep_shift(i) &&
+                !_pulse_muted(i)) {
+                timer_[i] = uint16_t(_sweep_target(i));
+            }
+            if (sweep.divider_==0 || sweep.reload_) {
+                sweep.divider_ = reg_.voice_sweep_period(i);
+                sweep.reload_  = false;
+            }
+            else {
+                --sweep.divider_;
+            }
+        }
+    }
+
+    void _quarter_frame()
+    {
+        _clock_env(0);      // pulse 1
+        _clock_env(1);      // pulse 2
+        _clock_env(3);      // noise
+        _clock_env_tri();   // triangle
+    }
+
+    void _half_frame()
+    {
+        _clock_length();
+        _clock_sweep_units();
+    }
+
+    // index into the sequence and step tables for the current step
+    uint32_t _frame_index() const
+    {
+        return reg_.frame_mode() ? frame_ix_%5 + 4 : frame_ix_%4;
+    }
+
+    // cpu cycles until the step after the current one
+    uint32_t _frame_step() const
+    {
+        return pal_ ?
+            g_frame_step_pal [_frame_index()] :
+            g_frame_step_ntsc[_frame_index()];
     }
 
     void _frame()
     {
-        static const std::array<uint8_t, 11> g_sequence = {
+        static const std::array<uint8_t, 9> g_sequence = {
             1, 3, 1, 3,     // 4 frame cycle
-            3, 1, 3, 1, 0   // 5 frame cycle
+            1, 3, 1, 0, 3   // 5 frame cycle
         };
 
-        uint8_t bits = reg_.frame_mode() ?
-            g_sequence[frame_ix_%5 + 4] :
-            g_sequence[frame_ix_%4];
+        uint8_t bits = g_sequence[_frame_index()];
 
         if (bits&1) {
-            _clock_env(0);      // pulse 1
-            _clock_env(1);      // pulse 2
-            _clock_env(3);      // noise
-            _clock_env_tri();   // triangle
+            _quarter_frame();
         }
 
         if (bits&2) {
-            for (uint32_t i = 0; i<4; ++i) {
-                lcounter_[i] -= (lcounter_[i]>0)&&(!lhalt_[i]);
-            }
-            _clock_sweep_units();
+            _half_frame();
         }
 
         ++frame_ix_;
     }
-    
+
+    void _load_length(uint32_t ix)
+    {
+        // the length counter only loads while the channel is enabled
+        if (reg_.data_[0x15]&(1<<ix)) {
+            lcounter_[ix] = g_length_value[reg_.voice_length(ix)];
+        }
+    }
+
+    // render a block with the sources as they are
+    void _render(int16_t * dst, uint32_t len)
+    {
+        sound_render(&sound_, dst, len, &source_[0]);
+    }
+
+    // a muted source is not rendered at all
+    void _mute_sources()
+    {
+        for (uint32_t i = 0; i<5; ++i) {
+            source_[i].enable_ = !(mute_&(1u<<i));
+        }
+    }
+
     vgm_chip_nes_apu_t(uint32_t clock)
-        : vgm_chip_t(e_chip_nes_apu)
-        , frame_(frame_rate_)
+        : chip_t(e_chip_nes_apu)
+        , clock_(clock ? clock : C_CLOCK_NTSC)
+        , pal_(clock_<(C_CLOCK_NTSC+C_CLOCK_PAL)/2)
+        , mute_(0)
     {
     }
 
     virtual void init() override
     {
         memset(&reg_, 0, sizeof(nes_reg_t));
-        frame_ = frame_rate_;
+        memset(env_, 0, sizeof(env_));
+        memset(sweep_, 0, sizeof(sweep_));
+        lhalt_.fill(false);
+        lcounter_.fill(0);
+        timer_.fill(0);
+        linear_ = 0;
+        linear_reload_ = false;
+        ram_.fill(0);
+
+        frame_ix_ = 0;
+        frame_ = int64_t(_frame_step())*SAMPLE_RATE;
+
         sound_init(&sound_);
+        pulse_[0] = blit_t();
+        pulse_[1] = blit_t();
+        triangle_ = nestri_t();
+        lfsr_ = lfsr_t();
+
+        dmc_ = vgm_dmc_t();
+        dmc_.ram_    = ram_.data();
+        dmc_.clock_  = clock_;
+        dmc_.period_ = uint64_t(g_dmc_period_ntsc[0])*uint64_t(C_RATE);
+        dmc_.acc_    = 0;
+        dmc_.start_  = 0xc000;
+        dmc_.length_ = 1;
+        dmc_.addr_   = 0xc000;
+        dmc_.remain_ = 0;
+        dmc_.level_  = 0;
+        dmc_.shift_  = 0;
+        dmc_.bits_   = 8;
+        dmc_.buffer_ = 0;
+        dmc_.full_   = false;
+        dmc_.silent_ = true;
+        dmc_.loop_   = false;
+
+        source_ = {
+            source_t{sound_source_blit,   &pulse_[0], true, .6f},
+            source_t{sound_source_blit,   &pulse_[1], true, .6f},
+            source_t{sound_source_nestri, &triangle_, true, .8f},
+            source_t{sound_source_lfsr,   &lfsr_,     true, .1f},
+            source_t{nes_source_dmc,      &dmc_,      true, 1.f},
+            source_t{nullptr, nullptr, false, 0.f},
+        };
+        _mute_sources();
+
+        // force every source to be set up
+        mix_.volume_.fill(0);
+        mix_.timer_.fill(0xffff);
+        _apply(_mix());
     }
 
     virtual void write(uint32_t reg, uint32_t data) override
     {
-        assert(reg<0x18);
-        reg_.data_[reg] = data;
-
-        printf("[%02x] %02x\n", reg, data);
-
-        reg_.dirty_.pulse_1_  = reg>=0x00 && reg<=0x03;
-        reg_.dirty_.pulse_2_  = reg>=0x04 && reg<=0x07;
-        reg_.dirty_.triangle_ = reg>=0x08 && reg<=0x0f;
-        reg_.dirty_.reg_4017_ = reg==0x17;
-
-        // ---- ---- ---- ---- PULSE 1 CHANNEL
-
-        if (reg==0x00) {
-            lhalt_[0]       = BOOL(data&0x10);
-            env_[0].loop_   = BOOL(data&0x20);
-            env_[0].period_ = (reg_.data_[0]&0xf)+1;
-        }
-        if (reg==0x03) {
-            env_[0].start_  = true;
-            lcounter_[0]    = g_length_value[reg_.voice_length(0)];
+        // ignore the expansion audio registers
+        if (reg>=0x18) {
+            return;
         }
+        reg_.data_[reg] = data;
 
-        // ---- ---- ---- ---- PULSE 2 CHANNEL
-
-        if (reg==0x04) {
-            lhalt_[1]       = BOOL(data&0x10);
-            env_[1].loop_   = BOOL(data&0x20);
-            env_[1].period_ = (reg_.data_[4]&0xf)+1;
-        }
-        if (reg==0x07) {
-            env_[1].start_  = true;
-            lcounter_[1]    = g_length_value[reg_.voice_length(1)];
+        // ---- ---- ---- ---- PULSE CHANNELS
+
+        if (reg<0x08) {
+            const uint32_t ix = reg>>2;
+            switch (reg&3) {
+            case 0:
+                lhalt_[ix]       = BOOL(data&0x20);
+                env_[ix].loop_   = BOOL(data&0x20);
+                env_[ix].period_ = data&0xf;
+                pulse_[ix].set_duty(g_duty[reg_.voice_duty(ix)]);
+                break;
+            case 1:
+                sweep_[ix].reload_ = true;
+                break;
+            case 2:
+                timer_[ix] = uint16_t(reg_.voice_timer(ix));
+                break;
+            case 3:
+                timer_[ix] = uint16_t(reg_.voice_timer(ix));
+                env_[ix].start_ = true;
+                _load_length(ix);
+                break;
+            }
         }
 
         // ---- ---- ---- ---- TRIANGLE CHANNEL
@@ -300,121 +658,157 @@ struct vgm_chip_nes_apu_t: public vgm_chip_t
         if (reg==0x08) {
             lhalt_[2]       = BOOL(data&0x80);
         }
+        if (reg==0x0a) {
+            timer_[2]       = uint16_t(reg_.voice_timer(2));
+        }
         if (reg==0x0b) {
-            lcounter_[2]    = g_length_value[reg_.voice_length(2)];
+            timer_[2]       = uint16_t(reg_.voice_timer(2));
+            linear_reload_  = true;
+            _load_length(2);
         }
 
         // ---- ---- ---- ---- NOISE CHANNEL
 
         if (reg==0x0c) {
-            // triangle halt bit
-            lhalt_[3]       = BOOL(data&0x10);
+            lhalt_[3]       = BOOL(data&0x20);
             env_[3].loop_   = BOOL(data&0x20);
+            env_[3].period_ = data&0xf;
         }
         if (reg==0x0e) {
-            lfsr_.set_period(g_noise_period_pal[data&0xf]);
+            const uint32_t period = pal_ ?
+                g_noise_period_pal [reg_.noise_period()] :
+                g_noise_period_ntsc[reg_.noise_period()];
+            lfsr_.set_period(float(period)*C_RATE/float(clock_));
+            lfsr_.set_tap(reg_.noise_loop() ? 6 : 1);
         }
         if (reg==0x0f) {
             env_[3].start_  = true;
-            lcounter_[3] = g_length_value[reg_.voice_length(3)];
+            _load_length(3);
         }
-        
 
-        if (reg==0x17) {
-            frame_ix_ = 0;
-        }
+        // ---- ---- ---- ---- DMC CHANNEL
 
-        if (reg_.dirty_.pulse_1_) {
-            _pulse_1();
-            reg_.dirty_.pulse_1_ = true;
+        if (reg==0x10) {
+            const uint32_t period = pal_ ?
+                g_dmc_period_pal [reg_.dmc_rate()] :
+                g_dmc_period_ntsc[reg_.dmc_rate()];
+            dmc_.period_ = uint64_t(period)*uint64_t(C_RATE);
+            dmc_.acc_   %= dmc_.period_;
+            dmc_.loop_   = reg_.dmc_loop();
         }
-
-        if (reg_.dirty_.pulse_2_) {
-            _pulse_2();
-            reg_.dirty_.pulse_2_ = false;
+        if (reg==0x11) {
+            dmc_.load(data&0x7f);
         }
-
-        if (reg_.dirty_.triangle_) {
-            _triangle();
-            reg_.dirty_.triangle_ = false;
+        if (reg==0x12) {
+            dmc_.start_  = reg_.dmc_address();
+        }
+        if (reg==0x13) {
+            dmc_.length_ = reg_.dmc_length();
         }
-    }
 
-    virtual void render(int16_t * dst, uint32_t len) override
-    {
-        float p1 = 0.f, p2 = 0.f, tr = 0.f, nz = 0;
-
-        if (reg_.data_[0x15]&0x01) {
-            if (lcounter_[0]>0) {
-                uint8_t vol = reg_.voice_const(0) ?
-                    (reg_.data_[0x00]&0x0f) :
-                    (env_[0].counter_);
-                p1 = float(vol)/32.f;
+        // ---- ---- ---- ---- STATUS
+
+        if (reg==0x15) {
+            for (uint32_t i = 0; i<4; ++i) {
+                if (!(data&(1<<i))) {
+                    lcounter_[i] = 0;
+                }
+            }
+            if (data&0x10) {
+                if (dmc_.remain_==0) {
+                    dmc_.restart();
+                    dmc_.fetch();
+                }
+            }
+            else {
+                dmc_.remain_ = 0;
             }
         }
 
-        if (reg_.data_[0x15]&0x02) {
-            if (lcounter_[1]>0) {
-                uint8_t vol = reg_.voice_const(1) ?
-                    (reg_.data_[0x04]&0x0f) :
-                    (env_[1].counter_);
-                p2 = float(vol)/32.f;
-            }
-        }        
+        // ---- ---- ---- ---- FRAME COUNTER
 
-        if (reg_.data_[0x15]&0x04) {
-            if (lcounter_[2]>0) {
-                tr = .5f;
+        if (reg==0x17) {
+            frame_ix_ = 0;
+            frame_ = int64_t(_frame_step())*SAMPLE_RATE;
+            // 5 step mode clocks every unit straight away
+            if (reg_.frame_mode()) {
+                _quarter_frame();
+                _half_frame();
             }
         }
 
-        if (reg_.data_[0x15]&0x08) {
-            if (lcounter_[3]>0) {
-                uint8_t vol = reg_.voice_const(1) ?
-                    (reg_.data_[0x0C]&0x0f) :
-                    (env_[3].counter_);
-                nz = float(vol)/32.f;
+        _apply(_mix());
+    }
+
+    virtual void write_block(uint32_t type, const uint8_t * data, uint32_t size) override
+    {
+        // ram write, a 16 bit address then the bytes to write there
+        if (type!=0xc2 || size<2) {
+            return;
+        }
+        uint32_t addr = data[0]|(data[1]<<8);
+        for (uint32_t i = 2; i<size; ++i, ++addr) {
+            if (addr>=0x8000 && addr<=0xffff) {
+                ram_[addr&0x7fff] = data[i];
             }
         }
+    }
 
-        pulse_[0].set_volume(p1);
-        pulse_[1].set_volume(p2);
-        triangle_.set_volume(tr);
-        lfsr_.set_volume(nz);
+    virtual void render(int16_t * dst, uint32_t len) override
+    {
+        const int64_t c_sample = clock_;
 
+        // sequencer steps are run ahead of the audio and one block is
+        // rendered up to the first that changes what the sources play
+        int64_t next = frame_;
         while (len) {
-
-            uint32_t count = minv(frame_, len);
-            len -= count;
-
-            if (count > 0) {
-
-                std::array<source_t, 5> source = {
-                    source_t{sound_source_blit,   &pulse_[0], true, .6f},
-                    source_t{sound_source_blit,   &pulse_[1], true, .6f},
-                    source_t{sound_source_nestri, &triangle_, true, .8f},
-                    source_t{sound_source_lfsr,   &lfsr_,     true, .1f},
-                    source_t{nullptr, nullptr, false},
-                };
-                sound_render(&sound_, dst, count, &source[0]);
-                dst += count;
+            // samples that start before the next sequencer step
+            const int64_t before = (next+c_sample-1)/c_sample;
+            if (before>=int64_t(len)) {
+                _render(dst, len);
+                next -= int64_t(len)*c_sample;
+                break;
             }
-
-            if ((frame_ -= count) <= 0) {
-                frame_ += frame_rate_;
-                _frame();
+            _frame();
+            next += int64_t(_frame_step())*SAMPLE_RATE;
+            const nes_mix_t mix = _mix();
+            if (mix!=mix_) {
+                // the sources still hold the mix from before the step
+                if (before>0) {
+                    _render(dst, uint32_t(before));
+                    dst  += before;
+                    len  -= uint32_t(before);
+                    next -= before*c_sample;
+                }
+                _apply(mix);
             }
         }
+        frame_ = next;
     }
 
     virtual void silence() override
     {
+        lcounter_.fill(0);
+        dmc_.remain_ = 0;
+        _apply(_mix());
+    }
+
+    virtual uint32_t channels() const override
+    {
+        // pulse 1, pulse 2, triangle, noise and dmc
+        return 5;
+    }
+
+    virtual void set_mute(uint32_t mask) override
+    {
+        mute_ = mask;
+        _mute_sources();
     }
 };
 
 } // namespace {}
 
-vgm_chip_t * chip_create_nes_apu(uint32_t clock)
+chip_t * chip_create_nes_apu(uint32_t clock)
 {
     vgm_chip_nes_apu_t * chip = new vgm_chip_nes_apu_t(clock);
     chip->init();
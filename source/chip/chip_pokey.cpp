@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <string.h>
+#include <array>
+
+#include "../assert.h"
+#include "../config.h"
+#include "../sound/sound.h"
+
+#include "chip.h"
+
+namespace
+{
+
+const uint32_t C_CLOCK_POKEY = 1789772; // 1.79MHz
+
+// 2x oversampled rate the source is rendered at
+const uint64_t C_RATE = SAMPLE_RATE*2;
+
+// gain of one output level step, four channels of 15 in half steps
+const float C_GAIN = .5f/(4.f*15.f*2.f);
+
+// poly counter lengths
+enum
+{
+    POLY4  = 15,
+    POLY5  = 31,
+    POLY9  = 511,
+    POLY17 = 131071,
+};
+
+// AUDCTL bits
+enum
+{
+    _POLY9    = 0x80,   // 9 bit poly instead of 17
+    _CH1_FAST = 0x40,   // channel 1 clocked at 1.79MHz
+    _CH3_FAST = 0x20,   // channel 3 clocked at 1.79MHz
+    _JOIN12   = 0x10,   // channel 2 clocked by channel 1, 16 bit
+    _JOIN34   = 0x08,   // channel 4 clocked by channel 3, 16 bit
+    _FILTER1  = 0x04,   // channel 1 high passed by channel 3
+    _FILTER2  = 0x02,   // channel 2 high passed by channel 4
+    _CLK15K   = 0x01,   // 15khz base clock instead of 64khz
+};
+
+// AUDC bits
+enum
+{
+    _NOTPOLY5 = 0x80,   // not gated by the 5 bit poly
+    _POLY4    = 0x40,   // 4 bit poly instead of 17/9
+    _PURE     = 0x20,   // pure tone
+    _VOLONLY  = 0x10,   // output is the volume
+};
+
+/* Poly counter output sequences
+ * The polys all run from the cpu clock, so the bit a channel samples is the
+ * sequence at the current cycle modulo its length. They are precomputed once
+ * rather than clocked.
+**/
+struct pokey_poly_t
+{
+    std::array<uint8_t, POLY4>  poly4_;
+    std::array<uint8_t, POLY5>  poly5_;
+    std::array<uint8_t, POLY9>  poly9_;
+    std::array<uint8_t, POLY17> poly17_;
+
+    // maximal length shift register of a width with taps {0,tap}
+    template <size_t length>
+    static void _fill(std::array<uint8_t, length> & out, uint32_t width, uint32_t tap)
+    {
+        uint32_t x = (1u<<width)-1;
+        for (size_t i = 0; i<length; ++i) {
+            out[i] = x&1;
+            const uint32_t in = (x^(x>>tap))&1;
+            x = (x>>1)|(in<<(width-1));
+        }
+    }
+
+    pokey_poly_t()
+    {
+        _fill(poly4_,   4, 1);
+        _fill(poly5_,   5, 2);
+        _fill(poly9_,   9, 4);
+        _fill(poly17_, 17, 3);
+    }
+
+    static const pokey_poly_t & get()
+    {
+        static const pokey_poly_t poly;
+        return poly;
+    }
+};
+
+struct pokey_channel_t
+{
+    uint64_t expire_;   // cycle of the next divider underflow
+    uint32_t period_;   // cycles between underflows, as scheduled
+    bool     fast_;     // pure tone above the output rate
+    bool     heard_;    // false for the low half of a 16 bit pair
+    uint8_t  out_;      // output flip-flop
+    uint8_t  audf_;
+    uint8_t  audc_;
+};
+
+struct pokey_t
+{
+    const pokey_poly_t * poly_;
+
+    std::array<pokey_channel_t, 4> ch_;
+    // high pass flip-flops of channels 1 and 2
+    std::array<uint8_t, 2> filter_;
+    uint8_t  audctl_;
+    // channels the player asked to leave out of the render
+    uint32_t mute_;
+
+    uint64_t clock_;
+    // oversampled samples rendered so far, the time of register writes
+    uint64_t sample_;
+    // output level in half volume steps, as last written into step_
+    int32_t  level_;
+    // source volume the steps in step_ are scaled by
+    float    volume_;
+
+    step_t   step_;
+
+    // cpu cycle at the start of the next sample to render
+    uint64_t _now() const {
+        return (sample_*clock_+C_RATE-1)/C_RATE;
+    }
+
+    // nothing can be heard until a register is written
+    bool silent() const {
+        for (uint32_t i = 0; i<4; ++i) {
+            const pokey_channel_t & ch = ch_[i];
+            if (ch.heard_ && (ch.audc_&0xf) && !(mute_&(1u<<i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // muted channels are not stepped, unless they clock the high pass of
+    // a channel that is heard. the high pass is kept up to date while it
+    // is switched off, so that does not depend on AUDCTL
+    bool _stepped(uint32_t ix) const {
+        if (!(mute_&(1u<<ix))) {
+            return true;
+        }
+        return (ix==2 && !(mute_&1)) || (ix==3 && !(mute_&2));
+    }
+
+    int32_t _channel_level(uint32_t ix) const {
+        const pokey_channel_t & ch = ch_[ix];
+        const int32_t vol = ch.audc_&0xf;
+        if (!ch.heard_ || vol==0 || (mute_&(1u<<ix))) {
+            return 0;
+        }
+        if (ch.audc_&_VOLONLY) {
+            return vol*2;
+        }
+        // pure tones above the output rate average out to half volume
+        if (ch.fast_ && (ch.audc_&_PURE)) {
+            return vol;
+        }
+        uint8_t out = ch.out_;
+        if (ix==0 && (audctl_&_FILTER1)) {
+            out ^= filter_[0];
+        }
+        if (ix==1 && (audctl_&_FILTER2)) {
+            out ^= filter_[1];
+        }
+        return out ? vol*2 : 0;
+    }
+
+    int32_t level() const {
+        return _channel_level(0)+_channel_level(1)+_channel_level(2)+_channel_level(3);
+    }
+
+    // write a step to the current level, phase places it within the last
+    // sample read
+    void step(float phase) {
+        const int32_t lvl = level();
+        if (lvl!=level_) {
+            sound_step_add(step_, phase, volume_*C_GAIN*float(lvl-level_));
+            level_ = lvl;
+        }
+    }
+
+    // cycle of the next underflow of any stepped channel, far enough off
+    // to never be reached when every channel is muted
+    uint64_t next() const {
+        uint64_t e = ~uint64_t(0)/C_RATE;
+        for (uint32_t i = 0; i<4; ++i) {
+            if (_stepped(i)) {
+                e = (ch_[i].expire_<e) ? ch_[i].expire_ : e;
+            }
+        }
+        return e;
+    }
+
+    // clock every stepped channel underflowing at cycle e
+    void expire(uint64_t e) {
+        for (uint32_t i = 0; i<4; ++i) {
+            pokey_channel_t & ch = ch_[i];
+            if (ch.expire_!=e || !_stepped(i)) {
+                continue;
+            }
+            ch.expire_ += ch.period_;
+            const uint8_t audc = ch.audc_;
+            if ((audc&_NOTPOLY5) || poly_->poly5_[e%POLY5]) {
+                if (audc&_PURE) {
+                    ch.out_ ^= 1;
+                }
+                else if (audc&_POLY4) {
+                    ch.out_ = poly_->poly4_[e%POLY4];
+                }
+                else if (audctl_&_POLY9) {
+                    ch.out_ = poly_->poly9_[e%POLY9];
+                }
+                else {
+                    ch.out_ = poly_->poly17_[e%POLY17];
+                }
+            }
+            // channels 3 and 4 clock the high pass of channels 1 and 2
+            if (i>=2) {
+                filter_[i-2] = ch_[i-2].out_;
+            }
+        }
+    }
+
+    // move every channel past cycle now without output, keeping pure
+    // tones in phase
+    void skip(uint64_t now) {
+        for (pokey_channel_t & ch : ch_) {
+            if (ch.expire_<now) {
+                const uint64_t n = (now-ch.expire_+ch.period_-1)/ch.period_;
+                ch.expire_ += n*ch.period_;
+                ch.out_ ^= uint8_t(n&(ch.audc_&_PURE ? 1 : 0));
+            }
+        }
+    }
+};
+
+/* SOUND SOURCE: Atari POKEY
+ * Stepped from one divider underflow to the next, the output level only
+ * changes there and is written as band limited steps.
+**/
+bool pokey_source(float * out,
+                  size_t length,
+                  void * user,
+                  float volume)
+{
+    pokey_t & pokey = *(pokey_t*)user;
+
+    const uint64_t end = pokey.sample_+length;
+
+    // a new source volume rescales the level the steps already hold
+    if (volume!=pokey.volume_) {
+        if (pokey.level_) {
+            sound_step_add(pokey.step_, 0.f, (volume-pokey.volume_)*C_GAIN*float(pokey.level_));
+        }
+        pokey.volume_ = volume;
+    }
+
+    // silent so just keep the dividers in step
+    if (pokey.silent() && pokey.level_==0 && sound_step_settled(pokey.step_)) {
+        pokey.sample_ = end;
+        pokey.skip(pokey._now());
+        return false;
+    }
+
+    const uint64_t clock = pokey.clock_;
+    uint64_t sample = pokey.sample_;
+    for (;;) {
+        const uint64_t e = pokey.next();
+        // time of the underflow and the sample it lands in
+        const uint64_t t  = e*C_RATE;
+        const uint64_t at = t/clock;
+        if (at>=end) {
+            sound_step_read(pokey.step_, out, size_t(end-sample));
+            break;
+        }
+        if (at>=sample) {
+            const size_t count = size_t(at+1-sample);
+            sound_step_read(pokey.step_, out, count);
+            out += count;
+            sample = at+1;
+        }
+        pokey.expire(e);
+        pokey.step(float(t%clock)/float(clock));
+    }
+    pokey.sample_ = end;
+    return true;
+}
+
+struct vgm_chip_pokey_t: public chip_t
+{
+    pokey_t  pokey_;
+    uint32_t clock_;
+
+    sound_t  sound_;
+    std::array<source_t, 2> source_;
+
+    // work out the divider periods from AUDF and AUDCTL
+    void _periods()
+    {
+        const uint8_t  audctl = pokey_.audctl_;
+        const uint32_t base   = (audctl&_CLK15K) ? 114 : 28;
+        // fastest underflow rate that is scheduled, one per output sample
+        const uint32_t c_min  = uint32_t((uint64_t(clock_)+C_RATE-1)/C_RATE);
+
+        std::array<pokey_channel_t, 4> & ch = pokey_.ch_;
+        std::array<uint32_t, 4> period;
+        for (uint32_t i = 0; i<4; ++i) {
+            period[i] = (uint32_t(ch[i].audf_)+1)*base;
+            ch[i].heard_ = true;
+        }
+        if (audctl&_CH1_FAST) {
+            period[0] = ch[0].audf_+4;
+        }
+        if (audctl&_CH3_FAST) {
+            period[2] = ch[2].audf_+4;
+        }
+        if (audctl&_JOIN12) {
+            const uint32_t f = ch[0].audf_|(ch[1].audf_<<8);
+            period[1] = (audctl&_CH1_FAST) ? f+7 : (f+1)*base;
+            ch[0].heard_ = false;
+        }
+        if (audctl&_JOIN34) {
+            const uint32_t f = ch[2].audf_|(ch[3].audf_<<8);
+            period[3] = (audctl&_CH3_FAST) ? f+7 : (f+1)*base;
+            ch[2].heard_ = false;
+        }
+
+        const uint64_t now = pokey_._now();
+        for (uint32_t i = 0; i<4; ++i) {
+            ch[i].fast_   = period[i]<c_min;
+            ch[i].period_ = (period[i]<c_min) ? c_min : period[i];
+            // a shorter period takes effect by the next underflow
+            if (ch[i].expire_>now+ch[i].period_) {
+                ch[i].expire_ = now+ch[i].period_;
+            }
+        }
+    }
+
+    vgm_chip_pokey_t(uint32_t clock)
+        : chip_t(e_chip_pokey)
+        , clock_(clock ? clock : C_CLOCK_POKEY)
+    {
+        pokey_.mute_ = 0;
+    }
+
+    virtual void init() override
+    {
+        sound_init(&sound_);
+
+        pokey_.poly_   = &pokey_poly_t::get();
+        pokey_.clock_  = clock_;
+        pokey_.sample_ = 0;
+        pokey_.level_  = 0;
+        pokey_.volume_ = 1.f;
+        pokey_.audctl_ = 0;
+        pokey_.filter_.fill(0);
+        pokey_.step_   = step_t();
+        for (pokey_channel_t & ch : pokey_.ch_) {
+            memset(&ch, 0, sizeof(ch));
+        }
+        _periods();
+
+        source_ = {
+            source_t{pokey_source, &pokey_, true, 1.f},
+            source_t{nullptr, nullptr, false, 0.f},
+        };
+    }
+
+    virtual void write(uint32_t reg, uint32_t data) override
+    {
+        // bit 7 addresses a second pokey which is not emulated
+        if (reg>0x0f) {
+            return;
+        }
+        // channels that are not stepped while muted are brought up to now
+        // before a period change, so they stay in step with the others
+        if (pokey_.mute_ && (reg==0x08 || (reg<0x08 && !(reg&1)))) {
+            pokey_.skip(pokey_._now());
+        }
+        if (reg<0x08) {
+            pokey_channel_t & ch = pokey_.ch_[reg>>1];
+            if (reg&1) {
+                ch.audc_ = data;
+            }
+            else {
+                ch.audf_ = data;
+                _periods();
+            }
+        }
+        if (reg==0x08) {
+            pokey_.audctl_ = data;
+            _periods();
+        }
+        if (reg==0x09) {
+            // STIMER restarts every divider
+            const uint64_t now = pokey_._now();
+            for (pokey_channel_t & ch : pokey_.ch_) {
+                ch.expire_ = now+ch.period_;
+            }
+        }
+        // volume only output changes straight away
+        pokey_.step(0.f);
+    }
+
+    virtual void render(int16_t * dst, uint32_t len) override
+    {
+        sound_render(&sound_, dst, len, &source_[0]);
+    }
+
+    virtual void silence() override
+    {
+        for (pokey_channel_t & ch : pokey_.ch_) {
+            ch.audc_ = 0;
+        }
+        pokey_.step(0.f);
+    }
+
+    virtual uint32_t channels() const override
+    {
+        return 4;
+    }
+
+    virtual void set_mute(uint32_t mask) override
+    {
+        // bring every divider up to now, channels that were not stepped
+        // pick up from here when they are unmuted
+        pokey_.skip(pokey_._now());
+        pokey_.mute_ = mask;
+        pokey_.step(0.f);
+    }
+};
+
+} // namespace {}
+
+chip_t * chip_create_pokey(uint32_t clock)
+{
+    vgm_chip_pokey_t * chip = new vgm_chip_pokey_t(clock);
+    chip->init();
+    return chip;
+}
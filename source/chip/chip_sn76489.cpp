@@ -13,18 +13,25 @@ struct sn76489_t
 {
     sound_t sound_;
     blit_t pulse_[3];
+    step_t noise_step_;
 
-    uint32_t delta[3];    // deltas
     uint16_t tone[3];     // tone register
 
     uint16_t noise_sr;
-    uint16_t noise_div;
-    uint16_t noise_rate;
+    // time since the last shift and between shifts, in units where one
+    // master clock is 2*SAMPLE_RATE so one oversampled sample is clock units
+    uint64_t noise_acc;
+    uint64_t noise_period;
     float noise_volume_;
+    // level last written into noise_step_
+    float noise_level_;
 
     // mode (1: white noise) (0: periodic)
     uint8_t noise_md;
 
+    // a tone register of zero counts 0x400 rather than stopping the tone
+    bool freq0_max;
+
     // previous registers
     uint8_t prev_reg;
 
@@ -50,65 +57,180 @@ static const std::array<uint16_t, 16> _volTab =
     0x0813, 0x066A, 0x0518, 0x0000
 };
 
-uint16_t _parity(uint16_t x)
+uint32_t _popcount(uint32_t x)
+{
+    x = x-((x>>1)&0x55555555);
+    x = (x&0x33333333)+((x>>2)&0x33333333);
+    x = (x+(x>>4))&0x0f0f0f0f;
+    return (x*0x01010101)>>24;
+}
+
+// lowest and highest set bit of a tap pattern
+constexpr uint16_t _tap_lo(uint16_t taps)
+{
+    return (taps&1) ? 0 : 1+_tap_lo(taps>>1);
+}
+
+constexpr uint16_t _tap_hi(uint16_t taps)
 {
-    x ^= x>>8;
-    x ^= x>>4;
-    x ^= x>>2;
-    x ^= x>>1;
-    return x&1;
+    return (taps>>1) ? 1+_tap_hi(taps>>1) : 0;
+}
+
+/* Noise shift register of one variant of the psg, as the vgm header gives it
+** with a feedback pattern of two taps and a register width. the noise code is
+** instantiated per variant so the taps fold into constants.
+**/
+template <uint16_t taps, uint8_t width>
+struct variant_t
+{
+    static const uint16_t c_feedback = taps;
+    static const uint8_t c_width = width;
+    // top bit of the register, where the feedback is shifted in
+    static const uint16_t c_size = width-1;
+    static const uint16_t c_tap_lo = _tap_lo(taps);
+    static const uint16_t c_tap_hi = _tap_hi(taps);
+    // shifts that can be done at once before a new bit reaches the high tap
+    static const uint32_t c_chunk = c_size+1-c_tap_hi;
+
+    static_assert(taps==((1u<<c_tap_lo)|(1u<<c_tap_hi)), "two taps expected");
 };
 
-void psg_noise(float * out,
+typedef variant_t<0x0009, 16> variant_sega_t;    // sms2, game gear, mega drive
+typedef variant_t<0x0003, 15> variant_bbc_t;     // bbc micro, sc-3000, colecovision
+typedef variant_t<0x0006, 16> variant_sn76496_t; // sn76494/6, tandy 1000 and pcjr
+typedef variant_t<0x0022, 16> variant_ncr8496_t; // ncr8496, later tandy 1000s
+
+// master clocks between noise shifts for each rate, the last tracks tone 2
+const uint32_t c_noise_clocks[] = {512, 1024, 2048};
+
+// clock the noise shift register count times, returning how many of the
+// bits shifted into the output were set
+template <typename V>
+uint32_t _shift_noise(sn76489_t * psg, uint32_t count)
+{
+    // get a nice ref to the shift register
+    uint16_t &sr = psg->noise_sr;
+
+    uint32_t ones = 0;
+    while (count) {
+        // the feedback for k shifts only reads bits of the register as it
+        // is now, so they can be worked out side by side
+        const uint32_t k = (count<V::c_chunk) ? count : V::c_chunk;
+        const uint32_t mask = (1u<<k)-1;
+        const uint32_t in = (psg->noise_md & _FB) ?
+            // white noise
+            (sr>>V::c_tap_lo)^(sr>>V::c_tap_hi) :
+            // periodic noise
+            sr;
+        ones += _popcount((sr>>1)&mask);
+        sr = uint16_t((sr>>k)|((in&mask)<<(V::c_size+1-k)));
+        count -= k;
+    }
+    return ones;
+}
+
+// advance the noise over a number of oversampled samples without output
+template <typename V>
+void _skip_noise(sn76489_t * psg, size_t length)
+{
+    const uint64_t total = psg->noise_acc+uint64_t(length)*psg->clock;
+    _shift_noise<V>(psg, uint32_t(total/psg->noise_period));
+    psg->noise_acc = total%psg->noise_period;
+}
+
+// write a step to a new noise level, phase places it within the last sample
+void _noise_level(sn76489_t * psg, float level, float phase)
+{
+    if (level!=psg->noise_level_) {
+        sound_step_add(psg->noise_step_, phase, level-psg->noise_level_);
+        psg->noise_level_ = level;
+    }
+}
+
+template <typename V>
+bool psg_noise(float * out,
                size_t length,
                void * user,
                float volume) {
 
-    assert((length&1)==0);
-
     sn76489_t * psg = (sn76489_t*)user;
 
-    float vol = volume * psg->noise_volume_;
+    const float vol = volume * psg->noise_volume_;
+
+    // silent so just keep the shift register in step
+    if (vol==0.f && psg->noise_level_==0.f && sound_step_settled(psg->noise_step_)) {
+        _skip_noise<V>(psg, length);
+        return false;
+    }
+
+    const uint64_t clock  = psg->clock;
+    const uint64_t period = psg->noise_period;
+
+    // the volume may have changed since the last call
+    _noise_level(psg, (psg->noise_sr&1) ? vol : -vol, 0.f);
 
     while (length > 0) {
 
-        const uint16_t c_size = 15;     // tandy = 14, other = 15
-        const uint16_t c_taps = 0x0009; // genesis and game gear
-#if 0
-        const uint16_t c_taps = 0x0006;	// sega master system
-        const uint16_t c_taps = 0x0003;	// bbc micro, colecovision
-        const uint16_t c_taps = 0x0011;	// tandy 1000
-#endif
-
-        psg->noise_div += (psg->clock/SAMPLE_RATE);
-        if (psg->noise_div>psg->noise_rate) {
-
-            psg->noise_div -= psg->noise_rate;
-
-            // get a nice ref to the shift register
-            uint16_t &sr = psg->noise_sr;
-
-            // generate white noise
-            if (psg->noise_md & _FB)
-                // white noise
-                sr = (sr>>1)|(_parity(sr & c_taps)<<c_size);
-            else
-                // periodic noise
-                sr = (sr>>1)|((sr&1)<<c_size);
+        if (period<=clock) {
+            // at least one shift per sample, so output the average of the
+            // bits shifted out during the sample
+            const uint64_t acc = psg->noise_acc+clock;
+            const uint32_t shifts = uint32_t(acc/period);
+            psg->noise_acc = acc-shifts*period;
+            const uint32_t ones = _shift_noise<V>(psg, shifts);
+            sound_step_read(psg->noise_step_, out, 1);
+            _noise_level(psg, vol*float(int32_t(2*ones)-int32_t(shifts))/float(shifts), .5f);
+            out += 1;
+            length -= 1;
+            continue;
         }
 
-        out[0] += (psg->noise_sr&1) ? vol : -vol;
-        out[1] += (psg->noise_sr&1) ? vol : -vol;
+        // whole samples before the one the next shift lands in
+        const uint64_t remain = period-psg->noise_acc;
+        const uint64_t before = remain/clock;
+        if (before>=length) {
+            sound_step_read(psg->noise_step_, out, length);
+            psg->noise_acc += uint64_t(length)*clock;
+            break;
+        }
+        const size_t count = size_t(before)+1;
+        sound_step_read(psg->noise_step_, out, count);
+        out += count;
+        length -= count;
+        psg->noise_acc += uint64_t(count)*clock-period;
+
+        _shift_noise<V>(psg, 1);
+        _noise_level(psg, (psg->noise_sr&1) ? vol : -vol, float(remain%clock)/float(clock));
+    }
+    return true;
+}
 
-        out += 2;
-        length -= 2;
+// tone register value with a zero mapped as the header flags ask
+uint32_t _tone(sn76489_t* psg, uint8_t index)
+{
+    const uint32_t tdat = psg->tone[index];
+    return (tdat==0 && psg->freq0_max) ? 0x400 : tdat;
+}
+
+// set the time between noise shifts from the noise register
+void _noise_period(sn76489_t* psg)
+{
+    // rate 3 shifts once per tone 2 period of 32 clocks per step, a zero
+    // tone 2 shifts on every 16 clock count like the sega psg
+    uint32_t clocks = 16;
+    if ((psg->noise_md&0x3)!=0x3) {
+        clocks = c_noise_clocks[psg->noise_md&0x3];
+    }
+    else if (const uint32_t tdat = _tone(psg, 2)) {
+        clocks = 32*tdat;
     }
+    psg->noise_period = uint64_t(clocks)*2*SAMPLE_RATE;
 }
 
 // compute oscillator delta for specific channel
 void _compute_delta(sn76489_t* psg, uint8_t index)
 {
-    uint16_t tdat = psg->tone[index];
+    const uint32_t tdat = _tone(psg, index);
 
     float hz = 0.f;
 
@@ -117,19 +239,22 @@ void _compute_delta(sn76489_t* psg, uint8_t index)
     }
     
     psg->pulse_[index].set_freq(hz, 88200);
+
+    // noise rate 3 follows tone 2
+    if (index==2) {
+        _noise_period(psg);
+    }
 }
 
+template <typename V>
 void _reset_noise(sn76489_t* psg, uint8_t data)
 {
-    uint16_t val[] = {0x010, 0x020, 0x040, uint16_t(psg->delta[1]>>16)};
-    uint16_t div[] = {0x100, 0x200, 0x400, uint16_t(psg->delta[1]>>16)};
-    // set noise shift register bits
-    psg->noise_sr = val[data&0x3];
+    // writing the noise register reloads the shift register
+    psg->noise_sr = 1<<V::c_size;
     // feedback bit
     psg->noise_md = data;
-    // noise divider
-    psg->noise_div = 0;
-    psg->noise_rate = div[data&0x3];
+    psg->noise_acc = 0;
+    _noise_period(psg);
 }
 
 void _set_vol(sn76489_t* psg, int32_t ix, int32_t data)
@@ -143,6 +268,7 @@ void _set_vol(sn76489_t* psg, int32_t ix, int32_t data)
     }
 }
 
+template <typename V>
 void sn76489_write(sn76489_t* psg, uint8_t data)
 {
     // check if latch bit is set
@@ -161,7 +287,7 @@ void sn76489_write(sn76489_t* psg, uint8_t data)
             // noise control register
             if (ix == 0x03) {
                 // noise register
-                _reset_noise(psg, data);
+                _reset_noise<V>(psg, data);
             }
             // must be a tone frequency register
             else {
@@ -186,7 +312,7 @@ void sn76489_write(sn76489_t* psg, uint8_t data)
             // noise control register
             if (ix == 0x03) {
                 // noise register
-                _reset_noise(psg, data);
+                _reset_noise<V>(psg, data);
             }
             // must be a tone frequency register
             else {
@@ -209,7 +335,7 @@ void sn76489_silence(sn76489_t* psg)
     psg->pulse_[2].set_volume(0.f);
 }
 
-void sn76489_init(sn76489_t* psg, uint32_t clock) 
+void sn76489_init(sn76489_t* psg, uint32_t clock, uint8_t flags)
 {
     sound_init(&psg->sound_);
 
@@ -217,74 +343,109 @@ void sn76489_init(sn76489_t* psg, uint32_t clock)
     psg->pulse_[1] = blit_t();
     psg->pulse_[2] = blit_t();
     
+    psg->noise_step_ = step_t();
+    
     psg->noise_volume_ = 0;
+    psg->noise_level_ = 0;
 
-    psg->delta[0] = 0;
     psg->tone[0] = 0;
-    psg->delta[1] = 0;
     psg->tone[1] = 0;
-    psg->delta[2] = 0;
     psg->tone[2] = 0;
 
     psg->noise_sr = 1;
-    psg->noise_div = 0;
-    psg->noise_rate = 0;
+    psg->noise_acc = 0;
     psg->noise_md = 1;
     psg->prev_reg = 0;
+    psg->freq0_max = (flags&1)!=0;
     psg->clock = clock;
+    _noise_period(psg);
 }
 
-void sn76489_render(struct sn76489_t* psg, int16_t* stream, int32_t samples)
+// mute has a bit set for each channel that is left out of the render
+template <typename V>
+void sn76489_render(struct sn76489_t* psg, int16_t* stream, int32_t samples, uint32_t mute)
 {
     std::array<source_t, 5> source = {
-        source_t{sound_source_blit, &psg->pulse_[0], true, .4f},
-        source_t{sound_source_blit, &psg->pulse_[1], true, .4f},
-        source_t{sound_source_blit, &psg->pulse_[2], true, .4f},
-        source_t{psg_noise, psg, true, .3f},
-        source_t{nullptr, nullptr, false},
+        source_t{sound_source_blit, &psg->pulse_[0], !(mute&1), .4f},
+        source_t{sound_source_blit, &psg->pulse_[1], !(mute&2), .4f},
+        source_t{sound_source_blit, &psg->pulse_[2], !(mute&4), .4f},
+        source_t{psg_noise<V>, psg, !(mute&8), .3f},
+        source_t{nullptr, nullptr, false, 0.f},
     };
     sound_render(&psg->sound_, stream, samples, &source[0]);
     return;
 }
 
-struct vgm_chip_sn76489_t : public vgm_chip_t
+template <typename V>
+struct vgm_chip_sn76489_t : public chip_t
 {
     uint32_t clock_;
+    uint8_t flags_;
+    uint32_t mute_;
     sn76489_t psg_;
 
-    vgm_chip_sn76489_t(uint32_t clock)
-        : vgm_chip_t(e_chip_sn67489)
+    vgm_chip_sn76489_t(uint32_t clock, uint8_t flags)
+        : chip_t(e_chip_sn67489)
         , clock_(clock)
+        , flags_(flags)
+        , mute_(0)
     {
         init();
     }
 
     virtual void init() override
     {
-        sn76489_init(&psg_, clock_);
+        sn76489_init(&psg_, clock_, flags_);
     }
 
     virtual void write(uint32_t reg, uint32_t data) override
     {
-        sn76489_write(&psg_, data);
+        sn76489_write<V>(&psg_, data);
     }
 
     virtual void render(int16_t * dst, uint32_t len) override
     {
-        sn76489_render(&psg_, dst, len);
+        sn76489_render<V>(&psg_, dst, len, mute_);
     }
 
     virtual void silence() override
     {
         sn76489_silence(&psg_);
     }
+
+    virtual uint32_t channels() const override
+    {
+        return 4;
+    }
+
+    virtual void set_mute(uint32_t mask) override
+    {
+        mute_ = mask;
+    }
 };
 
 } // namespace {}
 
-vgm_chip_t * chip_create_sn76489(uint32_t clock)
+chip_t * chip_create_sn76489(uint32_t clock, uint16_t feedback, uint8_t width, uint8_t flags)
 {
-    vgm_chip_sn76489_t * chip = new vgm_chip_sn76489_t(clock);
+    // logs before vgm 1.10 leave these as zero, meaning the sega psg
+    feedback = feedback ? feedback : variant_sega_t::c_feedback;
+    width    = width    ? width    : variant_sega_t::c_width;
+
+    chip_t * chip = nullptr;
+    if (feedback==variant_bbc_t::c_feedback && width==variant_bbc_t::c_width) {
+        chip = new vgm_chip_sn76489_t<variant_bbc_t>(clock, flags);
+    }
+    else if (feedback==variant_sn76496_t::c_feedback && width==variant_sn76496_t::c_width) {
+        chip = new vgm_chip_sn76489_t<variant_sn76496_t>(clock, flags);
+    }
+    else if (feedback==variant_ncr8496_t::c_feedback && width==variant_ncr8496_t::c_width) {
+        chip = new vgm_chip_sn76489_t<variant_ncr8496_t>(clock, flags);
+    }
+    else {
+        // the sega psg, and anything the vgm spec does not list
+        chip = new vgm_chip_sn76489_t<variant_sega_t>(clock, flags);
+    }
     chip->init();
     return chip;
 }
@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <array>
+
+#include "chip.h"
+#include "../assert.h"
+#include "../config.h"
+#include "../../libchip/mame_ym2151/Fm2151.h"
+#include "../../libresample/resample.h"
+
+namespace
+{
+
+/* Minimum value
+**/
+template <typename type_t>
+type_t _min(type_t a, type_t b)
+{
+    return (a<b) ? a : b;
+}
+
+
+/* Clamp value within range
+**/
+template <typename type_t>
+type_t _clamp(type_t lo, type_t in, type_t hi)
+{
+    if (in<lo) return lo;
+    if (in>hi) return hi;
+    return in;
+}
+
+} // namespace {}
+
+
+struct vgm_chip_2151_t: public chip_t
+{
+    void * ym_;
+    // the core runs at one output per 64 master clocks
+    resample_t resample_;
+
+    vgm_chip_2151_t(uint32_t clock)
+        : chip_t(e_chip_ym2151)
+        , ym_(ym2151_init(clock, clock/64))
+        , resample_(clock/64, SAMPLE_RATE, 1)
+    {
+    }
+
+    virtual ~vgm_chip_2151_t()
+    {
+        ym2151_shutdown(ym_);
+    }
+
+    virtual void init() override
+    {
+        ym2151_reset(ym_);
+        resample_.reset();
+    }
+
+    virtual void write(uint32_t reg, uint32_t data) override
+    {
+        ym2151_write(ym_, reg, data);
+    }
+
+    virtual void render(int16_t * dst, uint32_t len) override
+    {
+        std::array<int32_t, 512*2> stereo_;
+        std::array<int32_t, 512> native_;
+        std::array<int32_t, 256> buffer_;
+
+        while (len) {
+
+            uint32_t count = _min<uint32_t>(buffer_.size(), len);
+            len -= count;
+
+            // render at the native rate then convert to the output rate
+            const uint32_t need = resample_.input_frames(count);
+            assert(need <= native_.size());
+            ym2151_render(ym_, &stereo_[0], need, false);
+            // the player is mono, average the left and right outputs
+            for (uint32_t i = 0; i<need; ++i) {
+                native_[i] = (stereo_[i*2]+stereo_[i*2+1])/2;
+            }
+            resample_.write(&native_[0], need);
+            buffer_.fill(0);
+            resample_.read(&buffer_[0], count);
+
+            for (uint32_t i = 0; i<count; ++i, ++dst) {
+
+                // one operator at full level peaks at a quarter scale
+                *dst = int16_t(_clamp<int32_t>(-0x8000, buffer_[i], 0x7fff));
+            }
+        }
+    }
+
+    virtual void silence() override
+    {
+        init();
+    }
+
+    virtual uint32_t channels() const override
+    {
+        return 8;
+    }
+
+    virtual void set_mute(uint32_t mask) override
+    {
+        // the core takes a mask of enabled channels
+        ym2151_set_mute(ym_, int(~mask&0xff));
+    }
+};
+
+
+chip_t * chip_create_ym2151(uint32_t clock)
+{
+    // default to the 3.58MHz of most arcade boards when the header gives no clock
+    vgm_chip_2151_t * chip = new vgm_chip_2151_t(clock ? clock : 3579545);
+
+    chip->init();
+    return chip;
+}
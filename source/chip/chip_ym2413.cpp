@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include <array>
+#include <mutex>
+
+#include "chip.h"
+#include "../assert.h"
+#include "../config.h"
+#include "../ym/ym2413.h"
+#include "../../libresample/resample.h"
+
+namespace
+{
+
+/* Minimum value
+**/
+template <typename type_t>
+type_t _min(type_t a, type_t b)
+{
+    return (a<b) ? a : b;
+}
+
+
+/* Clamp value within range
+**/
+template <typename type_t>
+type_t _clamp(type_t lo, type_t in, type_t hi)
+{
+    if (in<lo) return lo;
+    if (in>hi) return hi;
+    return in;
+}
+
+/* The tables and instrument ROM shared by every core are built by the
+** first chip
+**/
+std::once_flag _tables_once;
+
+} // namespace {}
+
+
+struct vgm_chip_2413_t: public chip_t
+{
+    YM2413 * ym_;
+    // the core always runs at one output per 72 master clocks
+    resample_t resample_;
+
+    vgm_chip_2413_t(uint32_t clock)
+        : chip_t(e_chip_ym2413)
+        , ym_(nullptr)
+        , resample_(clock/72, SAMPLE_RATE, 1)
+    {
+        std::call_once(_tables_once, YM2413Init);
+        ym_ = YM2413New();
+    }
+
+    virtual ~vgm_chip_2413_t()
+    {
+        YM2413Delete(ym_);
+    }
+
+    virtual void init() override
+    {
+        YM2413ResetChip(ym_);
+        // the output enable latch is for the sega fm unit, keep it on
+        YM2413Write(ym_, 2, 1);
+        resample_.reset();
+    }
+
+    virtual void write(uint32_t reg, uint32_t data) override
+    {
+        YM2413Write(ym_, 0, reg);
+        YM2413Write(ym_, 1, data);
+    }
+
+    virtual void render(int16_t * dst, uint32_t len) override
+    {
+        std::array<int32_t, 512> native_;
+        std::array<int32_t, 256> buffer_;
+
+        while (len) {
+
+            uint32_t count = _min<uint32_t>(buffer_.size(), len);
+            len -= count;
+
+            // render at the native rate then convert to the output rate
+            const uint32_t need = resample_.input_frames(count);
+            assert(need <= native_.size());
+            YM2413Update(ym_, &native_[0], need);
+            resample_.write(&native_[0], need);
+            buffer_.fill(0);
+            resample_.read(&buffer_[0], count);
+
+            for (uint32_t i = 0; i<count; ++i, ++dst) {
+
+                // one channel at full level peaks near a quarter scale
+                *dst = int16_t(_clamp<int32_t>(-0x8000, buffer_[i]*2, 0x7fff));
+            }
+        }
+    }
+
+    virtual void silence() override
+    {
+        init();
+    }
+
+    virtual uint32_t channels() const override
+    {
+        return 9;
+    }
+
+    virtual void set_mute(uint32_t mask) override
+    {
+        YM2413SetMute(ym_, mask);
+    }
+};
+
+
+chip_t * chip_create_ym2413(uint32_t clock)
+{
+    // default to an NTSC Master System when the header gives no clock
+    vgm_chip_2413_t * chip = new vgm_chip_2413_t(clock ? clock : 3579545);
+
+    chip->init();
+    return chip;
+}
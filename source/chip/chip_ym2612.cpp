@@ -1,9 +1,12 @@
 #include <stdint.h>
 #include <array>
+#include <mutex>
 
 #include "chip.h"
 #include "../assert.h"
+#include "../config.h"
 #include "../ym/ym2612.h"
+#include "../../libresample/resample.h"
 
 namespace
 {
@@ -28,96 +31,100 @@ type_t _clamp(type_t lo, type_t in, type_t hi)
 }
 
 
-/* Return clipped input between [-1,+1]
+/* The tables shared by every core are built by the first chip
 **/
-float _clip(float in)
-{
-    return _clamp(-1.f, in, 1.f);
-}
-
-
-/* 64 bit xor shift pseudo random number generator
-**/
-uint64_t _rand64(uint64_t & x)
-{
-    x ^= x>>12;
-    x ^= x<<25;
-    x ^= x>>27;
-    return x;
-}
-
-
-/* Triangular noise distribution [-1,+1] tending to 0
-**/
-float _dither(uint64_t & x)
-{
-    static const uint32_t fmask = (1<<23)-1;
-    union { float f; uint32_t i; } u, v;
-    u.i = (uint32_t(_rand64(x)) & fmask)|0x3f800000;
-    v.i = (uint32_t(_rand64(x)) & fmask)|0x3f800000;
-    float out = (u.f+v.f-3.f);
-    return out;
-}
-
-
-/* Linear Interpolation
-**/
-float _lerp(float a, float b, float i)
-{
-    return a+(b-a) * i;
-}
+std::once_flag _tables_once;
 
 } // namespace {}
 
 
-struct vgm_chip_2612_t: public vgm_chip_t
+struct vgm_chip_2612_t: public chip_t
 {
-    vgm_chip_2612_t()
-        : vgm_chip_t(e_chip_ym2612)
-    {}
+    YM2612 * ym_;
+    // the core always runs at one output per 144 master clocks
+    resample_t resample_;
+
+    vgm_chip_2612_t(uint32_t clock)
+        : chip_t(e_chip_ym2612)
+        , ym_(nullptr)
+        , resample_(clock/144, SAMPLE_RATE, 1)
+    {
+        std::call_once(_tables_once, YM2612Init);
+        ym_ = YM2612New();
+    }
+
+    virtual ~vgm_chip_2612_t()
+    {
+        YM2612Delete(ym_);
+    }
 
     virtual void init() override
     {
-        YM2612Init();
-        YM2612Config(14);
-        YM2612ResetChip();
+        YM2612Config(ym_, 14);
+        YM2612ResetChip(ym_);
+        resample_.reset();
     }
 
     virtual void write(uint32_t reg, uint32_t data) override
     {
-        YM2612Write(reg, data);
+        // bit 8 picks the second bank, addressed through ports 2 and 3
+        const uint32_t port = (reg>>8)&1;
+        YM2612Write(ym_, port*2+0, reg&0xff);
+        YM2612Write(ym_, port*2+1, data);
     }
 
     virtual void render(int16_t * dst, uint32_t len) override
     {
-        const float c_gain = float(0x7000);
-
-        std::array<int32_t, 1024> buffer_;
+        std::array<int32_t, 1024> native_;
+        std::array<int32_t, 256> buffer_;
 
         while (len) {
 
-            uint32_t count = _min<uint32_t>(buffer_.size()/2, len);
+            uint32_t count = _min<uint32_t>(buffer_.size(), len);
             len -= count;
 
-            YM2612Update(&buffer_[0], count);
+            // render at the native rate then convert to the output rate
+            const uint32_t need = resample_.input_frames(count);
+            assert(need*2 <= native_.size());
+            YM2612Update(ym_, &native_[0], need);
+            // the player is mono, average the left and right outputs
+            for (uint32_t i = 0; i<need; ++i) {
+                native_[i] = (native_[i*2]+native_[i*2+1])/2;
+            }
+            resample_.write(&native_[0], need);
+            buffer_.fill(0);
+            resample_.read(&buffer_[0], count);
 
             for (uint32_t i = 0; i<count; ++i, ++dst) {
 
-                *dst = int16_t(buffer_[i*2]>>16);
+                // one channel at full level peaks at a quarter scale
+                *dst = int16_t(_clamp<int32_t>(-0x8000, buffer_[i], 0x7fff));
             }
         }
     }
 
     virtual void silence() override
     {
-        YM2612ResetChip();
+        YM2612ResetChip(ym_);
+        resample_.reset();
+    }
+
+    virtual uint32_t channels() const override
+    {
+        return 6;
+    }
+
+    virtual void set_mute(uint32_t mask) override
+    {
+        YM2612SetMute(ym_, mask);
     }
 };
 
 
-vgm_chip_t * chip_create_ym2612(uint32_t clock)
+chip_t * chip_create_ym2612(uint32_t clock)
 {
-    vgm_chip_2612_t * chip = new vgm_chip_2612_t();
+    // default to an NTSC Mega Drive when the header gives no clock
+    vgm_chip_2612_t * chip = new vgm_chip_2612_t(clock ? clock : 7670453);
     
     chip->init();
     return chip;
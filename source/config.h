@@ -4,4 +4,8 @@
 #define SAMPLE_RATE 44100
 
 // audio buffer size
-#define BUFFER_SIZE 1024*4
+#define BUFFER_SIZE (1024*4)
+
+// default samples the render thread keeps queued ahead of the audio device,
+// the player can override it with -fill
+#define TARGET_FILL (BUFFER_SIZE*2)
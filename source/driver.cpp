@@ -2,25 +2,92 @@
 #define _SDL_main_h
 #include <SDL/SDL.h>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
 
 #include "gzip.h"
 #include "vgm.h"
+#include "../libvgm/vgm_ring.h"
+#include "../libvgm/vgm_stats.h"
+#include "../libvgm/vgm_trace.h"
 
 namespace {
 
+struct player_t
+{
+    sVGMFile* vgm_;
+    // rendered audio waiting for the device
+    vgm_ring_t<int16_t> ring_;
+    std::thread thread_;
+    std::atomic<bool> running_;
+    // set by the render thread once the stream has ended
+    std::atomic<bool> finished_;
+    // samples to keep queued ahead of the device
+    uint32_t target_;
+
+    player_t(sVGMFile* vgm, uint32_t target)
+        : vgm_(vgm)
+        , ring_(target*2)
+        , running_(false)
+        , finished_(false)
+        , target_(target)
+    {
+    }
+};
+
+// top up the ring to the target fill level
+void _fill(player_t* player)
+{
+    std::array<int16_t, 512> buffer;
+    const uint32_t target = player->target_;
+    while (!player->vgm_->finished && !player->ring_.full(target)) {
+        const uint32_t todo = std::min<uint32_t>(buffer.size(), target-player->ring_.size());
+        const uint32_t done = vgm_render(player->vgm_, &(buffer[0]), todo);
+        player->ring_.write(&(buffer[0]), done);
+    }
+    if (player->vgm_->finished) {
+        player->ring_.close();
+        player->finished_ = true;
+    }
+}
+
+void _render_thread(player_t* player)
+{
+    VGM_TRACE_THREAD("render");
+    while (player->running_ && !player->finished_) {
+        _fill(player);
+        // wait for the device to drain some samples
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// the audio callback only copies out of the ring
 void _audio_cb(void* data, uint8_t* stream, int len)
 {
-    sVGMFile* vgm = (sVGMFile*)data;
+    VGM_STAT_SCOPE(add_callback);
+    VGM_TRACE_THREAD("audio");
+    VGM_TRACE_SCOPE("audio_callback");
+    player_t* player = (player_t*)data;
     int16_t* smp = (int16_t*)stream;
     len /= sizeof(int16_t);
-    vgm_render(vgm, smp, len);
+    VGM_STAT(vgm_stats_t::get().set_ring(player->ring_.size(), player->ring_.capacity()));
+    player->ring_.read(smp, len);
 }
 
-bool _startAudio(sVGMFile* file)
+bool _startAudio(player_t* player)
 {
     if (SDL_Init(SDL_INIT_AUDIO)!=0)
         return false;
 
+    // prime the ring before the device starts pulling from it
+    _fill(player);
+    player->running_ = true;
+    player->thread_ = std::thread(_render_thread, player);
+
     SDL_AudioSpec spec = {
         SAMPLE_RATE,
         AUDIO_S16,
@@ -30,7 +97,7 @@ bool _startAudio(sVGMFile* file)
         0,
         0,
         _audio_cb,
-        file
+        player
     };
 
     if (SDL_OpenAudio(&spec, nullptr)!=0)
@@ -40,9 +107,13 @@ bool _startAudio(sVGMFile* file)
     return true;
 }
 
-void _stopAudio(void)
+void _stopAudio(player_t* player)
 {
     SDL_CloseAudio();
+    player->running_ = false;
+    if (player->thread_.joinable()) {
+        player->thread_.join();
+    }
     SDL_Quit();
 }
 
@@ -52,8 +123,8 @@ bool _writeToFile(sVGMFile* vgm, const char * path) {
     if (fd) {
         std::array<int16_t, 512> buffer;
         while (!vgm->finished) {
-            vgm_render(vgm, &(buffer[0]), buffer.size());
-            fwrite(&(buffer[0]), sizeof(uint16_t), buffer.size(), fd);
+            const uint32_t done = vgm_render(vgm, &(buffer[0]), buffer.size());
+            fwrite(&(buffer[0]), sizeof(uint16_t), done, fd);
         }
         fclose(fd);
     }
@@ -64,6 +135,32 @@ bool _writeToFile(sVGMFile* vgm, const char * path) {
 
 int main(int argc, const char** args)
 {
+    // -stats dumps the instrumentation counters once a second
+    // -trace writes a chrome trace of the render pipeline at exit
+    // -fill sets the samples queued ahead of the device
+    std::unique_ptr<vgm_stats_dump_t> stats;
+    uint32_t target = TARGET_FILL;
+    while (argc>2 && args[1][0]=='-') {
+        if (strcmp(args[1], "-stats")==0) {
+            stats.reset(new vgm_stats_dump_t(args[2]));
+        }
+        else if (strcmp(args[1], "-trace")==0) {
+            vgm_trace_t::get().open(args[2]);
+        }
+        else if (strcmp(args[1], "-fill")==0) {
+            target = uint32_t(strtoul(args[2], nullptr, 0));
+            if (target==0) {
+                printf("invalid fill [%s]\n", args[2]);
+                return 1;
+            }
+        }
+        else {
+            break;
+        }
+        args += 2;
+        argc -= 2;
+    }
+
     const char *path = (argc>1) ? args[1] : "";
 
     sVGMFile* vgm = vgm_load(path);
@@ -79,13 +176,17 @@ int main(int argc, const char** args)
         _writeToFile(vgm, args[2]);
     }
     else {
-        if (_startAudio(vgm)) {
+        player_t player(vgm, target);
+        if (_startAudio(&player)) {
             printf("playing...\n");
-            while (!vgm->finished) {
+            while (!player.finished_ || player.ring_.size()) {
                 SDL_Delay(200);
             }
         }
-        _stopAudio();
+        _stopAudio(&player);
+        printf("underruns: %u, overruns: %u\n",
+               player.ring_.underruns(),
+               player.ring_.overruns());
     }
 
     vgm_free(vgm);
@@ -32,6 +32,12 @@ public:
         R1=R2=R3=R4=R5=0.0f;
     }
 
+    // true when every delay register has drained to zero
+    bool settled() const
+    {
+        return (R1==0.f)&&(R2==0.f)&&(R3==0.f)&&(R4==0.f)&&(R5==0.f);
+    }
+
     float operator () (const float x0, const float x1)
     {
         const float h5x0 = h5 * x0;
@@ -71,6 +77,13 @@ public:
     {
         R1=R2=R3=R4=R5=R6=R7=0.0f;
     }
+
+    // true when every delay register has drained to zero
+    bool settled() const
+    {
+        return (R1==0.f)&&(R2==0.f)&&(R3==0.f)&&(R4==0.f)&&(R5==0.f)&&
+               (R6==0.f)&&(R7==0.f);
+    }
     
     float operator () (const float x0, const float x1)
     {
@@ -117,6 +130,13 @@ public:
     {
         R1=R2=R3=R4=R5=R6=R7=R8=R9=0.0f;
     }
+
+    // true when every delay register has drained to zero
+    bool settled() const
+    {
+        return (R1==0.f)&&(R2==0.f)&&(R3==0.f)&&(R4==0.f)&&(R5==0.f)&&
+               (R6==0.f)&&(R7==0.f)&&(R8==0.f)&&(R9==0.f);
+    }
     
     float operator () (const float x0, const float x1)
     {
@@ -1,5 +1,9 @@
+#include <math.h>
+
 #include "sound.h"
 #include "../assert.h"
+#include "../../libvgm/vgm_stats.h"
+#include "../../libvgm/vgm_trace.h"
 
 namespace
 {
@@ -75,12 +79,25 @@ float _fpart(float in)
 }
 
 
+/* Wrap a phase accumulator that has been decremented past zero
+**/
+float _wrap(float accum, float period)
+{
+    accum = fmodf(accum, period);
+    return (accum<0.f) ? accum+period : accum;
+}
+
+
 /* Clear an intermediate buffer leaving the oversample region untouched
 **/
 void sound_clear(sound_t * buffer)
 {
-    for (size_t i = 0; i<buffer->data_.size(); ++i) {
-        buffer->data_[i] = 0.f;
+    // the buffer is still clean if every source was idle last time
+    if (buffer->dirty_) {
+        for (size_t i = 0; i<buffer->data_.size(); ++i) {
+            buffer->data_[i] = 0.f;
+        }
+        buffer->dirty_ = false;
     }
     buffer->dc_ = 0.f;
     buffer->dither_ = 1.f;
@@ -124,6 +141,21 @@ void sound_mixdown(sound_t * in, int16_t * out, size_t length)
     in->dc_     = dc_;
 }
 
+/* Clock the NES noise shift register while its phase is behind
+**/
+void _lfsr_shift(uint32_t & reg, float & accum, float period, uint32_t tap, uint32_t feedback)
+{
+    while (accum<0.f) {
+        // calculate new bit (taps{tap,0})
+        uint32_t bit = ((reg>>tap)^reg)&1;
+        // shift out and shift in new bit
+        reg = ((reg>>1)&~feedback)|(feedback&(0u-bit));
+        // reset counter
+        accum += period;
+    }
+}
+
+
 } // namespace {}
 
 
@@ -134,6 +166,7 @@ void sound_init(sound_t * buffer)
     for (size_t i = 0; i<buffer->data_.size(); ++i) {
         buffer->data_[i] = 0.f;
     }
+    buffer->dirty_ = false;
     buffer->dc_ = 0.f;
     buffer->dither_ = 1.f;
 }
@@ -146,6 +179,7 @@ void sound_render(sound_t  * buffer,
                   size_t     length,
                   source_t * source)
 {
+    VGM_TRACE_SCOPE("sound_render");
     // buffer size halved since we are 2x oversampling
     const size_t c_buffer_size = buffer->data_.size()/2;
     // while there are samples to render
@@ -159,14 +193,25 @@ void sound_render(sound_t  * buffer,
             // if this source is enabled
             if (s->enable_) {
                 // render into the intermediate buffer
-                s->render_(&buffer->data_[0],
-                           count*2,
-                           s->user_,
-                           s->volume_);
+                buffer->dirty_ |= s->render_(&buffer->data_[0],
+                                             count*2,
+                                             s->user_,
+                                             s->volume_);
+            }
+        }
+        // with no input and a drained decimator the mixdown would only
+        // produce dither which truncates to zero
+        if (!buffer->dirty_ && buffer->decimate_.settled()) {
+            for (size_t i = 0; i<count; ++i) {
+                out[i] = 0;
             }
         }
-        // mixdown into the output buffer
-        sound_mixdown(buffer, out, count);
+        else {
+            // mixdown into the output buffer
+            VGM_STAT_START(start);
+            sound_mixdown(buffer, out, count);
+            VGM_STAT(vgm_stats_t::get().add_mixdown(vgm_stats_t::elapsed_ns(start), count));
+        }
         // advance in samples
         length -= count;
         out    += count;
@@ -176,7 +221,7 @@ void sound_render(sound_t  * buffer,
 
 /* SOUND SOURCE: Simple Pulse Wave Generator
 **/
-void sound_source_pulse(float * out,
+bool sound_source_pulse(float * out,
                         size_t length,
                         void * user,
                         float attenuation)
@@ -190,7 +235,13 @@ void sound_source_pulse(float * out,
     const float volume = pulse.volume_ * attenuation;
 
     // dont render if over nyquist
-    if (period<=2.f) return;
+    if (period<=2.f) return false;
+
+    // silent so just advance the phase
+    if (volume==0.f) {
+        pulse.accum_ = _wrap(accum-float(length), period);
+        return false;
+    }
 
     // while there are samples to render
     while (length--) {
@@ -209,12 +260,13 @@ void sound_source_pulse(float * out,
     }
     // copy period back to structure
     pulse.accum_ = accum;
+    return true;
 }
 
 
 /* SOUND SOURCE: NES Linear Feedback Shift Register
 **/
-void sound_source_lfsr(float * out,
+bool sound_source_lfsr(float * out,
                        size_t length,
                        void * user,
                        float attenuation)
@@ -223,12 +275,20 @@ void sound_source_lfsr(float * out,
     lfsr_t & lfsr = *(lfsr_t*)user;
 
     uint32_t reg            = lfsr.lfsr_;
-    uint32_t counter        = lfsr.counter_;
-    const uint32_t period   = lfsr.period_;
+    float    accum          = lfsr.accum_;
+    const uint32_t tap      = lfsr.tap_;
+    const uint32_t feedback = lfsr.feedback_;
+    const float period      = lfsr.period_;
     const float volume      = lfsr.volume_ * attenuation;
 
-    if (volume<=0.f)
-        return;
+    // silent so just step the shift register
+    if (volume<=0.f) {
+        accum -= float(length);
+        _lfsr_shift(reg, accum, period, tap, feedback);
+        lfsr.lfsr_  = reg;
+        lfsr.accum_ = accum;
+        return false;
+    }
 
     // while there are samples to render
     while (length--) {
@@ -236,32 +296,98 @@ void sound_source_lfsr(float * out,
         float value = (reg&1) ? 1.f : -1.f;
         // apply attenuation
         *(out++) += value * volume;
-        // if the shift register should be clocked
-        if (counter==0) {
-            // calculate new bit (taps{6,0})
-            uint32_t bit = ((reg>>1)^reg);
-            // shift out
-            reg >>= 1;
-            // shift in new bit
-            reg |= (bit<<14)&0x4000;
-            // reset counter
-            counter += period;
-        }
-        else {
-            // decrement the lfsr clock counter
-           --counter;
-        }
+        // clock the shift register for the shifts due in this sample
+        accum -= 1.f;
+        _lfsr_shift(reg, accum, period, tap, feedback);
     }
 
     // copy shift register back into structure
-    lfsr.lfsr_    = reg;
-    lfsr.counter_ = counter;
+    lfsr.lfsr_  = reg;
+    lfsr.accum_ = accum;
+    return true;
+}
+
+
+/* Add a band limited step to a step buffer
+**/
+void sound_step_add(step_t & step, float phase, float delta)
+{
+    // defined in blip_table.cpp
+    extern const float g_blip_table[];
+
+    const uint32_t c_ring_size  = step_t::c_ring_size;
+    const uint32_t c_blip_count = 16;
+    const uint32_t c_blip_size  = 32;
+
+    static_assert(c_blip_size==step_t::c_ring_size, "one blip fills the ring");
+
+    auto & ring = step.ring_;
+    const uint32_t index = step.index_;
+
+    // find lerp data
+    float    r = phase * float(c_blip_count);
+    uint32_t a = int32_t(r+0) & (c_blip_count-1);
+    uint32_t b = int32_t(r+1) & (c_blip_count-1);
+    float    l = _fpart(r);
+    // locate the blip tables that bracket this index
+    const float * blip_a = &g_blip_table[a * c_blip_size];
+    const float * blip_b = &g_blip_table[b * c_blip_size];
+    // for all samples in the blip
+    for (uint32_t i = 0; i<c_ring_size; ++i) {
+        // lerp blip value
+        float v = _lerp(blip_a[i], blip_b[i], l);
+        // sum into blip ring buffer
+        ring[(index+i)%c_ring_size] += v * delta;
+    }
+}
+
+
+/* Integrate samples out of a step buffer
+**/
+void sound_step_read(step_t & step, float * dst, size_t length)
+{
+    const uint32_t c_ring_size = step_t::c_ring_size;
+    const float    c_leak      = 0.999f;
+
+    auto   & ring  = step.ring_;
+    float    out   = step.out_;
+    uint32_t index = step.index_;
+
+    for (size_t i = 0; i<length; ++i, ++dst) {
+        // get this ring buffer slot
+        float & slot = ring[(index++)%c_ring_size];
+        // integrate using blip ring buffer
+        out  += slot;
+        out  *= c_leak;
+        *dst += out;
+        // clear ring buffer slot
+        slot  = 0.f;
+    }
+    step.out_   = out;
+    step.index_ = index;
+}
+
+
+/* True when a step buffer has no pending steps and has leaked away
+**/
+bool sound_step_settled(const step_t & step)
+{
+    static const float c_epsilon = 1.f/65536.f;
+    if (fabsf(step.out_)>c_epsilon) {
+        return false;
+    }
+    for (uint32_t i = 0; i<step.ring_.size(); ++i) {
+        if (step.ring_[i]!=0.f) {
+            return false;
+        }
+    }
+    return true;
 }
 
 
 /* SOUND SOURCE: Band Limited Impulse Train Pulse Wave Generator
 **/
-void sound_source_blit(float * dst,
+bool sound_source_blit(float * dst,
                        size_t length,
                        void * user,
                        float attenuation)
@@ -272,26 +398,36 @@ void sound_source_blit(float * dst,
     assert(user && dst && length);
     blit_t & blit = *(blit_t*)user;
 
-    // defined in blip_table.cpp
-    extern const float g_blip_table[];
-
-    const uint32_t c_ring_size  = blit_t::c_ring_size;
-    const float    c_leak       = 0.999f;
-    const uint32_t c_blip_count = 16;
-    const uint32_t c_blip_size  = 32;
-
-    assert(c_blip_size==c_ring_size);
-
-    auto   & ring   = blit.ring_;
     float    accum  = blit.accum_;
-    float    out    = blit.out_;
-    uint32_t index  = blit.index_;
     uint32_t edge   = blit.edge_;
     
     const float volume = blit.volume_ * attenuation;
 
     if ((blit.hcycle_[0]<=0.f)||(blit.hcycle_[1]<=0.f)) {
-        return;
+        return false;
+    }
+
+    // silent and the integrator has drained so just advance the phase
+    if (volume==0.f && sound_step_settled(blit.step_)) {
+        const float period = blit.hcycle_[0]+blit.hcycle_[1];
+        // bring the edges up to the start of the last sample as the render
+        // loop would, whole periods flip the edge twice so only the
+        // remainder matters
+        accum -= float(length-1);
+        if (accum < 0.f) {
+            accum = _wrap(accum, period)-period;
+            while (accum < 0.f) {
+                edge ^= 0x1;
+                accum += blit.hcycle_[edge&1];
+            }
+        }
+        // the last sample may leave an edge pending for the next call
+        accum -= 1.f;
+        blit.accum_        = accum;
+        blit.edge_         = edge;
+        blit.step_.index_ += uint32_t(length);
+        blit.step_.out_    = 0.f;
+        return false;
     }
 
     assert(blit.hcycle_[0] > 0.f);
@@ -305,21 +441,7 @@ void sound_source_blit(float * dst,
             const float scale = (edge&1) ? volume : -volume;
             // flip pulse edge
             edge ^= 0x1;
-            // find lerp data
-            float    r = (1.f+accum) * float(c_blip_count);
-            uint32_t a = int32_t(r+0) & (c_blip_count-1);
-            uint32_t b = int32_t(r+1) & (c_blip_count-1);
-            float    l = _fpart(r);
-            // locate the blip tables that bracket this index
-            const float * blip_a = &g_blip_table[a * c_blip_size];
-            const float * blip_b = &g_blip_table[b * c_blip_size];
-            // for all samples in the blip
-            for (uint32_t i = 0; i<c_ring_size; ++i) {
-                // lerp blip value
-                float v = _lerp(blip_a[i], blip_b[i], l);
-                // sum into blip ring buffer
-                ring[(index+i)%c_ring_size] += v * scale;
-            }
+            sound_step_add(blit.step_, 1.f+accum, scale);
             // reset the period with this duty cycle period
             accum += blit.hcycle_[edge&1];
         }
@@ -331,28 +453,19 @@ void sound_source_blit(float * dst,
         // advance the period by the amount we will render
         accum -= float(count);
         // render using the blip ring buffer
-        for (uint32_t i = 0; i<count; ++i, ++dst) {
-            // get this ring buffer slot
-            float & slot = ring[(index++)%c_ring_size];
-            // integrate using blip ring buffer
-            out  += slot;
-            out  *= c_leak;
-            *dst += out;
-            // clear ring buffer slot
-            slot  = 0.f;
-        }
+        sound_step_read(blit.step_, dst, count);
+        dst += count;
     }
     // pack blip state back into struct
-    blit.out_   = out;
     blit.accum_ = accum;
-    blit.index_ = index;
     blit.edge_  = edge;
+    return true;
 }
 
 
 /* SOUND SOURCE: Nintendo Entertainment System APU Triangle
 **/
-void sound_source_nestri(float * out,
+bool sound_source_nestri(float * out,
                          size_t length,
                          void * user,
                          float attenuation)
@@ -372,7 +485,13 @@ void sound_source_nestri(float * out,
     float accum = nestri.accum_;
     const float delta  = nestri.delta_;
     const float volume = nestri.volume_ * attenuation;
-    
+
+    // silent so just advance the phase
+    if (volume==0.f) {
+        nestri.accum_ = _wrap(accum-delta*float(length), 32.f);
+        return false;
+    }
+
     // while there are samples to render
     while (length--) {
         // tick the sqaure wave counter
@@ -395,4 +514,5 @@ void sound_source_nestri(float * out,
     }
     // copy period back to structure
     nestri.accum_ = accum;
+    return true;
 }
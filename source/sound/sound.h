@@ -9,6 +9,7 @@ struct sound_t
     decimate_9_t decimate_;
     uint64_t     dither_;
     float        dc_;
+    bool         dirty_;    // a source wrote into data_ since the last clear
 
     std::array<float, 1024> data_;
 
@@ -16,6 +17,7 @@ struct sound_t
     sound_t()
         : decimate_()
         , dither_(1)
+        , dirty_(false)
     {
         for (uint32_t i = 0; i<data_.size(); ++i)
             data_[i] = 0.f;
@@ -79,14 +81,18 @@ struct nestri_t
 struct lfsr_t
 {
     uint32_t lfsr_;
-    uint32_t period_;
-    uint32_t counter_;
+    uint32_t tap_;      // second feedback tap, 1 or 6 for short mode
+    uint32_t feedback_; // bits the feedback is written to
+    float    period_;   // samples between shifts
+    float    accum_;    // samples until the next shift
     float    volume_;
 
     lfsr_t()
         : lfsr_(1)
-        , period_(100)
-        , counter_(100)
+        , tap_(1)
+        , feedback_(0x4000)
+        , period_(100.f)
+        , accum_(100.f)
         , volume_(0.f)
     {
     }
@@ -95,38 +101,59 @@ struct lfsr_t
         volume_ = volume;
     }
 
-    void set_period(uint32_t period) {
+    void set_period(float period) {
         period_ = period;
     }
+
+    void set_tap(uint32_t tap) {
+        tap_ = tap;
+    }
+
+    void set_feedback(uint32_t feedback) {
+        feedback_ = feedback;
+    }
 };
 
-struct blit_t
+/* Band limited step buffer
+ * Steps are written as band limited impulses into a ring which is
+ * integrated back into steps as samples are read out.
+**/
+struct step_t
 {
     static const size_t c_ring_size = 32;
-    
+
+    float    out_;
+    uint32_t index_;
+    std::array<float, c_ring_size> ring_;
+
+    step_t()
+        : out_(0.f)
+        , index_(0)
+    {
+        for (uint32_t i = 0; i<ring_.size(); ++i) {
+            ring_[i] = 0.f;
+        }
+    }
+};
+
+struct blit_t
+{
     float   period_;
     float   duty_;
     float   volume_;
 
     float    accum_;
-    float    out_;
     int32_t  edge_;
     float    hcycle_[2];
-    uint32_t index_;
-    std::array<float, c_ring_size> ring_;
+    step_t   step_;
 
     blit_t()
         : duty_(.5f)
-        , out_(0.f)
         , edge_(0)
-        , index_(0)
         , volume_(0.f)
         , accum_(0.f)
         , period_(1.f)
     {
-        for (uint32_t i = 0; i<ring_.size(); ++i) {
-            ring_[i] = 0.f;
-        }
         hcycle_[0] = 1.f;
         hcycle_[1] = 1.f;
     }
@@ -155,7 +182,8 @@ struct blit_t
 
 struct source_t {
 
-    void(*render_)(float * out, size_t length, void * user, float volume);
+    // returns false if the source was idle and wrote nothing to out
+    bool(*render_)(float * out, size_t length, void * user, float volume);
     void *user_;
     bool enable_;
     float volume_;
@@ -166,6 +194,8 @@ struct source_t {
 void sound_init(sound_t * buffer);
 
 /* Render into sound buffer at 2x oversample rate
+ * If every source is idle and the decimator has drained the output is
+ * written as silence without running the mixdown.
 **/
 void sound_render(sound_t  * buffer,
                   int16_t  * out,
@@ -173,29 +203,44 @@ void sound_render(sound_t  * buffer,
                   source_t * source);
 
 /* Simple Pulse Wave Generator
+ * Sound sources return false when they are silent, in which case their
+ * phase is advanced without rendering.
 **/
-void sound_source_pulse(float * out,
+bool sound_source_pulse(float * out,
                         size_t length,
                         void * user,
                         float volume);
 
 /* NES Noise Channel
 **/
-void sound_source_lfsr(float * out,
+bool sound_source_lfsr(float * out,
                        size_t length,
                        void * user,
                        float volume);
 
+/* Add a band limited step of height delta to a step buffer
+ * phase [0,1) places the step within the sample before the next one read.
+**/
+void sound_step_add(step_t & step, float phase, float delta);
+
+/* Integrate samples out of a step buffer, adding them to out
+**/
+void sound_step_read(step_t & step, float * out, size_t length);
+
+/* True when a step buffer has no pending steps and has leaked away
+**/
+bool sound_step_settled(const step_t & step);
+
 /* Band Limited Inpulse Train Pules Generator
 **/
-void sound_source_blit(float * out,
+bool sound_source_blit(float * out,
                        size_t length,
                        void * user,
                        float volume);
 
 /* NES Triangle Channel
 **/
-void sound_source_nestri(float * out,
+bool sound_source_nestri(float * out,
                          size_t length,
                          void * user,
                          float volume);
@@ -1,11 +1,15 @@
 #define _CRT_SECURE_NO_WARNINGS
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <array>
 
 #include "assert.h"
 #include "vgm.h"
 #include "gzip.h"
 #include "config.h"
+#include "../libvgm/vgm_stats.h"
+#include "../libvgm/vgm_trace.h"
 
 namespace {
 
@@ -18,114 +22,239 @@ uint32_t inline _toSamples(uint32_t count)
     return count;
 }
 
-// Gamegear/SegaMegadrive/BBC Micro
-void _write_sn76489(sVGMFile* vgm, uint8_t data)
+/* A chip backend and the header field giving the chip clock, vgm_load
+** builds every chip whose clock is set. Chips with more than one backend
+** list the most accurate one first
+**/
+struct chip_factory_t
 {
-    if (!vgm->chip_) {
-        // construct on demand
-        uint32_t clock = vgm->header->clock_sn76489 & 0x7fffffffu;
-        vgm->chip_ = chip_create_sn76489(clock);
-    }
-    assert(vgm->chip_);
-    if (vgm->chip_->id_==e_chip_sn67489) {
-        vgm->chip_->write(0, data);
-    }
+    chip_type_e  type;
+    const char * chip;
+    const char * backend;
+    // offset of the clock in the vgm header
+    uint32_t     clock;
+    chip_t *   (*create)(const sVGMHeader & header, uint32_t clock);
+};
+
+chip_t * _create_sn76489(const sVGMHeader & header, uint32_t clock)
+{
+    // the lfsr fields were added in 1.10 and the flags in 1.51
+    uint16_t feedback = (header.version>=0x110) ? header.feedback_sn76489 : 0;
+    uint8_t  width    = (header.version>=0x110) ? header.width_sn76489 : 0;
+    uint8_t  flags    = (header.version>=0x151) ? header.flags_sn76489 : 0;
+    return chip_create_sn76489(clock, feedback, width, flags);
 }
 
-// Nintendo Entertainment System
-void _write_nes(sVGMFile* vgm, uint8_t reg, uint8_t data)
+chip_t * _create_ay8910(const sVGMHeader & header, uint32_t clock)
 {
-    if (!vgm->chip_) {
-        // construct on demand
-        vgm->chip_ = chip_create_nes_apu(0);
-    }
-    assert(vgm->chip_);
-    if (vgm->chip_->id_==e_chip_nes_apu) {
-        vgm->chip_->write(reg, data);
-    }
+    return chip_create_ay8910(clock, header.type_ay8910);
 }
 
-void _write_gb_dmg(sVGMFile* vgm, uint8_t reg, uint8_t data)
+const chip_factory_t c_factories[] = {
+    // Gamegear/SegaMegadrive/BBC Micro
+    { e_chip_sn67489, "sn76489", "source", offsetof(sVGMHeader, clock_sn76489), _create_sn76489 },
+    // Master System FM unit/MSX-MUSIC synth
+    { e_chip_ym2413,  "ym2413",  "source", offsetof(sVGMHeader, clock_ym2413),
+      [](const sVGMHeader &, uint32_t clock) { return chip_create_ym2413(clock); } },
+    // Sega Genesis/Mega Drive synth
+    { e_chip_ym2612,  "ym2612",  "source", offsetof(sVGMHeader, clock_ym2612),
+      [](const sVGMHeader &, uint32_t clock) { return chip_create_ym2612(clock); } },
+    // Arcade/X68000 OPM synth
+    { e_chip_ym2151,  "ym2151",  "source", offsetof(sVGMHeader, clock_ym2151),
+      [](const sVGMHeader &, uint32_t clock) { return chip_create_ym2151(clock); } },
+    // Soundblaster synth, the float port and the faster fixed point one
+    { e_chip_ym3812,  "ym3812",  "java",   offsetof(sVGMHeader, clock_ym3812),
+      [](const sVGMHeader &, uint32_t clock) { return chip_create_ym3812(clock); } },
+    { e_chip_ym3812,  "ym3812",  "fixed",  offsetof(sVGMHeader, clock_ym3812),
+      [](const sVGMHeader &, uint32_t clock) { return chip_create_ym3812_fixed(clock); } },
+    // MSX/ZX Spectrum/Atari ST psg
+    { e_chip_ay8910,  "ay8910",  "source", offsetof(sVGMHeader, clock_ay8910), _create_ay8910 },
+    // Nintendo Game Boy
+    { e_chip_gb_dmg,  "gb_dmg",  "source", offsetof(sVGMHeader, clock_gb_dmg),
+      [](const sVGMHeader &, uint32_t clock) { return chip_create_gb_dmg(clock); } },
+    // Nintendo Entertainment System
+    { e_chip_nes_apu, "nes_apu", "source", offsetof(sVGMHeader, clock_nes_apu),
+      [](const sVGMHeader &, uint32_t clock) { return chip_create_nes_apu(clock); } },
+    // Atari 8 bit computers
+    { e_chip_pokey,   "pokey",   "source", offsetof(sVGMHeader, clock_pokey),
+      [](const sVGMHeader &, uint32_t clock) { return chip_create_pokey(clock); } },
+};
+
+// clock of a chip from the header, zero when the log does not use it
+uint32_t _header_clock(const sVGMHeader & header, const chip_factory_t & f)
 {
-    //XXX: todo
+    uint32_t clock = 0;
+    memcpy(&clock, ((const uint8_t*)&header)+f.clock, sizeof(clock));
+    // the top bits flag a second chip or a chip variant
+    return clock & 0x3fffffffu;
 }
 
-void _write_pokey(sVGMFile* vgm, uint8_t reg, uint8_t data)
+// chip of the log with a name, null if the log does not use it
+chip_t * _find_chip(sVGMFile* vgm, const char* name)
 {
-    //XXX: todo
+    for (const chip_factory_t & f : c_factories) {
+        if (strcmp(f.chip, name)==0) {
+            return vgm->chips_[f.type];
+        }
+    }
+    return nullptr;
 }
 
-// Soundblaster synth
-void _write_ym3812(sVGMFile* vgm, uint8_t reg, uint8_t data)
+// logs before 1.10 have no ym2612 or ym2151 clock, those chips share the
+// ym2413 one. give it to the fm chips the stream writes
+void _map_old_clocks(sVGMHeader & header, const uint8_t* data, const uint8_t* end)
 {
-    if (!vgm->chip_) {
-        // construct on demand
-        vgm->chip_ = chip_create_ym3812(0);
+    if (header.version>=0x110 || header.clock_ym2413==0) {
+        return;
+    }
+    bool ym2413 = false, ym2612 = false, ym2151 = false;
+    while (data<end) {
+        const uint8_t opcode = *data;
+        ym2413 |= (opcode==0x51);
+        ym2612 |= (opcode==0x52 || opcode==0x53);
+        ym2151 |= (opcode==0x54);
+        if (opcode==0x4f || opcode==0x50) {
+            data += 2;
+        }
+        else if ((opcode>=0x51 && opcode<=0x5f) || opcode==0x61) {
+            data += 3;
+        }
+        else if (opcode==0x62 || opcode==0x63 || (opcode&0xf0)==0x70) {
+            data += 1;
+        }
+        else {
+            // end of the data, or an opcode newer than the log
+            break;
+        }
     }
-    assert(vgm->chip_);
-    if (vgm->chip_->id_==e_chip_ym3812) {
-        vgm->chip_->write(reg, data);
+    if (ym2612) {
+        header.clock_ym2612 = header.clock_ym2413;
+    }
+    if (ym2151) {
+        header.clock_ym2151 = header.clock_ym2413;
+    }
+    // the ym2413 keeps the clock only if it is written to as well
+    if ((ym2612 || ym2151) && !ym2413) {
+        header.clock_ym2413 = 0;
     }
 }
 
-// Sega Genesis/Mega Drive synth
-void _write_ym2612(sVGMFile* vgm, uint32_t port, uint8_t reg, uint8_t data)
+// build every chip the header gives a clock for, before the first render
+void _create_chips(sVGMFile* vgm, const sVGMBackends* backends)
 {
-    if (!vgm->chip_) {
-        // construct on demand
-        vgm->chip_ = chip_create_ym2612(0);
+    for (const chip_factory_t & f : c_factories) {
+        const uint32_t clock = _header_clock(vgm->header, f);
+        if (clock==0 || vgm->chips_[f.type]) {
+            continue;
+        }
+        // a chip takes its first backend unless another one is asked for
+        const char* name = backends ? backends->name[f.type] : nullptr;
+        if (name && strcmp(name, f.backend)) {
+            continue;
+        }
+        vgm->chips_[f.type] = f.create(vgm->header, clock);
     }
-    assert(vgm->chip_);
-    if (vgm->chip_->id_==e_chip_ym2612) {
-        vgm->chip_->write(reg, data);
+}
+
+#if defined(VGM_STATS) || defined(VGM_TRACE)
+// instrumentation counter index for a chip
+uint32_t _stat_index(chip_type_e type)
+{
+    switch (type) {
+    case e_chip_sn67489: return VGM_STAT_SN76489;
+    case e_chip_nes_apu: return VGM_STAT_NES_APU;
+    case e_chip_ym3812:  return VGM_STAT_YM3812;
+    case e_chip_ym2612:  return VGM_STAT_YM2612;
+    case e_chip_gb_dmg:  return VGM_STAT_GB_DMG;
+    case e_chip_pokey:   return VGM_STAT_POKEY;
+    case e_chip_ym2413:  return VGM_STAT_YM2413;
+    case e_chip_ym2151:  return VGM_STAT_YM2151;
+    case e_chip_ay8910:  return VGM_STAT_AY8910;
+    case e_chip_count:   break;
+    }
+    assert(!"unknown chip");
+    return 0;
+}
+#endif
+
+// write to a chip, dropped when the header gave it no clock. chips with a
+// second register bank see the port as bit 8 of the register
+void _write(sVGMFile* vgm, chip_type_e type, uint32_t reg, uint32_t data, uint32_t port=0)
+{
+    VGM_STAT(vgm_stats_t::get().add_write(_stat_index(type)));
+    if (chip_t* chip = vgm->chips_[type]) {
+        vgm->live_ |= 1u<<type;
+        chip->write(reg|(port<<8), data);
     }
 }
 
 void _silence(sVGMFile* vgm)
 {
-    if (vgm->chip_) {
-        vgm->chip_->silence();
+    for (chip_t* chip : vgm->chips_) {
+        if (chip) {
+            chip->silence();
+        }
     }
 }
 
 void _handle_data_block(sVGMFile* vgm, uint8_t *data, uint8_t type, uint32_t size)
 {
-    //XXX: need to implement data block handling
+    // nes apu ram write, holding the samples for the dmc
+    if (type==0xC2) {
+        if (chip_t* chip = vgm->chips_[e_chip_nes_apu]) {
+            chip->write_block(type, data, size);
+        }
+    }
+    //XXX: other data block types are skipped
 }
 
 // return samples to render
 bool _parse(sVGMFile* vgm, uint32_t & count)
 {
+    VGM_STAT_SCOPE(add_parse);
+    VGM_TRACE_SCOPE("parse");
     uint8_t * &data = vgm->stream;
 
     // while we have no samples to render keep parsing
     while (count==0 && !vgm->finished) {
 
-        printf("%02x\n", data[0]);
+        VGM_STAT_OPCODE(data[0]);
 
         // parse this vgm opcode
         switch (uint8_t opcode = data[0]) {
         case (0x4f):
         case (0x50):
             // write to sn76489
-            _write_sn76489(vgm, data[1]);
+            _write(vgm, e_chip_sn67489, 0, data[1]);
             data += 2;
             break;
 
+        case (0x51):
+            // write to YM2413
+            _write(vgm, e_chip_ym2413, data[1], data[2]);
+            data += 3;
+            break;
+
         case (0x52) :
             // write to YM2612 PORT 1
-            _write_ym2612(vgm, 0, data[1], data[2]);
+            _write(vgm, e_chip_ym2612, data[1], data[2]);
             data += 3;
             break;
 
         case (0x53):
             // write to YM2612 PORT 2
-            _write_ym2612(vgm, 1, data[1], data[2]);
+            _write(vgm, e_chip_ym2612, data[1], data[2], 1);
+            data += 3;
+            break;
+
+        case (0x54):
+            // write to YM2151
+            _write(vgm, e_chip_ym2151, data[1], data[2]);
             data += 3;
             break;
 
         case (0x5A) :
-            _write_ym3812(vgm, data[1], data[2]);
+            _write(vgm, e_chip_ym3812, data[1], data[2]);
             data += 3;
             break;
 
@@ -165,21 +294,27 @@ bool _parse(sVGMFile* vgm, uint32_t & count)
             break;
             }
 
+        case (0xA0):
+            // write to the AY8910
+            _write(vgm, e_chip_ay8910, data[1], data[2]);
+            data += 3;
+            break;
+
         case (0xB4):
             // write to the NES APU
-            _write_nes(vgm, data[1], data[2]);
+            _write(vgm, e_chip_nes_apu, data[1], data[2]);
             data += 3;
             break;
 
         case (0xB3):
             // write to the GameBoy DMG
-            _write_gb_dmg(vgm, data[1], data[2]);
+            _write(vgm, e_chip_gb_dmg, data[1], data[2]);
             data += 3;
             break;
 
         case (0xBB):
             // write to the atari pokey
-            _write_pokey(vgm, data[1], data[2]);
+            _write(vgm, e_chip_pokey, data[1], data[2]);
             data += 3;
             break;
 
@@ -233,9 +368,11 @@ bool _parse(sVGMFile* vgm, uint32_t & count)
                 data += 1;
             }
             else {
-                uint32_t offset = data - vgm->raw;
-                printf("Unknown Opcode 0x%02X @ 0x%04X\n", data[0], offset);
-                getchar();
+                // renders run on pool workers, so fail the track rather
+                // than wait on the console
+                const uint32_t offset = uint32_t(data - vgm->raw);
+                fprintf(stderr, "unknown opcode 0x%02X at 0x%04X\n", data[0], offset);
+                vgm->failed = true;
                 vgm->finished = true;
             }
             break;
@@ -250,16 +387,81 @@ uint32_t _minv(uint32_t a, uint32_t b)
     return (a<b) ? a : b;
 }
 
+// render one chip, the first chip rendered writes dst and the rest mix in
+void _render_chip(sVGMFile* vgm, chip_type_e type, int16_t* dst, uint32_t count, bool mix)
+{
+    chip_t* chip = vgm->chips_[type];
+    VGM_TRACE_SCOPE(vgm_stat_chip_name(_stat_index(type)));
+    VGM_STAT_START(start);
+    if (!mix) {
+        chip->render(dst, count);
+    }
+    else {
+        std::array<int16_t, 1024> buffer;
+        for (uint32_t done = 0; done<count;) {
+            const uint32_t todo = _minv(count-done, buffer.size());
+            buffer.fill(0);
+            chip->render(&buffer[0], todo);
+            for (uint32_t i = 0; i<todo; ++i, ++done) {
+                const int32_t sum = int32_t(dst[done])+buffer[i];
+                dst[done] = int16_t((sum<-0x8000) ? -0x8000 : (sum>0x7fff) ? 0x7fff : sum);
+            }
+        }
+    }
+    VGM_STAT(vgm_stats_t::get().add_render(_stat_index(type),
+                                           vgm_stats_t::elapsed_ns(start),
+                                           count));
+}
+
 } // namespace {}
 
-sVGMFile* vgm_load(const char* path)
+bool vgm_select_backend(sVGMBackends* backends, const char* chip, const char* backend)
+{
+    for (const chip_factory_t & f : c_factories) {
+        if (strcmp(f.chip, chip)==0 && strcmp(f.backend, backend)==0) {
+            backends->name[f.type] = f.backend;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool vgm_set_mute(sVGMFile* vgm, const char* chip, uint32_t mask)
+{
+    chip_t* c = _find_chip(vgm, chip);
+    if (!c || !c->channels()) {
+        return false;
+    }
+    c->set_mute(mask);
+    // writes still reach a fully muted chip so it picks up the registers
+    // when unmuted, it just does not render in between
+    const uint32_t all = (1u<<c->channels())-1;
+    if ((mask & all)==all) {
+        vgm->muted_ |= 1u<<c->id_;
+    }
+    else {
+        vgm->muted_ &= ~(1u<<c->id_);
+    }
+    return true;
+}
+
+bool vgm_set_solo(sVGMFile* vgm, const char* chip, uint32_t mask)
+{
+    chip_t* c = _find_chip(vgm, chip);
+    if (!c || !c->channels()) {
+        return false;
+    }
+    return vgm_set_mute(vgm, chip, ~mask & ((1u<<c->channels())-1));
+}
+
+sVGMFile* vgm_load(const char* path, const sVGMBackends* backends)
 {
     int32_t size = 0;
     uint8_t* stream = gzOpen(path, &size);
     if (stream == nullptr)
         return nullptr;
 
-    if (memcmp(stream, "Vgm ", 4)) {
+    if (size<0x40 || memcmp(stream, "Vgm ", 4)) {
         gzClose(stream);
         return nullptr;
     }
@@ -267,32 +469,34 @@ sVGMFile* vgm_load(const char* path)
     sVGMFile* vgm = new sVGMFile;
     memset(vgm, 0, sizeof(sVGMFile));
 
-    vgm->header = (sVGMHeader*)stream;
     vgm->raw = stream;
+    const sVGMHeader* header = (const sVGMHeader*)stream;
 
-    // find start of music data
-    if (vgm->header->offset_vgmdata==0) {
-        const uint32_t header_size = 64;
-        vgm->stream = stream+header_size;
-    }
-    else {
-        const uint32_t start = 0x34+vgm->header->offset_vgmdata;
-        vgm->stream = stream + start;
+    // find start of music data, the header ends where it starts
+    uint32_t start = 0x40;
+    if (header->version>=0x150 && header->offset_vgmdata!=0) {
+        start = 0x34+header->offset_vgmdata;
     }
+    vgm->stream = stream + start;
+    memcpy(&vgm->header, stream, _minv(_minv(start, uint32_t(size)), sizeof(sVGMHeader)));
+    _map_old_clocks(vgm->header, vgm->stream, stream + size);
+
+    _create_chips(vgm, backends);
     return vgm;
 }
 
 void vgm_free(sVGMFile* vgm)
 {
-    if (vgm->chip_) {
-        delete vgm->chip_;
+    for (chip_t* chip : vgm->chips_) {
+        delete chip;
     }
     gzClose(vgm->raw);
     delete vgm;
 }
 
-void vgm_render(sVGMFile* vgm, int16_t* dst, uint32_t samples)
+uint32_t vgm_render(sVGMFile* vgm, int16_t* dst, uint32_t samples)
 {
+    const uint32_t total = samples;
     // clear the sound buffer
     memset(dst, 0, samples * sizeof(int16_t));
 
@@ -306,9 +510,13 @@ void vgm_render(sVGMFile* vgm, int16_t* dst, uint32_t samples)
         uint32_t count = _minv(samples, spill);
         // handle any spill between audio frames
         if (count) {
-            // render the requested number of frames
-            if (vgm->chip_) {
-                vgm->chip_->render(dst, count);
+            // render the requested number of frames from each written chip
+            bool mix = false;
+            for (uint32_t i = 0; i<e_chip_count; ++i) {
+                if ((vgm->live_ & ~vgm->muted_) & (1u<<i)) {
+                    _render_chip(vgm, chip_type_e(i), dst, count, mix);
+                    mix = true;
+                }
             }
             // advance the sample stream
             spill   -= count;
@@ -325,4 +533,5 @@ void vgm_render(sVGMFile* vgm, int16_t* dst, uint32_t samples)
         assert(--watchdog);
     }
     vgm->spill = spill;
+    return total - samples;
 }
@@ -17,31 +17,75 @@ struct sVGMHeader {
     uint32_t loop_samples;      // number of samples in one loop, or 0 if no loop
     uint32_t rate;              // rate of recording in hz. 50 pal, 60 ntsc;
     uint16_t feedback_sn76489;  // lfsr feedback pattern
-    uint8_t  width_sn76489;     // lfsr width	- 15 sms2,gg,smd
-                                //				- 16 bbcmicro,segacomputer3000
+    uint8_t  width_sn76489;     // lfsr width	- 16 sms2,gg,smd
+                                //				- 15 bbcmicro,segacomputer3000
     uint8_t flags_sn76489;      // lfsr flags	- bit 0 frequency is 0x400
                                 //				- bit 1 output negate flag
                                 //				- bit 2 stereo
                                 // on(0)/off(1)
                                 //				- bit 3 /8 clock divider	on(0)/off(1)
-    uint32_t _1;
-    uint32_t _2;
+    uint32_t clock_ym2612;
+    uint32_t clock_ym2151;
     uint32_t offset_vgmdata;
-    uint32_t _3;
+    // vgm 1.51 additions, only there when the data starts after them
+    uint32_t _3[6];
+    uint32_t clock_ym3812;
+    uint32_t _4[8];
+    uint32_t clock_ay8910;
+    uint8_t  type_ay8910;
+    uint8_t  flags_ay8910;
+    uint8_t  _5[6];
+    // vgm 1.61 additions
+    uint32_t clock_gb_dmg;
+    uint32_t clock_nes_apu;
+    uint32_t _6[10];
+    uint32_t clock_pokey;
 };
 #pragma pack(pop)
 
 struct sVGMFile {
     uint8_t* raw;
-    sVGMHeader* header;
+    // copy of the header with the fields past the vgm data zeroed
+    sVGMHeader header;
     uint8_t* stream;
-    vgm_chip_t *chip_;
+    // every chip with a clock in the header, built by vgm_load
+    chip_t *chips_[e_chip_count];
+    // bit per chip written to so far, only those are rendered
+    uint32_t live_;
+    // bit per chip with every channel muted, left out of the render
+    uint32_t muted_;
     uint32_t spill;
     bool finished;
+    // set along with finished when the stream has an unknown opcode
+    bool failed;
 };
 
-sVGMFile* vgm_load(const char* path);
+/* Backend to build each chip with, by name. A null name takes the first
+** backend listed for the chip, the most accurate one
+**/
+struct sVGMBackends {
+    const char* name[e_chip_count];
+};
+
+/* Set the backend of a chip by name, false if the chip or backend is unknown
+**/
+bool vgm_select_backend(sVGMBackends* backends, const char* chip, const char* backend);
+
+sVGMFile* vgm_load(const char* path, const sVGMBackends* backends=nullptr);
+
+/* Mute channels of a chip by name, bit n set mutes channel n. Muted channels
+** are not computed at all and a chip with every channel muted is not rendered.
+** False if the log does not use the chip or it has no channel mask
+**/
+bool vgm_set_mute(sVGMFile* vgm, const char* chip, uint32_t mask);
+
+/* Mute every channel of a chip but those set in mask
+**/
+bool vgm_set_solo(sVGMFile* vgm, const char* chip, uint32_t mask);
 
 void vgm_free(sVGMFile* vgm);
 
-void vgm_render(sVGMFile* vgm, int16_t* out, uint32_t samples);
+/* Render up to samples into out, returns how many were produced. Fewer than
+** asked for means the log finished, the rest of out is cleared
+**/
+uint32_t vgm_render(sVGMFile* vgm, int16_t* out, uint32_t samples);
@@ -0,0 +1,218 @@
+/*
+ * Generates the tables of the OPL3 emulator in ym3812.cpp.
+ *
+ * These used to be built by the first OPL3 instance of a process and freed
+ * with the last one. They are now built once at build time and compiled in
+ * as read-only data, using the same arithmetic so the values are bit for bit
+ * the ones the emulator computed at run time on the same compiler and cpu.
+ *
+ * The vibrato table steps through 8 levels of 1024 samples each, only the
+ * 8 levels are stored.
+ *
+ * usage: ym3812_tables <output.inc>
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../ym3812.h"
+
+// same as ym3812.cpp, the tables depend on it
+#if !defined(M_PI)
+#define M_PI	3.141592654
+#endif
+
+static const double tremoloFrequency = 3.7;
+static const int tremoloTableLength = (int)(OPL_SAMPLE_RATE/tremoloFrequency);
+static const int vibratoLevels = 8;
+static const int waveLength = 1024;
+
+#define MIN_DB				(-120.0)
+#define DB_TABLE_RES		(4.0)
+#define DB_TABLE_SIZE		(int)(-MIN_DB * DB_TABLE_RES)
+
+#define ATTACK_MIN			(-5.0)
+#define ATTACK_MAX			(8.0)
+#define ATTACK_RES			(0.03125)
+#define ATTACK_TABLE_SIZE	(int)((ATTACK_MAX - ATTACK_MIN) / ATTACK_RES)
+
+static double vibratoTable[2][vibratoLevels];
+static double tremoloTable[2][tremoloTableLength];
+static double waveforms[8][waveLength];
+static double dbpow[DB_TABLE_SIZE];
+static double attackTable[ATTACK_TABLE_SIZE];
+
+static double calculateIncrement(double begin, double end, double period) {
+	return (end-begin)/OPL_SAMPLE_RATE * (1/period);
+}
+
+static void loadVibratoTable() {
+
+	// According to the YMF262 datasheet, the OPL3 vibrato repetition rate is 6.1 Hz.
+	// According to the YMF278B manual, it is 6.0 Hz. 
+	// The information that the vibrato table has 8 levels standing 1024 samples each
+	// was taken from the emulator by Jarek Burczynski and Tatsuyuki Satoh,
+	// with a frequency of 6,06689453125 Hz, what  makes sense with the difference 
+	// in the information on the datasheets.
+	
+	const double semitone = pow(2.0,1/12.0);
+	// A cent is 1/100 of a semitone:
+	const double cent = pow(semitone, 1/100.0);
+	
+	// When dvb=0, the depth is 7 cents, when it is 1, the depth is 14 cents.
+	const double DVB0 = pow(cent,7.0);
+	const double DVB1 = pow(cent,14.0);        
+	const double levels[2][vibratoLevels] = {
+		{ 1, sqrt(DVB0), DVB0, sqrt(DVB0), 1, 1/sqrt(DVB0), 1/DVB0, 1/sqrt(DVB0) },
+		{ 1, sqrt(DVB1), DVB1, sqrt(DVB1), 1, 1/sqrt(DVB1), 1/DVB1, 1/sqrt(DVB1) },
+	};
+	memcpy(vibratoTable, levels, sizeof(vibratoTable));
+}
+
+static void loadTremoloTable()
+{
+	// The tremolo depth is -1 dB when DAM = 0, and -4.8 dB when DAM = 1.
+	static const double tremoloDepth[] = {-1, -4.8};
+	
+	//  According to the YMF278B manual's OPL3 section graph, 
+	//              the tremolo waveform is not 
+	//   \      /   a sine wave, but a single triangle waveform.
+	//    \    /    Thus, the period to achieve the tremolo depth is T/2, and      
+	//     \  /     the increment in each T/2 section uses a frequency of 2*f.
+	//      \/      Tremolo varies from 0 dB to depth, to 0 dB again, at frequency*2:
+	const double tremoloIncrement[] = {
+		calculateIncrement(tremoloDepth[0],0,1/(2*tremoloFrequency)),
+		calculateIncrement(tremoloDepth[1],0,1/(2*tremoloFrequency))
+	};
+	
+	// This is undocumented. The tremolo starts at the maximum attenuation,
+	// instead of at 0 dB:
+	tremoloTable[0][0] = tremoloDepth[0];
+	tremoloTable[1][0] = tremoloDepth[1];
+	int counter = 0;
+	// The first half of the triangle waveform:
+	while(tremoloTable[0][counter]<0) {
+		counter++;
+		tremoloTable[0][counter] = tremoloTable[0][counter-1] + tremoloIncrement[0];
+		tremoloTable[1][counter] = tremoloTable[1][counter-1] + tremoloIncrement[1];
+	}
+	// The second half of the triangle waveform:
+	while(tremoloTable[0][counter]>tremoloDepth[0] && counter<tremoloTableLength-1) {
+		counter++;
+		tremoloTable[0][counter] = tremoloTable[0][counter-1] - tremoloIncrement[0];
+		tremoloTable[1][counter] = tremoloTable[1][counter-1] - tremoloIncrement[1];
+	}
+}
+
+static void loadWaveforms() {
+	int i;
+	// 1st waveform: sinusoid.
+	double theta = 0, thetaIncrement = 2*M_PI / 1024;
+	
+	for(i=0, theta=0; i<1024; i++, theta += thetaIncrement)
+		waveforms[0][i] = sin(theta);
+	
+	double *sineTable = waveforms[0];
+	// 2nd: first half of a sinusoid.
+	for(i=0; i<512; i++) {
+		waveforms[1][i] = sineTable[i];
+		waveforms[1][512+i] = 0;
+	} 
+	// 3rd: double positive sinusoid.
+	for(i=0; i<512; i++) 
+		waveforms[2][i] = waveforms[2][512+i] = sineTable[i];         
+	// 4th: first and third quarter of double positive sinusoid.
+	for(i=0; i<256; i++) {
+		waveforms[3][i] = waveforms[3][512+i] = sineTable[i];
+		waveforms[3][256+i] = waveforms[3][768+i] = 0;
+	}
+	// 5th: first half with double frequency sinusoid.
+	for(i=0; i<512; i++) {
+		waveforms[4][i] = sineTable[i*2];
+		waveforms[4][512+i] = 0;
+	} 
+	// 6th: first half with double frequency positive sinusoid.
+	for(i=0; i<256; i++) {
+		waveforms[5][i] = waveforms[5][256+i] = sineTable[i*2];
+		waveforms[5][512+i] = waveforms[5][768+i] = 0;
+	}
+	// 7th: square wave
+	for(i=0; i<512; i++) {
+		waveforms[6][i] = 1;
+		waveforms[6][512+i] = -1;
+	}                
+	// 8th: exponential
+	double x;
+	double xIncrement = 1 * 16.0 / 256.0;
+	for(i=0, x=0; i<512; i++, x+=xIncrement) {
+		waveforms[7][i] = pow(2.0,-x);
+		waveforms[7][1023-i] = -pow(2.0,-(x + 1/16.0));
+	}
+}
+
+static void loaddBPowTable()
+{
+	for (int i = 0; i < DB_TABLE_SIZE; ++i)
+	{
+		dbpow[i] = pow(10.0, -(i / DB_TABLE_RES) / 10.0);
+	}
+}
+
+static void loadAttackTable()
+{
+	for (int i = 0; i < ATTACK_TABLE_SIZE; ++i)
+	{
+		attackTable[i] = -pow(2.0, ATTACK_MIN + i * ATTACK_RES);
+	}
+}
+
+// %.17g reads back as the same double
+static void writeTable(FILE *fd, const char *decl, const double *table, int rows, int length)
+{
+	fprintf(fd, "%s = {\n", decl);
+	for (int row = 0; row < rows; ++row)
+	{
+		fprintf(fd, rows > 1 ? "\t{" : "");
+		for (int i = 0; i < length; ++i)
+		{
+			fprintf(fd, "%s%.17g,", (i % 8) ? " " : "\n\t", table[row * length + i]);
+		}
+		fprintf(fd, rows > 1 ? "\n\t},\n" : "\n");
+	}
+	fprintf(fd, "};\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: ym3812_tables <output.inc>\n");
+		return 1;
+	}
+
+	loadVibratoTable();
+	loadTremoloTable();
+	loadWaveforms();
+	loaddBPowTable();
+	loadAttackTable();
+
+	FILE *fd = fopen(argv[1], "w");
+	if (!fd)
+	{
+		fprintf(stderr, "unable to write [%s]\n", argv[1]);
+		return 1;
+	}
+	char decl[128];
+	fprintf(fd, "// generated by gen/ym3812_tables.cpp, do not edit\n\n");
+	writeTable(fd, "const double OPL3DataStruct::vibratoTable[2][8]", vibratoTable[0], 2, vibratoLevels);
+	snprintf(decl, sizeof(decl), "const double OPL3DataStruct::tremoloTable[2][%d]", tremoloTableLength);
+	writeTable(fd, decl, tremoloTable[0], 2, tremoloTableLength);
+	writeTable(fd, "const double OperatorDataStruct::waveforms[8][1024]", waveforms[0], 8, waveLength);
+	snprintf(decl, sizeof(decl), "const double OperatorDataStruct::dbpow[%d]", DB_TABLE_SIZE);
+	writeTable(fd, decl, dbpow, 1, DB_TABLE_SIZE);
+	snprintf(decl, sizeof(decl), "const double OperatorDataStruct::attackTable[%d]", ATTACK_TABLE_SIZE);
+	writeTable(fd, decl, attackTable, 1, ATTACK_TABLE_SIZE);
+	fclose(fd);
+	return 0;
+}
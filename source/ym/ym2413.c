@@ -26,11 +26,15 @@ to do:
 */
 
 /** EkeEke (2011): removed multiple chips support, cleaned code & added FM board interface for Genesis Plus GX **/
+/** chip state is per instance again, instruments are decoded once and channels that are off are skipped **/
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <math.h>
 
+#include "ym2413.h"
+
 typedef uint32_t UINT32;
 typedef uint8_t UINT8;
 typedef int32_t INT32;
@@ -135,9 +139,33 @@ typedef struct
   UINT8   sus;          /* sus on/off (release speed in percussive mode)  */
 } YM2413_OPLL_CH;
 
+/* operator parameters of an instrument, decoded once from its 8 bytes */
+typedef struct
+{
+  UINT32  ar;       /* attack rate: AR<<2           */
+  UINT32  dr;       /* decay rate:  DR<<2           */
+  UINT32  rr;       /* release rate:RR<<2           */
+  UINT32  sl;       /* sustain level: sl_tab[SL]    */
+  UINT32  TL;       /* modulator only, the carrier TL is the channel volume */
+  UINT32  AMmask;
+  UINT8   KSR;
+  UINT8   ksl;
+  UINT8   mul;
+  UINT8   eg_type;
+  UINT8   vib;
+  UINT8   fb_shift; /* modulator only */
+  unsigned int wavetable;
+} YM2413_OPLL_PARAM;
+
+typedef struct
+{
+  YM2413_OPLL_PARAM op[2];
+} YM2413_OPLL_PATCH;
+
 /* chip state */
-typedef struct {
-    YM2413_OPLL_CH P_CH[9];   /* OPLL chips have 9 channels */
+struct ym2413_s
+{
+  YM2413_OPLL_CH P_CH[9];     /* OPLL chips have 9 channels */
   UINT8  instvol_r[9];        /* instrument/volume (or volume/volume in percussive mode)  */
 
   UINT32  eg_cnt;             /* global envelope generator counter  */
@@ -146,6 +174,7 @@ typedef struct {
   UINT32  eg_timer_overflow;  /* envelope generator timer overlfows every 1 sample (on real chip) */
 
   UINT8  rhythm;              /* Rhythm mode  */
+  UINT32 mute;                /* channels that are not calculated, bit n for channel n */
 
   /* LFO */
   UINT32  lfo_am_cnt;
@@ -165,16 +194,16 @@ typedef struct {
   16 -bass drum settings
   17,18 - other percussion instruments
 */
-  UINT8 inst_tab[19][8];
+  YM2413_OPLL_PATCH patch[19];
+  UINT8 user_inst[8];         /* user instrument registers 0x00-0x07 */
 
-  UINT32  fn_tab[1024];     /* fnumber->increment counter  */
+  UINT32  LFO_AM;
+  INT32   LFO_PM;
 
   UINT8 address;          /* address register */
   UINT8 status;          /* status flag       */
 
-  double clock;         /* master clock  (Hz) */
-  int rate;            /* sampling rate (Hz)  */
-} YM2413;
+};
 
 /* key scale level */
 /* table is 3dB/octave, DV converts this into 6dB/octave */
@@ -472,7 +501,7 @@ static const INT8 lfo_pm_table[8*8] = {
  - waveform DC and DM select are 100% correct
 */
 
-static unsigned char table[19][8] = {
+static const unsigned char table[19][8] = {
 /* MULT  MULT modTL DcDmFb AR/DR AR/DR SL/RR SL/RR */
 /*   0     1     2     3     4     5     6    7    */
   {0x49, 0x4c, 0x4c, 0x12, 0x00, 0x00, 0x00, 0x00 },  /* 0 */
@@ -512,47 +541,45 @@ static unsigned char table[19][8] = {
   {0x05, 0x01, 0x00, 0x00, 0xf8, 0xba, 0x49, 0x55 },/* TOM(multi,env verified), TOP CYM(multi verified, env verified) */
 };
 
-static signed int output[2];
+/* instrument ROM, decoded by YM2413Init */
+static YM2413_OPLL_PATCH rom_patch[19];
 
-static UINT32  LFO_AM;
-static INT32  LFO_PM;
-
-/* emulated chip */
-static YM2413 ym2413;
+/* fnumber->increment counter, the chip always runs at its own rate */
+static UINT32 fn_tab[1024];
 
 /* advance LFO to next sample */
-static INLINE void advance_lfo(void)
+static INLINE void advance_lfo(YM2413 *chip)
 {
   /* LFO */
-  ym2413.lfo_am_cnt += ym2413.lfo_am_inc;
-  if (ym2413.lfo_am_cnt >= (LFO_AM_TAB_ELEMENTS<<LFO_SH) )  /* lfo_am_table is 210 elements long */
-    ym2413.lfo_am_cnt -= (LFO_AM_TAB_ELEMENTS<<LFO_SH);
+  chip->lfo_am_cnt += chip->lfo_am_inc;
+  if (chip->lfo_am_cnt >= (LFO_AM_TAB_ELEMENTS<<LFO_SH) )  /* lfo_am_table is 210 elements long */
+    chip->lfo_am_cnt -= (LFO_AM_TAB_ELEMENTS<<LFO_SH);
 
-  LFO_AM = lfo_am_table[ ym2413.lfo_am_cnt >> LFO_SH ] >> 1;
+  chip->LFO_AM = lfo_am_table[ chip->lfo_am_cnt >> LFO_SH ] >> 1;
 
-  ym2413.lfo_pm_cnt += ym2413.lfo_pm_inc;
-  LFO_PM = (ym2413.lfo_pm_cnt>>LFO_SH) & 7;
+  chip->lfo_pm_cnt += chip->lfo_pm_inc;
+  chip->LFO_PM = (chip->lfo_pm_cnt>>LFO_SH) & 7;
 }
 
-/* advance to next sample */
-static INLINE void advance(void)
+/* advance to next sample, slots missing from live are off */
+static INLINE void advance(YM2413 *chip, UINT32 live)
 {
   YM2413_OPLL_CH *CH;
   YM2413_OPLL_SLOT *op;
   unsigned int i;
 
   /* Envelope Generator */
-  ym2413.eg_timer += ym2413.eg_timer_add;
+  chip->eg_timer += chip->eg_timer_add;
 
-  while (ym2413.eg_timer >= ym2413.eg_timer_overflow)
+  while (chip->eg_timer >= chip->eg_timer_overflow)
   {
-    ym2413.eg_timer -= ym2413.eg_timer_overflow;
+    chip->eg_timer -= chip->eg_timer_overflow;
 
-    ym2413.eg_cnt++;
+    chip->eg_cnt++;
 
     for (i=0; i<9*2; i++)
     {
-      CH  = &ym2413.P_CH[i>>1];
+      CH  = &chip->P_CH[i>>1];
 
       op  = &CH->SLOT[i&1];
 
@@ -563,9 +590,9 @@ static INLINE void advance(void)
         /*when CARRIER envelope gets down to zero level,
         **  phases in BOTH opearators are reset (at the same time ?)
         */
-          if ( !(ym2413.eg_cnt & ((1<<op->eg_sh_dp)-1) ) )
+          if ( !(chip->eg_cnt & ((1<<op->eg_sh_dp)-1) ) )
           {
-            op->volume += eg_inc[op->eg_sel_dp + ((ym2413.eg_cnt>>op->eg_sh_dp)&7)];
+            op->volume += eg_inc[op->eg_sel_dp + ((chip->eg_cnt>>op->eg_sh_dp)&7)];
 
             if ( op->volume >= MAX_ATT_INDEX )
             {
@@ -578,10 +605,10 @@ static INLINE void advance(void)
           break;
 
         case EG_ATT:    /* attack phase */
-          if ( !(ym2413.eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
+          if ( !(chip->eg_cnt & ((1<<op->eg_sh_ar)-1) ) )
           {
             op->volume += (~op->volume *
-                                           (eg_inc[op->eg_sel_ar + ((ym2413.eg_cnt>>op->eg_sh_ar)&7)])
+                                           (eg_inc[op->eg_sel_ar + ((chip->eg_cnt>>op->eg_sh_ar)&7)])
                                           ) >>2;
 
             if (op->volume <= MIN_ATT_INDEX)
@@ -593,9 +620,9 @@ static INLINE void advance(void)
           break;
 
         case EG_DEC:  /* decay phase */
-          if ( !(ym2413.eg_cnt & ((1<<op->eg_sh_dr)-1) ) )
+          if ( !(chip->eg_cnt & ((1<<op->eg_sh_dr)-1) ) )
           {
-            op->volume += eg_inc[op->eg_sel_dr + ((ym2413.eg_cnt>>op->eg_sh_dr)&7)];
+            op->volume += eg_inc[op->eg_sel_dr + ((chip->eg_cnt>>op->eg_sh_dr)&7)];
 
             if ( op->volume >= op->sl )
               op->state = EG_SUS;
@@ -614,9 +641,9 @@ static INLINE void advance(void)
           else        /* percussive mode */
           {
             /* during sustain phase chip adds Release Rate (in percussive mode) */
-            if ( !(ym2413.eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
+            if ( !(chip->eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
             {
-              op->volume += eg_inc[op->eg_sel_rr + ((ym2413.eg_cnt>>op->eg_sh_rr)&7)];
+              op->volume += eg_inc[op->eg_sel_rr + ((chip->eg_cnt>>op->eg_sh_rr)&7)];
 
               if ( op->volume >= MAX_ATT_INDEX )
                 op->volume = MAX_ATT_INDEX;
@@ -643,7 +670,7 @@ static INLINE void advance(void)
           7: 14(r),  15(a)
           8: 16(r),  17(a)
         */
-          if ( (i&1) || ((ym2413.rhythm&0x20) && (i>=12)) )/* exclude modulators */
+          if ( (i&1) || ((chip->rhythm&0x20) && (i>=12)) )/* exclude modulators */
           {
             if(op->eg_type)    /* non-percussive mode (sustained tone) */
             /*this is correct: use RR when SUS = OFF*/
@@ -651,9 +678,9 @@ static INLINE void advance(void)
             {
               if (CH->sus)
               {
-                if ( !(ym2413.eg_cnt & ((1<<op->eg_sh_rs)-1) ) )
+                if ( !(chip->eg_cnt & ((1<<op->eg_sh_rs)-1) ) )
                 {
-                  op->volume += eg_inc[op->eg_sel_rs + ((ym2413.eg_cnt>>op->eg_sh_rs)&7)];
+                  op->volume += eg_inc[op->eg_sel_rs + ((chip->eg_cnt>>op->eg_sh_rs)&7)];
                   if ( op->volume >= MAX_ATT_INDEX )
                   {
                     op->volume = MAX_ATT_INDEX;
@@ -663,9 +690,9 @@ static INLINE void advance(void)
               }
               else
               {
-                if ( !(ym2413.eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
+                if ( !(chip->eg_cnt & ((1<<op->eg_sh_rr)-1) ) )
                 {
-                  op->volume += eg_inc[op->eg_sel_rr + ((ym2413.eg_cnt>>op->eg_sh_rr)&7)];
+                  op->volume += eg_inc[op->eg_sel_rr + ((chip->eg_cnt>>op->eg_sh_rr)&7)];
                   if ( op->volume >= MAX_ATT_INDEX )
                   {
                     op->volume = MAX_ATT_INDEX;
@@ -676,9 +703,9 @@ static INLINE void advance(void)
             }
             else        /* percussive mode */
             {
-              if ( !(ym2413.eg_cnt & ((1<<op->eg_sh_rs)-1) ) )
+              if ( !(chip->eg_cnt & ((1<<op->eg_sh_rs)-1) ) )
               {
-                op->volume += eg_inc[op->eg_sel_rs + ((ym2413.eg_cnt>>op->eg_sh_rs)&7)];
+                op->volume += eg_inc[op->eg_sel_rs + ((chip->eg_cnt>>op->eg_sh_rs)&7)];
                 if ( op->volume >= MAX_ATT_INDEX )
                 {
                   op->volume = MAX_ATT_INDEX;
@@ -697,9 +724,14 @@ static INLINE void advance(void)
 
   for (i=0; i<9*2; i++)
   {
-    CH  = &ym2413.P_CH[i/2];
+    CH  = &chip->P_CH[i/2];
     op  = &CH->SLOT[i&1];
 
+    /* key on restarts the phase of a slot that is off, channels 6-8 keep
+       running as the rhythm section reads their phases */
+    if ((i < 12) && !(live & (1<<i)))
+      continue;
+
     /* Phase Generator */
     if(op->vib)
     {
@@ -707,13 +739,13 @@ static INLINE void advance(void)
 
       unsigned int fnum_lfo   = 8*((CH->block_fnum&0x01c0) >> 6);
       unsigned int block_fnum = CH->block_fnum * 2;
-      signed int lfo_fn_table_index_offset = lfo_pm_table[LFO_PM + fnum_lfo ];
+      signed int lfo_fn_table_index_offset = lfo_pm_table[chip->LFO_PM + fnum_lfo ];
 
       if (lfo_fn_table_index_offset)  /* LFO phase modulation active */
       {
         block_fnum += lfo_fn_table_index_offset;
         block = (block_fnum&0x1c00) >> 10;
-        op->phase += (ym2413.fn_tab[block_fnum&0x03ff] >> (7-block)) * op->mul;
+        op->phase += (fn_tab[block_fnum&0x03ff] >> (7-block)) * op->mul;
       }
       else  /* LFO phase modulation  = zero */
       {
@@ -737,9 +769,9 @@ static INLINE void advance(void)
   *  Simply use bit 22 as the noise output.
   */
 
-  ym2413.noise_p += ym2413.noise_f;
-  i = ym2413.noise_p >> FREQ_SH;    /* number of events (shifts of the shift register) */
-  ym2413.noise_p &= FREQ_MASK;
+  chip->noise_p += chip->noise_f;
+  i = chip->noise_p >> FREQ_SH;    /* number of events (shifts of the shift register) */
+  chip->noise_p &= FREQ_MASK;
   while (i)
   {
     /*
@@ -756,8 +788,8 @@ static INLINE void advance(void)
       what is real state of the noise_rng after the reset.
     */
 
-    if (ym2413.noise_rng & 1) ym2413.noise_rng ^= 0x800302;
-    ym2413.noise_rng >>= 1;
+    if (chip->noise_rng & 1) chip->noise_rng ^= 0x800302;
+    chip->noise_rng >>= 1;
 
     i--;
   }
@@ -782,10 +814,10 @@ static INLINE signed int op_calc1(UINT32 phase, unsigned int env, signed int pm,
   return tl_tab[p];
 }
 
-#define volume_calc(OP) ((OP)->TLL + ((UINT32)(OP)->volume) + (LFO_AM & (OP)->AMmask))
+#define volume_calc(OP) ((OP)->TLL + ((UINT32)(OP)->volume) + (chip->LFO_AM & (OP)->AMmask))
 
-/* calculate output */
-static INLINE void chan_calc( YM2413_OPLL_CH *CH )
+/* calculate output of a melody channel */
+static INLINE signed int chan_calc(YM2413 *chip, YM2413_OPLL_CH *CH )
 {
   YM2413_OPLL_SLOT *SLOT;
   unsigned int env;
@@ -815,8 +847,9 @@ static INLINE void chan_calc( YM2413_OPLL_CH *CH )
   env = volume_calc(SLOT);
   if( env < ENV_QUIET )
   {
-    output[0] += op_calc(SLOT->phase, env, phase_modulation, SLOT->wavetable);
+    return op_calc(SLOT->phase, env, phase_modulation, SLOT->wavetable);
   }
+  return 0;
 }
 
 /*
@@ -854,11 +887,15 @@ number   number    BLK/FNUM2 FNUM    Drum  Hat   Drum  Tom  Cymbal
 
 */
 
-/* calculate rhythm */
+/* calculate rhythm output */
 
-static INLINE void rhythm_calc( YM2413_OPLL_CH *CH, unsigned int noise )
+/* a drum on a muted channel reads as quiet so it is not calculated,
+   the bass drum is channel 6, high hat and snare 7, tom and cymbal 8 */
+static INLINE signed int rhythm_calc(YM2413 *chip, YM2413_OPLL_CH *CH, unsigned int noise )
 {
+  const UINT32 mute = chip->mute;
   YM2413_OPLL_SLOT *SLOT;
+  signed int output = 0;
   signed int out;
   unsigned int env;
   signed int phase_modulation;  /* phase modulation input (SLOT 2) */
@@ -874,7 +911,7 @@ static INLINE void rhythm_calc( YM2413_OPLL_CH *CH, unsigned int noise )
 
   /* SLOT 1 */
   SLOT = &CH[6].SLOT[SLOT1];
-  env = volume_calc(SLOT);
+  env = (mute & 0x40) ? ENV_QUIET : volume_calc(SLOT);
 
   out = SLOT->op1_out[0] + SLOT->op1_out[1];
   SLOT->op1_out[0] = SLOT->op1_out[1];
@@ -891,9 +928,9 @@ static INLINE void rhythm_calc( YM2413_OPLL_CH *CH, unsigned int noise )
 
   /* SLOT 2 */
   SLOT++;
-  env = volume_calc(SLOT);
+  env = (mute & 0x40) ? ENV_QUIET : volume_calc(SLOT);
   if( env < ENV_QUIET )
-    output[1] += op_calc(SLOT->phase, env, phase_modulation, SLOT->wavetable);
+    output += op_calc(SLOT->phase, env, phase_modulation, SLOT->wavetable);
 
 
   /* Phase generation is based on: */
@@ -914,7 +951,7 @@ static INLINE void rhythm_calc( YM2413_OPLL_CH *CH, unsigned int noise )
   */
 
   /* High Hat (verified on real YM3812) */
-  env = volume_calc(&CH[7].SLOT[SLOT1]);
+  env = (mute & 0x80) ? ENV_QUIET : volume_calc(&CH[7].SLOT[SLOT1]);
   if( env < ENV_QUIET )
   {
 
@@ -961,11 +998,11 @@ static INLINE void rhythm_calc( YM2413_OPLL_CH *CH, unsigned int noise )
         phase = 0xd0>>2;
     }
 
-    output[1] += op_calc(phase<<FREQ_SH, env, 0, CH[7].SLOT[SLOT1].wavetable);
+    output += op_calc(phase<<FREQ_SH, env, 0, CH[7].SLOT[SLOT1].wavetable);
   }
 
   /* Snare Drum (verified on real YM3812) */
-  env = volume_calc(&CH[7].SLOT[SLOT2]);
+  env = (mute & 0x80) ? ENV_QUIET : volume_calc(&CH[7].SLOT[SLOT2]);
   if( env < ENV_QUIET )
   {
     /* base frequency derived from operator 1 in channel 7 */
@@ -982,16 +1019,16 @@ static INLINE void rhythm_calc( YM2413_OPLL_CH *CH, unsigned int noise )
     if (noise)
       phase ^= 0x100;
 
-    output[1] += op_calc(phase<<FREQ_SH, env, 0, CH[7].SLOT[SLOT2].wavetable);
+    output += op_calc(phase<<FREQ_SH, env, 0, CH[7].SLOT[SLOT2].wavetable);
   }
 
   /* Tom Tom (verified on real YM3812) */
-  env = volume_calc(&CH[8].SLOT[SLOT1]);
+  env = (mute & 0x100) ? ENV_QUIET : volume_calc(&CH[8].SLOT[SLOT1]);
   if( env < ENV_QUIET )
-    output[1] += op_calc(CH[8].SLOT[SLOT1].phase, env, 0, CH[8].SLOT[SLOT1].wavetable);
+    output += op_calc(CH[8].SLOT[SLOT1].phase, env, 0, CH[8].SLOT[SLOT1].wavetable);
 
   /* Top Cymbal (verified on real YM2413) */
-  env = volume_calc(&CH[8].SLOT[SLOT2]);
+  env = (mute & 0x100) ? ENV_QUIET : volume_calc(&CH[8].SLOT[SLOT2]);
   if( env < ENV_QUIET )
   {
     /* base frequency derived from operator 1 in channel 7 */
@@ -1015,8 +1052,10 @@ static INLINE void rhythm_calc( YM2413_OPLL_CH *CH, unsigned int noise )
     if (res2)
       phase = 0x300;
 
-    output[1] += op_calc(phase<<FREQ_SH, env, 0, CH[8].SLOT[SLOT2].wavetable);
+    output += op_calc(phase<<FREQ_SH, env, 0, CH[8].SLOT[SLOT2].wavetable);
   }
+
+  return output;
 }
 
 
@@ -1084,36 +1123,34 @@ static int init_tables(void)
       sin_tab[1*SIN_LEN+i] = sin_tab[i];
   }
 
+  /* make fnumber -> increment counter table, freqbase is 1.0 */
+  for( i = 0 ; i < 1024; i++ )
+  {
+    /* OPLL (YM2413) phase increment counter = 18bit */
+    fn_tab[i] = (UINT32)( (double)i * 64 * (1<<(FREQ_SH-10)) ); /* -10 because chip works with 10.10 fixed point, while we use 16.16 */
+  }
+
   return 1;
 }
 
 
-static void OPLL_initalize(void)
+static void OPLL_initalize(YM2413 *chip)
 {
-  int i;
-
   /* YM2413 always running at original frequency */
   double freqbase = 1.0;
 
-  /* make fnumber -> increment counter table */
-  for( i = 0 ; i < 1024; i++ )
-  {
-    /* OPLL (YM2413) phase increment counter = 18bit */
-    ym2413.fn_tab[i] = (UINT32)( (double)i * 64 * freqbase * (1<<(FREQ_SH-10)) ); /* -10 because chip works with 10.10 fixed point, while we use 16.16 */
-  }
-
   /* Amplitude modulation: 27 output levels (triangle waveform); 1 level takes one of: 192, 256 or 448 samples */
   /* One entry from LFO_AM_TABLE lasts for 64 samples */
-  ym2413.lfo_am_inc = (1.0 / 64.0 ) * (1<<LFO_SH) * freqbase;
+  chip->lfo_am_inc = (1.0 / 64.0 ) * (1<<LFO_SH) * freqbase;
 
   /* Vibrato: 8 output levels (triangle waveform); 1 level takes 1024 samples */
-  ym2413.lfo_pm_inc = (1.0 / 1024.0) * (1<<LFO_SH) * freqbase;
+  chip->lfo_pm_inc = (1.0 / 1024.0) * (1<<LFO_SH) * freqbase;
 
   /* Noise generator: a step takes 1 sample */
-  ym2413.noise_f = (1.0 / 1.0) * (1<<FREQ_SH) * freqbase;
+  chip->noise_f = (1.0 / 1.0) * (1<<FREQ_SH) * freqbase;
 
-  ym2413.eg_timer_add  = (1<<EG_SH) * freqbase;
-  ym2413.eg_timer_overflow = ( 1 ) * (1<<EG_SH);
+  chip->eg_timer_add  = (1<<EG_SH) * freqbase;
+  chip->eg_timer_overflow = ( 1 ) * (1<<EG_SH);
 }
 
 static INLINE void KEY_ON(YM2413_OPLL_SLOT *SLOT, UINT32 key_set)
@@ -1142,6 +1179,25 @@ static INLINE void KEY_OFF(YM2413_OPLL_SLOT *SLOT, UINT32 key_clr)
   }
 }
 
+/* calculate the attack, decay and release rates for the current ksr */
+static INLINE void CALC_RATES(YM2413_OPLL_SLOT *SLOT)
+{
+  if ((SLOT->ar + SLOT->ksr) < 16+62)
+  {
+    SLOT->eg_sh_ar  = eg_rate_shift [SLOT->ar + SLOT->ksr ];
+    SLOT->eg_sel_ar = eg_rate_select[SLOT->ar + SLOT->ksr ];
+  }
+  else
+  {
+    SLOT->eg_sh_ar  = 0;
+    SLOT->eg_sel_ar = 13*RATE_STEPS;
+  }
+  SLOT->eg_sh_dr  = eg_rate_shift [SLOT->dr + SLOT->ksr ];
+  SLOT->eg_sel_dr = eg_rate_select[SLOT->dr + SLOT->ksr ];
+  SLOT->eg_sh_rr  = eg_rate_shift [SLOT->rr + SLOT->ksr ];
+  SLOT->eg_sel_rr = eg_rate_select[SLOT->rr + SLOT->ksr ];
+}
+
 /* update phase increment counter of operator (also update the EG rates if necessary) */
 static INLINE void CALC_FCSLOT(YM2413_OPLL_CH *CH,YM2413_OPLL_SLOT *SLOT)
 {
@@ -1158,21 +1214,7 @@ static INLINE void CALC_FCSLOT(YM2413_OPLL_CH *CH,YM2413_OPLL_SLOT *SLOT)
     SLOT->ksr = ksr;
 
     /* calculate envelope generator rates */
-    if ((SLOT->ar + SLOT->ksr) < 16+62)
-    {
-      SLOT->eg_sh_ar  = eg_rate_shift [SLOT->ar + SLOT->ksr ];
-      SLOT->eg_sel_ar = eg_rate_select[SLOT->ar + SLOT->ksr ];
-    }
-    else
-    {
-      SLOT->eg_sh_ar  = 0;
-      SLOT->eg_sel_ar = 13*RATE_STEPS;
-    }
-    SLOT->eg_sh_dr  = eg_rate_shift [SLOT->dr + SLOT->ksr ];
-    SLOT->eg_sel_dr = eg_rate_select[SLOT->dr + SLOT->ksr ];
-    SLOT->eg_sh_rr  = eg_rate_shift [SLOT->rr + SLOT->ksr ];
-    SLOT->eg_sel_rr = eg_rate_select[SLOT->rr + SLOT->ksr ];
-
+    CALC_RATES(SLOT);
   }
 
   if (CH->sus)
@@ -1188,195 +1230,109 @@ static INLINE void CALC_FCSLOT(YM2413_OPLL_CH *CH,YM2413_OPLL_SLOT *SLOT)
   SLOT->eg_sel_dp = eg_rate_select[SLOT_dp + SLOT->ksr ];
 }
 
-/* set multi,am,vib,EG-TYP,KSR,mul */
-static INLINE void set_mul(int slot,int v)
-{
-  YM2413_OPLL_CH   *CH   = &ym2413.P_CH[slot/2];
-  YM2413_OPLL_SLOT *SLOT = &CH->SLOT[slot&1];
-
-  SLOT->mul     = mul_tab[v&0x0f];
-  SLOT->KSR     = (v&0x10) ? 0 : 2;
-  SLOT->eg_type = (v&0x20);
-  SLOT->vib     = (v&0x40);
-  SLOT->AMmask  = (v&0x80) ? ~0 : 0;
-  CALC_FCSLOT(CH,SLOT);
-}
-
-/* set ksl, tl */
-static INLINE void set_ksl_tl(int chan,int v)
-{
-  YM2413_OPLL_CH   *CH   = &ym2413.P_CH[chan];
-  /* modulator */
-  YM2413_OPLL_SLOT *SLOT = &CH->SLOT[SLOT1];
-
-  int ksl = v>>6; /* 0 / 1.5 / 3.0 / 6.0 dB/OCT */
-
-  SLOT->ksl = ksl ? 3-ksl : 31;
-  SLOT->TL  = (v&0x3f)<<(ENV_BITS-2-7); /* 7 bits TL (bit 6 = always 0) */
-  SLOT->TLL = SLOT->TL + (CH->ksl_base>>SLOT->ksl);
-}
-
-/* set ksl , waveforms, feedback */
-static INLINE void set_ksl_wave_fb(int chan,int v)
+/* decode the 8 instrument bytes into operator parameters */
+static void decode_patch(YM2413_OPLL_PATCH *patch, const UINT8 *inst)
 {
-  YM2413_OPLL_CH   *CH   = &ym2413.P_CH[chan];
-  /* modulator */
-  YM2413_OPLL_SLOT *SLOT = &CH->SLOT[SLOT1];
-  SLOT->wavetable = ((v&0x08)>>3)*SIN_LEN;
-  SLOT->fb_shift  = (v&7) ? (v&7) + 8 : 0;
-
-  /*carrier*/
-  SLOT = &CH->SLOT[SLOT2];
-  SLOT->wavetable = ((v&0x10)>>4)*SIN_LEN;
-  v >>= 6; /* 0 / 1.5 / 3.0 / 6.0 dB/OCT */
-  SLOT->ksl = v ? 3-v : 31;
-  SLOT->TLL = SLOT->TL + (CH->ksl_base>>SLOT->ksl);
-}
+  int s, v;
 
-/* set attack rate & decay rate  */
-static INLINE void set_ar_dr(int slot,int v)
-{
-  YM2413_OPLL_CH   *CH   = &ym2413.P_CH[slot/2];
-  YM2413_OPLL_SLOT *SLOT = &CH->SLOT[slot&1];
+  memset(patch, 0, sizeof(YM2413_OPLL_PATCH));
 
-  SLOT->ar = (v>>4)  ? 16 + ((v>>4)  <<2) : 0;
-
-  if ((SLOT->ar + SLOT->ksr) < 16+62)
-  {
-    SLOT->eg_sh_ar  = eg_rate_shift [SLOT->ar + SLOT->ksr ];
-    SLOT->eg_sel_ar = eg_rate_select[SLOT->ar + SLOT->ksr ];
-  }
-  else
+  for (s=0; s<2; s++)
   {
-    SLOT->eg_sh_ar  = 0;
-    SLOT->eg_sel_ar = 13*RATE_STEPS;
+    YM2413_OPLL_PARAM *op = &patch->op[s];
+
+    /* multi,am,vib,EG-TYP,KSR,mul */
+    v = inst[0+s];
+    op->mul     = mul_tab[v&0x0f];
+    op->KSR     = (v&0x10) ? 0 : 2;
+    op->eg_type = (v&0x20);
+    op->vib     = (v&0x40);
+    op->AMmask  = (v&0x80) ? ~0 : 0;
+
+    /* attack rate & decay rate */
+    v = inst[4+s];
+    op->ar = (v>>4)   ? 16 + ((v>>4)  <<2) : 0;
+    op->dr = (v&0x0f) ? 16 + ((v&0x0f)<<2) : 0;
+
+    /* sustain level & release rate */
+    v = inst[6+s];
+    op->sl = sl_tab[ (v>>4)&0xF ];
+    op->rr = (v&0x0f) ? 16 + ((v&0x0f)<<2) : 0;
   }
 
-  SLOT->dr    = (v&0x0f)? 16 + ((v&0x0f)<<2) : 0;
-  SLOT->eg_sh_dr  = eg_rate_shift [SLOT->dr + SLOT->ksr ];
-  SLOT->eg_sel_dr = eg_rate_select[SLOT->dr + SLOT->ksr ];
+  /* modulator ksl, tl */
+  v = inst[2];
+  patch->op[SLOT1].ksl = (v>>6) ? 3-(v>>6) : 31; /* 0 / 1.5 / 3.0 / 6.0 dB/OCT */
+  patch->op[SLOT1].TL  = (v&0x3f)<<(ENV_BITS-2-7); /* 7 bits TL (bit 6 = always 0) */
+
+  /* carrier ksl, waveforms, feedback */
+  v = inst[3];
+  patch->op[SLOT1].wavetable = ((v&0x08)>>3)*SIN_LEN;
+  patch->op[SLOT1].fb_shift  = (v&7) ? (v&7) + 8 : 0;
+  patch->op[SLOT2].wavetable = ((v&0x10)>>4)*SIN_LEN;
+  patch->op[SLOT2].ksl       = (v>>6) ? 3-(v>>6) : 31;
 }
 
-/* set sustain level & release rate */
-static INLINE void set_sl_rr(int slot, int v)
+/* copy decoded instrument parameters into both operators of a channel */
+static void load_instrument(YM2413 *chip, UINT32 chan, const YM2413_OPLL_PATCH *patch)
 {
-  YM2413_OPLL_CH   *CH   = &ym2413.P_CH[slot/2];
-  YM2413_OPLL_SLOT *SLOT = &CH->SLOT[slot&1];
+  YM2413_OPLL_CH *CH = &chip->P_CH[chan];
+  int s;
 
-  SLOT->sl  = sl_tab[ (v>>4)&0xF ];
-
-  SLOT->rr  = (v&0x0f)? 16 + ((v&0x0f)<<2) : 0;
-  SLOT->eg_sh_rr  = eg_rate_shift [SLOT->rr + SLOT->ksr ];
-  SLOT->eg_sel_rr = eg_rate_select[SLOT->rr + SLOT->ksr ];
-}
+  for (s=0; s<2; s++)
+  {
+    YM2413_OPLL_SLOT *SLOT = &CH->SLOT[s];
+    const YM2413_OPLL_PARAM *op = &patch->op[s];
+
+    SLOT->mul       = op->mul;
+    SLOT->KSR       = op->KSR;
+    SLOT->eg_type   = op->eg_type;
+    SLOT->vib       = op->vib;
+    SLOT->AMmask    = op->AMmask;
+    SLOT->ar        = op->ar;
+    SLOT->dr        = op->dr;
+    SLOT->sl        = op->sl;
+    SLOT->rr        = op->rr;
+    SLOT->ksl       = op->ksl;
+    SLOT->wavetable = op->wavetable;
+
+    /* the carrier TL is set by the volume register */
+    if (s == SLOT1)
+    {
+      SLOT->TL       = op->TL;
+      SLOT->fb_shift = op->fb_shift;
+    }
+    SLOT->TLL = SLOT->TL + (CH->ksl_base>>SLOT->ksl);
 
-static void load_instrument(UINT32 chan, UINT32 slot, UINT8* inst )
-{
-  set_mul(slot, inst[0]);
-  set_mul(slot+1, inst[1]);
-  set_ksl_tl(chan, inst[2]);
-  set_ksl_wave_fb(chan, inst[3]);
-  set_ar_dr(slot,   inst[4]);
-  set_ar_dr(slot+1, inst[5]);
-  set_sl_rr(slot,   inst[6]);
-  set_sl_rr(slot+1, inst[7]);
+    SLOT->ksr = CH->kcode >> SLOT->KSR;
+    CALC_RATES(SLOT);
+    CALC_FCSLOT(CH,SLOT);
+  }
 }
 
-static void update_instrument_zero(UINT8 r)
+/* the user instrument is decoded again on each write to it */
+static void update_instrument_zero(YM2413 *chip, UINT8 r, UINT8 v)
 {
-  UINT8* inst = &ym2413.inst_tab[0][0]; /* point to user instrument */
   UINT32 chan;
 
   UINT32 chan_max = 9;
-  if (ym2413.rhythm & 0x20)
+  if (chip->rhythm & 0x20)
     chan_max=6;
 
-  switch(r&7)
-  {
-    case 0:
-      for (chan=0; chan<chan_max; chan++)
-      {
-        if ((ym2413.instvol_r[chan]&0xf0)==0)
-        {
-          set_mul(chan*2, inst[0]);
-        }
-      }
-      break;
-
-    case 1:
-      for (chan=0; chan<chan_max; chan++)
-      {
-        if ((ym2413.instvol_r[chan]&0xf0)==0)
-        {
-          set_mul(chan*2+1, inst[1]);
-        }
-      }
-      break;
-
-    case 2:
-      for (chan=0; chan<chan_max; chan++)
-      {
-        if ((ym2413.instvol_r[chan]&0xf0)==0)
-        {
-          set_ksl_tl(chan, inst[2]);
-        }
-      }
-      break;
-
-    case 3:
-      for (chan=0; chan<chan_max; chan++)
-      {
-        if ((ym2413.instvol_r[chan]&0xf0)==0)
-        {
-          set_ksl_wave_fb(chan, inst[3]);
-        }
-      }
-      break;
-
-    case 4:
-      for (chan=0; chan<chan_max; chan++)
-      {
-        if ((ym2413.instvol_r[chan]&0xf0)==0)
-        {
-          set_ar_dr(chan*2, inst[4]);
-        }
-      }
-      break;
-
-    case 5:
-      for (chan=0; chan<chan_max; chan++)
-      {
-        if ((ym2413.instvol_r[chan]&0xf0)==0)
-        {
-          set_ar_dr(chan*2+1, inst[5]);
-        }
-      }
-      break;
-
-    case 6:
-      for (chan=0; chan<chan_max; chan++)
-      {
-        if ((ym2413.instvol_r[chan]&0xf0)==0)
-        {
-          set_sl_rr(chan*2, inst[6]);
-        }
-      }
-      break;
+  chip->user_inst[r&7] = v;
+  decode_patch(&chip->patch[0], chip->user_inst);
 
-    case 7:
-      for (chan=0; chan<chan_max; chan++)
-      {
-        if ((ym2413.instvol_r[chan]&0xf0)==0)
-        {
-          set_sl_rr(chan*2+1, inst[7]);
-        }
-      }
-      break;
+  for (chan=0; chan<chan_max; chan++)
+  {
+    if ((chip->instvol_r[chan]&0xf0)==0)
+    {
+      load_instrument(chip, chan, &chip->patch[0]);
+    }
   }
 }
 
 /* write a value v to register r on chip chip */
-static void OPLLWriteReg(int r, int v)
+static void OPLLWriteReg(YM2413 *chip, int r, int v)
 {
   YM2413_OPLL_CH *CH;
   YM2413_OPLL_SLOT *SLOT;
@@ -1400,8 +1356,7 @@ static void OPLLWriteReg(int r, int v)
         case 0x06:  /* Sustain, Release (modulator) */
         case 0x07:  /* Sustain, Release (carrier) */
         {
-          ym2413.inst_tab[0][r] = v;
-          update_instrument_zero(r);
+          update_instrument_zero(chip, r, v);
           break;
         }
 
@@ -1410,89 +1365,89 @@ static void OPLLWriteReg(int r, int v)
           if(v&0x20)
           {
             /* rhythm OFF to ON */
-            if ((ym2413.rhythm&0x20)==0)
+            if ((chip->rhythm&0x20)==0)
             {
               /* Load instrument settings for channel seven(chan=6 since we're zero based). (Bass drum) */
-              load_instrument(6, 12, &ym2413.inst_tab[16][0]);
+              load_instrument(chip, 6, &chip->patch[16]);
 
               /* Load instrument settings for channel eight. (High hat and snare drum) */
-              load_instrument(7, 14, &ym2413.inst_tab[17][0]);
+              load_instrument(chip, 7, &chip->patch[17]);
 
-              CH   = &ym2413.P_CH[7];
+              CH   = &chip->P_CH[7];
               SLOT = &CH->SLOT[SLOT1]; /* modulator envelope is HH */
-              SLOT->TL  = ((ym2413.instvol_r[7]>>4)<<2)<<(ENV_BITS-2-7); /* 7 bits TL (bit 6 = always 0) */
+              SLOT->TL  = ((chip->instvol_r[7]>>4)<<2)<<(ENV_BITS-2-7); /* 7 bits TL (bit 6 = always 0) */
               SLOT->TLL = SLOT->TL + (CH->ksl_base>>SLOT->ksl);
 
               /* Load instrument settings for channel nine. (Tom-tom and top cymbal) */
-              load_instrument(8, 16, &ym2413.inst_tab[18][0]);
+              load_instrument(chip, 8, &chip->patch[18]);
 
-              CH   = &ym2413.P_CH[8];
+              CH   = &chip->P_CH[8];
               SLOT = &CH->SLOT[SLOT1]; /* modulator envelope is TOM */
-              SLOT->TL  = ((ym2413.instvol_r[8]>>4)<<2)<<(ENV_BITS-2-7); /* 7 bits TL (bit 6 = always 0) */
+              SLOT->TL  = ((chip->instvol_r[8]>>4)<<2)<<(ENV_BITS-2-7); /* 7 bits TL (bit 6 = always 0) */
               SLOT->TLL = SLOT->TL + (CH->ksl_base>>SLOT->ksl);
             }
 
             /* BD key on/off */
             if(v&0x10)
             {
-              KEY_ON (&ym2413.P_CH[6].SLOT[SLOT1], 2);
-              KEY_ON (&ym2413.P_CH[6].SLOT[SLOT2], 2);
+              KEY_ON (&chip->P_CH[6].SLOT[SLOT1], 2);
+              KEY_ON (&chip->P_CH[6].SLOT[SLOT2], 2);
             }
             else
             {
-              KEY_OFF(&ym2413.P_CH[6].SLOT[SLOT1],~2);
-              KEY_OFF(&ym2413.P_CH[6].SLOT[SLOT2],~2);
+              KEY_OFF(&chip->P_CH[6].SLOT[SLOT1],~2);
+              KEY_OFF(&chip->P_CH[6].SLOT[SLOT2],~2);
             }
 
             /* HH key on/off */
-            if(v&0x01) KEY_ON (&ym2413.P_CH[7].SLOT[SLOT1], 2);
-            else       KEY_OFF(&ym2413.P_CH[7].SLOT[SLOT1],~2);
+            if(v&0x01) KEY_ON (&chip->P_CH[7].SLOT[SLOT1], 2);
+            else       KEY_OFF(&chip->P_CH[7].SLOT[SLOT1],~2);
 
             /* SD key on/off */
-            if(v&0x08) KEY_ON (&ym2413.P_CH[7].SLOT[SLOT2], 2);
-            else       KEY_OFF(&ym2413.P_CH[7].SLOT[SLOT2],~2);
+            if(v&0x08) KEY_ON (&chip->P_CH[7].SLOT[SLOT2], 2);
+            else       KEY_OFF(&chip->P_CH[7].SLOT[SLOT2],~2);
 
             /* TOM key on/off */
-            if(v&0x04) KEY_ON (&ym2413.P_CH[8].SLOT[SLOT1], 2);
-            else       KEY_OFF(&ym2413.P_CH[8].SLOT[SLOT1],~2);
+            if(v&0x04) KEY_ON (&chip->P_CH[8].SLOT[SLOT1], 2);
+            else       KEY_OFF(&chip->P_CH[8].SLOT[SLOT1],~2);
 
             /* TOP-CY key on/off */
-            if(v&0x02) KEY_ON (&ym2413.P_CH[8].SLOT[SLOT2], 2);
-            else       KEY_OFF(&ym2413.P_CH[8].SLOT[SLOT2],~2);
+            if(v&0x02) KEY_ON (&chip->P_CH[8].SLOT[SLOT2], 2);
+            else       KEY_OFF(&chip->P_CH[8].SLOT[SLOT2],~2);
           }
           else
           {
             /* rhythm ON to OFF */
-            if (ym2413.rhythm&0x20)
+            if (chip->rhythm&0x20)
             {
               /* Load instrument settings for channel seven(chan=6 since we're zero based).*/
-              load_instrument(6, 12, &ym2413.inst_tab[ym2413.instvol_r[6]>>4][0]);
+              load_instrument(chip, 6, &chip->patch[chip->instvol_r[6]>>4]);
 
               /* Load instrument settings for channel eight.*/
-              load_instrument(7, 14, &ym2413.inst_tab[ym2413.instvol_r[7]>>4][0]);
+              load_instrument(chip, 7, &chip->patch[chip->instvol_r[7]>>4]);
 
               /* Load instrument settings for channel nine.*/
-              load_instrument(8, 16, &ym2413.inst_tab[ym2413.instvol_r[8]>>4][0]);
+              load_instrument(chip, 8, &chip->patch[chip->instvol_r[8]>>4]);
             }
 
             /* BD key off */
-            KEY_OFF(&ym2413.P_CH[6].SLOT[SLOT1],~2);
-            KEY_OFF(&ym2413.P_CH[6].SLOT[SLOT2],~2);
+            KEY_OFF(&chip->P_CH[6].SLOT[SLOT1],~2);
+            KEY_OFF(&chip->P_CH[6].SLOT[SLOT2],~2);
 
             /* HH key off */
-            KEY_OFF(&ym2413.P_CH[7].SLOT[SLOT1],~2);
+            KEY_OFF(&chip->P_CH[7].SLOT[SLOT1],~2);
 
             /* SD key off */
-            KEY_OFF(&ym2413.P_CH[7].SLOT[SLOT2],~2);
+            KEY_OFF(&chip->P_CH[7].SLOT[SLOT2],~2);
 
             /* TOM key off */
-            KEY_OFF(&ym2413.P_CH[8].SLOT[SLOT1],~2);
+            KEY_OFF(&chip->P_CH[8].SLOT[SLOT1],~2);
 
             /* TOP-CY off */
-            KEY_OFF(&ym2413.P_CH[8].SLOT[SLOT2],~2);
+            KEY_OFF(&chip->P_CH[8].SLOT[SLOT2],~2);
           }
 
-          ym2413.rhythm = v&0x3f;
+          chip->rhythm = v&0x3f;
           break;
         }
       }
@@ -1510,7 +1465,7 @@ static void OPLLWriteReg(int r, int v)
       if (chan >= 9)
         chan -= 9;  /* verified on real YM2413 */
 
-      CH = &ym2413.P_CH[chan];
+      CH = &chip->P_CH[chan];
 
       if(r&0x10)
       {
@@ -1533,7 +1488,13 @@ static void OPLLWriteReg(int r, int v)
           KEY_OFF(&CH->SLOT[SLOT2],~1);
         }
 
-        CH->sus = v & 0x20;
+        /* the release rate with sustain on is picked in CALC_FCSLOT */
+        if (CH->sus != (v & 0x20))
+        {
+          CH->sus = v & 0x20;
+          CALC_FCSLOT(CH,&CH->SLOT[SLOT1]);
+          CALC_FCSLOT(CH,&CH->SLOT[SLOT2]);
+        }
       }
 
       /* update */
@@ -1549,7 +1510,7 @@ static void OPLLWriteReg(int r, int v)
 
         block_fnum   = block_fnum * 2;
         block        = (block_fnum&0x1c00) >> 10;
-        CH->fc       = ym2413.fn_tab[block_fnum&0x03ff] >> (7-block);
+        CH->fc       = fn_tab[block_fnum&0x03ff] >> (7-block);
 
         /* refresh Total Level in both SLOTs of this channel */
         CH->SLOT[SLOT1].TLL = CH->SLOT[SLOT1].TL + (CH->ksl_base>>CH->SLOT[SLOT1].ksl);
@@ -1570,13 +1531,13 @@ static void OPLLWriteReg(int r, int v)
       if (chan >= 9)
         chan -= 9;  /* verified on real YM2413 */
 
-      CH   = &ym2413.P_CH[chan];
+      CH   = &chip->P_CH[chan];
       SLOT = &CH->SLOT[SLOT2]; /* carrier */
       SLOT->TL  = ((v&0x0f)<<2)<<(ENV_BITS-2-7); /* 7 bits TL (bit 6 = always 0) */
       SLOT->TLL = SLOT->TL + (CH->ksl_base>>SLOT->ksl);
 
       /*check wether we are in rhythm mode and handle instrument/volume register accordingly*/
-      if ((chan>=6) && (ym2413.rhythm&0x20))
+      if ((chan>=6) && (chip->rhythm&0x20))
       {
         /* we're in rhythm mode*/
 
@@ -1589,10 +1550,10 @@ static void OPLLWriteReg(int r, int v)
       }
       else
       {
-        if ((ym2413.instvol_r[chan]&0xf0) != (v&0xf0))
+        if ((chip->instvol_r[chan]&0xf0) != (v&0xf0))
         {
-          ym2413.instvol_r[chan] = v;  /* store for later use */
-          load_instrument(chan, chan * 2, &ym2413.inst_tab[v>>4][0]);
+          chip->instvol_r[chan] = v;  /* store for later use */
+          load_instrument(chip, chan, &chip->patch[v>>4]);
         }
       }
 
@@ -1605,50 +1566,90 @@ static void OPLLWriteReg(int r, int v)
 }
 
 
+/* slots that are not off, a modulator with feedback left counts as live.
+   only a key on write takes a slot out of EG_OFF so a slot that is off at
+   the start of a block stays silent to the end of it */
+static UINT32 live_slots(const YM2413 *chip)
+{
+  UINT32 live = 0;
+  int i;
+
+  for (i=0; i<9*2; i++)
+  {
+    const YM2413_OPLL_SLOT *SLOT = &chip->P_CH[i>>1].SLOT[i&1];
+    if ((SLOT->state != EG_OFF) || SLOT->op1_out[0] || SLOT->op1_out[1])
+      live |= 1<<i;
+  }
+  return live;
+}
+
 void YM2413Init(void)
 {
+  int i;
+
   init_tables();
 
-  /* clear */
-  memset(&ym2413,0,sizeof(YM2413));
+  /* decode the instrument ROM */
+  for (i=0; i<19; i++)
+  {
+    decode_patch(&rom_patch[i], table[i]);
+  }
+}
+
+/* create a ym2413 emulator */
+YM2413 *YM2413New(void)
+{
+  YM2413 *chip = (YM2413 *)calloc(1, sizeof(YM2413));
+  if (!chip)
+    return NULL;
 
-  /* init global tables */
-  OPLL_initalize();
+  OPLL_initalize(chip);
+  return chip;
 }
 
-void YM2413ResetChip(void)
+void YM2413Delete(YM2413 *chip)
+{
+  free(chip);
+}
+
+void YM2413ResetChip(YM2413 *chip)
 {
   int c,s;
   int i;
 
-  ym2413.eg_timer = 0;
-  ym2413.eg_cnt   = 0;
+  chip->eg_timer = 0;
+  chip->eg_cnt   = 0;
 
-  ym2413.noise_rng = 1;  /* noise shift register */
+  chip->lfo_am_cnt = 0;
+  chip->lfo_pm_cnt = 0;
 
+  chip->noise_rng = 1;  /* noise shift register */
+  chip->noise_p   = 0;
 
-  /* setup instruments table */
-  for (i=0; i<19; i++)
-  {
-    for (c=0; c<8; c++)
-    {
-      ym2413.inst_tab[i][c] = table[i][c];
-    }
-  }
+  chip->rhythm = 0;
+  memset(chip->P_CH, 0, sizeof(chip->P_CH));
+  memset(chip->instvol_r, 0, sizeof(chip->instvol_r));
 
+  /* setup instruments table, the user instrument starts as the first entry */
+  memcpy(chip->patch, rom_patch, sizeof(chip->patch));
+  memcpy(chip->user_inst, table[0], sizeof(chip->user_inst));
 
   /* reset with register write */
-  OPLLWriteReg(0x0f,0); /*test reg*/
-  for(i = 0x3f ; i >= 0x10 ; i-- ) OPLLWriteReg(i,0x00);
+  OPLLWriteReg(chip,0x0f,0); /*test reg*/
+  for(i = 0x3f ; i >= 0x10 ; i-- ) OPLLWriteReg(chip,i,0x00);
+
+  /* every channel now selects the user instrument */
+  for( c = 0 ; c < 9 ; c++ )
+  {
+    load_instrument(chip, c, &chip->patch[0]);
+  }
 
   /* reset operator parameters */
   for( c = 0 ; c < 9 ; c++ )
   {
-    YM2413_OPLL_CH *CH = &ym2413.P_CH[c];
+    YM2413_OPLL_CH *CH = &chip->P_CH[c];
     for(s = 0 ; s < 2 ; s++ )
     {
-      /* wave table */
-      CH->SLOT[s].wavetable = 0;
       CH->SLOT[s].state     = EG_OFF;
       CH->SLOT[s].volume    = MAX_ATT_INDEX;
     }
@@ -1657,81 +1658,80 @@ void YM2413ResetChip(void)
 
 /* YM2413 I/O interface */
 
-void YM2413Write(unsigned int a, unsigned int v)
+void YM2413Write(YM2413 *chip, unsigned int a, unsigned int v)
 {
   if( !(a&2) )
   {
     if( !(a&1) )
     {
       /* address port */
-      ym2413.address = v & 0xff;
+      chip->address = v & 0xff;
     }
     else
     {
       /* data port */
-      OPLLWriteReg(ym2413.address,v);
+      OPLLWriteReg(chip,chip->address,v);
     }
   }
   else
   {
     /* bit 0 enable/disable FM output (Master System / Mark-III FM adapter specific) */
-    ym2413.status = v & 0x01;
+    chip->status = v & 0x01;
   }
 }
 
-unsigned int YM2413Read(void)
+unsigned int YM2413Read(YM2413 *chip)
 {
   /* bit 0 returns latched FM enable status, bits 1-2 return zero (Master System / Mark-III FM adapter specific) */
-  return 0xF8 | ym2413.status;
+  return 0xF8 | chip->status;
 }
 
-void YM2413Update(int *buffer, int length)
+void YM2413SetMute(YM2413 *chip, unsigned int mask)
 {
-  int i, out;
+  chip->mute = mask;
+}
+
+void YM2413Update(YM2413 *chip, int *buffer, int length)
+{
+  int i, c, out;
+  signed int output[2];
+
+  const UINT32 live = live_slots(chip);
+
+  /* melody channels with a live slot that are not muted, the rest are
+     skipped for the block */
+  YM2413_OPLL_CH *chan[9];
+  int chan_count = 0;
+  for (c=0; c<((chip->rhythm&0x20) ? 6 : 9); c++)
+  {
+    if ((live & (3<<(c*2))) && !(chip->mute & (1<<c)))
+      chan[chan_count++] = &chip->P_CH[c];
+  }
 
   for( i=0; i < length ; i++ )
   {
     output[0] = 0;
     output[1] = 0;
 
-    advance_lfo();
+    advance_lfo(chip);
 
     /* FM part */
-    chan_calc(&ym2413.P_CH[0]);
-    chan_calc(&ym2413.P_CH[1]);
-    chan_calc(&ym2413.P_CH[2]);
-    chan_calc(&ym2413.P_CH[3]);
-    chan_calc(&ym2413.P_CH[4]);
-    chan_calc(&ym2413.P_CH[5]);
-
-    if(!(ym2413.rhythm&0x20))
+    for (c=0; c<chan_count; c++)
     {
-      chan_calc(&ym2413.P_CH[6]);
-      chan_calc(&ym2413.P_CH[7]);
-      chan_calc(&ym2413.P_CH[8]);
+      output[0] += chan_calc(chip, chan[c]);
     }
-    else    /* Rhythm part */
+
+    if((chip->rhythm&0x20) && (chip->mute&0x1c0)!=0x1c0)    /* Rhythm part */
     {
-      rhythm_calc(&ym2413.P_CH[0], (ym2413.noise_rng>>0)&1 );
+      output[1] = rhythm_calc(chip, &chip->P_CH[0], (chip->noise_rng>>0)&1 );
     }
 
     /* Melody (MO) & Rythm (RO) outputs mixing & amplification (latched bit controls FM output) */
-    out = (output[0] + (output[1] * 2)) * 2 * ym2413.status;
+    out = (output[0] + (output[1] * 2)) * 2 * chip->status;
 
-    /* Store to stereo sound buffer */
-    *buffer++ = out;
+    /* Store to mono sound buffer */
     *buffer++ = out;
 
-    advance();
+    advance(chip, live);
   }
 }
-
-unsigned char *YM2413GetContextPtr(void)
-{
-  return (unsigned char *)&ym2413;
-}
-
-unsigned int YM2413GetContextSize(void)
-{
-  return sizeof(YM2413);
-}
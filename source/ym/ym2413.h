@@ -12,12 +12,30 @@
 #ifndef _H_YM2413_
 #define _H_YM2413_
 
-extern void YM2413Init(void);
-extern void YM2413ResetChip(void);
-extern void YM2413Update(int *buffer, int length);
-extern void YM2413Write(unsigned int a, unsigned int v);
-extern unsigned int YM2413Read(void);
-extern unsigned char *YM2413GetContextPtr(void);
-extern unsigned int YM2413GetContextSize(void);
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+    /* all chip state lives in the instance, the tables and decoded
+    ** instrument ROM built by YM2413Init are shared read only */
+    typedef struct ym2413_s YM2413;
+
+    /* build the shared tables, once before the first YM2413New */
+    extern void YM2413Init(void);
+
+    extern YM2413 *YM2413New(void);
+    extern void YM2413Delete(YM2413 *chip);
+    extern void YM2413ResetChip(YM2413 *chip);
+    /* mono output, one sample per 72 master clocks */
+    extern void YM2413Update(YM2413 *chip, int *buffer, int length);
+    extern void YM2413Write(YM2413 *chip, unsigned int a, unsigned int v);
+    extern unsigned int YM2413Read(YM2413 *chip);
+    /* bit n set leaves channel n out of the render without calculating it,
+    ** in rhythm mode channels 6 to 8 mute their drums */
+    extern void YM2413SetMute(YM2413 *chip, unsigned int mask);
+
+#if defined(__cplusplus)
+}
+#endif
 
 #endif /*_H_YM2413_*/
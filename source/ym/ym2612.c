@@ -128,10 +128,13 @@
 /*    YM2610B : PSG:3ch FM:6ch ADPCM(18.5KHz):6ch DeltaT ADPCM:1ch      */
 /************************************************************************/
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <math.h>
 
+#include "ym2612.h"
+
 typedef uint32_t UINT32;
 typedef uint8_t UINT8;
 typedef int32_t INT32;
@@ -612,30 +615,27 @@ typedef struct
 /***********************************************************/
 /* YM2612 chip                                                */
 /***********************************************************/
-typedef struct
+struct ym2612_s
 {
   FM_CH   CH[6];  /* channel state */
   UINT8   dacen;  /* DAC mode  */
   INT32   dacout; /* DAC output */
   FM_OPN  OPN;    /* OPN state */
 
-} YM2612;
-
-/* emulated chip */
-static YM2612 ym2612;
-
-/* current chip state */
-static INT32  m2,c1,c2;   /* Phase Modulation input for operators 2,3,4 */
-static INT32  mem;        /* one sample delay memory */
-static INT32  out_fm[8];  /* outputs of working channels */
-static UINT32 bitmask;    /* working channels output bitmasking (DAC quantization) */ 
+  /* current chip state */
+  INT32  m2,c1,c2;   /* Phase Modulation input for operators 2,3,4 */
+  INT32  mem;        /* one sample delay memory */
+  INT32  out_fm[8];  /* outputs of working channels */
+  UINT32 bitmask;    /* working channels output bitmasking (DAC quantization) */ 
+  UINT32 mute;       /* channels that are not calculated, bit n for channel n */
+};
 
 
-static INLINE void FM_KEYON(FM_CH *CH , int s )
+static INLINE void FM_KEYON(YM2612 *chip, FM_CH *CH , int s )
 {
   FM_SLOT *SLOT = &CH->SLOT[s];
 
-  if (!SLOT->key && !ym2612.OPN.SL3.key_csm)
+  if (!SLOT->key && !chip->OPN.SL3.key_csm)
   {
     /* restart Phase Generator */
     SLOT->phase = 0;
@@ -666,11 +666,11 @@ static INLINE void FM_KEYON(FM_CH *CH , int s )
   SLOT->key = 1;
 }
 
-static INLINE void FM_KEYOFF(FM_CH *CH , int s )
+static INLINE void FM_KEYOFF(YM2612 *chip, FM_CH *CH , int s )
 {
   FM_SLOT *SLOT = &CH->SLOT[s];
 
-  if (SLOT->key && !ym2612.OPN.SL3.key_csm)
+  if (SLOT->key && !chip->OPN.SL3.key_csm)
   {
     if (SLOT->state>EG_REL)
     {
@@ -699,11 +699,11 @@ static INLINE void FM_KEYOFF(FM_CH *CH , int s )
   SLOT->key = 0;
 }
 
-static INLINE void FM_KEYON_CSM(FM_CH *CH , int s )
+static INLINE void FM_KEYON_CSM(YM2612 *chip, FM_CH *CH , int s )
 {
   FM_SLOT *SLOT = &CH->SLOT[s];
 
-  if (!SLOT->key && !ym2612.OPN.SL3.key_csm)
+  if (!SLOT->key && !chip->OPN.SL3.key_csm)
   {
     /* restart Phase Generator */
     SLOT->phase = 0;
@@ -763,59 +763,59 @@ static INLINE void FM_KEYOFF_CSM(FM_CH *CH , int s )
 }
 
 /* CSM Key Controll */
-static INLINE void CSMKeyControll(FM_CH *CH)
+static INLINE void CSMKeyControll(YM2612 *chip, FM_CH *CH)
 {
   /* all key ON (verified by Nemesis on real hardware) */
-  FM_KEYON_CSM(CH,SLOT1);
-  FM_KEYON_CSM(CH,SLOT2);
-  FM_KEYON_CSM(CH,SLOT3);
-  FM_KEYON_CSM(CH,SLOT4);
-  ym2612.OPN.SL3.key_csm = 1;
+  FM_KEYON_CSM(chip,CH,SLOT1);
+  FM_KEYON_CSM(chip,CH,SLOT2);
+  FM_KEYON_CSM(chip,CH,SLOT3);
+  FM_KEYON_CSM(chip,CH,SLOT4);
+  chip->OPN.SL3.key_csm = 1;
 }
 
-static INLINE void INTERNAL_TIMER_A()
+static INLINE void INTERNAL_TIMER_A(YM2612 *chip)
 {
-  if (ym2612.OPN.ST.mode & 0x01)
+  if (chip->OPN.ST.mode & 0x01)
   {
-    ym2612.OPN.ST.TAC--;
-    if (ym2612.OPN.ST.TAC <= 0)
+    chip->OPN.ST.TAC--;
+    if (chip->OPN.ST.TAC <= 0)
     {
       /* set status (if enabled) */
-      if (ym2612.OPN.ST.mode & 0x04)
-        ym2612.OPN.ST.status |= 0x01;
+      if (chip->OPN.ST.mode & 0x04)
+        chip->OPN.ST.status |= 0x01;
 
       /* reload the counter */
-      ym2612.OPN.ST.TAC = ym2612.OPN.ST.TAL;
+      chip->OPN.ST.TAC = chip->OPN.ST.TAL;
 
       /* CSM mode auto key on */
-      if ((ym2612.OPN.ST.mode & 0xC0) == 0x80)
-        CSMKeyControll(&ym2612.CH[2]);
+      if ((chip->OPN.ST.mode & 0xC0) == 0x80)
+        CSMKeyControll(chip,&chip->CH[2]);
     }
   }
 }
 
-static INLINE void INTERNAL_TIMER_B(int step)
+static INLINE void INTERNAL_TIMER_B(YM2612 *chip, int step)
 {
-  if (ym2612.OPN.ST.mode & 0x02)
+  if (chip->OPN.ST.mode & 0x02)
   {
-    ym2612.OPN.ST.TBC-=step;
-    if (ym2612.OPN.ST.TBC <= 0)
+    chip->OPN.ST.TBC-=step;
+    if (chip->OPN.ST.TBC <= 0)
     {
       /* set status (if enabled) */
-      if (ym2612.OPN.ST.mode & 0x08)
-        ym2612.OPN.ST.status |= 0x02;
+      if (chip->OPN.ST.mode & 0x08)
+        chip->OPN.ST.status |= 0x02;
 
       /* reload the counter */
-      if (ym2612.OPN.ST.TBL)
-        ym2612.OPN.ST.TBC += ym2612.OPN.ST.TBL;
+      if (chip->OPN.ST.TBL)
+        chip->OPN.ST.TBC += chip->OPN.ST.TBL;
       else
-        ym2612.OPN.ST.TBC = ym2612.OPN.ST.TBL;
+        chip->OPN.ST.TBC = chip->OPN.ST.TBL;
     }
   }
 }
 
 /* OPN Mode Register Write */
-static INLINE void set_timers(int v )
+static INLINE void set_timers(YM2612 *chip, int v )
 {
   /* b7 = CSM MODE */
   /* b6 = 3 slot mode */
@@ -826,39 +826,39 @@ static INLINE void set_timers(int v )
   /* b1 = load b */
   /* b0 = load a */
 
-  if ((ym2612.OPN.ST.mode ^ v) & 0xC0)
+  if ((chip->OPN.ST.mode ^ v) & 0xC0)
   {
     /* phase increment need to be recalculated */
-    ym2612.CH[2].SLOT[SLOT1].Incr=-1;
+    chip->CH[2].SLOT[SLOT1].Incr=-1;
 
     /* CSM mode disabled and CSM key ON active*/
-    if (((v & 0xC0) != 0x80) && ym2612.OPN.SL3.key_csm)
+    if (((v & 0xC0) != 0x80) && chip->OPN.SL3.key_csm)
     {
       /* CSM Mode Key OFF (verified by Nemesis on real hardware) */
-      FM_KEYOFF_CSM(&ym2612.CH[2],SLOT1);
-      FM_KEYOFF_CSM(&ym2612.CH[2],SLOT2);
-      FM_KEYOFF_CSM(&ym2612.CH[2],SLOT3);
-      FM_KEYOFF_CSM(&ym2612.CH[2],SLOT4);
-      ym2612.OPN.SL3.key_csm = 0;
+      FM_KEYOFF_CSM(&chip->CH[2],SLOT1);
+      FM_KEYOFF_CSM(&chip->CH[2],SLOT2);
+      FM_KEYOFF_CSM(&chip->CH[2],SLOT3);
+      FM_KEYOFF_CSM(&chip->CH[2],SLOT4);
+      chip->OPN.SL3.key_csm = 0;
     }
   }
 
   /* reload Timers */
-  if ((v&1) && !(ym2612.OPN.ST.mode&1))
-    ym2612.OPN.ST.TAC = ym2612.OPN.ST.TAL;
-  if ((v&2) && !(ym2612.OPN.ST.mode&2))
-    ym2612.OPN.ST.TBC = ym2612.OPN.ST.TBL;
+  if ((v&1) && !(chip->OPN.ST.mode&1))
+    chip->OPN.ST.TAC = chip->OPN.ST.TAL;
+  if ((v&2) && !(chip->OPN.ST.mode&2))
+    chip->OPN.ST.TBC = chip->OPN.ST.TBL;
   
   /* reset Timers flags */
-  ym2612.OPN.ST.status &= (~v >> 4); 
+  chip->OPN.ST.status &= (~v >> 4); 
 
-  ym2612.OPN.ST.mode = v;
+  chip->OPN.ST.mode = v;
 }
 
 /* set algorithm connection */
-static INLINE void setup_connection( FM_CH *CH, int ch )
+static INLINE void setup_connection(YM2612 *chip,  FM_CH *CH, int ch )
 {
-  INT32 *carrier = &out_fm[ch];
+  INT32 *carrier = &chip->out_fm[ch];
 
   INT32 **om1 = &CH->connect1;
   INT32 **om2 = &CH->connect3;
@@ -869,43 +869,43 @@ static INLINE void setup_connection( FM_CH *CH, int ch )
   switch( CH->ALGO ){
     case 0:
       /* M1---C1---MEM---M2---C2---OUT */
-      *om1 = &c1;
-      *oc1 = &mem;
-      *om2 = &c2;
-      *memc= &m2;
+      *om1 = &chip->c1;
+      *oc1 = &chip->mem;
+      *om2 = &chip->c2;
+      *memc= &chip->m2;
       break;
     case 1:
       /* M1------+-MEM---M2---C2---OUT */
       /*      C1-+                     */
-      *om1 = &mem;
-      *oc1 = &mem;
-      *om2 = &c2;
-      *memc= &m2;
+      *om1 = &chip->mem;
+      *oc1 = &chip->mem;
+      *om2 = &chip->c2;
+      *memc= &chip->m2;
       break;
     case 2:
       /* M1-----------------+-C2---OUT */
       /*      C1---MEM---M2-+          */
-      *om1 = &c2;
-      *oc1 = &mem;
-      *om2 = &c2;
-      *memc= &m2;
+      *om1 = &chip->c2;
+      *oc1 = &chip->mem;
+      *om2 = &chip->c2;
+      *memc= &chip->m2;
       break;
     case 3:
       /* M1---C1---MEM------+-C2---OUT */
       /*                 M2-+          */
-      *om1 = &c1;
-      *oc1 = &mem;
-      *om2 = &c2;
-      *memc= &c2;
+      *om1 = &chip->c1;
+      *oc1 = &chip->mem;
+      *om2 = &chip->c2;
+      *memc= &chip->c2;
       break;
     case 4:
       /* M1---C1-+-OUT */
       /* M2---C2-+     */
       /* MEM: not used */
-      *om1 = &c1;
+      *om1 = &chip->c1;
       *oc1 = carrier;
-      *om2 = &c2;
-      *memc= &mem;  /* store it anywhere where it will not be used */
+      *om2 = &chip->c2;
+      *memc= &chip->mem;  /* store it anywhere where it will not be used */
       break;
     case 5:
       /*    +----C1----+     */
@@ -914,17 +914,17 @@ static INLINE void setup_connection( FM_CH *CH, int ch )
       *om1 = 0;  /* special mark */
       *oc1 = carrier;
       *om2 = carrier;
-      *memc= &m2;
+      *memc= &chip->m2;
       break;
     case 6:
       /* M1---C1-+     */
       /*      M2-+-OUT */
       /*      C2-+     */
       /* MEM: not used */
-      *om1 = &c1;
+      *om1 = &chip->c1;
       *oc1 = carrier;
       *om2 = carrier;
-      *memc= &mem;  /* store it anywhere where it will not be used */
+      *memc= &chip->mem;  /* store it anywhere where it will not be used */
       break;
     case 7:
       /* M1-+     */
@@ -935,7 +935,7 @@ static INLINE void setup_connection( FM_CH *CH, int ch )
       *om1 = carrier;
       *oc1 = carrier;
       *om2 = carrier;
-      *memc= &mem;  /* store it anywhere where it will not be used */
+      *memc= &chip->mem;  /* store it anywhere where it will not be used */
       break;
   }
 
@@ -943,10 +943,10 @@ static INLINE void setup_connection( FM_CH *CH, int ch )
 }
 
 /* set detune & multiple */
-static INLINE void set_det_mul(FM_CH *CH,FM_SLOT *SLOT,int v)
+static INLINE void set_det_mul(YM2612 *chip, FM_CH *CH,FM_SLOT *SLOT,int v)
 {
   SLOT->mul = (v&0x0f)? (v&0x0f)*2 : 1;
-  SLOT->DT  = ym2612.OPN.ST.dt_tab[(v>>4)&7];
+  SLOT->DT  = chip->OPN.ST.dt_tab[(v>>4)&7];
   CH->SLOT[SLOT1].Incr=-1;
 }
 
@@ -1027,30 +1027,30 @@ static INLINE void set_sl_rr(FM_SLOT *SLOT,int v)
 }
 
 /* advance LFO to next sample */
-static INLINE void advance_lfo()
+static INLINE void advance_lfo(YM2612 *chip)
 {
-  if (ym2612.OPN.lfo_timer_overflow)   /* LFO enabled ? */
+  if (chip->OPN.lfo_timer_overflow)   /* LFO enabled ? */
   {
     /* increment LFO timer (every samples) */
-    ym2612.OPN.lfo_timer ++;
+    chip->OPN.lfo_timer ++;
 
     /* when LFO is enabled, one level will last for 108, 77, 71, 67, 62, 44, 8 or 5 samples */
-    if (ym2612.OPN.lfo_timer >= ym2612.OPN.lfo_timer_overflow)
+    if (chip->OPN.lfo_timer >= chip->OPN.lfo_timer_overflow)
     {
-      ym2612.OPN.lfo_timer = 0;
+      chip->OPN.lfo_timer = 0;
 
       /* There are 128 LFO steps */
-      ym2612.OPN.lfo_cnt = ( ym2612.OPN.lfo_cnt + 1 ) & 127;
+      chip->OPN.lfo_cnt = ( chip->OPN.lfo_cnt + 1 ) & 127;
 
       /* triangle (inverted) */
       /* AM: from 126 to 0 step -2, 0 to 126 step +2 */
-      if (ym2612.OPN.lfo_cnt<64)
-        ym2612.OPN.LFO_AM = (ym2612.OPN.lfo_cnt ^ 63) << 1;
+      if (chip->OPN.lfo_cnt<64)
+        chip->OPN.LFO_AM = (chip->OPN.lfo_cnt ^ 63) << 1;
       else
-        ym2612.OPN.LFO_AM = (ym2612.OPN.lfo_cnt & 63) << 1;
+        chip->OPN.LFO_AM = (chip->OPN.lfo_cnt & 63) << 1;
 
       /* PM works with 4 times slower clock */
-      ym2612.OPN.LFO_PM = ym2612.OPN.lfo_cnt >> 2;
+      chip->OPN.LFO_PM = chip->OPN.lfo_cnt >> 2;
     }
   }
 }
@@ -1282,9 +1282,9 @@ static INLINE void update_ssg_eg_channels(FM_CH *CH)
   } while (--i);
 }
 
-static INLINE void update_phase_lfo_slot(FM_SLOT *SLOT, INT32 pms, UINT32 block_fnum)
+static INLINE void update_phase_lfo_slot(YM2612 *chip, FM_SLOT *SLOT, INT32 pms, UINT32 block_fnum)
 {
-  INT32 lfo_fn_table_index_offset = lfo_pm_table[(((block_fnum & 0x7f0) >> 4) << 8) + pms + ym2612.OPN.LFO_PM];
+  INT32 lfo_fn_table_index_offset = lfo_pm_table[(((block_fnum & 0x7f0) >> 4) << 8) + pms + chip->OPN.LFO_PM];
   
   if (lfo_fn_table_index_offset)  /* LFO phase modulation active */
   {
@@ -1312,11 +1312,11 @@ static INLINE void update_phase_lfo_slot(FM_SLOT *SLOT, INT32 pms, UINT32 block_
   }
 }
 
-static INLINE void update_phase_lfo_channel(FM_CH *CH)
+static INLINE void update_phase_lfo_channel(YM2612 *chip, FM_CH *CH)
 {
   UINT32 block_fnum = CH->block_fnum;
   
-  INT32 lfo_fn_table_index_offset = lfo_pm_table[(((block_fnum & 0x7f0) >> 4) << 8) + CH->pms + ym2612.OPN.LFO_PM];
+  INT32 lfo_fn_table_index_offset = lfo_pm_table[(((block_fnum & 0x7f0) >> 4) << 8) + CH->pms + chip->OPN.LFO_PM];
 
   if (lfo_fn_table_index_offset)  /* LFO phase modulation active */
   {
@@ -1434,14 +1434,50 @@ static INLINE signed int op_calc1(UINT32 phase, unsigned int env, unsigned int p
   return tl_tab[p];
 }
 
-static INLINE void chan_calc(FM_CH *CH, int num)
+static INLINE void chan_update_phase(YM2612 *chip, FM_CH *CH)
+{
+  if(CH->pms)
+  {
+    /* add support for 3 slot mode */
+    if ((chip->OPN.ST.mode & 0xC0) && (CH == &chip->CH[2]))
+    {
+      update_phase_lfo_slot(chip,&CH->SLOT[SLOT1], CH->pms, chip->OPN.SL3.block_fnum[1]);
+      update_phase_lfo_slot(chip,&CH->SLOT[SLOT2], CH->pms, chip->OPN.SL3.block_fnum[2]);
+      update_phase_lfo_slot(chip,&CH->SLOT[SLOT3], CH->pms, chip->OPN.SL3.block_fnum[0]);
+      update_phase_lfo_slot(chip,&CH->SLOT[SLOT4], CH->pms, CH->block_fnum);
+    }
+    else
+    {
+      update_phase_lfo_channel(chip,CH);
+    }
+  }
+  else  /* no LFO phase modulation */
+  {
+    CH->SLOT[SLOT1].phase += CH->SLOT[SLOT1].Incr;
+    CH->SLOT[SLOT2].phase += CH->SLOT[SLOT2].Incr;
+    CH->SLOT[SLOT3].phase += CH->SLOT[SLOT3].Incr;
+    CH->SLOT[SLOT4].phase += CH->SLOT[SLOT4].Incr;
+  }
+}
+
+static INLINE void chan_calc(YM2612 *chip, FM_CH *CH, int num)
 {
   do
   {
-    UINT32 AM = ym2612.OPN.LFO_AM >> CH->ams;
-    unsigned int eg_out = volume_calc(&CH->SLOT[SLOT1]);
+    UINT32 AM = chip->OPN.LFO_AM >> CH->ams;
+    unsigned int eg_out;
+
+    /* muted channels are not calculated, only their phase runs on */
+    if (chip->mute & (1 << (CH - chip->CH)))
+    {
+      chan_update_phase(chip,CH);
+      CH++;
+      continue;
+    }
+
+    eg_out = volume_calc(&CH->SLOT[SLOT1]);
 
-    m2 = c1 = c2 = mem = 0;
+    chip->m2 = chip->c1 = chip->c2 = chip->mem = 0;
 
     *CH->mem_connect = CH->mem_value;  /* restore delayed sample (MEM) value to m2 or c2 */
     {
@@ -1450,7 +1486,7 @@ static INLINE void chan_calc(FM_CH *CH, int num)
 
       if( !CH->connect1 ){
         /* algorithm 5  */
-        mem = c1 = c2 = CH->op1_out[0];
+        chip->mem = chip->c1 = chip->c2 = CH->op1_out[0];
       }else{
         /* other algorithms */
         *CH->connect1 += CH->op1_out[0];
@@ -1468,43 +1504,22 @@ static INLINE void chan_calc(FM_CH *CH, int num)
 
     eg_out = volume_calc(&CH->SLOT[SLOT3]);
     if( eg_out < ENV_QUIET )    /* SLOT 3 */
-      *CH->connect3 += op_calc(CH->SLOT[SLOT3].phase, eg_out, m2);
+      *CH->connect3 += op_calc(CH->SLOT[SLOT3].phase, eg_out, chip->m2);
 
     eg_out = volume_calc(&CH->SLOT[SLOT2]);
     if( eg_out < ENV_QUIET )    /* SLOT 2 */
-    *CH->connect2 += op_calc(CH->SLOT[SLOT2].phase, eg_out, c1);
+    *CH->connect2 += op_calc(CH->SLOT[SLOT2].phase, eg_out, chip->c1);
 
     eg_out = volume_calc(&CH->SLOT[SLOT4]);
     if( eg_out < ENV_QUIET )    /* SLOT 4 */
-      *CH->connect4 += op_calc(CH->SLOT[SLOT4].phase, eg_out, c2);
+      *CH->connect4 += op_calc(CH->SLOT[SLOT4].phase, eg_out, chip->c2);
 
 
     /* store current MEM */
-    CH->mem_value = mem;
+    CH->mem_value = chip->mem;
 
     /* update phase counters AFTER output calculations */
-    if(CH->pms)
-    {
-      /* add support for 3 slot mode */
-      if ((ym2612.OPN.ST.mode & 0xC0) && (CH == &ym2612.CH[2]))
-      {
-        update_phase_lfo_slot(&CH->SLOT[SLOT1], CH->pms, ym2612.OPN.SL3.block_fnum[1]);
-        update_phase_lfo_slot(&CH->SLOT[SLOT2], CH->pms, ym2612.OPN.SL3.block_fnum[2]);
-        update_phase_lfo_slot(&CH->SLOT[SLOT3], CH->pms, ym2612.OPN.SL3.block_fnum[0]);
-        update_phase_lfo_slot(&CH->SLOT[SLOT4], CH->pms, CH->block_fnum);
-      }
-      else
-      {
-        update_phase_lfo_channel(CH);
-      }
-    }
-    else  /* no LFO phase modulation */
-    {
-      CH->SLOT[SLOT1].phase += CH->SLOT[SLOT1].Incr;
-      CH->SLOT[SLOT2].phase += CH->SLOT[SLOT2].Incr;
-      CH->SLOT[SLOT3].phase += CH->SLOT[SLOT3].Incr;
-      CH->SLOT[SLOT4].phase += CH->SLOT[SLOT4].Incr;
-    }
+    chan_update_phase(chip,CH);
 
     /* next channel */
     CH++;
@@ -1512,7 +1527,7 @@ static INLINE void chan_calc(FM_CH *CH, int num)
 }
 
 /* write a OPN mode register 0x20-0x2f */
-static INLINE void OPNWriteMode(int r, int v)
+static INLINE void OPNWriteMode(YM2612 *chip, int r, int v)
 {
   UINT8 c;
   FM_CH *CH;
@@ -1524,49 +1539,49 @@ static INLINE void OPNWriteMode(int r, int v)
     case 0x22:  /* LFO FREQ (YM2608/YM2610/YM2610B/ym2612) */
       if (v&8) /* LFO enabled ? */
       {
-        ym2612.OPN.lfo_timer_overflow = lfo_samples_per_step[v&7];
+        chip->OPN.lfo_timer_overflow = lfo_samples_per_step[v&7];
       }
       else
       {
         /* hold LFO waveform in reset state */
-        ym2612.OPN.lfo_timer_overflow = 0;
-        ym2612.OPN.lfo_timer = 0;
-        ym2612.OPN.lfo_cnt = 0;
-        ym2612.OPN.LFO_PM = 0;
-        ym2612.OPN.LFO_AM = 126;
+        chip->OPN.lfo_timer_overflow = 0;
+        chip->OPN.lfo_timer = 0;
+        chip->OPN.lfo_cnt = 0;
+        chip->OPN.LFO_PM = 0;
+        chip->OPN.LFO_AM = 126;
       }
       break;
     case 0x24:  /* timer A High 8*/
-      ym2612.OPN.ST.TA = (ym2612.OPN.ST.TA & 0x03)|(((int)v)<<2);
-      ym2612.OPN.ST.TAL = 1024 - ym2612.OPN.ST.TA;
+      chip->OPN.ST.TA = (chip->OPN.ST.TA & 0x03)|(((int)v)<<2);
+      chip->OPN.ST.TAL = 1024 - chip->OPN.ST.TA;
       break;
     case 0x25:  /* timer A Low 2*/
-      ym2612.OPN.ST.TA = (ym2612.OPN.ST.TA & 0x3fc)|(v&3);
-      ym2612.OPN.ST.TAL = 1024 - ym2612.OPN.ST.TA;
+      chip->OPN.ST.TA = (chip->OPN.ST.TA & 0x3fc)|(v&3);
+      chip->OPN.ST.TAL = 1024 - chip->OPN.ST.TA;
       break;
     case 0x26:  /* timer B */
-      ym2612.OPN.ST.TB = v;
-      ym2612.OPN.ST.TBL = (256 - v) << 4;
+      chip->OPN.ST.TB = v;
+      chip->OPN.ST.TBL = (256 - v) << 4;
       break;
     case 0x27:  /* mode, timer control */
-      set_timers(v);
+      set_timers(chip,v);
       break;
     case 0x28:  /* key on / off */
       c = v & 0x03;
       if( c == 3 ) break;
       if (v&0x04) c+=3; /* CH 4-6 */
-      CH = &ym2612.CH[c];
+      CH = &chip->CH[c];
 
-      if (v&0x10) FM_KEYON(CH,SLOT1); else FM_KEYOFF(CH,SLOT1);
-      if (v&0x20) FM_KEYON(CH,SLOT2); else FM_KEYOFF(CH,SLOT2);
-      if (v&0x40) FM_KEYON(CH,SLOT3); else FM_KEYOFF(CH,SLOT3);
-      if (v&0x80) FM_KEYON(CH,SLOT4); else FM_KEYOFF(CH,SLOT4);
+      if (v&0x10) FM_KEYON(chip,CH,SLOT1); else FM_KEYOFF(chip,CH,SLOT1);
+      if (v&0x20) FM_KEYON(chip,CH,SLOT2); else FM_KEYOFF(chip,CH,SLOT2);
+      if (v&0x40) FM_KEYON(chip,CH,SLOT3); else FM_KEYOFF(chip,CH,SLOT3);
+      if (v&0x80) FM_KEYON(chip,CH,SLOT4); else FM_KEYOFF(chip,CH,SLOT4);
       break;
   }
 }
 
 /* write a OPN register (0x30-0xff) */
-static INLINE void OPNWriteReg(int r, int v)
+static INLINE void OPNWriteReg(YM2612 *chip, int r, int v)
 {
   FM_CH *CH = NULL;
   FM_SLOT *SLOT = NULL;
@@ -1577,13 +1592,13 @@ static INLINE void OPNWriteReg(int r, int v)
 
   if (r >= 0x100) c+=3;
 
-  CH = &ym2612.CH[c];
+  CH = &chip->CH[c];
 
   SLOT = &(CH->SLOT[OPN_SLOT(r)]);
 
   switch( r & 0xf0 ) {
     case 0x30:  /* DET , MUL */
-      set_det_mul(CH,SLOT,v);
+      set_det_mul(chip,CH,SLOT,v);
       break;
 
     case 0x40:  /* TL */
@@ -1700,8 +1715,8 @@ static INLINE void OPNWriteReg(int r, int v)
       switch( OPN_SLOT(r) ){
         case 0:    /* 0xa0-0xa2 : FNUM1 */
         {
-          UINT32 fn = (((UINT32)((ym2612.OPN.ST.fn_h)&7))<<8) + v;
-          UINT8 blk = ym2612.OPN.ST.fn_h>>3;
+          UINT32 fn = (((UINT32)((chip->OPN.ST.fn_h)&7))<<8) + v;
+          UINT8 blk = chip->OPN.ST.fn_h>>3;
           /* keyscale code */
           CH->kcode = (blk<<2) | opn_fktable[fn >> 7];
           /* phase increment counter */
@@ -1714,24 +1729,24 @@ static INLINE void OPNWriteReg(int r, int v)
           break;
         }
         case 1:    /* 0xa4-0xa6 : FNUM2,BLK */
-          ym2612.OPN.ST.fn_h = v&0x3f;
+          chip->OPN.ST.fn_h = v&0x3f;
           break;
         case 2:    /* 0xa8-0xaa : 3CH FNUM1 */
           if(r < 0x100)
           {
-            UINT32 fn = (((UINT32)(ym2612.OPN.SL3.fn_h&7))<<8) + v;
-            UINT8 blk = ym2612.OPN.SL3.fn_h>>3;
+            UINT32 fn = (((UINT32)(chip->OPN.SL3.fn_h&7))<<8) + v;
+            UINT8 blk = chip->OPN.SL3.fn_h>>3;
             /* keyscale code */
-            ym2612.OPN.SL3.kcode[c]= (blk<<2) | opn_fktable[fn >> 7];
+            chip->OPN.SL3.kcode[c]= (blk<<2) | opn_fktable[fn >> 7];
             /* phase increment counter */
-            ym2612.OPN.SL3.fc[c] = (fn << 6) >> (7 - blk);
-            ym2612.OPN.SL3.block_fnum[c] = (blk<<11) | fn;
-            ym2612.CH[2].SLOT[SLOT1].Incr=-1;
+            chip->OPN.SL3.fc[c] = (fn << 6) >> (7 - blk);
+            chip->OPN.SL3.block_fnum[c] = (blk<<11) | fn;
+            chip->CH[2].SLOT[SLOT1].Incr=-1;
           }
           break;            
         case 3:    /* 0xac-0xae : 3CH FNUM2,BLK */
           if(r < 0x100)
-            ym2612.OPN.SL3.fn_h = v&0x3f;
+            chip->OPN.SL3.fn_h = v&0x3f;
           break;
       }
       break;
@@ -1742,7 +1757,7 @@ static INLINE void OPNWriteReg(int r, int v)
         {
           CH->ALGO = v&7;
           CH->FB   = (v>>3)&7;
-          setup_connection( CH, c );
+          setup_connection(chip, CH, c );
           break;        
         }
         case 1:    /* 0xb4-0xb6 : L , R , AMS , PMS */
@@ -1753,8 +1768,8 @@ static INLINE void OPNWriteReg(int r, int v)
           CH->ams = lfo_ams_depth_shift[(v>>4) & 0x03];
 
           /* PAN :  b7 = L, b6 = R */
-          ym2612.OPN.pan[ c*2   ] = (v & 0x80) ? bitmask : 0;
-          ym2612.OPN.pan[ c*2+1 ] = (v & 0x40) ? bitmask : 0;
+          chip->OPN.pan[ c*2   ] = (v & 0x80) ? chip->bitmask : 0;
+          chip->OPN.pan[ c*2+1 ] = (v & 0x40) ? chip->bitmask : 0;
           break;
       }
       break;
@@ -1786,7 +1801,7 @@ static void reset_channels(FM_CH *CH , int num )
 /* initialize generic tables */
 static void init_tables(void)
 {
-  signed int d,i,x;
+  signed int i,x;
   signed int n;
   double o,m;
 
@@ -1880,64 +1895,78 @@ static void init_tables(void)
     }
   }
 
+}
+
+/* build the tables shared by all chips */
+void YM2612Init(void)
+{
+  init_tables();
+}
+
+/* create a ym2612 emulator */
+YM2612 *YM2612New(void)
+{
+  int d,i;
+  YM2612 *chip = (YM2612 *)calloc(1, sizeof(YM2612));
+  if (!chip)
+    return NULL;
+
   /* build DETUNE table */
   for (d = 0;d <= 3;d++)
   {
     for (i = 0;i <= 31;i++)
     {
-      ym2612.OPN.ST.dt_tab[d][i]   = (INT32) dt_tab[d*32 + i];
-      ym2612.OPN.ST.dt_tab[d+4][i] = -ym2612.OPN.ST.dt_tab[d][i];
+      chip->OPN.ST.dt_tab[d][i]   = (INT32) dt_tab[d*32 + i];
+      chip->OPN.ST.dt_tab[d+4][i] = -chip->OPN.ST.dt_tab[d][i];
     }
   }
-
+  return chip;
 }
 
-/* initialize ym2612 emulator */
-void YM2612Init(void)
+void YM2612Delete(YM2612 *chip)
 {
-  memset(&ym2612,0,sizeof(YM2612));
-  init_tables();
+  free(chip);
 }
 
 /* reset OPN registers */
-void YM2612ResetChip(void)
+void YM2612ResetChip(YM2612 *chip)
 {
   int i;
 
-  ym2612.OPN.eg_timer           = 0;
-  ym2612.OPN.eg_cnt             = 0;
+  chip->OPN.eg_timer           = 0;
+  chip->OPN.eg_cnt             = 0;
 
-  ym2612.OPN.lfo_timer_overflow = 0;
-  ym2612.OPN.lfo_timer          = 0;
-  ym2612.OPN.lfo_cnt            = 0;
-  ym2612.OPN.LFO_AM             = 126;
-  ym2612.OPN.LFO_PM             = 0;
+  chip->OPN.lfo_timer_overflow = 0;
+  chip->OPN.lfo_timer          = 0;
+  chip->OPN.lfo_cnt            = 0;
+  chip->OPN.LFO_AM             = 126;
+  chip->OPN.LFO_PM             = 0;
 
-  ym2612.OPN.ST.TAC             = 0;
-  ym2612.OPN.ST.TBC             = 0;
+  chip->OPN.ST.TAC             = 0;
+  chip->OPN.ST.TBC             = 0;
 
-  ym2612.OPN.SL3.key_csm        = 0;
+  chip->OPN.SL3.key_csm        = 0;
 
-  ym2612.dacen                  = 0;
-  ym2612.dacout                 = 0;
+  chip->dacen                  = 0;
+  chip->dacout                 = 0;
  
-  set_timers(0x30);
-  ym2612.OPN.ST.TB              = 0;
-  ym2612.OPN.ST.TBL             = 256 << 4;
-  ym2612.OPN.ST.TA              = 0;
-  ym2612.OPN.ST.TAL             = 1024;
+  set_timers(chip,0x30);
+  chip->OPN.ST.TB              = 0;
+  chip->OPN.ST.TBL             = 256 << 4;
+  chip->OPN.ST.TA              = 0;
+  chip->OPN.ST.TAL             = 1024;
 
-  reset_channels(&ym2612.CH[0] , 6 );
+  reset_channels(&chip->CH[0] , 6 );
 
   for(i = 0xb6 ; i >= 0xb4 ; i-- )
   {
-    OPNWriteReg(i      ,0xc0);
-    OPNWriteReg(i|0x100,0xc0);
+    OPNWriteReg(chip,i      ,0xc0);
+    OPNWriteReg(chip,i|0x100,0xc0);
   }
   for(i = 0xb2 ; i >= 0x30 ; i-- )
   {
-    OPNWriteReg(i      ,0);
-    OPNWriteReg(i|0x100,0);
+    OPNWriteReg(chip,i      ,0);
+    OPNWriteReg(chip,i|0x100,0);
   }
 }
 
@@ -1945,151 +1974,151 @@ void YM2612ResetChip(void)
 /* n = number  */
 /* a = address */
 /* v = value   */
-void YM2612Write(unsigned int a, unsigned int v)
+void YM2612Write(YM2612 *chip, unsigned int a, unsigned int v)
 {
   v &= 0xff;  /* adjust to 8 bit bus */
 
   switch( a )
   {
     case 0:  /* address port 0 */
-      ym2612.OPN.ST.address = v;
+      chip->OPN.ST.address = v;
       break;
 
     case 2:  /* address port 1 */
-      ym2612.OPN.ST.address = v | 0x100;
+      chip->OPN.ST.address = v | 0x100;
       break;
 
     default:  /* data port */
     {
-      int addr = ym2612.OPN.ST.address; /* verified by Nemesis on real YM2612 */
+      int addr = chip->OPN.ST.address; /* verified by Nemesis on real YM2612 */
       switch( addr & 0x1f0 )
       {
         case 0x20:  /* 0x20-0x2f Mode */
           switch( addr )
           {
             case 0x2a:  /* DAC data (ym2612) */
-              ym2612.dacout = ((int)v - 0x80) << 6; /* convert to 14-bit output */
+              chip->dacout = ((int)v - 0x80) << 6; /* convert to 14-bit output */
               break;
             case 0x2b:  /* DAC Sel  (ym2612) */
               /* b7 = dac enable */
-              ym2612.dacen = v & 0x80;
+              chip->dacen = v & 0x80;
               break;
             default:  /* OPN section */
               /* write register */
-              OPNWriteMode(addr,v);
+              OPNWriteMode(chip,addr,v);
           }
           break;
         default:  /* 0x30-0xff OPN section */
           /* write register */
-          OPNWriteReg(addr,v);
+          OPNWriteReg(chip,addr,v);
       }
       break;
     }
   }
 }
 
-unsigned int YM2612Read(void)
+unsigned int YM2612Read(YM2612 *chip)
 {
-  return ym2612.OPN.ST.status & 0xff;
+  return chip->OPN.ST.status & 0xff;
 }
 
 /* Generate samples for ym2612 */
-void YM2612Update(int *buffer, int length)
+void YM2612Update(YM2612 *chip, int *buffer, int length)
 {
   int i;
   int lt,rt;
 
   /* refresh PG increments and EG rates if required */
-  refresh_fc_eg_chan(&ym2612.CH[0]);
-  refresh_fc_eg_chan(&ym2612.CH[1]);
+  refresh_fc_eg_chan(&chip->CH[0]);
+  refresh_fc_eg_chan(&chip->CH[1]);
 
-  if (!(ym2612.OPN.ST.mode & 0xC0))
+  if (!(chip->OPN.ST.mode & 0xC0))
   {
-    refresh_fc_eg_chan(&ym2612.CH[2]);
+    refresh_fc_eg_chan(&chip->CH[2]);
   }
   else
   {  
     /* 3SLOT MODE (operator order is 0,1,3,2) */
-    if(ym2612.CH[2].SLOT[SLOT1].Incr==-1)
+    if(chip->CH[2].SLOT[SLOT1].Incr==-1)
     {
-      refresh_fc_eg_slot(&ym2612.CH[2].SLOT[SLOT1] , ym2612.OPN.SL3.fc[1] , ym2612.OPN.SL3.kcode[1] );
-      refresh_fc_eg_slot(&ym2612.CH[2].SLOT[SLOT2] , ym2612.OPN.SL3.fc[2] , ym2612.OPN.SL3.kcode[2] );
-      refresh_fc_eg_slot(&ym2612.CH[2].SLOT[SLOT3] , ym2612.OPN.SL3.fc[0] , ym2612.OPN.SL3.kcode[0] );
-      refresh_fc_eg_slot(&ym2612.CH[2].SLOT[SLOT4] , ym2612.CH[2].fc , ym2612.CH[2].kcode );
+      refresh_fc_eg_slot(&chip->CH[2].SLOT[SLOT1] , chip->OPN.SL3.fc[1] , chip->OPN.SL3.kcode[1] );
+      refresh_fc_eg_slot(&chip->CH[2].SLOT[SLOT2] , chip->OPN.SL3.fc[2] , chip->OPN.SL3.kcode[2] );
+      refresh_fc_eg_slot(&chip->CH[2].SLOT[SLOT3] , chip->OPN.SL3.fc[0] , chip->OPN.SL3.kcode[0] );
+      refresh_fc_eg_slot(&chip->CH[2].SLOT[SLOT4] , chip->CH[2].fc , chip->CH[2].kcode );
     }
   }
 
-  refresh_fc_eg_chan(&ym2612.CH[3]);
-  refresh_fc_eg_chan(&ym2612.CH[4]);
-  refresh_fc_eg_chan(&ym2612.CH[5]);
+  refresh_fc_eg_chan(&chip->CH[3]);
+  refresh_fc_eg_chan(&chip->CH[4]);
+  refresh_fc_eg_chan(&chip->CH[5]);
 
   /* buffering */
   for(i=0; i < length ; i++)
   {
     /* clear outputs */
-    out_fm[0] = 0;
-    out_fm[1] = 0;
-    out_fm[2] = 0;
-    out_fm[3] = 0;
-    out_fm[4] = 0;
-    out_fm[5] = 0;
+    chip->out_fm[0] = 0;
+    chip->out_fm[1] = 0;
+    chip->out_fm[2] = 0;
+    chip->out_fm[3] = 0;
+    chip->out_fm[4] = 0;
+    chip->out_fm[5] = 0;
 
     /* update SSG-EG output */
-    update_ssg_eg_channels(&ym2612.CH[0]);
+    update_ssg_eg_channels(&chip->CH[0]);
 
     /* calculate FM */
-    if (!ym2612.dacen)
+    if (!chip->dacen)
     {
-      chan_calc(&ym2612.CH[0],6);
+      chan_calc(chip,&chip->CH[0],6);
     }
     else
     {
       /* DAC Mode */
-      out_fm[5] = ym2612.dacout;
-      chan_calc(&ym2612.CH[0],5);
+      chip->out_fm[5] = (chip->mute & 0x20) ? 0 : chip->dacout;
+      chan_calc(chip,&chip->CH[0],5);
     }
 
     /* advance LFO */
-    advance_lfo();
+    advance_lfo(chip);
 
     /* advance envelope generator */
-    ym2612.OPN.eg_timer ++;
+    chip->OPN.eg_timer ++;
 
     /* EG is updated every 3 samples */
-    if (ym2612.OPN.eg_timer >= 3)
+    if (chip->OPN.eg_timer >= 3)
     {
-      ym2612.OPN.eg_timer = 0;
-      ym2612.OPN.eg_cnt++;
-      advance_eg_channels(&ym2612.CH[0], ym2612.OPN.eg_cnt);
+      chip->OPN.eg_timer = 0;
+      chip->OPN.eg_cnt++;
+      advance_eg_channels(&chip->CH[0], chip->OPN.eg_cnt);
     }
 
     /* 14-bit accumulator channels outputs (range is -8192;+8192) */
-    if (out_fm[0] > 8192) out_fm[0] = 8192;
-    else if (out_fm[0] < -8192) out_fm[0] = -8192;
-    if (out_fm[1] > 8192) out_fm[1] = 8192;
-    else if (out_fm[1] < -8192) out_fm[1] = -8192;
-    if (out_fm[2] > 8192) out_fm[2] = 8192;
-    else if (out_fm[2] < -8192) out_fm[2] = -8192;
-    if (out_fm[3] > 8192) out_fm[3] = 8192;
-    else if (out_fm[3] < -8192) out_fm[3] = -8192;
-    if (out_fm[4] > 8192) out_fm[4] = 8192;
-    else if (out_fm[4] < -8192) out_fm[4] = -8192;
-    if (out_fm[5] > 8192) out_fm[5] = 8192;
-    else if (out_fm[5] < -8192) out_fm[5] = -8192;
+    if (chip->out_fm[0] > 8192) chip->out_fm[0] = 8192;
+    else if (chip->out_fm[0] < -8192) chip->out_fm[0] = -8192;
+    if (chip->out_fm[1] > 8192) chip->out_fm[1] = 8192;
+    else if (chip->out_fm[1] < -8192) chip->out_fm[1] = -8192;
+    if (chip->out_fm[2] > 8192) chip->out_fm[2] = 8192;
+    else if (chip->out_fm[2] < -8192) chip->out_fm[2] = -8192;
+    if (chip->out_fm[3] > 8192) chip->out_fm[3] = 8192;
+    else if (chip->out_fm[3] < -8192) chip->out_fm[3] = -8192;
+    if (chip->out_fm[4] > 8192) chip->out_fm[4] = 8192;
+    else if (chip->out_fm[4] < -8192) chip->out_fm[4] = -8192;
+    if (chip->out_fm[5] > 8192) chip->out_fm[5] = 8192;
+    else if (chip->out_fm[5] < -8192) chip->out_fm[5] = -8192;
 
     /* stereo DAC channels outputs mixing  */
-    lt  = ((out_fm[0]) & ym2612.OPN.pan[0]);
-    rt  = ((out_fm[0]) & ym2612.OPN.pan[1]);
-    lt += ((out_fm[1]) & ym2612.OPN.pan[2]);
-    rt += ((out_fm[1]) & ym2612.OPN.pan[3]);
-    lt += ((out_fm[2]) & ym2612.OPN.pan[4]);
-    rt += ((out_fm[2]) & ym2612.OPN.pan[5]);
-    lt += ((out_fm[3]) & ym2612.OPN.pan[6]);
-    rt += ((out_fm[3]) & ym2612.OPN.pan[7]);
-    lt += ((out_fm[4]) & ym2612.OPN.pan[8]);
-    rt += ((out_fm[4]) & ym2612.OPN.pan[9]);
-    lt += ((out_fm[5]) & ym2612.OPN.pan[10]);
-    rt += ((out_fm[5]) & ym2612.OPN.pan[11]);
+    lt  = ((chip->out_fm[0]) & chip->OPN.pan[0]);
+    rt  = ((chip->out_fm[0]) & chip->OPN.pan[1]);
+    lt += ((chip->out_fm[1]) & chip->OPN.pan[2]);
+    rt += ((chip->out_fm[1]) & chip->OPN.pan[3]);
+    lt += ((chip->out_fm[2]) & chip->OPN.pan[4]);
+    rt += ((chip->out_fm[2]) & chip->OPN.pan[5]);
+    lt += ((chip->out_fm[3]) & chip->OPN.pan[6]);
+    rt += ((chip->out_fm[3]) & chip->OPN.pan[7]);
+    lt += ((chip->out_fm[4]) & chip->OPN.pan[8]);
+    rt += ((chip->out_fm[4]) & chip->OPN.pan[9]);
+    lt += ((chip->out_fm[5]) & chip->OPN.pan[10]);
+    rt += ((chip->out_fm[5]) & chip->OPN.pan[11]);
 
     /* buffering */
     *buffer++ = lt;
@@ -2097,53 +2126,58 @@ void YM2612Update(int *buffer, int length)
 
     /* CSM mode: if CSM Key ON has occured, CSM Key OFF need to be sent       */
     /* only if Timer A does not overflow again (i.e CSM Key ON not set again) */
-    ym2612.OPN.SL3.key_csm <<= 1;
+    chip->OPN.SL3.key_csm <<= 1;
 
     /* timer A control */
-    INTERNAL_TIMER_A();
+    INTERNAL_TIMER_A(chip);
 
     /* CSM Mode Key ON still disabled */
-    if (ym2612.OPN.SL3.key_csm & 2)
+    if (chip->OPN.SL3.key_csm & 2)
     {
       /* CSM Mode Key OFF (verified by Nemesis on real hardware) */
-      FM_KEYOFF_CSM(&ym2612.CH[2],SLOT1);
-      FM_KEYOFF_CSM(&ym2612.CH[2],SLOT2);
-      FM_KEYOFF_CSM(&ym2612.CH[2],SLOT3);
-      FM_KEYOFF_CSM(&ym2612.CH[2],SLOT4);
-      ym2612.OPN.SL3.key_csm = 0;
+      FM_KEYOFF_CSM(&chip->CH[2],SLOT1);
+      FM_KEYOFF_CSM(&chip->CH[2],SLOT2);
+      FM_KEYOFF_CSM(&chip->CH[2],SLOT3);
+      FM_KEYOFF_CSM(&chip->CH[2],SLOT4);
+      chip->OPN.SL3.key_csm = 0;
     }
   }
 
   /* timer B control */
-  INTERNAL_TIMER_B(length);
+  INTERNAL_TIMER_B(chip,length);
+}
+
+void YM2612SetMute(YM2612 *chip, unsigned int mask)
+{
+  chip->mute = mask;
 }
 
-void YM2612Config(unsigned char dac_bits)
+void YM2612Config(YM2612 *chip, unsigned char dac_bits)
 {
   int i;
 
   /* DAC precision (normally 9-bit on real hardware, implemented through simple 14-bit channel output bitmasking) */
-  bitmask = ~((1 << (TL_BITS - dac_bits)) - 1);
+  chip->bitmask = ~((1 << (TL_BITS - dac_bits)) - 1);
 
   /* update L/R panning bitmasks */
   for (i=0; i<2*6; i++)
   {
-    if (ym2612.OPN.pan[i])
+    if (chip->OPN.pan[i])
     {
-      ym2612.OPN.pan[i] = bitmask;
+      chip->OPN.pan[i] = chip->bitmask;
     }
   }
 }
 
 #if 0
-int YM2612LoadContext(unsigned char *state)
+int YM2612LoadContext(YM2612 *chip, unsigned char *state)
 {
   int c,s;
   uint8 index;
   int bufferptr = 0;
 
   /* restore YM2612 context */
-  load_param(&ym2612, sizeof(ym2612));
+  load_param(chip, sizeof(*chip));
 
   /* restore DT table address pointer for each channel slots */
   for (c=0; c<6; c++)
@@ -2152,36 +2186,36 @@ int YM2612LoadContext(unsigned char *state)
     {
       load_param(&index,sizeof(index));
       bufferptr += sizeof(index);
-      ym2612.CH[c].SLOT[s].DT = ym2612.OPN.ST.dt_tab[index&7];
+      chip->CH[c].SLOT[s].DT = chip->OPN.ST.dt_tab[index&7];
     }
   }
 
   /* restore outputs connections */
-  setup_connection(&ym2612.CH[0],0);
-  setup_connection(&ym2612.CH[1],1);
-  setup_connection(&ym2612.CH[2],2);
-  setup_connection(&ym2612.CH[3],3);
-  setup_connection(&ym2612.CH[4],4);
-  setup_connection(&ym2612.CH[5],5);
+  setup_connection(chip,&chip->CH[0],0);
+  setup_connection(chip,&chip->CH[1],1);
+  setup_connection(chip,&chip->CH[2],2);
+  setup_connection(chip,&chip->CH[3],3);
+  setup_connection(chip,&chip->CH[4],4);
+  setup_connection(chip,&chip->CH[5],5);
 
   return bufferptr;
 }
 
-int YM2612SaveContext(unsigned char *state)
+int YM2612SaveContext(YM2612 *chip, unsigned char *state)
 {
   int c,s;
   uint8 index;
   int bufferptr = 0;
 
   /* save YM2612 context */
-  save_param(&ym2612, sizeof(ym2612));
+  save_param(chip, sizeof(*chip));
 
   /* save DT table index for each channel slots */
   for (c=0; c<6; c++)
   {
     for (s=0; s<4; s++)
     {
-      index = (ym2612.CH[c].SLOT[s].DT - ym2612.OPN.ST.dt_tab[0]) >> 5;
+      index = (chip->CH[c].SLOT[s].DT - chip->OPN.ST.dt_tab[0]) >> 5;
       save_param(&index,sizeof(index));
       bufferptr += sizeof(index);
     }
@@ -20,12 +20,23 @@
 extern "C" {
 #endif
 
+    /* all chip state lives in the instance, the tables built by
+    ** YM2612Init are shared read only so instances may render on
+    ** different threads at the same time */
+    typedef struct ym2612_s YM2612;
+
+    /* build the shared tables, once before the first YM2612New */
     extern void YM2612Init(void);
-    extern void YM2612Config(unsigned char dac_bits);
-    extern void YM2612ResetChip(void);
-    extern void YM2612Update(int *buffer, int length);
-    extern void YM2612Write(unsigned int a, unsigned int v);
-    extern unsigned int YM2612Read(void);
+
+    extern YM2612 *YM2612New(void);
+    extern void YM2612Delete(YM2612 *chip);
+    extern void YM2612Config(YM2612 *chip, unsigned char dac_bits);
+    extern void YM2612ResetChip(YM2612 *chip);
+    extern void YM2612Update(YM2612 *chip, int *buffer, int length);
+    extern void YM2612Write(YM2612 *chip, unsigned int a, unsigned int v);
+    extern unsigned int YM2612Read(YM2612 *chip);
+    /* bit n set leaves channel n out of the render without calculating it */
+    extern void YM2612SetMute(YM2612 *chip, unsigned int mask);
 
 #if defined(__cplusplus)
 }
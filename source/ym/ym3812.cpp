@@ -83,6 +83,16 @@ double Rand_Real1()
 
 class Operator;
 
+// Tremolo and vibrato of one sample. OPL3::Update() works these out for a
+// whole block up front instead of in every Operator.
+struct LFOValues
+{
+	// tremolo attenuation in dB, halved like the other envelope levels
+	double tremolo;
+	// phase increment multiplier
+	double vibrato;
+};
+
 static inline double StripIntPart(double num)
 {
 #if 0
@@ -121,7 +131,6 @@ public:
 	void update_CHD1_CHC1_CHB1_CHA1_FB3_CNT1(class OPL3 *OPL3);
 	void updateChannel(class OPL3 *OPL3);
 	void updatePan(class OPL3 *OPL3);
-	virtual double getChannelOutput(class OPL3 *OPL3) = 0;
 
 	virtual void keyOn() = 0;
 	virtual void keyOff() = 0;
@@ -135,7 +144,8 @@ public:
 	Operator *op1, *op2;
 	
 	Channel2op (int baseAddress, double startvol, Operator *o1, Operator *o2);
-	double getChannelOutput(class OPL3 *OPL3);
+	bool isSilent();
+	double getChannelOutput(const LFOValues &lfo, int wsMask);
 	
 	void keyOn();
 	void keyOff();
@@ -149,7 +159,9 @@ public:
 	Operator *op1, *op2, *op3, *op4;
 
 	Channel4op (int baseAddress, double startvol, Operator *o1, Operator *o2, Operator *o3, Operator *o4);
-	double getChannelOutput(class OPL3 *OPL3);
+	int getCnt4op(class OPL3 *OPL3);
+	bool isSilent(int cnt4op);
+	double getChannelOutput(const LFOValues &lfo, int wsMask, int cnt4op);
 	
 	void keyOn();
 	void keyOff();
@@ -161,7 +173,6 @@ class DisabledChannel : public Channel
 {
 public:
 	DisabledChannel() : Channel(0, 0) { }
-	double getChannelOutput(class OPL3 *OPL3) { return 0; }    
 	void keyOn() { }
 	void keyOff() { }
 	void updateOperators(class OPL3 *OPL3) { }
@@ -197,7 +208,7 @@ public:
 private:
 	int calculateActualRate(int rate, int ksr, int keyScaleNumber);
 public:
-	double getEnvelope(OPL3 *OPL3, int egt, int am);
+	double getEnvelope(int egt, int am, double envelopeTremolo);
 	void keyOn();
 	void keyOff();
 
@@ -219,7 +230,7 @@ class PhaseGenerator {
 public:
 	PhaseGenerator();
 	void setFrequency(int f_number, int block, int mult);
-	double getPhase(class OPL3 *OPL3, int vib);
+	double getPhase(int vib, double vibrato);
 	void keyOn();
 };
 
@@ -250,13 +261,13 @@ public:
 	void update_AR4_DR4(class OPL3 *OPL3);
 	void update_SL4_RR4(class OPL3 *OPL3);
 	void update_5_WS3(class OPL3 *OPL3);
-	double getOperatorOutput(class OPL3 *OPL3, double modulator);
+	double getOperatorOutput(const LFOValues &lfo, int wsMask, double modulator);
 
 	void keyOn();
 	void keyOff();
  	void updateOperator(class OPL3 *OPL3, int ksn, int f_num, int blk);
 protected:
-	double getOutput(double modulator, double outputPhase, double *waveform);
+	double getOutput(double modulator, double outputPhase, const double *waveform);
 };
 
 
@@ -273,7 +284,8 @@ public:
 	RhythmChannel(int baseAddress, double startvol, Operator *o1, Operator *o2)
 	: Channel2op(baseAddress, startvol, o1, o2)
 	{ }
-	double getChannelOutput(class OPL3 *OPL3);
+	bool isSilent();
+	double getChannelOutput(const LFOValues &lfo, int wsMask);
 
 	// Rhythm channels are always running, 
 	// only the envelope is activated by the user.
@@ -302,22 +314,22 @@ class TopCymbalOperator : public Operator {
 public:
 	TopCymbalOperator(int baseAddress);
 	TopCymbalOperator();
-	double getOperatorOutput(class OPL3 *OPL3, double modulator);
-	double getOperatorOutput(class OPL3 *OPL3, double modulator, double externalPhase);
+	double getOperatorOutput(class OPL3 *OPL3, const LFOValues &lfo, double modulator);
+	double getOperatorOutput(class OPL3 *OPL3, const LFOValues &lfo, double modulator, double externalPhase);
 };
 
 class HighHatOperator : public TopCymbalOperator {
 	static const int highHatOperatorBaseAddress = 0x11;     
 public:
 	HighHatOperator();
-	double getOperatorOutput(class OPL3 *OPL3, double modulator);
+	double getOperatorOutput(class OPL3 *OPL3, const LFOValues &lfo, double modulator);
 };
 
 class SnareDrumOperator : public Operator {
 	static const int snareDrumOperatorBaseAddress = 0x14;
 public:
 	SnareDrumOperator();
-	double getOperatorOutput(class OPL3 *OPL3, double modulator);
+	double getOperatorOutput(class OPL3 *OPL3, const LFOValues &lfo, double modulator);
 };
 
 class TomTomOperator : public Operator {
@@ -335,7 +347,7 @@ class BassDrumChannel : public Channel2op {
 
 public:
 	BassDrumChannel(double startvol);
-	double getChannelOutput(class OPL3 *OPL3);
+	bool isSilent();
 	
 	// Key ON and OFF are unused in rhythm channels.
 	void keyOn() { }
@@ -364,25 +376,16 @@ public:
 	static const int tremoloTableLength = (int)(OPL_SAMPLE_RATE/tremoloFrequency);
 	static const int vibratoTableLength = 8192;
 
-	OPL3DataStruct()
-	{
-		loadVibratoTable();
-		loadTremoloTable();
-	}
-
 	// The first array is used when DVB=0 and the second array is used when DVB=1.
-	double vibratoTable[2][vibratoTableLength];
+	// The vibrato has 8 levels standing 1024 samples each, only the levels are stored.
+	static const double vibratoTable[2][8];
 
 	// First array used when AM = 0 and second array used when AM = 1.
-	double tremoloTable[2][tremoloTableLength];
+	static const double tremoloTable[2][tremoloTableLength];
 
 	static double calculateIncrement(double begin, double end, double period) {
 		return (end-begin)/OPL_SAMPLE_RATE * (1/period);
 	}
-
-private:
-	void loadVibratoTable();
-	void loadTremoloTable();
 };
 
 
@@ -427,35 +430,24 @@ struct OperatorDataStruct
 	static const float ksl3dBtable[16][8];
 	
 	//OPL3 has eight waveforms:
-	double waveforms[8][waveLength];
+	static const double waveforms[8][waveLength];
 
 #define MIN_DB				(-120.0)
 #define DB_TABLE_RES		(4.0)
 #define DB_TABLE_SIZE		(int)(-MIN_DB * DB_TABLE_RES)
 
-	double dbpow[DB_TABLE_SIZE];
+	static const double dbpow[DB_TABLE_SIZE];
 
 #define ATTACK_MIN			(-5.0)
 #define ATTACK_MAX			(8.0)
 #define ATTACK_RES			(0.03125)
 #define ATTACK_TABLE_SIZE	(int)((ATTACK_MAX - ATTACK_MIN) / ATTACK_RES)
 
-	double attackTable[ATTACK_TABLE_SIZE];
+	static const double attackTable[ATTACK_TABLE_SIZE];
 
-	OperatorDataStruct()
-	{
-		loadWaveforms();
-		loaddBPowTable();
-		loadAttackTable();
-	}
-	
 	static double log2(double x) {
 		return log(x)/log(2.0);
 	}
-private:
-	void loadWaveforms();
-	void loaddBPowTable();
-	void loadAttackTable();
 };
 const float OperatorDataStruct::multTable[16] = {0.5,1,2,3,4,5,6,7,8,9,10,10,12,12,15,15};
 
@@ -481,6 +473,10 @@ const float OperatorDataStruct::ksl3dBtable[16][8] = {
 	{0,-3,-6,-9,-12,-15,-18,-21}
 };
 
+// the OPL3DataStruct and OperatorDataStruct tables, generated at build time
+// by gen/ym3812_tables.cpp
+#include "ym3812_tables.inc"
+
 //
 // Envelope Generator Data
 //
@@ -579,11 +575,23 @@ public:
 	int nts, dam, dvb, ryt, bd, sd, tom, tc, hh, _new, connectionsel;
 	int vibratoIndex, tremoloIndex;
 
+	// Update() renders this many samples at a time, with the LFOs worked out
+	// and the silent channels dropped once for the whole block.
+	static const int renderBlockLength = 64;
+
+	enum ChannelKind { Kind2op, Kind4op, KindRhythm };
+
+	struct ActiveChannel
+	{
+		ChannelKind kind;
+		int cnt4op;
+		Channel *channel;
+	};
+
 	bool FullPan;
+	// channels left out of Update(), bit n for channel n of either array
+	uint32_t muteMask;
 	
-	static OperatorDataStruct *OperatorData;
-	static OPL3DataStruct *OPL3Data;
-
 	// The methods read() and write() are the only 
 	// ones needed by the user to interface with the emulator.
 	// read() returns one frame at a time, to be played at 49700 Hz, 
@@ -611,55 +619,103 @@ private:
 	void set4opConnections();
 	void setRhythmMode();
 
-	static int InstanceCount;
-
 	// OPLEmul interface
 public:
 	void Reset();
 	void WriteReg(int reg, int v);
 	void Update(float *buffer, int length);
 	void SetPanning(int c, float left, float right);
+	void SetMute(unsigned int mask);
 };
 
-OperatorDataStruct *OPL3::OperatorData;
-OPL3DataStruct *OPL3::OPL3Data;
-int OPL3::InstanceCount;
 
 void OPL3::Update(float *output, int numsamples) {
+	LFOValues lfo[renderBlockLength];
+	ActiveChannel active[18];
+
+	while (numsamples > 0) {
+		int blockLength = numsamples < renderBlockLength ? numsamples : renderBlockLength;
+
+		for (int i = 0; i < blockLength; i++) {
+			lfo[i].tremolo = OPL3DataStruct::tremoloTable[dam][tremoloIndex] / 2;
+			lfo[i].vibrato = OPL3DataStruct::vibratoTable[dvb][vibratoIndex >> 10];
+			// Advances the OPL3-wide vibrato index, which is used by 
+			// PhaseGenerator.getPhase() in each Operator.
+			vibratoIndex = (vibratoIndex + 1) & (OPL3DataStruct::vibratoTableLength - 1);
+			// Advances the OPL3-wide tremolo index, which is used by 
+			// EnvelopeGenerator.getEnvelope() in each Operator.
+			tremoloIndex++;
+			if(tremoloIndex >= OPL3DataStruct::tremoloTableLength) tremoloIndex = 0;
+		}
 
-	while (numsamples--) {
-
-        // clear destination value
-        output[0] = 0.f;
-
+		// Registers only change between calls to Update(), so a channel that is
+		// silent now stays silent for the whole block and can be left out.
+		// The channel type is known from where it sits, so no virtual call
+		// is needed per sample.
+		int numActive = 0;
 		// If _new = 0, use OPL2 mode with 9 channels. If _new = 1, use OPL3 18 channels;
-        for (int array = 0; array<(_new+1); array++) {
-            for (int channelNumber = 0; channelNumber<9; channelNumber++) {
-                // Reads output from each OPL3 channel, and accumulates it in the output buffer:
-                Channel *channel = channels[array][channelNumber];
-                if (channel!=&disabledChannel)
-                {
-                    double channelOutput = channel->getChannelOutput(this);
-                    // We don't need no stinking stereo
-                    //output[0] += float(channelOutput * channel->leftPan);
-                    //output[1] += float(channelOutput * channel->rightPan);
-                    output[0] += float(channelOutput);
-                }
-            }
-        }
+		for (int array = 0; array<(_new+1); array++) {
+			for (int channelNumber = 0; channelNumber<9; channelNumber++) {
+				Channel *channel = channels[array][channelNumber];
+				ActiveChannel &a = active[numActive];
+				a.channel = channel;
+				a.cnt4op = 0;
+				if (channel==&disabledChannel)
+					continue;
+				// muted channels are left out like silent ones
+				if (muteMask & (1u << (array*9+channelNumber)))
+					continue;
+				if (channel==&bassDrumChannel) {
+					a.kind = Kind2op;
+					if (bassDrumChannel.isSilent()) continue;
+				}
+				else if (channel==&highHatSnareDrumChannel || channel==&tomTomTopCymbalChannel) {
+					a.kind = KindRhythm;
+					if (static_cast<RhythmChannel*>(channel)->isSilent()) continue;
+				}
+				else if (channelNumber<3 && channel==channels4op[array][channelNumber]) {
+					a.kind = Kind4op;
+					a.cnt4op = channels4op[array][channelNumber]->getCnt4op(this);
+					if (channels4op[array][channelNumber]->isSilent(a.cnt4op)) continue;
+				}
+				else {
+					a.kind = Kind2op;
+					if (static_cast<Channel2op*>(channel)->isSilent()) continue;
+				}
+				numActive++;
+			}
+		}
+
+		// Channels are still summed one sample at a time in their usual order.
+		// This keeps the output bit exact, and lets the feedback chains of
+		// different channels overlap instead of running one after the other.
+		int wsMask = (_new<<2) + 3;
+		for (int i = 0; i < blockLength; i++) {
+			// clear destination value
+			float out = 0.f;
+			for (int c = 0; c < numActive; c++) {
+				const ActiveChannel &a = active[c];
+				double channelOutput;
+				switch (a.kind) {
+				case Kind4op:
+					channelOutput = static_cast<Channel4op*>(a.channel)->getChannelOutput(lfo[i], wsMask, a.cnt4op);
+					break;
+				case KindRhythm:
+					channelOutput = static_cast<RhythmChannel*>(a.channel)->getChannelOutput(lfo[i], wsMask);
+					break;
+				default:
+					channelOutput = static_cast<Channel2op*>(a.channel)->getChannelOutput(lfo[i], wsMask);
+				}
+				// We don't need no stinking stereo
+				//output[0] += float(channelOutput * channel->leftPan);
+				//output[1] += float(channelOutput * channel->rightPan);
+				out += float(channelOutput);
+			}
+			output[i] = out / 2.0f;	// scale output down to avoid clipping
+		}
 
-		output[0] /= 2.0f;	// scale output down to avoid clipping
-
-		// Advances the OPL3-wide vibrato index, which is used by 
-		// PhaseGenerator.getPhase() in each Operator.
-		vibratoIndex = (vibratoIndex + 1) & (OPL3DataStruct::vibratoTableLength - 1);
-		// Advances the OPL3-wide tremolo index, which is used by 
-		// EnvelopeGenerator.getEnvelope() in each Operator.
-		tremoloIndex++;
-		if(tremoloIndex >= OPL3DataStruct::tremoloTableLength) tremoloIndex = 0;
-		// We don't need no stinking stereo
-		//output += 2;
-		output += 1;
+		output += blockLength;
+		numsamples -= blockLength;
 	}
 }
 
@@ -754,15 +810,10 @@ OPL3::OPL3(bool fullpan)
   highHatSnareDrumChannel(fullpan ? CENTER_PANNING_POWER : 1, &highHatOperator, &snareDrumOperator)
 {
 	FullPan = fullpan;
+	muteMask = 0;
     nts = dam = dvb = ryt = bd = sd = tom = tc = hh = _new = connectionsel = 0;
     vibratoIndex = tremoloIndex = 0; 
 
-	if (InstanceCount++ == 0)
-	{
-		OPL3Data = new struct OPL3DataStruct;
-		OperatorData = new struct OperatorDataStruct;
-	}
-
     initOperators();
     initChannels2op();
     initChannels4op();
@@ -792,13 +843,6 @@ OPL3::~OPL3()
 			delete channels4op[array][channelNumber];
 		}
 	}
-	if (--InstanceCount == 0)
-	{
-		delete OPL3Data;
-		OPL3Data = NULL;
-		delete OperatorData;
-		OperatorData = NULL;
-	}
 }
 
 
@@ -1007,7 +1051,14 @@ static double EnvelopeFromDB(double db)
 #else
 	if (db < MIN_DB)
 		return 0;
-	return OPL3::OperatorData->dbpow[xs_FloorToInt(-db * DB_TABLE_RES)];
+	// the envelope and attenuation can sum to just above 0dB, and MIN_DB
+	// itself lands one past the end, so keep the index inside the table
+	int index = xs_FloorToInt(-db * DB_TABLE_RES);
+	if (index < 0)
+		index = 0;
+	if (index > DB_TABLE_SIZE - 1)
+		index = DB_TABLE_SIZE - 1;
+	return OperatorDataStruct::dbpow[index];
 #endif
 }
 
@@ -1085,7 +1136,15 @@ Channel2op::Channel2op (int baseAddress, double startvol, Operator *o1, Operator
 	op2 = o2;
 }
 
-double Channel2op::getChannelOutput(OPL3 *OPL3) {
+// True when neither operator can be heard until the next register write.
+bool Channel2op::isSilent() {
+	if(cnt==0)
+		return op2->envelopeGenerator.stage==EnvelopeGenerator::OFF;
+	return op1->envelopeGenerator.stage==EnvelopeGenerator::OFF && 
+		op2->envelopeGenerator.stage==EnvelopeGenerator::OFF;
+}
+
+double Channel2op::getChannelOutput(const LFOValues &lfo, int wsMask) {
 	double channelOutput = 0, op1Output = 0, op2Output = 0;
 	// The feedback uses the last two outputs from
 	// the first operator, instead of just the last one. 
@@ -1096,16 +1155,16 @@ double Channel2op::getChannelOutput(OPL3 *OPL3) {
 		case 0:
 			if(op2->envelopeGenerator.stage==EnvelopeGenerator::OFF) 
 				return 0;
-			op1Output = op1->getOperatorOutput(OPL3, feedbackOutput);
-			channelOutput = op2->getOperatorOutput(OPL3, op1Output*toPhase);
+			op1Output = op1->getOperatorOutput(lfo, wsMask, feedbackOutput);
+			channelOutput = op2->getOperatorOutput(lfo, wsMask, op1Output*toPhase);
 			break;
 		// CNT = 1, the operators are in parallel, with the first in feedback.
 		case 1:
 			if(op1->envelopeGenerator.stage==EnvelopeGenerator::OFF && 
 				op2->envelopeGenerator.stage==EnvelopeGenerator::OFF) 
 					return 0;
-			op1Output = op1->getOperatorOutput(OPL3, feedbackOutput);
-			op2Output = op2->getOperatorOutput(OPL3, Operator::noModulator);
+			op1Output = op1->getOperatorOutput(lfo, wsMask, feedbackOutput);
+			op2Output = op2->getOperatorOutput(lfo, wsMask, Operator::noModulator);
 			channelOutput = (op1Output + op2Output) / 2;
 	}
 	
@@ -1142,13 +1201,33 @@ Channel4op::Channel4op (int baseAddress, double startvol, Operator *o1, Operator
 	op4 = o4;
 }
 
-double Channel4op::getChannelOutput(OPL3 *OPL3) {
-	double channelOutput = 0, 
-		   op1Output = 0, op2Output = 0, op3Output = 0, op4Output = 0;
-	
+int Channel4op::getCnt4op(OPL3 *OPL3) {
 	int secondChannelBaseAddress = channelBaseAddress+3;
 	int secondCnt = OPL3->registers[secondChannelBaseAddress+ChannelData::CHD1_CHC1_CHB1_CHA1_FB3_CNT1_Offset] & 0x1;
-	int cnt4op = (cnt << 1) | secondCnt;
+	return (cnt << 1) | secondCnt;
+}
+
+// True when none of the output operators can be heard until the next register write.
+bool Channel4op::isSilent(int cnt4op) {
+	switch(cnt4op) {
+		case 0:
+			return op4->envelopeGenerator.stage==EnvelopeGenerator::OFF;
+		case 1:
+			return op2->envelopeGenerator.stage==EnvelopeGenerator::OFF && 
+				op4->envelopeGenerator.stage==EnvelopeGenerator::OFF;
+		case 2:
+			return op1->envelopeGenerator.stage==EnvelopeGenerator::OFF && 
+				op4->envelopeGenerator.stage==EnvelopeGenerator::OFF;
+		default:
+			return op1->envelopeGenerator.stage==EnvelopeGenerator::OFF && 
+				op3->envelopeGenerator.stage==EnvelopeGenerator::OFF && 
+				op4->envelopeGenerator.stage==EnvelopeGenerator::OFF;
+	}
+}
+
+double Channel4op::getChannelOutput(const LFOValues &lfo, int wsMask, int cnt4op) {
+	double channelOutput = 0, 
+		   op1Output = 0, op2Output = 0, op3Output = 0, op4Output = 0;
 	
 	double feedbackOutput = (feedback[0] + feedback[1]) / 2;
 	
@@ -1157,10 +1236,10 @@ double Channel4op::getChannelOutput(OPL3 *OPL3) {
 			if(op4->envelopeGenerator.stage==EnvelopeGenerator::OFF) 
 				return 0;
 			
-			op1Output = op1->getOperatorOutput(OPL3, feedbackOutput);
-			op2Output = op2->getOperatorOutput(OPL3, op1Output*toPhase);
-			op3Output = op3->getOperatorOutput(OPL3, op2Output*toPhase);
-			channelOutput = op4->getOperatorOutput(OPL3, op3Output*toPhase);
+			op1Output = op1->getOperatorOutput(lfo, wsMask, feedbackOutput);
+			op2Output = op2->getOperatorOutput(lfo, wsMask, op1Output*toPhase);
+			op3Output = op3->getOperatorOutput(lfo, wsMask, op2Output*toPhase);
+			channelOutput = op4->getOperatorOutput(lfo, wsMask, op3Output*toPhase);
 
 			break;
 		case 1:
@@ -1168,11 +1247,11 @@ double Channel4op::getChannelOutput(OPL3 *OPL3) {
 				op4->envelopeGenerator.stage==EnvelopeGenerator::OFF) 
 				   return 0;
 			
-			op1Output = op1->getOperatorOutput(OPL3, feedbackOutput);
-			op2Output = op2->getOperatorOutput(OPL3, op1Output*toPhase);
+			op1Output = op1->getOperatorOutput(lfo, wsMask, feedbackOutput);
+			op2Output = op2->getOperatorOutput(lfo, wsMask, op1Output*toPhase);
 			
-			op3Output = op3->getOperatorOutput(OPL3, Operator::noModulator);
-			op4Output = op4->getOperatorOutput(OPL3, op3Output*toPhase);
+			op3Output = op3->getOperatorOutput(lfo, wsMask, Operator::noModulator);
+			op4Output = op4->getOperatorOutput(lfo, wsMask, op3Output*toPhase);
 
 			channelOutput = (op2Output + op4Output) / 2;
 			break;
@@ -1181,11 +1260,11 @@ double Channel4op::getChannelOutput(OPL3 *OPL3) {
 				op4->envelopeGenerator.stage==EnvelopeGenerator::OFF) 
 				   return 0;
 
-			op1Output = op1->getOperatorOutput(OPL3, feedbackOutput);
+			op1Output = op1->getOperatorOutput(lfo, wsMask, feedbackOutput);
 			
-			op2Output = op2->getOperatorOutput(OPL3, Operator::noModulator);
-			op3Output = op3->getOperatorOutput(OPL3, op2Output*toPhase);
-			op4Output = op4->getOperatorOutput(OPL3, op3Output*toPhase);
+			op2Output = op2->getOperatorOutput(lfo, wsMask, Operator::noModulator);
+			op3Output = op3->getOperatorOutput(lfo, wsMask, op2Output*toPhase);
+			op4Output = op4->getOperatorOutput(lfo, wsMask, op3Output*toPhase);
 
 			channelOutput = (op1Output + op4Output) / 2;
 			break;
@@ -1195,12 +1274,12 @@ double Channel4op::getChannelOutput(OPL3 *OPL3) {
 				op4->envelopeGenerator.stage==EnvelopeGenerator::OFF) 
 				   return 0;
 			
-			op1Output = op1->getOperatorOutput(OPL3, feedbackOutput);
+			op1Output = op1->getOperatorOutput(lfo, wsMask, feedbackOutput);
 			
-			op2Output = op2->getOperatorOutput(OPL3, Operator::noModulator);
-			op3Output = op3->getOperatorOutput(OPL3, op2Output*toPhase);
+			op2Output = op2->getOperatorOutput(lfo, wsMask, Operator::noModulator);
+			op3Output = op3->getOperatorOutput(lfo, wsMask, op2Output*toPhase);
 			
-			op4Output = op4->getOperatorOutput(OPL3, Operator::noModulator);
+			op4Output = op4->getOperatorOutput(lfo, wsMask, Operator::noModulator);
 
 			channelOutput = (op1Output + op3Output + op4Output) / 3;
 	}
@@ -1313,23 +1392,23 @@ void Operator::update_5_WS3(OPL3 *OPL3) {
 	ws =  _5_ws3 & 0x07;
 }
 
-double Operator::getOperatorOutput(OPL3 *OPL3, double modulator) {
+double Operator::getOperatorOutput(const LFOValues &lfo, int wsMask, double modulator) {
 	if(envelopeGenerator.stage == EnvelopeGenerator::OFF) return 0;
 	
-	double envelopeInDB = envelopeGenerator.getEnvelope(OPL3, egt, am);
+	double envelopeInDB = envelopeGenerator.getEnvelope(egt, am, lfo.tremolo);
 	envelope = EnvelopeFromDB(envelopeInDB);
 	
 	// If it is in OPL2 mode, use first four waveforms only:
-	ws &= ((OPL3->_new<<2) + 3); 
-	double *waveform = OPL3::OperatorData->waveforms[ws];
+	ws &= wsMask; 
+	const double *waveform = OperatorDataStruct::waveforms[ws];
 	
-	phase = phaseGenerator.getPhase(OPL3, vib);
+	phase = phaseGenerator.getPhase(vib, lfo.vibrato);
 	
 	double operatorOutput = getOutput(modulator, phase, waveform);
 	return operatorOutput;
 }
 
-double Operator::getOutput(double modulator, double outputPhase, double *waveform) {
+double Operator::getOutput(double modulator, double outputPhase, const double *waveform) {
 	int sampleIndex = xs_FloorToInt((outputPhase + modulator) * OperatorDataStruct::waveLength) & (OperatorDataStruct::waveLength - 1);
 	return waveform[sampleIndex] * envelope;
 }    
@@ -1461,12 +1540,10 @@ int EnvelopeGenerator::calculateActualRate(int rate, int ksr, int keyScaleNumber
 	return actualRate;
 }
 
-double EnvelopeGenerator::getEnvelope(OPL3 *OPL3, int egt, int am) {
+double EnvelopeGenerator::getEnvelope(int egt, int am, double envelopeTremolo) {
 	// The datasheets attenuation values
 	// must be halved to match the real OPL3 output.
 	double envelopeSustainLevel = sustainLevel / 2;
-	double envelopeTremolo = 
-		OPL3::OPL3Data->tremoloTable[OPL3->dam][OPL3->tremoloIndex] / 2;
 	double envelopeAttenuation = attenuation / 2;
 	double envelopeTotalLevel = totalLevel / 2;
 	
@@ -1488,11 +1565,11 @@ double EnvelopeGenerator::getEnvelope(OPL3 *OPL3, int egt, int am) {
 #else
 				int index = xs_FloorToInt((x - ATTACK_MIN) / ATTACK_RES);
 				if (index < 0)
-					envelope = OPL3::OperatorData->attackTable[0];
+					envelope = OperatorDataStruct::attackTable[0];
 				else if (index >= ATTACK_TABLE_SIZE)
-					envelope = OPL3::OperatorData->attackTable[ATTACK_TABLE_SIZE-1];
+					envelope = OperatorDataStruct::attackTable[ATTACK_TABLE_SIZE-1];
 				else
-					envelope = OPL3::OperatorData->attackTable[index];
+					envelope = OperatorDataStruct::attackTable[index];
 #endif
 				x += xAttackIncrement;
 				break;
@@ -1599,10 +1676,10 @@ void PhaseGenerator::setFrequency(int f_number, int block, int mult) {
 	phaseIncrement = operatorFrequency/OPL_SAMPLE_RATE;
 }
 
-double PhaseGenerator::getPhase(OPL3 *OPL3, int vib) {
+double PhaseGenerator::getPhase(int vib, double vibrato) {
 	if(vib==1) 
 		// phaseIncrement = (operatorFrequency * vibrato) / OPL_SAMPLE_RATE
-		phase += phaseIncrement*OPL3::OPL3Data->vibratoTable[OPL3->dvb][OPL3->vibratoIndex];
+		phase += phaseIncrement*vibrato;
 	else 
 		// phaseIncrement = operatorFrequency / OPL_SAMPLE_RATE
 		phase += phaseIncrement;
@@ -1614,15 +1691,22 @@ void PhaseGenerator::keyOn() {
 	phase = 0;
 }
 
-double RhythmChannel::getChannelOutput(OPL3 *OPL3) { 
+// Operators that are Off return silence without touching their phase,
+// so the channel has nothing to do while both are Off.
+bool RhythmChannel::isSilent() {
+	return op1->envelopeGenerator.stage==EnvelopeGenerator::OFF && 
+		op2->envelopeGenerator.stage==EnvelopeGenerator::OFF;
+}
+
+double RhythmChannel::getChannelOutput(const LFOValues &lfo, int wsMask) { 
 	double channelOutput = 0, op1Output = 0, op2Output = 0;
 	
 	// Note that, different from the common channel,
 	// we do not check to see if the Operator's envelopes are Off.
 	// Instead, we always do the calculations, 
 	// to update the publicly available phase.
-	op1Output = op1->getOperatorOutput(OPL3, Operator::noModulator);
-	op2Output = op2->getOperatorOutput(OPL3, Operator::noModulator);        
+	op1Output = op1->getOperatorOutput(lfo, wsMask, Operator::noModulator);
+	op2Output = op2->getOperatorOutput(lfo, wsMask, Operator::noModulator);        
 	channelOutput = (op1Output + op2Output) / 2;
 	
 	return channelOutput;
@@ -1636,25 +1720,25 @@ TopCymbalOperator::TopCymbalOperator()
 : Operator(topCymbalOperatorBaseAddress)
 { }
 
-double TopCymbalOperator::getOperatorOutput(OPL3 *OPL3, double modulator) {
+double TopCymbalOperator::getOperatorOutput(OPL3 *OPL3, const LFOValues &lfo, double modulator) {
 	double highHatOperatorPhase = 
 		OPL3->highHatOperator.phase * OperatorDataStruct::multTable[OPL3->highHatOperator.mult];
 	// The Top Cymbal operator uses its own phase together with the High Hat phase.
-	return getOperatorOutput(OPL3, modulator, highHatOperatorPhase);
+	return getOperatorOutput(OPL3, lfo, modulator, highHatOperatorPhase);
 }
 
 // This method is used here with the HighHatOperator phase
 // as the externalPhase. 
 // Conversely, this method is also used through inheritance by the HighHatOperator, 
 // now with the TopCymbalOperator phase as the externalPhase.
-double TopCymbalOperator::getOperatorOutput(OPL3 *OPL3, double modulator, double externalPhase) {
-	double envelopeInDB = envelopeGenerator.getEnvelope(OPL3, egt, am);
+double TopCymbalOperator::getOperatorOutput(OPL3 *OPL3, const LFOValues &lfo, double modulator, double externalPhase) {
+	double envelopeInDB = envelopeGenerator.getEnvelope(egt, am, lfo.tremolo);
 	envelope = EnvelopeFromDB(envelopeInDB);
 	
-	phase = phaseGenerator.getPhase(OPL3, vib);
+	phase = phaseGenerator.getPhase(vib, lfo.vibrato);
 	
 	int waveIndex = ws & ((OPL3->_new<<2) + 3); 
-	double *waveform = OPL3::OperatorData->waveforms[waveIndex];
+	const double *waveform = OperatorDataStruct::waveforms[waveIndex];
 	
 	// Empirically tested multiplied phase for the Top Cymbal:
 	double carrierPhase = 8 * phase;
@@ -1674,13 +1758,13 @@ HighHatOperator::HighHatOperator()
 : TopCymbalOperator(highHatOperatorBaseAddress)
 { }
 
-double HighHatOperator::getOperatorOutput(OPL3 *OPL3, double modulator) {
+double HighHatOperator::getOperatorOutput(OPL3 *OPL3, const LFOValues &lfo, double modulator) {
 	double topCymbalOperatorPhase = 
 		OPL3->topCymbalOperator.phase * OperatorDataStruct::multTable[OPL3->topCymbalOperator.mult];
 	// The sound output from the High Hat resembles the one from
 	// Top Cymbal, so we use the parent method and modify its output
 	// accordingly afterwards.
-	double operatorOutput = TopCymbalOperator::getOperatorOutput(OPL3, modulator, topCymbalOperatorPhase);
+	double operatorOutput = TopCymbalOperator::getOperatorOutput(OPL3, lfo, modulator, topCymbalOperatorPhase);
 	if(operatorOutput == 0) operatorOutput = Rand_Real1()*envelope;
 	return operatorOutput;
 }
@@ -1689,15 +1773,15 @@ SnareDrumOperator::SnareDrumOperator()
 : Operator(snareDrumOperatorBaseAddress)
 { }
 
-double SnareDrumOperator::getOperatorOutput(OPL3 *OPL3, double modulator) {
+double SnareDrumOperator::getOperatorOutput(OPL3 *OPL3, const LFOValues &lfo, double modulator) {
 	if(envelopeGenerator.stage == EnvelopeGenerator::OFF) return 0;
 	
-	double envelopeInDB = envelopeGenerator.getEnvelope(OPL3, egt, am);
+	double envelopeInDB = envelopeGenerator.getEnvelope(egt, am, lfo.tremolo);
 	envelope = EnvelopeFromDB(envelopeInDB);
 	
 	// If it is in OPL2 mode, use first four waveforms only:
 	int waveIndex = ws & ((OPL3->_new<<2) + 3); 
-	double *waveform = OPL3::OperatorData->waveforms[waveIndex];
+	const double *waveform = OperatorDataStruct::waveforms[waveIndex];
 	
 	phase = OPL3->highHatOperator.phase * 2;
 	
@@ -1719,157 +1803,11 @@ BassDrumChannel::BassDrumChannel(double startvol)
   my_op1(op1BaseAddress), my_op2(op2BaseAddress)
 { }
 
-double BassDrumChannel::getChannelOutput(OPL3 *OPL3) {
+bool BassDrumChannel::isSilent() {
 	// Bass Drum ignores first operator, when it is in series.
+	// ar is only read on key on, so once per block is enough.
 	if(cnt == 1) op1->ar=0;
-	return Channel2op::getChannelOutput(OPL3);
-}
-
-void OPL3DataStruct::loadVibratoTable() {
-
-	// According to the YMF262 datasheet, the OPL3 vibrato repetition rate is 6.1 Hz.
-	// According to the YMF278B manual, it is 6.0 Hz. 
-	// The information that the vibrato table has 8 levels standing 1024 samples each
-	// was taken from the emulator by Jarek Burczynski and Tatsuyuki Satoh,
-	// with a frequency of 6,06689453125 Hz, what  makes sense with the difference 
-	// in the information on the datasheets.
-	
-	const double semitone = pow(2.0,1/12.0);
-	// A cent is 1/100 of a semitone:
-	const double cent = pow(semitone, 1/100.0);
-	
-	// When dvb=0, the depth is 7 cents, when it is 1, the depth is 14 cents.
-	const double DVB0 = pow(cent,7.0);
-	const double DVB1 = pow(cent,14.0);        
-	int i;
-	for(i = 0; i<1024; i++) 
-		vibratoTable[0][i] = vibratoTable[1][i] = 1;        
-	for(;i<2048; i++) {
-		vibratoTable[0][i] = sqrt(DVB0);
-		vibratoTable[1][i] = sqrt(DVB1);
-	}
-	for(;i<3072; i++) {
-		vibratoTable[0][i] = DVB0;
-		vibratoTable[1][i] = DVB1;
-	}
-	for(;i<4096; i++) {
-		vibratoTable[0][i] = sqrt(DVB0);
-		vibratoTable[1][i] = sqrt(DVB1);
-	}
-	for(; i<5120; i++) 
-		vibratoTable[0][i] = vibratoTable[1][i] = 1;        
-	for(;i<6144; i++) {
-		vibratoTable[0][i] = 1/sqrt(DVB0);
-		vibratoTable[1][i] = 1/sqrt(DVB1);
-	}
-	for(;i<7168; i++) {
-		vibratoTable[0][i] = 1/DVB0;
-		vibratoTable[1][i] = 1/DVB1;
-	}
-	for(;i<8192; i++) {
-		vibratoTable[0][i] = 1/sqrt(DVB0);
-		vibratoTable[1][i] = 1/sqrt(DVB1);
-	}
-	
-}
-
-void OPL3DataStruct::loadTremoloTable()
-{
-	// The tremolo depth is -1 dB when DAM = 0, and -4.8 dB when DAM = 1.
-	static const double tremoloDepth[] = {-1, -4.8};
-	
-	//  According to the YMF278B manual's OPL3 section graph, 
-	//              the tremolo waveform is not 
-	//   \      /   a sine wave, but a single triangle waveform.
-	//    \    /    Thus, the period to achieve the tremolo depth is T/2, and      
-	//     \  /     the increment in each T/2 section uses a frequency of 2*f.
-	//      \/      Tremolo varies from 0 dB to depth, to 0 dB again, at frequency*2:
-	const double tremoloIncrement[] = {
-		calculateIncrement(tremoloDepth[0],0,1/(2*tremoloFrequency)),
-		calculateIncrement(tremoloDepth[1],0,1/(2*tremoloFrequency))
-	};
-	
-	int tremoloTableLength = (int)(OPL_SAMPLE_RATE/tremoloFrequency);
-	
-	// This is undocumented. The tremolo starts at the maximum attenuation,
-	// instead of at 0 dB:
-	tremoloTable[0][0] = tremoloDepth[0];
-	tremoloTable[1][0] = tremoloDepth[1];
-	int counter = 0;
-	// The first half of the triangle waveform:
-	while(tremoloTable[0][counter]<0) {
-		counter++;
-		tremoloTable[0][counter] = tremoloTable[0][counter-1] + tremoloIncrement[0];
-		tremoloTable[1][counter] = tremoloTable[1][counter-1] + tremoloIncrement[1];
-	}
-	// The second half of the triangle waveform:
-	while(tremoloTable[0][counter]>tremoloDepth[0] && counter<tremoloTableLength-1) {
-		counter++;
-		tremoloTable[0][counter] = tremoloTable[0][counter-1] - tremoloIncrement[0];
-		tremoloTable[1][counter] = tremoloTable[1][counter-1] - tremoloIncrement[1];
-	}
-}
-
-void OperatorDataStruct::loadWaveforms() {
-	int i;
-	// 1st waveform: sinusoid.
-	double theta = 0, thetaIncrement = 2*M_PI / 1024;
-	
-	for(i=0, theta=0; i<1024; i++, theta += thetaIncrement)
-		waveforms[0][i] = sin(theta);
-	
-	double *sineTable = waveforms[0];
-	// 2nd: first half of a sinusoid.
-	for(i=0; i<512; i++) {
-		waveforms[1][i] = sineTable[i];
-		waveforms[1][512+i] = 0;
-	} 
-	// 3rd: double positive sinusoid.
-	for(i=0; i<512; i++) 
-		waveforms[2][i] = waveforms[2][512+i] = sineTable[i];         
-	// 4th: first and third quarter of double positive sinusoid.
-	for(i=0; i<256; i++) {
-		waveforms[3][i] = waveforms[3][512+i] = sineTable[i];
-		waveforms[3][256+i] = waveforms[3][768+i] = 0;
-	}
-	// 5th: first half with double frequency sinusoid.
-	for(i=0; i<512; i++) {
-		waveforms[4][i] = sineTable[i*2];
-		waveforms[4][512+i] = 0;
-	} 
-	// 6th: first half with double frequency positive sinusoid.
-	for(i=0; i<256; i++) {
-		waveforms[5][i] = waveforms[5][256+i] = sineTable[i*2];
-		waveforms[5][512+i] = waveforms[5][768+i] = 0;
-	}
-	// 7th: square wave
-	for(i=0; i<512; i++) {
-		waveforms[6][i] = 1;
-		waveforms[6][512+i] = -1;
-	}                
-	// 8th: exponential
-	double x;
-	double xIncrement = 1 * 16.0 / 256.0;
-	for(i=0, x=0; i<512; i++, x+=xIncrement) {
-		waveforms[7][i] = pow(2.0,-x);
-		waveforms[7][1023-i] = -pow(2.0,-(x + 1/16.0));
-	}
-}
-
-void OperatorDataStruct::loaddBPowTable()
-{
-	for (int i = 0; i < DB_TABLE_SIZE; ++i)
-	{
-		dbpow[i] = pow(10.0, -(i / DB_TABLE_RES) / 10.0);
-	}
-}
-
-void OperatorDataStruct::loadAttackTable()
-{
-	for (int i = 0; i < ATTACK_TABLE_SIZE; ++i)
-	{
-		attackTable[i] = -pow(2.0, ATTACK_MIN + i * ATTACK_RES);
-	}
+	return Channel2op::isSilent();
 }
 
 void OPL3::Reset()
@@ -1900,6 +1838,11 @@ void OPL3::SetPanning(int c, float left, float right)
 	}
 }
 
+void OPL3::SetMute(unsigned int mask)
+{
+	muteMask = mask;
+}
+
 OPLEmul *JavaOPLCreate(bool stereo)
 {
 	return new OPL3(stereo);
@@ -13,9 +13,13 @@ public:
 	virtual void WriteReg(int reg, int v) = 0;
 	virtual void Update(float *buffer, int length) = 0;
 	virtual void SetPanning(int c, float left, float right) = 0;
+	// bit n set leaves channel n out of Update() without calculating it,
+	// in rhythm mode channels 6 to 8 mute their drums
+	virtual void SetMute(unsigned int mask) {}
 };
 
 OPLEmul *JavaOPLCreate(bool stereo);
+OPLEmul *FixedOPLCreate(bool stereo);
 
 #define OPL_SAMPLE_RATE			49716.0
 #define CENTER_PANNING_POWER	0.70710678118	/* [RH] volume at center for EQP */
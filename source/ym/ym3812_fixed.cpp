@@ -0,0 +1,936 @@
+/* Integer OPL2/OPL3 core
+**
+** A second implementation of the OPLEmul interface working like the chip
+** does, in the log domain. Each operator looks up its phase in a quarter wave
+** log-sin table, adds its attenuation and converts back through an exponent
+** table, so an operator sample costs two table reads and some shifts instead
+** of the floating point math and virtual calls of the Java port.
+**
+** Output is rendered in blocks of up to 64 samples. The tremolo steps every 64
+** samples and the vibrato every 1024, so both are constant across a block and
+** everything derived from them (phase increments, levels and envelope rates)
+** is worked out once per operator per block. Channels then render the whole
+** block in loops specialised for their connection, two operator channels a few
+** at a time so their feedback chains overlap.
+**
+** This is not bit exact with the Java core and is not meant to be, it follows
+** the behaviour of the hardware where the two differ.
+**/
+#include <stdint.h>
+#include <string.h>
+
+#include "ym3812.h"
+
+namespace
+{
+
+/* Exponent table, the fraction of 2^(i/256) as 10 bits
+**
+** When such a table is used for calculation of the exponential, the table
+** is read at the position given by the 8 LSB's of the input. The value +
+** 1024 (the hidden bit) is then the significand of the floating point output
+** and the yet unused MSB's of the input are the exponent of the floating
+** point output. Indeed, YM3812 sends the audio to the YM3014B DAC in floating
+** point, so it is quite possible that summing of voices is done in floating
+** point also.
+**/
+const uint16_t t_ym_exp[256] = {
+    0   , 3   , 6   , 8   , 11  , 14  , 17  , 20  ,
+    22  , 25  , 28  , 31  , 34  , 37  , 40  , 42  ,
+    45  , 48  , 51  , 54  , 57  , 60  , 63  , 66  ,
+    69  , 72  , 75  , 78  , 81  , 84  , 87  , 90  ,
+    93  , 96  , 99  , 102 , 105 , 108 , 111 , 114 ,
+    117 , 120 , 123 , 126 , 130 , 133 , 136 , 139 ,
+    142 , 145 , 148 , 152 , 155 , 158 , 161 , 164 ,
+    168 , 171 , 174 , 177 , 181 , 184 , 187 , 190 ,
+    194 , 197 , 200 , 204 , 207 , 210 , 214 , 217 ,
+    220 , 224 , 227 , 231 , 234 , 237 , 241 , 244 ,
+    248 , 251 , 255 , 258 , 262 , 265 , 268 , 272 ,
+    276 , 279 , 283 , 286 , 290 , 293 , 297 , 300 ,
+    304 , 308 , 311 , 315 , 318 , 322 , 326 , 329 ,
+    333 , 337 , 340 , 344 , 348 , 352 , 355 , 359 ,
+    363 , 367 , 370 , 374 , 378 , 382 , 385 , 389 ,
+    393 , 397 , 401 , 405 , 409 , 412 , 416 , 420 ,
+    424 , 428 , 432 , 436 , 440 , 444 , 448 , 452 ,
+    456 , 460 , 464 , 468 , 472 , 476 , 480 , 484 ,
+    488 , 492 , 496 , 501 , 505 , 509 , 513 , 517 ,
+    521 , 526 , 530 , 534 , 538 , 542 , 547 , 551 ,
+    555 , 560 , 564 , 568 , 572 , 577 , 581 , 585 ,
+    590 , 594 , 599 , 603 , 607 , 612 , 616 , 621 ,
+    625 , 630 , 634 , 639 , 643 , 648 , 652 , 657 ,
+    661 , 666 , 670 , 675 , 680 , 684 , 689 , 693 ,
+    698 , 703 , 708 , 712 , 717 , 722 , 726 , 731 ,
+    736 , 741 , 745 , 750 , 755 , 760 , 765 , 770 ,
+    774 , 779 , 784 , 789 , 794 , 799 , 804 , 809 ,
+    814 , 819 , 824 , 829 , 834 , 839 , 844 , 849 ,
+    854 , 859 , 864 , 869 , 874 , 880 , 885 , 890 ,
+    895 , 900 , 906 , 911 , 916 , 921 , 927 , 932 ,
+    937 , 942 , 948 , 953 , 959 , 964 , 969 , 975 ,
+    980 , 986 , 991 , 996 , 1002, 1007, 1013, 1018,
+};
+
+
+/* Quarter wave of -log2(sin) in 4.8 fixed point
+**/
+const uint16_t t_ym_logsin[256] = {
+    2137, 1731, 1543, 1419, 1326, 1252, 1190, 1137,
+    1091, 1050, 1013, 979 , 949 , 920 , 894 , 869 ,
+    846 , 825 , 804 , 785 , 767 , 749 , 732 , 717 ,
+    701 , 687 , 672 , 659 , 646 , 633 , 621 , 609 ,
+    598 , 587 , 576 , 566 , 556 , 546 , 536 , 527 ,
+    518 , 509 , 501 , 492 , 484 , 476 , 468 , 461 ,
+    453 , 446 , 439 , 432 , 425 , 418 , 411 , 405 ,
+    399 , 392 , 386 , 380 , 375 , 369 , 363 , 358 ,
+    352 , 347 , 341 , 336 , 331 , 326 , 321 , 316 ,
+    311 , 307 , 302 , 297 , 293 , 289 , 284 , 280 ,
+    276 , 271 , 267 , 263 , 259 , 255 , 251 , 248 ,
+    244 , 240 , 236 , 233 , 229 , 226 , 222 , 219 ,
+    215 , 212 , 209 , 205 , 202 , 199 , 196 , 193 ,
+    190 , 187 , 184 , 181 , 178 , 175 , 172 , 169 ,
+    167 , 164 , 161 , 159 , 156 , 153 , 151 , 148 ,
+    146 , 143 , 141 , 138 , 136 , 134 , 131 , 129 ,
+    127 , 125 , 122 , 120 , 118 , 116 , 114 , 112 ,
+    110 , 108 , 106 , 104 , 102 , 100 , 98  , 96  ,
+    94  , 92  , 91  , 89  , 87  , 85  , 83  , 82  ,
+    80  , 78  , 77  , 75  , 74  , 72  , 70  , 69  ,
+    67  , 66  , 64  , 63  , 62  , 60  , 59  , 57  ,
+    56  , 55  , 53  , 52  , 51  , 49  , 48  , 47  ,
+    46  , 45  , 43  , 42  , 41  , 40  , 39  , 38  ,
+    37  , 36  , 35  , 34  , 33  , 32  , 31  , 30  ,
+    29  , 28  , 27  , 26  , 25  , 24  , 23  , 23  ,
+    22  , 21  , 20  , 20  , 19  , 18  , 17  , 17  ,
+    16  , 15  , 15  , 14  , 13  , 13  , 12  , 12  ,
+    11  , 10  , 10  , 9   , 9   , 8   , 8   , 7   ,
+    7   , 7   , 6   , 6   , 5   , 5   , 5   , 4   ,
+    4   , 4   , 3   , 3   , 3   , 2   , 2   , 2   ,
+    2   , 1   , 1   , 1   , 1   , 1   , 1   , 1   ,
+    0   , 0   , 0   , 0   , 0   , 0   , 0   , 0   ,
+};
+
+
+/* Envelope increments, eight steps per row selected by the rate
+**/
+const uint8_t t_eg_inc[15*8] = {
+    0, 1, 0, 1, 0, 1, 0, 1, // rates 1..12, fraction 0
+    0, 1, 0, 1, 1, 1, 0, 1, // fraction 1
+    0, 1, 1, 1, 0, 1, 1, 1, // fraction 2
+    0, 1, 1, 1, 1, 1, 1, 1, // fraction 3
+    1, 1, 1, 1, 1, 1, 1, 1, // rate 13
+    1, 1, 1, 2, 1, 1, 1, 2,
+    1, 2, 1, 2, 1, 2, 1, 2,
+    1, 2, 2, 2, 1, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, // rate 14
+    2, 2, 2, 4, 2, 2, 2, 4,
+    2, 4, 2, 4, 2, 4, 2, 4,
+    2, 4, 4, 4, 2, 4, 4, 4,
+    4, 4, 4, 4, 4, 4, 4, 4, // rate 15
+    8, 8, 8, 8, 8, 8, 8, 8, // instant attack
+    0, 0, 0, 0, 0, 0, 0, 0, // rate 0
+};
+
+
+/* Key scale level attenuation by the top four bits of the fnum
+**/
+const uint8_t t_ksl[16] = {
+    0, 32, 40, 45, 48, 51, 53, 55, 56, 58, 59, 60, 61, 62, 63, 64,
+};
+
+
+/* Shift applied to the key scale level for 0, 3, 1.5 and 6 dB/oct
+**/
+const uint8_t t_ksl_shift[4] = { 8, 1, 2, 0 };
+
+
+/* Frequency multiple times two
+**/
+const uint8_t t_mult[16] = {
+    1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 20, 24, 24, 30, 30,
+};
+
+
+/* Operator slot of each register offset, or -1 for the gaps
+**/
+const int8_t t_slot[0x20] = {
+     0,  1,  2,  3,  4,  5, -1, -1,  6,  7,  8,  9, 10, 11, -1, -1,
+    12, 13, 14, 15, 16, 17, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+
+enum {
+    EG_ATTACK,
+    EG_DECAY,
+    EG_SUSTAIN,
+    EG_RELEASE,
+    EG_OFF,
+};
+
+enum {
+    KEY_NORMAL = 1,
+    KEY_DRUM   = 2,
+};
+
+// largest envelope attenuation, 96dB in 0.1875dB steps
+const int32_t c_eg_max = 511;
+
+// samples the tremolo and so a render block lasts
+const uint32_t c_block = 64;
+
+
+/* Convert a 4.8 attenuation to a linear 13 bit magnitude
+**/
+inline int32_t _exp(uint32_t att)
+{
+    if (att>0x1fff) {
+        att = 0x1fff;
+    }
+    return ((t_ym_exp[(att & 0xff)^0xff]+1024)<<1)>>(att>>8);
+}
+
+
+/* Sine lookup through the log domain
+**
+** flip bits every quarter to reverse the index into the quarter wave table.
+**/
+inline uint32_t _logsin(uint32_t phase)
+{
+    return t_ym_logsin[(phase & 0x100) ? (~phase & 0xff) : (phase & 0xff)];
+}
+
+
+/* Log domain output of one of the eight waveforms for a 10 bit phase
+**
+** The sign is held in bit 15, the parts of a wave that are cut out are given
+** as an attenuation large enough to convert to zero.
+**/
+uint16_t _wave(uint32_t ws, uint32_t phase)
+{
+    const uint16_t c_neg = 0x8000;
+    const uint16_t c_zero = 0x1000;
+    switch (ws) {
+    default:
+    case 0: // sine
+        return ((phase & 0x200) ? c_neg : 0) | _logsin(phase);
+    case 1: // half sine
+        return (phase & 0x200) ? c_zero : _logsin(phase);
+    case 2: // absolute sine
+        return _logsin(phase);
+    case 3: // pulse sine
+        return (phase & 0x100) ? c_zero : _logsin(phase);
+    case 4: // alternating sine
+        if (phase & 0x200) {
+            return c_zero;
+        }
+        return ((phase & 0x100) ? c_neg : 0) | _logsin(phase<<1);
+    case 5: // camel sine
+        return (phase & 0x200) ? c_zero : _logsin(phase<<1);
+    case 6: // square
+        return (phase & 0x200) ? c_neg : 0;
+    case 7: // derived square
+        if (phase & 0x200) {
+            return c_neg | (((~phase) & 0x1ff)<<3);
+        }
+        return (phase & 0x1ff)<<3;
+    }
+}
+
+
+/* Envelope rate as a counter shift and a row of t_eg_inc
+**/
+void _eg_rate(uint32_t rate, bool attack, uint32_t & mask, uint32_t & shift, uint32_t & select)
+{
+    if (rate<4) {
+        shift = 0;
+        select = 14*8;
+        mask = ~0u;
+        return;
+    }
+    else if (rate<52) {
+        shift = 12-(rate>>2);
+        select = (rate & 3)*8;
+    }
+    else if (rate<60) {
+        shift = 0;
+        select = (4+rate-52)*8;
+    }
+    else {
+        shift = 0;
+        select = (attack && rate>=62) ? 13*8 : 12*8;
+    }
+    mask = (1<<shift)-1;
+}
+
+} // namespace {}
+
+
+class OPLFixed : public OPLEmul
+{
+protected:
+
+    struct op_t
+    {
+        // phase in 10.9 fixed point and its step for this block
+        uint32_t phase_;
+        uint32_t inc_;
+        // envelope attenuation
+        int32_t volume_;
+        uint32_t state_;
+        uint32_t key_;
+        // total level, key scale level and tremolo for this block
+        int32_t level_;
+        // envelope rates for this block
+        uint32_t ar_mask_, ar_shift_, ar_sel_;
+        uint32_t dr_mask_, dr_shift_, dr_sel_;
+        uint32_t rr_mask_, rr_shift_, rr_sel_;
+        int32_t sl_;
+        uint32_t ws_;
+        // registers
+        uint8_t am_, vib_, egt_, ksr_, mult_, ksl_, tl_, ar_, dr_, rr_;
+    };
+
+    struct channel_t
+    {
+        op_t * op_[2];
+        uint32_t fnum_, block_, fb_, cnt_;
+        bool kon_;
+        // last two outputs of the first operator for feedback
+        int32_t out_[2];
+    };
+
+    // all eight waveforms over a full cycle as read by _out()
+    uint16_t wave_[8][1024];
+    // _exp() of every attenuation a wave entry and an envelope can add to
+    int16_t exp_[0x3000];
+    op_t op_[36];
+    channel_t ch_[18];
+
+    // sample counter driving the envelopes and lfos
+    uint32_t timer_;
+    uint32_t noise_;
+    uint32_t nts_, dam_, dvb_, ryt_, new_, connection_;
+    int32_t tremolo_;
+    uint32_t vibpos_;
+    // channels that are not rendered, bit n for channel n
+    uint32_t mute_;
+
+    bool _is_4op(uint32_t c) const
+    {
+        const uint32_t n = c % 9;
+        return new_ && n<6 && (connection_ & (1<<((c/9)*3+n%3)));
+    }
+
+    void _key_on(op_t & op, uint32_t src)
+    {
+        if (!op.key_) {
+            op.phase_ = 0;
+            op.state_ = EG_ATTACK;
+        }
+        op.key_ |= src;
+    }
+
+    void _key_off(op_t & op, uint32_t src)
+    {
+        if (op.key_) {
+            op.key_ &= ~src;
+            if (!op.key_ && op.state_!=EG_OFF) {
+                op.state_ = EG_RELEASE;
+            }
+        }
+    }
+
+    void _key_channel(uint32_t c, bool on)
+    {
+        const uint32_t n = c % 9;
+        if (_is_4op(c) && n>=3) {
+            // keyed by the first channel of the pair
+            return;
+        }
+        const uint32_t count = _is_4op(c) ? 2 : 1;
+        for (uint32_t i = 0; i<count; ++i) {
+            channel_t & ch = ch_[c+i*3];
+            _key(*ch.op_[0], on, KEY_NORMAL);
+            _key(*ch.op_[1], on, KEY_NORMAL);
+        }
+    }
+
+    void _key(op_t & op, bool on, uint32_t src)
+    {
+        on ? _key_on(op, src) : _key_off(op, src);
+    }
+
+    void _write_drums(uint8_t v)
+    {
+        if (!ryt_) {
+            v = 0;
+        }
+        _key(*ch_[6].op_[0], (v & 0x10)!=0, KEY_DRUM);  // bass drum
+        _key(*ch_[6].op_[1], (v & 0x10)!=0, KEY_DRUM);
+        _key(*ch_[7].op_[1], (v & 0x08)!=0, KEY_DRUM);  // snare drum
+        _key(*ch_[8].op_[0], (v & 0x04)!=0, KEY_DRUM);  // tom tom
+        _key(*ch_[8].op_[1], (v & 0x02)!=0, KEY_DRUM);  // top cymbal
+        _key(*ch_[7].op_[0], (v & 0x01)!=0, KEY_DRUM);  // high hat
+    }
+
+    void _write_op(op_t & op, uint32_t type, uint8_t v)
+    {
+        switch (type) {
+        case 0x20:
+            op.am_ = (v>>7) & 1;
+            op.vib_ = (v>>6) & 1;
+            op.egt_ = (v>>5) & 1;
+            op.ksr_ = (v>>4) & 1;
+            op.mult_ = v & 15;
+            break;
+        case 0x40:
+            op.ksl_ = v>>6;
+            op.tl_ = v & 63;
+            break;
+        case 0x60:
+            op.ar_ = v>>4;
+            op.dr_ = v & 15;
+            break;
+        case 0x80:
+            op.sl_ = ((v>>4)==15 ? 31 : (v>>4))<<4;
+            op.rr_ = v & 15;
+            break;
+        case 0xe0:
+            op.ws_ = v & 7;
+            break;
+        }
+    }
+
+    void _write(uint32_t array, uint32_t addr, uint8_t v)
+    {
+        if (addr<0x20) {
+            if (array==1 && addr==0x04) {
+                connection_ = v & 0x3f;
+            }
+            else if (array==1 && addr==0x05) {
+                new_ = v & 1;
+            }
+            else if (array==0 && addr==0x08) {
+                nts_ = (v>>6) & 1;
+            }
+            return;
+        }
+
+        if (addr==0xbd) {
+            if (array==0) {
+                dam_ = (v>>7) & 1;
+                dvb_ = (v>>6) & 1;
+                ryt_ = (v>>5) & 1;
+                _write_drums(v);
+            }
+            return;
+        }
+
+        const uint32_t row = addr & 0xf0;
+        if (row==0xa0 || row==0xb0 || row==0xc0) {
+            const uint32_t n = addr & 0x0f;
+            if (n>8) {
+                return;
+            }
+            channel_t & ch = ch_[array*9+n];
+            if (row==0xa0) {
+                ch.fnum_ = (ch.fnum_ & 0x300) | v;
+            }
+            else if (row==0xb0) {
+                ch.fnum_ = (ch.fnum_ & 0xff) | ((v & 3)<<8);
+                ch.block_ = (v>>2) & 7;
+                const bool kon = (v & 0x20)!=0;
+                if (kon!=ch.kon_) {
+                    ch.kon_ = kon;
+                    _key_channel(array*9+n, kon);
+                }
+            }
+            else {
+                ch.fb_ = (v>>1) & 7;
+                ch.cnt_ = v & 1;
+            }
+            return;
+        }
+
+        const int32_t slot = t_slot[addr & 0x1f];
+        if (slot>=0) {
+            _write_op(op_[array*18+slot], addr & 0xe0, v);
+        }
+    }
+
+    /* Work out the per block state of an operator from its channel
+    **/
+    void _prepare(op_t & op, const channel_t & ch) const
+    {
+        uint32_t fnum = ch.fnum_;
+        if (op.vib_) {
+            int32_t range = (fnum>>7) & 7;
+            if (!(vibpos_ & 3)) {
+                range = 0;
+            }
+            else if (vibpos_ & 1) {
+                range >>= 1;
+            }
+            range >>= dvb_ ? 0 : 1;
+            fnum += (vibpos_ & 4) ? -range : range;
+        }
+        op.inc_ = ((((fnum<<ch.block_)>>1)*t_mult[op.mult_])>>1);
+
+        int32_t ksl = (t_ksl[ch.fnum_>>6]<<2)-int32_t((8-ch.block_)<<5);
+        ksl = (ksl<0) ? 0 : ksl;
+        op.level_ = (op.tl_<<2)+(ksl>>t_ksl_shift[op.ksl_])+(op.am_ ? tremolo_ : 0);
+
+        const uint32_t keycode = (ch.block_<<1) | ((ch.fnum_>>(nts_ ? 8 : 9)) & 1);
+        const uint32_t ksr = keycode>>(op.ksr_ ? 0 : 2);
+        _eg_rate(op.ar_ ? op.ar_*4+ksr : 0, true, op.ar_mask_, op.ar_shift_, op.ar_sel_);
+        _eg_rate(op.dr_ ? op.dr_*4+ksr : 0, false, op.dr_mask_, op.dr_shift_, op.dr_sel_);
+        _eg_rate(op.rr_ ? op.rr_*4+ksr : 0, false, op.rr_mask_, op.rr_shift_, op.rr_sel_);
+    }
+
+    /* Advance an envelope by one sample
+    **/
+    static inline void _eg_step(op_t & op, uint32_t t)
+    {
+        switch (op.state_) {
+        case EG_ATTACK:
+            if (!(t & op.ar_mask_)) {
+                op.volume_ += (~op.volume_*t_eg_inc[op.ar_sel_+((t>>op.ar_shift_) & 7)])>>3;
+                if (op.volume_<=0) {
+                    op.volume_ = 0;
+                    op.state_ = EG_DECAY;
+                }
+            }
+            break;
+        case EG_DECAY:
+            if (!(t & op.dr_mask_)) {
+                op.volume_ += t_eg_inc[op.dr_sel_+((t>>op.dr_shift_) & 7)];
+                if (op.volume_>=op.sl_) {
+                    op.state_ = EG_SUSTAIN;
+                }
+            }
+            break;
+        case EG_SUSTAIN:
+            // percussive sounds carry on at the release rate
+            if (op.egt_) {
+                break;
+            }
+            // fall through
+        case EG_RELEASE:
+            if (!(t & op.rr_mask_)) {
+                op.volume_ += t_eg_inc[op.rr_sel_+((t>>op.rr_shift_) & 7)];
+                if (op.volume_>=c_eg_max) {
+                    op.volume_ = c_eg_max;
+                    op.state_ = EG_OFF;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* Envelope counter mask of the current state, all set when it holds
+    **/
+    static uint32_t _eg_mask(const op_t & op)
+    {
+        switch (op.state_) {
+        case EG_ATTACK:  return op.ar_mask_;
+        case EG_DECAY:   return op.dr_mask_;
+        case EG_SUSTAIN: return op.egt_ ? ~0u : op.rr_mask_;
+        case EG_RELEASE: return op.rr_mask_;
+        default:         return ~0u;
+        }
+    }
+
+    /* Step a slow envelope for the whole block
+    **
+    ** an envelope stepping at most every 64 samples can only step on the
+    ** first sample of a block, so that is done up front. Returns true when the
+    ** envelope still has to be stepped every sample.
+    **/
+    bool _eg_block(op_t & op) const
+    {
+        if (_eg_mask(op)<c_block-1) {
+            return true;
+        }
+        _eg_step(op, timer_);
+        return _eg_mask(op)<c_block-1;
+    }
+
+    /* Attenuation of an operator in 4.8 fixed point
+    **/
+    static inline uint32_t _att(const op_t & op)
+    {
+        const uint32_t att = uint32_t(op.volume_+op.level_)<<3;
+        return (att<0x1fff) ? att : 0x1fff;
+    }
+
+    /* Linear output of a wave table entry with attenuation added
+    **/
+    inline int32_t _out(const uint16_t * wave, uint32_t phase, uint32_t att) const
+    {
+        const uint32_t w = wave[phase];
+        // flip all bits when the sign is set
+        return exp_[(w & 0x7fff)+att] ^ -int32_t(w>>15);
+    }
+
+    /* One sample of an operator with phase modulation mod
+    **/
+    inline int32_t _op(op_t & op, const uint16_t * wave, int32_t mod) const
+    {
+        const uint32_t phase = (op.phase_>>9)+uint32_t(mod);
+        op.phase_ += op.inc_;
+        if (op.state_==EG_OFF) {
+            return 0;
+        }
+        return _out(wave, phase & 0x3ff, _att(op));
+    }
+
+    static inline int32_t _feedback(const channel_t & ch)
+    {
+        return ch.fb_ ? (ch.out_[0]+ch.out_[1])>>(9-ch.fb_) : 0;
+    }
+
+    static inline void _push(channel_t & ch, int32_t out)
+    {
+        ch.out_[0] = ch.out_[1];
+        ch.out_[1] = out;
+    }
+
+    static bool _silent(const op_t * const * op, uint32_t count)
+    {
+        for (uint32_t i = 0; i<count; ++i) {
+            if (op[i]->state_!=EG_OFF) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const uint16_t * _wave_of(const op_t & op) const
+    {
+        // only the first four waveforms are available in OPL2 mode
+        return wave_[op.ws_ & (new_ ? 7 : 3)];
+    }
+
+    /* Render up to N two operator channels at once
+    **
+    ** each channel is one long dependency chain through its feedback, running
+    ** several side by side lets the cpu overlap them. CNT picks FM or AM with
+    ** a mask rather than a branch. Without EG the envelopes have already been
+    ** stepped by _eg_block().
+    **/
+    template <uint32_t N, bool EG>
+    void _render_2op(channel_t * const * ch, int32_t * dst, uint32_t count)
+    {
+        // work on copies, dst could otherwise alias the state
+        channel_t c[N];
+        op_t a[N], b[N];
+        const uint16_t * wa[N];
+        const uint16_t * wb[N];
+        int32_t am[N];
+        for (uint32_t k = 0; k<N; ++k) {
+            c[k] = *ch[k];
+            a[k] = *ch[k]->op_[0];
+            b[k] = *ch[k]->op_[1];
+            wa[k] = _wave_of(a[k]);
+            wb[k] = _wave_of(b[k]);
+            am[k] = -int32_t(c[k].cnt_);
+        }
+        for (uint32_t i = 0; i<count; ++i) {
+            const uint32_t t = timer_+i;
+            int32_t out = 0;
+            for (uint32_t k = 0; k<N; ++k) {
+                if (EG) {
+                    _eg_step(a[k], t);
+                    _eg_step(b[k], t);
+                }
+                const int32_t o1 = _op(a[k], wa[k], _feedback(c[k]));
+                _push(c[k], o1);
+                out += _op(b[k], wb[k], o1 & ~am[k])+(o1 & am[k]);
+            }
+            dst[i] += out;
+        }
+        for (uint32_t k = 0; k<N; ++k) {
+            *ch[k] = c[k];
+            *ch[k]->op_[0] = a[k];
+            *ch[k]->op_[1] = b[k];
+        }
+    }
+
+    template <bool EG>
+    void _render_2op_list(channel_t * const * ch, uint32_t count, int32_t * dst, uint32_t samples)
+    {
+        for (uint32_t i = 0; i<count; i += 4) {
+            switch (count-i) {
+            case 1:  _render_2op<1, EG>(ch+i, dst, samples); break;
+            case 2:  _render_2op<2, EG>(ch+i, dst, samples); break;
+            case 3:  _render_2op<3, EG>(ch+i, dst, samples); break;
+            default: _render_2op<4, EG>(ch+i, dst, samples); break;
+            }
+        }
+    }
+
+    /* Render a four operator channel pair, ALG is the CNT of both channels
+    **/
+    template <uint32_t ALG>
+    void _render_4op(channel_t & ch, op_t * const * src, int32_t * dst, uint32_t count)
+    {
+        channel_t c = ch;
+        op_t op[4] = { *src[0], *src[1], *src[2], *src[3] };
+        const uint16_t * ws[4];
+        for (uint32_t j = 0; j<4; ++j) {
+            ws[j] = _wave_of(op[j]);
+        }
+        for (uint32_t i = 0; i<count; ++i) {
+            const uint32_t t = timer_+i;
+            for (uint32_t j = 0; j<4; ++j) {
+                _eg_step(op[j], t);
+            }
+            const int32_t o1 = _op(op[0], ws[0], _feedback(c));
+            _push(c, o1);
+            switch (ALG) {
+            case 0: // 1 > 2 > 3 > 4
+                dst[i] += _op(op[3], ws[3], _op(op[2], ws[2], _op(op[1], ws[1], o1)));
+                break;
+            case 1: // (1 > 2) + (3 > 4)
+                dst[i] += _op(op[1], ws[1], o1)+_op(op[3], ws[3], _op(op[2], ws[2], 0));
+                break;
+            case 2: // 1 + (2 > 3 > 4)
+                dst[i] += o1+_op(op[3], ws[3], _op(op[2], ws[2], _op(op[1], ws[1], 0)));
+                break;
+            case 3: // 1 + (2 > 3) + 4
+                dst[i] += o1+_op(op[2], ws[2], _op(op[1], ws[1], 0))+_op(op[3], ws[3], 0);
+                break;
+            }
+        }
+        ch = c;
+        for (uint32_t j = 0; j<4; ++j) {
+            *src[j] = op[j];
+        }
+    }
+
+    /* Render the rhythm section of channels 6, 7 and 8, the drums of muted
+    ** channels only keep their envelopes and phases running
+    **/
+    void _render_rhythm(int32_t * dst, uint32_t count)
+    {
+        channel_t & c6 = ch_[6];
+        op_t & bd1 = *ch_[6].op_[0];
+        op_t & bd2 = *ch_[6].op_[1];
+        op_t & hh = *ch_[7].op_[0];
+        op_t & sd = *ch_[7].op_[1];
+        op_t & tt = *ch_[8].op_[0];
+        op_t & tc = *ch_[8].op_[1];
+        op_t * const all[6] = { &bd1, &bd2, &hh, &sd, &tt, &tc };
+
+        for (uint32_t i = 0; i<count; ++i) {
+            const uint32_t t = timer_+i;
+            for (op_t * op : all) {
+                _eg_step(*op, t);
+            }
+
+            int32_t out = 0;
+            if (!(mute_ & 0x40)) {
+                // bass drum, the first operator is dropped when in parallel
+                const int32_t o1 = _op(bd1, _wave_of(bd1), _feedback(c6));
+                _push(c6, o1);
+                out += _op(bd2, _wave_of(bd2), c6.cnt_ ? 0 : o1);
+            }
+            else {
+                bd1.phase_ += bd1.inc_;
+                bd2.phase_ += bd2.inc_;
+            }
+
+            // tom tom is a plain operator
+            if (!(mute_ & 0x100)) {
+                out += _op(tt, _wave_of(tt), 0);
+            }
+            else {
+                tt.phase_ += tt.inc_;
+            }
+
+            // high hat, snare drum and top cymbal mix the phases of the
+            // high hat and top cymbal operators with noise
+            const uint32_t hp = hh.phase_>>9;
+            const uint32_t cp = tc.phase_>>9;
+            hh.phase_ += hh.inc_;
+            sd.phase_ += sd.inc_;
+            tc.phase_ += tc.inc_;
+            const uint32_t bit = (((hp>>2) ^ (hp>>7)) | ((hp>>3) ^ (cp>>5)) | ((cp>>3) ^ (cp>>5))) & 1;
+            const uint32_t noise = noise_ & 1;
+
+            if (hh.state_!=EG_OFF && !(mute_ & 0x80)) {
+                const uint32_t phase = (bit<<9) | ((bit ^ noise) ? 0xd0 : 0x34);
+                out += _out(_wave_of(hh), phase, _att(hh));
+            }
+            if (sd.state_!=EG_OFF && !(mute_ & 0x80)) {
+                const uint32_t b8 = (hp>>8) & 1;
+                const uint32_t phase = (b8<<9) | ((b8 ^ noise)<<8);
+                out += _out(_wave_of(sd), phase, _att(sd));
+            }
+            if (tc.state_!=EG_OFF && !(mute_ & 0x100)) {
+                const uint32_t phase = (bit<<9) | 0x80;
+                out += _out(_wave_of(tc), phase, _att(tc));
+            }
+
+            noise_ = (noise_>>1) | ((((noise_>>14) ^ noise_) & 1)<<22);
+
+            // rhythm operators are mixed at double level
+            dst[i] += out*2;
+        }
+    }
+
+    void _render_block(int32_t * dst, uint32_t count)
+    {
+        // lfos only step on block boundaries
+        const uint32_t pos = (timer_>>6) % 210;
+        tremolo_ = int32_t((pos<105) ? pos : 210-pos)>>(dam_ ? 2 : 4);
+        vibpos_ = (timer_>>10) & 7;
+
+        // two operator channels are rendered last, grouped by whether their
+        // envelopes need stepping every sample
+        channel_t * fast[18];
+        channel_t * slow[18];
+        uint32_t fasts = 0, slows = 0;
+
+        const uint32_t arrays = new_ ? 2 : 1;
+        for (uint32_t c = 0; c<arrays*9; ++c) {
+            channel_t & ch = ch_[c];
+            const uint32_t n = c % 9;
+
+            if (c==6 && ryt_) {
+                if ((mute_ & 0x1c0)!=0x1c0) {
+                    for (uint32_t i = 6; i<9; ++i) {
+                        _prepare(*ch_[i].op_[0], ch_[i]);
+                        _prepare(*ch_[i].op_[1], ch_[i]);
+                    }
+                    _render_rhythm(dst, count);
+                }
+                c = 8;
+                continue;
+            }
+
+            // muted channels are left out like silent ones
+            if (mute_ & (1u<<c)) {
+                continue;
+            }
+
+            if (_is_4op(c)) {
+                if (n>=3) {
+                    continue;
+                }
+                op_t * const op[4] = { ch.op_[0], ch.op_[1], ch_[c+3].op_[0], ch_[c+3].op_[1] };
+                if (_silent(op, 4)) {
+                    continue;
+                }
+                for (op_t * o : op) {
+                    _prepare(*o, ch);
+                }
+                switch ((ch.cnt_<<1) | ch_[c+3].cnt_) {
+                case 0: _render_4op<0>(ch, op, dst, count); break;
+                case 1: _render_4op<1>(ch, op, dst, count); break;
+                case 2: _render_4op<2>(ch, op, dst, count); break;
+                case 3: _render_4op<3>(ch, op, dst, count); break;
+                }
+                continue;
+            }
+
+            if (_silent(ch.op_, 2)) {
+                continue;
+            }
+            _prepare(*ch.op_[0], ch);
+            _prepare(*ch.op_[1], ch);
+            const bool fast_a = _eg_block(*ch.op_[0]);
+            const bool fast_b = _eg_block(*ch.op_[1]);
+            if (fast_a || fast_b) {
+                fast[fasts++] = &ch;
+            }
+            else {
+                slow[slows++] = &ch;
+            }
+        }
+
+        _render_2op_list<true>(fast, fasts, dst, count);
+        _render_2op_list<false>(slow, slows, dst, count);
+
+        timer_ += count;
+    }
+
+public:
+
+    OPLFixed()
+    {
+        for (uint32_t ws = 0; ws<8; ++ws) {
+            for (uint32_t phase = 0; phase<1024; ++phase) {
+                wave_[ws][phase] = _wave(ws, phase);
+            }
+        }
+        for (uint32_t att = 0; att<0x3000; ++att) {
+            exp_[att] = int16_t(_exp(att));
+        }
+        mute_ = 0;
+        Reset();
+    }
+
+    void Reset() override
+    {
+        memset(op_, 0, sizeof(op_));
+        memset(ch_, 0, sizeof(ch_));
+        for (uint32_t i = 0; i<36; ++i) {
+            op_[i].volume_ = c_eg_max;
+            op_[i].state_ = EG_OFF;
+            op_[i].sl_ = 0;
+        }
+        for (uint32_t c = 0; c<18; ++c) {
+            // operators of channel n are slots n and n+3 within each group of six
+            const uint32_t slot = (c/9)*18+((c%9)/3)*6+(c%3);
+            ch_[c].op_[0] = &op_[slot];
+            ch_[c].op_[1] = &op_[slot+3];
+        }
+        timer_ = 0;
+        noise_ = 1;
+        nts_ = dam_ = dvb_ = ryt_ = new_ = connection_ = 0;
+        tremolo_ = 0;
+        vibpos_ = 0;
+    }
+
+    void WriteReg(int reg, int v) override
+    {
+        if (reg>=0 && reg<0x200) {
+            _write(uint32_t(reg)>>8, uint32_t(reg) & 0xff, uint8_t(v));
+        }
+    }
+
+    void Update(float * buffer, int length) override
+    {
+        // a full scale operator is 4096, halved like the Java core
+        const float c_scale = 1.f/8192.f;
+        int32_t mix[c_block];
+
+        while (length>0) {
+            const uint32_t count = c_block-(timer_ & (c_block-1));
+            const uint32_t todo = (uint32_t(length)<count) ? uint32_t(length) : count;
+            memset(mix, 0, sizeof(int32_t)*todo);
+            _render_block(mix, todo);
+            for (uint32_t i = 0; i<todo; ++i) {
+                buffer[i] = float(mix[i])*c_scale;
+            }
+            buffer += todo;
+            length -= int(todo);
+        }
+    }
+
+    void SetPanning(int c, float left, float right) override
+    {
+        // output is mono like the Java core
+    }
+
+    void SetMute(unsigned int mask) override
+    {
+        mute_ = mask;
+    }
+};
+
+
+OPLEmul *FixedOPLCreate(bool stereo)
+{
+    return new OPLFixed();
+}
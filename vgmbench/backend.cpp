@@ -0,0 +1,418 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "resample.h"
+#include "vgm.h"
+#include "vgm_mstream.h"
+
+#include "../libchip/mame_sn76489/Sn76496.h"
+#include "../libchip/mame_ym2612/Fm2612.h"
+#include "../libchip/mame_ym2151/Fm2151.h"
+#include "../source/chip/chip.h"
+#include "../source/config.h"
+#include "../source/gzip.h"
+
+#include "backend.h"
+
+const char* CHIP_NAMES[CHIP_COUNT] = {
+    "sn76489",
+    "ym2612",
+    "ym3812",
+    "ym2151",
+    "ay8910",
+};
+
+const uint32_t DEFAULT_CLOCK[CHIP_COUNT] = {
+    3579545,
+    7670453,
+    3579545,
+    3579545,
+    1789772,
+};
+
+uint64_t elapsed_ns(const steady_t::time_point& start)
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(steady_t::now() - start).count());
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+namespace {
+
+// chips from the player in source/chip, mono so both channels get the same
+struct backend_source_t : public backend_t {
+
+    backend_source_t(chip_t* chip)
+        : _chip(chip)
+    {
+    }
+
+    ~backend_source_t() override
+    {
+        delete _chip;
+    }
+
+    void write(uint32_t port, uint32_t reg, uint32_t data) override
+    {
+        // the player carries the port as bit 8 of the register
+        _chip->write(reg | (port << 8), data);
+    }
+
+    void render(int32_t* dst, uint32_t frames) override
+    {
+        while (frames) {
+            const uint32_t todo = std::min<uint32_t>(frames, _buffer.size());
+            _chip->render(_buffer.data(), todo);
+            for (uint32_t i = 0; i < todo; ++i) {
+                dst[i * 2 + 0] += _buffer[i];
+                dst[i * 2 + 1] += _buffer[i];
+            }
+            dst += todo * 2;
+            frames -= todo;
+        }
+    }
+
+protected:
+    chip_t* _chip;
+    std::array<int16_t, 1024> _buffer;
+};
+
+// chips from libchip, run at their native rate and resampled like playvgm
+struct backend_mame_t : public backend_t {
+
+    backend_mame_t(uint32_t native_rate)
+        : _resample(native_rate, SAMPLE_RATE, 2)
+    {
+    }
+
+    void render(int32_t* dst, uint32_t frames) override
+    {
+        while (frames) {
+            const uint32_t todo = std::min<uint32_t>(frames, 512);
+            const uint32_t native = _resample.input_frames(todo);
+            _native.assign(native * 2, 0);
+            _render(_native.data(), native);
+            _resample.write(_native.data(), native);
+            _resample.read(dst, todo);
+            dst += todo * 2;
+            frames -= todo;
+        }
+    }
+
+protected:
+    virtual void _render(int32_t* dst, uint32_t frames) = 0;
+
+    resample_t _resample;
+    std::vector<int32_t> _native;
+};
+
+struct backend_mame_sn76489_t : public backend_mame_t {
+
+    backend_mame_sn76489_t(uint32_t clock, bool event)
+        : backend_mame_t(clock / 16)
+        , _inst(segapsg_init(clock, clock / 16, false))
+    {
+        segapsg_set_gain(_inst, 256);
+        segapsg_set_event(_inst, event);
+    }
+
+    ~backend_mame_sn76489_t() override
+    {
+        segapsg_shutdown(_inst);
+    }
+
+    void write(uint32_t port, uint32_t reg, uint32_t data) override
+    {
+        segapsg_write_register(_inst, data);
+    }
+
+protected:
+    void _render(int32_t* dst, uint32_t frames) override
+    {
+        segapsg_render(_inst, dst, frames, true);
+    }
+
+    void* _inst;
+};
+
+struct backend_mame_ym2612_t : public backend_mame_t {
+
+    backend_mame_ym2612_t(uint32_t clock, bool simd)
+        : backend_mame_t(clock / 144)
+        , _inst(ym2612_init(clock, clock / 144))
+    {
+        ym2612_set_simd(_inst, simd);
+    }
+
+    ~backend_mame_ym2612_t() override
+    {
+        ym2612_shutdown(_inst);
+    }
+
+    void write(uint32_t port, uint32_t reg, uint32_t data) override
+    {
+        ym2612_write(_inst, port, reg, data);
+    }
+
+protected:
+    void _render(int32_t* dst, uint32_t frames) override
+    {
+        ym2612_render(_inst, dst, frames, true);
+    }
+
+    void* _inst;
+};
+
+struct backend_mame_ym2151_t : public backend_mame_t {
+
+    backend_mame_ym2151_t(uint32_t clock, bool simd)
+        : backend_mame_t(clock / 64)
+        , _inst(ym2151_init(clock, clock / 64))
+    {
+        ym2151_set_simd(_inst, simd);
+    }
+
+    ~backend_mame_ym2151_t() override
+    {
+        ym2151_shutdown(_inst);
+    }
+
+    void write(uint32_t port, uint32_t reg, uint32_t data) override
+    {
+        ym2151_write(_inst, reg, data);
+    }
+
+protected:
+    void _render(int32_t* dst, uint32_t frames) override
+    {
+        ym2151_render(_inst, dst, frames, true);
+    }
+
+    void* _inst;
+};
+
+// records every register write with the frame it lands on
+struct recorder_t : public vgm_chip_t {
+
+    recorder_t(std::vector<vgm_log_t::event_t>& events, const uint32_t& time)
+        : _events(events)
+        , _time(time)
+    {
+    }
+
+    void write(uint32_t port, uint32_t reg, uint32_t data) override
+    {
+        const vgm_log_t::event_t e = { _time, uint8_t(port), uint16_t(reg), uint8_t(data) };
+        _events.push_back(e);
+    }
+
+protected:
+    std::vector<vgm_log_t::event_t>& _events;
+    const uint32_t& _time;
+};
+
+// render frames into dst, or into scratch when there is no dst
+void _render(backend_t& backend, int32_t* dst, uint32_t pos, uint32_t frames)
+{
+    if (dst) {
+        backend.render(dst + pos * 2, frames);
+        return;
+    }
+    std::array<int32_t, 2048> scratch;
+    while (frames) {
+        const uint32_t todo = std::min<uint32_t>(frames, scratch.size() / 2);
+        std::fill(scratch.begin(), scratch.begin() + todo * 2, 0);
+        backend.render(scratch.data(), todo);
+        frames -= todo;
+    }
+}
+
+} // namespace {}
+
+backend_t* create_backend(uint32_t chip, const std::string& name, uint32_t clock, uint8_t type)
+{
+    switch (chip) {
+    case CHIP_SN76489:
+        if (name == "source") {
+            return new backend_source_t(chip_create_sn76489(clock));
+        }
+        if (name == "mame") {
+            return new backend_mame_sn76489_t(clock, true);
+        }
+        if (name == "mame_clocked") {
+            return new backend_mame_sn76489_t(clock, false);
+        }
+        break;
+    case CHIP_YM2612:
+        if (name == "source") {
+            return new backend_source_t(chip_create_ym2612(clock));
+        }
+        if (name == "mame") {
+            return new backend_mame_ym2612_t(clock, true);
+        }
+        if (name == "mame_scalar") {
+            return new backend_mame_ym2612_t(clock, false);
+        }
+        break;
+    case CHIP_YM3812:
+        if (name == "java") {
+            return new backend_source_t(chip_create_ym3812(clock));
+        }
+        if (name == "fixed") {
+            return new backend_source_t(chip_create_ym3812_fixed(clock));
+        }
+        break;
+    case CHIP_YM2151:
+        if (name == "source") {
+            return new backend_source_t(chip_create_ym2151(clock));
+        }
+        if (name == "mame") {
+            return new backend_mame_ym2151_t(clock, true);
+        }
+        if (name == "mame_scalar") {
+            return new backend_mame_ym2151_t(clock, false);
+        }
+        break;
+    case CHIP_AY8910:
+        if (name == "source") {
+            return new backend_source_t(chip_create_ay8910(clock, type));
+        }
+        break;
+    }
+    return nullptr;
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+bool vgm_log_t::load(const std::string& path, uint64_t* parse_ns)
+{
+    int size = 0;
+    uint8_t* data = gzOpen(path.c_str(), &size);
+    if (!data) {
+        return false;
+    }
+    if (size < 4 || memcmp(data, "Vgm ", 4) != 0) {
+        gzClose(data);
+        return false;
+    }
+
+    uint32_t time = 0;
+    std::unique_ptr<recorder_t> rec[CHIP_COUNT];
+    for (uint32_t i = 0; i < CHIP_COUNT; ++i) {
+        events[i].clear();
+        rec[i].reset(new recorder_t(events[i], time));
+    }
+    vgm_chip_bank_t bank;
+    bank.sn76489 = rec[CHIP_SN76489].get();
+    bank.ym2612 = rec[CHIP_YM2612].get();
+    bank.ym3812 = rec[CHIP_YM3812].get();
+    bank.ym2151 = rec[CHIP_YM2151].get();
+    bank.ay8910 = rec[CHIP_AY8910].get();
+
+    vgm_mstream_t stream(data, uint32_t(size));
+    vgm_t vgm;
+    const steady_t::time_point start = steady_t::now();
+    if (!vgm.init(&stream, &bank)) {
+        gzClose(data);
+        return false;
+    }
+    while (!vgm.finished()) {
+        vgm.advance();
+        time += vgm.get_delay_samples();
+    }
+    if (parse_ns) {
+        *parse_ns = elapsed_ns(start);
+    }
+    gzClose(data);
+
+    samples = time;
+    clocks[CHIP_SN76489] = vgm.header().clock_sn76489 & 0x3fffffffu;
+    clocks[CHIP_YM2612] = vgm.header().clock_ym2612 & 0x3fffffffu;
+    clocks[CHIP_YM3812] = 0;
+    clocks[CHIP_YM2151] = vgm.header().clock_ym2151 & 0x3fffffffu;
+    clocks[CHIP_AY8910] = vgm.header().clock_ay8910 & 0x3fffffffu;
+    std::fill(types, types + CHIP_COUNT, uint8_t(0));
+    types[CHIP_AY8910] = vgm.header().type_ay8910;
+    return true;
+}
+
+void vgm_log_t::replay(uint32_t chip, backend_t& backend, int32_t* dst) const
+{
+    uint32_t pos = 0;
+    for (const event_t& e : events[chip]) {
+        if (e.time > pos) {
+            _render(backend, dst, pos, e.time - pos);
+            pos = e.time;
+        }
+        backend.write(e.port, e.reg, e.data);
+    }
+    if (samples > pos) {
+        _render(backend, dst, pos, samples - pos);
+    }
+}
+
+uint32_t vgm_log_t::clock(uint32_t chip) const
+{
+    return clocks[chip] ? clocks[chip] : DEFAULT_CLOCK[chip];
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// append all files below a directory to out, returns false if not a directory
+bool list_dir(const std::string& dir, std::vector<std::string>& out)
+{
+#if defined(_MSC_VER)
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        const std::string name = data.cFileName;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        const std::string path = dir + "\\" + name;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            list_dir(path, out);
+        } else {
+            out.push_back(path);
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+    return true;
+#else
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return false;
+    }
+    while (dirent* entry = readdir(d)) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        const std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            list_dir(path, out);
+        } else {
+            out.push_back(path);
+        }
+    }
+    closedir(d);
+    return true;
+#endif
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// chips the tools know how to drive
+enum {
+    CHIP_SN76489,
+    CHIP_YM2612,
+    CHIP_YM3812,
+    CHIP_YM2151,
+    CHIP_AY8910,
+    CHIP_COUNT,
+};
+
+extern const char* CHIP_NAMES[CHIP_COUNT];
+
+// clocks used when the header does not give one
+extern const uint32_t DEFAULT_CLOCK[CHIP_COUNT];
+
+typedef std::chrono::steady_clock steady_t;
+
+// nanoseconds since start
+uint64_t elapsed_ns(const steady_t::time_point& start);
+
+// append all files below a directory to out, returns false if not a directory
+bool list_dir(const std::string& dir, std::vector<std::string>& out);
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// a chip emulation producing stereo frames at SAMPLE_RATE
+struct backend_t {
+
+    virtual ~backend_t() {}
+
+    virtual void write(uint32_t port, uint32_t reg, uint32_t data) = 0;
+
+    // mix frames into interleaved stereo dst
+    virtual void render(int32_t* dst, uint32_t frames) = 0;
+};
+
+// create a backend by name, returns nullptr for an unknown name
+//   sn76489: source, mame, mame_clocked
+//   ym2612:  source, mame, mame_scalar
+//   ym3812:  java, fixed
+//   ym2151:  source, mame, mame_scalar
+//   ay8910:  source
+// type is the chip variant from the vgm header, zero for the default
+backend_t* create_backend(uint32_t chip, const std::string& name, uint32_t clock, uint8_t type = 0);
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// a vgm file parsed into a timestamped log of writes per chip
+struct vgm_log_t {
+
+    struct event_t {
+        uint32_t time;
+        uint8_t port;
+        uint16_t reg;
+        uint8_t data;
+    };
+
+    // parse a .vgm or .vgz file, returns false if it is not a vgm file.
+    // parse_ns receives the time spent in the parser alone.
+    bool load(const std::string& path, uint64_t* parse_ns = nullptr);
+
+    // replay the log into a backend, dst may be null to discard the output
+    // otherwise it must hold samples * 2 values
+    void replay(uint32_t chip, backend_t& backend, int32_t* dst) const;
+
+    // clock of a chip from the header or its default
+    uint32_t clock(uint32_t chip) const;
+
+    // length of the track in frames
+    uint32_t samples;
+    // writes to each chip
+    std::vector<event_t> events[CHIP_COUNT];
+    // clocks from the header, zero when not given
+    uint32_t clocks[CHIP_COUNT];
+    // chip variants from the header, zero when not given
+    uint8_t types[CHIP_COUNT];
+};
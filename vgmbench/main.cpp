@@ -0,0 +1,286 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../source/config.h"
+
+#include "backend.h"
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+enum {
+    RET_SUCCESS,
+    RET_BAD_ARGS,
+    RET_BAD_BACKEND,
+    RET_BAD_OUT_FILE,
+    RET_NO_INPUT,
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+struct chip_result_t {
+    uint32_t chip;
+    uint32_t writes;
+    // time spent replaying writes and rendering
+    uint64_t ns;
+};
+
+struct track_result_t {
+    std::string path;
+    uint64_t samples;
+    uint64_t parse_ns;
+    std::vector<chip_result_t> chips;
+
+    uint64_t render_ns() const
+    {
+        uint64_t out = 0;
+        for (const chip_result_t& c : chips) {
+            out += c.ns;
+        }
+        return out;
+    }
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+struct bench_t {
+
+    bench_t()
+        : repeat(1)
+    {
+        backends[CHIP_SN76489] = "mame";
+        backends[CHIP_YM2612] = "mame";
+        backends[CHIP_YM3812] = "java";
+        backends[CHIP_YM2151] = "mame";
+        backends[CHIP_AY8910] = "source";
+    }
+
+    // run a single track, returns false if it is not a vgm file
+    bool run(const std::string& path, track_result_t& out)
+    {
+        // parse the whole stream into a log of writes per chip
+        vgm_log_t log;
+        out.path = path;
+        out.parse_ns = ~0ull;
+        for (uint32_t r = 0; r < repeat; ++r) {
+            uint64_t ns = 0;
+            if (!log.load(path, &ns)) {
+                return false;
+            }
+            out.parse_ns = std::min(out.parse_ns, ns);
+        }
+        out.samples = log.samples;
+
+        // replay the log into each chip that was used
+        for (uint32_t i = 0; i < CHIP_COUNT; ++i) {
+            if (log.events[i].empty() || backends[i] == "none") {
+                continue;
+            }
+            chip_result_t result;
+            result.chip = i;
+            result.writes = uint32_t(log.events[i].size());
+            result.ns = ~0ull;
+            for (uint32_t r = 0; r < repeat; ++r) {
+                std::unique_ptr<backend_t> chip(create_backend(i, backends[i], log.clock(i), log.types[i]));
+                const steady_t::time_point start = steady_t::now();
+                log.replay(i, *chip, nullptr);
+                result.ns = std::min(result.ns, elapsed_ns(start));
+            }
+            out.chips.push_back(result);
+        }
+        return true;
+    }
+
+    // backend name for each chip
+    std::string backends[CHIP_COUNT];
+    // each measurement keeps the best of this many runs
+    uint32_t repeat;
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+static void _json_string(FILE* fd, const std::string& str)
+{
+    fputc('"', fd);
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            fprintf(fd, "\\%c", c);
+        } else if (uint8_t(c) < 0x20) {
+            fprintf(fd, "\\u%04x", c);
+        } else {
+            fputc(c, fd);
+        }
+    }
+    fputc('"', fd);
+}
+
+// throughput figures shared by each track and the totals
+static void _json_stats(FILE* fd, uint64_t samples, uint64_t parse_ns, uint64_t render_ns)
+{
+    const double seconds = double(parse_ns + render_ns) * 1e-9;
+    const double audio = double(samples) / SAMPLE_RATE;
+    fprintf(fd, "\"samples\": %llu, ", (unsigned long long)samples);
+    fprintf(fd, "\"parse_ms\": %.3f, ", double(parse_ns) * 1e-6);
+    fprintf(fd, "\"render_ms\": %.3f, ", double(render_ns) * 1e-6);
+    fprintf(fd, "\"samples_per_second\": %.1f, ", seconds > 0.0 ? samples / seconds : 0.0);
+    fprintf(fd, "\"realtime_factor\": %.2f", seconds > 0.0 ? audio / seconds : 0.0);
+}
+
+static void _json_chip(FILE* fd, const char* chip, const std::string& backend,
+                       uint64_t writes, uint64_t samples, uint64_t ns)
+{
+    fprintf(fd, "{ \"chip\": \"%s\", \"backend\": ", chip);
+    _json_string(fd, backend);
+    fprintf(fd, ", \"writes\": %llu, \"render_ms\": %.3f, \"ns_per_sample\": %.2f }",
+            (unsigned long long)writes, double(ns) * 1e-6,
+            samples ? double(ns) / samples : 0.0);
+}
+
+static void _write_json(FILE* fd, const bench_t& bench, const std::vector<track_result_t>& tracks)
+{
+    fprintf(fd, "{\n");
+    fprintf(fd, "  \"sample_rate\": %u,\n", SAMPLE_RATE);
+    fprintf(fd, "  \"repeat\": %u,\n", bench.repeat);
+    fprintf(fd, "  \"backends\": { ");
+    for (uint32_t i = 0; i < CHIP_COUNT; ++i) {
+        fprintf(fd, "%s\"%s\": ", i ? ", " : "", CHIP_NAMES[i]);
+        _json_string(fd, bench.backends[i]);
+    }
+    fprintf(fd, " },\n");
+
+    // accumulated over all tracks
+    uint64_t samples = 0, parse_ns = 0, render_ns = 0;
+    uint64_t chip_writes[CHIP_COUNT] = { 0 };
+    uint64_t chip_samples[CHIP_COUNT] = { 0 };
+    uint64_t chip_ns[CHIP_COUNT] = { 0 };
+
+    fprintf(fd, "  \"tracks\": [\n");
+    for (size_t t = 0; t < tracks.size(); ++t) {
+        const track_result_t& track = tracks[t];
+        fprintf(fd, "    { \"file\": ");
+        _json_string(fd, track.path);
+        fprintf(fd, ", ");
+        _json_stats(fd, track.samples, track.parse_ns, track.render_ns());
+        fprintf(fd, ", \"chips\": [");
+        for (size_t c = 0; c < track.chips.size(); ++c) {
+            const chip_result_t& chip = track.chips[c];
+            fprintf(fd, "%s", c ? ", " : " ");
+            _json_chip(fd, CHIP_NAMES[chip.chip], bench.backends[chip.chip],
+                       chip.writes, track.samples, chip.ns);
+            chip_writes[chip.chip] += chip.writes;
+            chip_samples[chip.chip] += track.samples;
+            chip_ns[chip.chip] += chip.ns;
+        }
+        fprintf(fd, " ] }%s\n", (t + 1 < tracks.size()) ? "," : "");
+        samples += track.samples;
+        parse_ns += track.parse_ns;
+        render_ns += track.render_ns();
+    }
+    fprintf(fd, "  ],\n");
+
+    fprintf(fd, "  \"total\": { \"tracks\": %u, ", uint32_t(tracks.size()));
+    _json_stats(fd, samples, parse_ns, render_ns);
+    fprintf(fd, ", \"chips\": [");
+    bool first = true;
+    for (uint32_t i = 0; i < CHIP_COUNT; ++i) {
+        if (chip_samples[i] == 0) {
+            continue;
+        }
+        fprintf(fd, "%s", first ? " " : ", ");
+        _json_chip(fd, CHIP_NAMES[i], bench.backends[i], chip_writes[i], chip_samples[i], chip_ns[i]);
+        first = false;
+    }
+    fprintf(fd, " ] }\n");
+    fprintf(fd, "}\n");
+}
+
+static void _usage()
+{
+    fprintf(stderr,
+            "usage: vgmbench [-sn76489 source|mame|mame_clocked|none] [-ym2612 source|mame|mame_scalar|none]\n"
+            "                [-ym3812 java|fixed|none] [-ym2151 source|mame|mame_scalar|none]\n"
+            "                [-ay8910 source|none]\n"
+            "                [-r repeat] [-o out.json] [file|dir]...\n"
+            "renders music/ and regression/ when no inputs are given\n");
+}
+
+int main(const int argc, char** args)
+{
+    bench_t bench;
+    std::string out_path;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = args[i];
+        bool matched = false;
+        for (uint32_t c = 0; c < CHIP_COUNT && i + 1 < argc; ++c) {
+            if (arg == std::string("-") + CHIP_NAMES[c]) {
+                bench.backends[c] = args[++i];
+                matched = true;
+                break;
+            }
+        }
+        if (matched) {
+            continue;
+        }
+        if (arg == "-r" && i + 1 < argc) {
+            bench.repeat = std::max(1, atoi(args[++i]));
+        } else if (arg == "-o" && i + 1 < argc) {
+            out_path = args[++i];
+        } else if (arg == "-h") {
+            _usage();
+            return RET_BAD_ARGS;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    // check every backend name before spending time rendering
+    for (uint32_t c = 0; c < CHIP_COUNT; ++c) {
+        if (bench.backends[c] == "none") {
+            continue;
+        }
+        std::unique_ptr<backend_t> test(create_backend(c, bench.backends[c], DEFAULT_CLOCK[c]));
+        if (!test) {
+            fprintf(stderr, "unknown %s backend [%s]\n", CHIP_NAMES[c], bench.backends[c].c_str());
+            return RET_BAD_BACKEND;
+        }
+    }
+
+    if (inputs.empty()) {
+        inputs.push_back("music");
+        inputs.push_back("regression");
+    }
+    std::vector<std::string> paths;
+    for (const std::string& in : inputs) {
+        if (!list_dir(in, paths)) {
+            paths.push_back(in);
+        }
+    }
+    // stable ordering so runs can be diffed
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<track_result_t> tracks;
+    for (const std::string& path : paths) {
+        track_result_t result;
+        if (bench.run(path, result)) {
+            tracks.push_back(result);
+        }
+    }
+    if (tracks.empty()) {
+        return RET_NO_INPUT;
+    }
+
+    FILE* fd = out_path.empty() ? stdout : fopen(out_path.c_str(), "w");
+    if (!fd) {
+        return RET_BAD_OUT_FILE;
+    }
+    _write_json(fd, bench, tracks);
+    if (fd != stdout) {
+        fclose(fd);
+    }
+    return RET_SUCCESS;
+}
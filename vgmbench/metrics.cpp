@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "metrics.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define METRICS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// frames of the first channel searched for the best correlation lag
+static const size_t XCORR_WINDOW = 1 << 16;
+
+// samples summed in float before folding into a double
+static const size_t BLOCK = 4096;
+
+// peak and sum of squares of a - b
+void _diff_block(const int16_t* a, const int16_t* b, size_t count, uint32_t& peak, double& sum)
+{
+    size_t i = 0;
+#if METRICS_SSE2
+    __m128 vsum = _mm_setzero_ps();
+    __m128 vpeak = _mm_setzero_ps();
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 8 <= count; i += 8) {
+        const __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        const __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        // sign extend to 32 bits so the difference cannot overflow
+        const __m128i a_lo = _mm_srai_epi32(_mm_unpacklo_epi16(va, va), 16);
+        const __m128i a_hi = _mm_srai_epi32(_mm_unpackhi_epi16(va, va), 16);
+        const __m128i b_lo = _mm_srai_epi32(_mm_unpacklo_epi16(vb, vb), 16);
+        const __m128i b_hi = _mm_srai_epi32(_mm_unpackhi_epi16(vb, vb), 16);
+        const __m128 d_lo = _mm_cvtepi32_ps(_mm_sub_epi32(a_lo, b_lo));
+        const __m128 d_hi = _mm_cvtepi32_ps(_mm_sub_epi32(a_hi, b_hi));
+        vsum = _mm_add_ps(vsum, _mm_add_ps(_mm_mul_ps(d_lo, d_lo), _mm_mul_ps(d_hi, d_hi)));
+        vpeak = _mm_max_ps(vpeak, _mm_max_ps(_mm_and_ps(d_lo, abs_mask), _mm_and_ps(d_hi, abs_mask)));
+    }
+    float s[4], p[4];
+    _mm_storeu_ps(s, vsum);
+    _mm_storeu_ps(p, vpeak);
+    sum += double(s[0]) + double(s[1]) + double(s[2]) + double(s[3]);
+    peak = std::max(peak, uint32_t(std::max(std::max(p[0], p[1]), std::max(p[2], p[3]))));
+#endif
+    for (; i < count; ++i) {
+        const int32_t d = int32_t(a[i]) - int32_t(b[i]);
+        sum += double(d) * double(d);
+        peak = std::max(peak, uint32_t(d < 0 ? -d : d));
+    }
+}
+
+float _dot(const float* a, const float* b, size_t count)
+{
+    size_t i = 0;
+    float out = 0.f;
+#if METRICS_SSE2
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i + 0), _mm_loadu_ps(b + i + 0)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float s[4];
+    _mm_storeu_ps(s, _mm_add_ps(acc0, acc1));
+    out = (s[0] + s[1]) + (s[2] + s[3]);
+#endif
+    for (; i < count; ++i) {
+        out += a[i] * b[i];
+    }
+    return out;
+}
+
+// first channel as float, scaled to [-1, +1] to keep the dot products small
+std::vector<float> _channel(const int16_t* src, size_t frames, uint32_t channels)
+{
+    std::vector<float> out(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        out[i] = src[i * channels] * (1.f / 32768.f);
+    }
+    return out;
+}
+
+// normalized correlation of a[i] with b[i + lag] over their overlap
+double _correlate(const std::vector<float>& a, const std::vector<float>& b, int32_t lag)
+{
+    const size_t ia = (lag < 0) ? size_t(-lag) : 0;
+    const size_t ib = (lag < 0) ? 0 : size_t(lag);
+    const size_t n = a.size() - std::max(ia, ib);
+    const double ab = _dot(&a[ia], &b[ib], n);
+    const double aa = _dot(&a[ia], &a[ia], n);
+    const double bb = _dot(&b[ib], &b[ib], n);
+    if (aa > 0.0 && bb > 0.0) {
+        return ab / sqrt(aa * bb);
+    }
+    // two silent windows are taken as a perfect match
+    return (aa == bb) ? 1.0 : 0.0;
+}
+
+} // namespace {}
+
+uint64_t pcm_hash(const int16_t* src, size_t count)
+{
+    const uint8_t* data = (const uint8_t*)src;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < count * sizeof(int16_t); ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+pcm_diff_t pcm_compare(const int16_t* ref, const int16_t* test,
+                       size_t frames, uint32_t channels, uint32_t max_lag)
+{
+    pcm_diff_t out = { 0, 0.0, 0, 1.0 };
+    const size_t count = frames * channels;
+    if (count == 0) {
+        return out;
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < count; i += BLOCK) {
+        _diff_block(ref + i, test + i, std::min(BLOCK, count - i), out.peak, sum);
+    }
+    out.rms = sqrt(sum / double(count));
+
+    // search for the lag with the best normalized correlation
+    const size_t window = std::min(frames, XCORR_WINDOW);
+    const std::vector<float> a = _channel(ref, window, channels);
+    const std::vector<float> b = _channel(test, window, channels);
+    const int32_t lag_max = int32_t(std::min<size_t>(max_lag, window / 2));
+    // lag 0 goes first and another lag has to beat it by more than rounding
+    out.correlation = _correlate(a, b, 0);
+    for (int32_t lag = -lag_max; lag <= lag_max; ++lag) {
+        const double c = lag ? _correlate(a, b, lag) : -2.0;
+        if (c > out.correlation + 1e-6) {
+            out.correlation = c;
+            out.lag = lag;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// difference between a reference and a test render
+struct pcm_diff_t {
+    // largest absolute sample difference
+    uint32_t peak;
+    // root mean square of the sample difference
+    double rms;
+    // frames the test is shifted against the reference, by cross correlation
+    int32_t lag;
+    // normalized cross correlation at that lag, 1 for identical shapes
+    double correlation;
+};
+
+// 64 bit FNV-1a hash of pcm samples
+uint64_t pcm_hash(const int16_t* src, size_t count);
+
+// compare interleaved pcm of equal length, the lag search covers the first
+// channel over at most the first 64k frames
+pcm_diff_t pcm_compare(const int16_t* ref, const int16_t* test,
+                       size_t frames, uint32_t channels, uint32_t max_lag);
@@ -0,0 +1,318 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../source/config.h"
+#include "../vgmrender/wav.h"
+
+#include "backend.h"
+#include "metrics.h"
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+enum {
+    RET_SUCCESS,
+    RET_FAILED,
+    RET_BAD_ARGS,
+    RET_BAD_BACKEND,
+    RET_BAD_GOLDEN,
+    RET_NO_INPUT,
+};
+
+// lag search range for the cross correlation, in frames
+static const uint32_t MAX_LAG = 256;
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+struct golden_t {
+    uint64_t hash;
+    uint32_t frames;
+};
+
+// golden hashes keyed on the path of each track
+//
+// # comment
+// backends <sn76489> <ym2612> <ym3812> <ym2151> <ay8910>
+// <hash> <frames> <path>
+struct golden_file_t {
+
+    bool load(const std::string& path)
+    {
+        FILE* fd = fopen(path.c_str(), "r");
+        if (!fd) {
+            return false;
+        }
+        char line[1024];
+        while (fgets(line, sizeof(line), fd)) {
+            std::string str = line;
+            while (!str.empty() && (str.back() == '\n' || str.back() == '\r')) {
+                str.pop_back();
+            }
+            if (str.empty() || str[0] == '#') {
+                continue;
+            }
+            // one name per chip in CHIP_NAMES order
+            if (str.compare(0, 9, "backends ") == 0) {
+                backends = str.substr(9);
+                continue;
+            }
+            unsigned long long hash = 0;
+            unsigned frames = 0;
+            int offset = 0;
+            if (sscanf(str.c_str(), "%llx %u %n", &hash, &frames, &offset) >= 2 && offset > 0) {
+                const golden_t g = { uint64_t(hash), uint32_t(frames) };
+                tracks[str.substr(offset)] = g;
+            }
+        }
+        fclose(fd);
+        return true;
+    }
+
+    bool save(const std::string& path) const
+    {
+        FILE* fd = fopen(path.c_str(), "w");
+        if (!fd) {
+            return false;
+        }
+        fprintf(fd, "# golden pcm hashes written by vgmregress -update\n");
+        fprintf(fd, "# the float resampler makes these specific to the compiler and cpu family\n");
+        fprintf(fd, "backends %s\n", backends.c_str());
+        for (const auto& t : tracks) {
+            fprintf(fd, "%016llx %u %s\n", (unsigned long long)t.second.hash,
+                    t.second.frames, t.first.c_str());
+        }
+        fclose(fd);
+        return true;
+    }
+
+    std::string backends;
+    std::map<std::string, golden_t> tracks;
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// read a 16 bit pcm wav as written by wav_writer_t
+static bool _read_wav(const std::string& path, uint32_t channels, std::vector<int16_t>& out)
+{
+    FILE* fd = fopen(path.c_str(), "rb");
+    if (!fd) {
+        return false;
+    }
+    bool ok = false;
+    char riff[12];
+    if (fread(riff, 1, 12, fd) == 12 && memcmp(riff, "RIFF", 4) == 0 && memcmp(riff + 8, "WAVE", 4) == 0) {
+        char id[4];
+        uint32_t size = 0;
+        uint16_t fmt[8] = { 0 };
+        while (fread(id, 1, 4, fd) == 4 && fread(&size, 4, 1, fd) == 1) {
+            if (memcmp(id, "fmt ", 4) == 0) {
+                fread(fmt, 1, std::min<uint32_t>(size, sizeof(fmt)), fd);
+                fseek(fd, long(size - std::min<uint32_t>(size, sizeof(fmt))), SEEK_CUR);
+            } else if (memcmp(id, "data", 4) == 0) {
+                // format, channels and bits must match what we render
+                if (fmt[0] != 1 || fmt[1] != channels || fmt[7] != 16) {
+                    break;
+                }
+                out.resize(size / sizeof(int16_t));
+                ok = fread(out.data(), sizeof(int16_t), out.size(), fd) == out.size();
+                break;
+            } else {
+                fseek(fd, long(size + (size & 1)), SEEK_CUR);
+            }
+        }
+    }
+    fclose(fd);
+    return ok;
+}
+
+// name of the reference wav for a track
+static std::string _wav_path(const std::string& dir, const std::string& track)
+{
+    std::string name = track;
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::replace(name.begin(), name.end(), '\\', '_');
+    return dir + "/" + name + ".wav";
+}
+
+// render all chips of a track mixed down to 16 bit stereo
+static bool _render(const std::string& path, const std::string* backends, std::vector<int16_t>& out)
+{
+    vgm_log_t log;
+    if (!log.load(path)) {
+        return false;
+    }
+    std::vector<int32_t> mix(size_t(log.samples) * 2, 0);
+    for (uint32_t i = 0; i < CHIP_COUNT; ++i) {
+        if (log.events[i].empty() || backends[i] == "none") {
+            continue;
+        }
+        std::unique_ptr<backend_t> chip(create_backend(i, backends[i], log.clock(i), log.types[i]));
+        log.replay(i, *chip, mix.data());
+    }
+    out.resize(mix.size());
+    for (size_t i = 0; i < mix.size(); ++i) {
+        out[i] = int16_t(std::min<int32_t>(std::max<int32_t>(mix[i], -0x8000), 0x7fff));
+    }
+    return true;
+}
+
+static void _usage()
+{
+    fprintf(stderr,
+            "usage: vgmregress [-update] [-golden file] [-wav dir] [-peak n] [-rms x]\n"
+            "                  [-sn76489 name] [-ym2612 name] [-ym3812 name] [-ym2151 name]\n"
+            "                  [-ay8910 name] [file|dir]...\n"
+            "checks regression/ against regression/golden.txt when no inputs are given\n"
+            "regression/golden_source.txt holds the same tracks with -ym2612 source\n");
+}
+
+int main(const int argc, char** args)
+{
+    std::string backends[CHIP_COUNT] = { "mame", "mame", "java", "mame", "source" };
+    std::string golden_path = "regression/golden.txt";
+    std::string wav_dir;
+    bool update = false;
+    // tolerance used when the hash differs but a reference wav is present
+    uint32_t tol_peak = 0;
+    double tol_rms = 0.0;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = args[i];
+        bool matched = false;
+        for (uint32_t c = 0; c < CHIP_COUNT && i + 1 < argc; ++c) {
+            if (arg == std::string("-") + CHIP_NAMES[c]) {
+                backends[c] = args[++i];
+                matched = true;
+                break;
+            }
+        }
+        if (matched) {
+            continue;
+        }
+        if (arg == "-update") {
+            update = true;
+        } else if (arg == "-golden" && i + 1 < argc) {
+            golden_path = args[++i];
+        } else if (arg == "-wav" && i + 1 < argc) {
+            wav_dir = args[++i];
+        } else if (arg == "-peak" && i + 1 < argc) {
+            tol_peak = uint32_t(atoi(args[++i]));
+        } else if (arg == "-rms" && i + 1 < argc) {
+            tol_rms = atof(args[++i]);
+        } else if (arg == "-h") {
+            _usage();
+            return RET_BAD_ARGS;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    for (uint32_t c = 0; c < CHIP_COUNT; ++c) {
+        if (backends[c] == "none") {
+            continue;
+        }
+        std::unique_ptr<backend_t> test(create_backend(c, backends[c], DEFAULT_CLOCK[c]));
+        if (!test) {
+            fprintf(stderr, "unknown %s backend [%s]\n", CHIP_NAMES[c], backends[c].c_str());
+            return RET_BAD_BACKEND;
+        }
+    }
+    std::string config = backends[0];
+    for (uint32_t c = 1; c < CHIP_COUNT; ++c) {
+        config += " " + backends[c];
+    }
+
+    golden_file_t golden;
+    if (!golden.load(golden_path) && !update) {
+        fprintf(stderr, "unable to read golden file [%s]\n", golden_path.c_str());
+        return RET_BAD_GOLDEN;
+    }
+    if (!update && golden.backends != config) {
+        fprintf(stderr, "golden file was made with backends [%s] not [%s]\n",
+                golden.backends.c_str(), config.c_str());
+        return RET_BAD_GOLDEN;
+    }
+    golden.backends = config;
+
+    if (inputs.empty()) {
+        inputs.push_back("regression");
+    }
+    std::vector<std::string> paths;
+    for (const std::string& in : inputs) {
+        if (!list_dir(in, paths)) {
+            paths.push_back(in);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    uint32_t checked = 0, failed = 0;
+    std::vector<int16_t> pcm, ref;
+    for (const std::string& path : paths) {
+        if (!_render(path, backends, pcm)) {
+            // not a vgm file
+            continue;
+        }
+        ++checked;
+        const uint64_t hash = pcm_hash(pcm.data(), pcm.size());
+        const uint32_t frames = uint32_t(pcm.size() / 2);
+
+        if (update) {
+            const golden_t g = { hash, frames };
+            golden.tracks[path] = g;
+            if (!wav_dir.empty()) {
+                const std::string wav_path = _wav_path(wav_dir, path);
+                wav_writer_t wav(wav_path.c_str(), SAMPLE_RATE, 2);
+                if (!wav.valid()) {
+                    fprintf(stderr, "unable to write [%s]\n", wav_path.c_str());
+                    return RET_BAD_ARGS;
+                }
+                wav.write(pcm.data(), uint32_t(pcm.size()));
+            }
+            printf("updated  %016llx %s\n", (unsigned long long)hash, path.c_str());
+            continue;
+        }
+
+        auto found = golden.tracks.find(path);
+        if (found == golden.tracks.end()) {
+            printf("MISSING  %s\n", path.c_str());
+            ++failed;
+            continue;
+        }
+        if (found->second.hash == hash && found->second.frames == frames) {
+            printf("exact    %s\n", path.c_str());
+            continue;
+        }
+
+        // not bit exact, measure how far off we are against the reference
+        if (wav_dir.empty() || !_read_wav(_wav_path(wav_dir, path), 2, ref)) {
+            printf("FAILED   %s: hash %016llx, expected %016llx\n", path.c_str(),
+                   (unsigned long long)hash, (unsigned long long)found->second.hash);
+            ++failed;
+            continue;
+        }
+        const size_t common = std::min(ref.size(), pcm.size()) / 2;
+        const pcm_diff_t diff = pcm_compare(ref.data(), pcm.data(), common, 2, MAX_LAG);
+        const bool pass = ref.size() == pcm.size() && diff.lag == 0 &&
+                          diff.peak <= tol_peak && diff.rms <= tol_rms;
+        printf("%s %s: peak %u, rms %.3f, lag %d, correlation %.6f, frames %u/%u\n",
+               pass ? "within  " : "FAILED  ", path.c_str(), diff.peak, diff.rms,
+               diff.lag, diff.correlation, frames, uint32_t(ref.size() / 2));
+        failed += pass ? 0 : 1;
+    }
+
+    if (checked == 0) {
+        return RET_NO_INPUT;
+    }
+    if (update) {
+        return golden.save(golden_path) ? RET_SUCCESS : RET_BAD_GOLDEN;
+    }
+    printf("%u of %u tracks passed\n", checked - failed, checked);
+    return failed ? RET_FAILED : RET_SUCCESS;
+}
@@ -0,0 +1,378 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "../libvgm/vgm_trace.h"
+#include "../source/vgm.h"
+
+#include "pool.h"
+#include "wav.h"
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+enum {
+    RET_SUCCESS,
+    RET_BAD_ARGS,
+    RET_NO_INPUT,
+    RET_FAILED,
+};
+
+// samples rendered per vgm_render call
+static const uint32_t BLOCK_SIZE = 4096;
+
+// chip backends chosen on the command line, shared by every worker
+static sVGMBackends _backends;
+
+// channel masks from the command line, applied to every track that uses
+// the chip
+struct mask_t {
+    std::string chip;
+    uint32_t mask;
+    bool solo;
+};
+static std::vector<mask_t> _masks;
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+struct track_t {
+    std::string in;
+    std::string out;
+    uint64_t size;
+    // results
+    bool ok;
+    uint64_t samples;
+    double seconds;
+};
+
+struct worker_t {
+    worker_t()
+        : tracks(0)
+        , samples(0)
+        , seconds(0.0)
+    {
+    }
+
+    uint32_t tracks;
+    uint64_t samples;
+    // time spent rendering
+    double seconds;
+};
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+static uint64_t _file_size(const std::string& path)
+{
+    FILE* fd = fopen(path.c_str(), "rb");
+    if (!fd) {
+        return 0;
+    }
+    fseek(fd, 0, SEEK_END);
+    const long size = ftell(fd);
+    fclose(fd);
+    return (size > 0) ? uint64_t(size) : 0;
+}
+
+// append all files below a directory to out, returns false if not a directory
+static bool _list_dir(const std::string& dir, std::vector<std::string>& out)
+{
+#if defined(_MSC_VER)
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        const std::string name = data.cFileName;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        const std::string path = dir + "\\" + name;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            _list_dir(path, out);
+        } else {
+            out.push_back(path);
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+    return true;
+#else
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return false;
+    }
+    while (dirent* entry = readdir(d)) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        const std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            _list_dir(path, out);
+        } else {
+            out.push_back(path);
+        }
+    }
+    closedir(d);
+    return true;
+#endif
+}
+
+// create a directory along with any missing parents, returns false if it
+// is not there afterwards
+static bool _make_dir(const std::string& dir)
+{
+    for (size_t i = 1; i <= dir.size(); ++i) {
+        if (i < dir.size() && dir[i] != '/' && dir[i] != '\\') {
+            continue;
+        }
+        // existing parts fail and are skipped over
+        const std::string part = dir.substr(0, i);
+#if defined(_MSC_VER)
+        CreateDirectoryA(part.c_str(), nullptr);
+#else
+        mkdir(part.c_str(), 0755);
+#endif
+    }
+#if defined(_MSC_VER)
+    const DWORD attr = GetFileAttributesA(dir.c_str());
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+// read one path per line from a list file
+static bool _read_list(const std::string& list, std::vector<std::string>& out)
+{
+    FILE* fd = fopen(list.c_str(), "r");
+    if (!fd) {
+        return false;
+    }
+    std::array<char, 1024> line;
+    while (fgets(line.data(), int(line.size()), fd)) {
+        std::string path = line.data();
+        while (!path.empty() && (path.back() == '\n' || path.back() == '\r')) {
+            path.pop_back();
+        }
+        if (!path.empty()) {
+            out.push_back(path);
+        }
+    }
+    fclose(fd);
+    return true;
+}
+
+// output path for an input, relative paths are flattened into out_dir so
+// tracks from different directories with the same name do not collide
+static std::string _out_path(const std::string& out_dir, const std::string& rel)
+{
+    std::string name = rel;
+    const size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos) {
+        const std::string ext = name.substr(dot);
+        if (ext == ".vgm" || ext == ".vgz") {
+            name.erase(dot);
+        }
+    }
+    if (out_dir.empty()) {
+        return name + ".wav";
+    }
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::replace(name.begin(), name.end(), '\\', '_');
+    return out_dir + "/" + name + ".wav";
+}
+
+static void _add_input(const std::string& arg, const std::string& out_dir, std::vector<track_t>& tracks)
+{
+    std::vector<std::string> paths;
+    std::string root;
+    if (!arg.empty() && arg[0] == '@') {
+        if (!_read_list(arg.substr(1), paths)) {
+            fprintf(stderr, "unable to read list [%s]\n", arg.c_str() + 1);
+        }
+    } else if (_list_dir(arg, paths)) {
+        root = arg;
+    } else {
+        paths.push_back(arg);
+    }
+    for (const std::string& path : paths) {
+        // paths found in a directory are named relative to it
+        std::string rel = path;
+        if (!root.empty() && out_dir.size()) {
+            rel = path.substr(std::min(path.size(), root.size() + 1));
+        } else if (out_dir.size()) {
+            const size_t slash = path.find_last_of("/\\");
+            rel = (slash == std::string::npos) ? path : path.substr(slash + 1);
+        }
+        track_t t;
+        t.in = path;
+        t.out = _out_path(out_dir, rel);
+        t.size = _file_size(path);
+        t.ok = false;
+        t.samples = 0;
+        t.seconds = 0.0;
+        tracks.push_back(t);
+    }
+}
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+static bool _render_track(track_t& track)
+{
+    VGM_TRACE_THREAD("worker");
+    VGM_TRACE_SCOPE("track");
+    sVGMFile* vgm = vgm_load(track.in.c_str(), &_backends);
+    if (vgm == nullptr) {
+        // not a vgm file
+        return false;
+    }
+    for (const mask_t& m : _masks) {
+        if (m.solo) {
+            vgm_set_solo(vgm, m.chip.c_str(), m.mask);
+        } else {
+            vgm_set_mute(vgm, m.chip.c_str(), m.mask);
+        }
+    }
+    wav_writer_t wav(track.out.c_str(), SAMPLE_RATE, 1);
+    if (!wav.valid()) {
+        fprintf(stderr, "unable to write [%s]\n", track.out.c_str());
+        vgm_free(vgm);
+        return false;
+    }
+    std::array<int16_t, BLOCK_SIZE> buffer;
+    while (!vgm->finished) {
+        const uint32_t done = vgm_render(vgm, buffer.data(), buffer.size());
+        wav.write(buffer.data(), done);
+    }
+    track.samples = wav.samples();
+    const bool failed = vgm->failed;
+    vgm_free(vgm);
+    if (failed) {
+        fprintf(stderr, "unable to parse [%s]\n", track.in.c_str());
+        wav.close();
+        return false;
+    }
+    return wav.close();
+}
+
+static void _usage()
+{
+    printf("usage: vgmrender [-j threads] [-o out_dir] [-trace file] [-b chip backend]\n"
+           "                 [-mute chip mask] [-solo chip mask] <file|dir|@list>...\n");
+}
+
+int main(const int argc, char** args)
+{
+    uint32_t threads = std::thread::hardware_concurrency();
+    std::string out_dir;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = args[i];
+        if (arg == "-j" && i + 1 < argc) {
+            threads = uint32_t(atoi(args[++i]));
+        } else if (arg == "-o" && i + 1 < argc) {
+            out_dir = args[++i];
+        } else if (arg == "-trace" && i + 1 < argc) {
+            vgm_trace_t::get().open(args[++i]);
+        } else if (arg == "-b" && i + 2 < argc) {
+            if (!vgm_select_backend(&_backends, args[i + 1], args[i + 2])) {
+                fprintf(stderr, "unknown backend [%s %s]\n", args[i + 1], args[i + 2]);
+                return RET_BAD_ARGS;
+            }
+            i += 2;
+        } else if ((arg == "-mute" || arg == "-solo") && i + 2 < argc) {
+            // mask has a bit per channel, ie. -solo ym2612 0x20 for the dac
+            const mask_t m = { args[i + 1], uint32_t(strtoul(args[i + 2], nullptr, 0)), arg == "-solo" };
+            _masks.push_back(m);
+            i += 2;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        _usage();
+        return RET_BAD_ARGS;
+    }
+    if (!out_dir.empty() && !_make_dir(out_dir)) {
+        fprintf(stderr, "unable to create [%s]\n", out_dir.c_str());
+        return RET_FAILED;
+    }
+
+    std::vector<track_t> tracks;
+    for (const std::string& in : inputs) {
+        _add_input(in, out_dir, tracks);
+    }
+    if (tracks.empty()) {
+        return RET_NO_INPUT;
+    }
+    // deal the biggest files first so the long tail is made of small tracks
+    std::stable_sort(tracks.begin(), tracks.end(), [](const track_t& a, const track_t& b) {
+        return a.size > b.size;
+    });
+
+    typedef std::chrono::steady_clock steady_t;
+    work_pool_t pool(threads);
+    std::vector<worker_t> workers(pool.workers());
+
+    const steady_t::time_point start = steady_t::now();
+    pool.run(uint32_t(tracks.size()), [&](uint32_t w, uint32_t index) {
+        track_t& track = tracks[index];
+        const steady_t::time_point t0 = steady_t::now();
+        track.ok = _render_track(track);
+        track.seconds = std::chrono::duration<double>(steady_t::now() - t0).count();
+        if (!track.ok) {
+            return;
+        }
+        worker_t& worker = workers[w];
+        worker.tracks += 1;
+        worker.samples += track.samples;
+        worker.seconds += track.seconds;
+        const double audio = double(track.samples) / SAMPLE_RATE;
+        printf("[%2u] %s: %.1fs in %.2fs (%.1fx)\n",
+               w, track.in.c_str(), audio, track.seconds,
+               audio / std::max(track.seconds, 1e-9));
+    });
+    const double wall = std::chrono::duration<double>(steady_t::now() - start).count();
+
+    // throughput summary
+    uint32_t rendered = 0;
+    uint64_t samples = 0;
+    double busy = 0.0;
+    for (uint32_t i = 0; i < workers.size(); ++i) {
+        const worker_t& worker = workers[i];
+        const double audio = double(worker.samples) / SAMPLE_RATE;
+        printf("worker %2u: %u tracks, %.1fs audio, %.1fx realtime\n",
+               i, worker.tracks, audio, audio / std::max(worker.seconds, 1e-9));
+        rendered += worker.tracks;
+        samples += worker.samples;
+        busy += worker.seconds;
+    }
+    const double audio = double(samples) / SAMPLE_RATE;
+    printf("rendered %u of %u files, %.1fs audio in %.2fs\n",
+           rendered, uint32_t(tracks.size()), audio, wall);
+    printf("realtime factor: %.1fx total, %.1fx per core (%u workers)\n",
+           audio / std::max(wall, 1e-9),
+           audio / std::max(busy, 1e-9),
+           pool.workers());
+
+    return rendered ? RET_SUCCESS : RET_FAILED;
+}
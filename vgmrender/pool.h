@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work stealing thread pool for a fixed batch of tasks
+//
+// tasks are dealt round robin onto one queue per worker. a worker takes from
+// the front of its own queue and when that runs dry it steals from the back
+// of another worker's queue, so deal the most expensive tasks first.
+struct work_pool_t {
+
+    // called with the worker index and the task index
+    typedef std::function<void(uint32_t, uint32_t)> task_t;
+
+    work_pool_t(uint32_t workers)
+    {
+        if (workers == 0) {
+            workers = 1;
+        }
+        for (uint32_t i = 0; i < workers; ++i) {
+            _queues.emplace_back(new queue_t);
+        }
+    }
+
+    uint32_t workers() const
+    {
+        return uint32_t(_queues.size());
+    }
+
+    // run tasks [0, count) and return once they have all completed
+    void run(uint32_t count, const task_t& task)
+    {
+        for (uint32_t i = 0; i < count; ++i) {
+            _queues[i % _queues.size()]->tasks.push_back(i);
+        }
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < workers(); ++i) {
+            threads.emplace_back(&work_pool_t::_worker, this, i, std::cref(task));
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+protected:
+    struct queue_t {
+        std::mutex lock;
+        std::deque<uint32_t> tasks;
+    };
+
+    bool _pop(uint32_t worker, uint32_t& out)
+    {
+        queue_t& q = *_queues[worker];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.tasks.empty()) {
+            return false;
+        }
+        out = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+    }
+
+    bool _steal(uint32_t worker, uint32_t& out)
+    {
+        for (uint32_t i = 1; i < workers(); ++i) {
+            queue_t& q = *_queues[(worker + i) % workers()];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (!q.tasks.empty()) {
+                out = q.tasks.back();
+                q.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void _worker(uint32_t worker, const task_t& task)
+    {
+        uint32_t index = 0;
+        // no task ever spawns another so once every queue is empty we are done
+        while (_pop(worker, index) || _steal(worker, index)) {
+            task(worker, index);
+        }
+    }
+
+    std::vector<std::unique_ptr<queue_t>> _queues;
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// 16 bit pcm wav file writer
+//
+// samples are gathered in a large buffer and written out in few big fwrites,
+// the riff header is written up front and patched with the sizes on close.
+struct wav_writer_t {
+
+    // default buffer size in samples (2MB)
+    static const uint32_t DEFAULT_BUFFER = 1024 * 1024;
+
+    wav_writer_t(const char* path, uint32_t rate, uint32_t channels,
+                 uint32_t buffer = DEFAULT_BUFFER)
+        : _fd(fopen(path, "wb"))
+        , _rate(rate)
+        , _channels(channels)
+        , _written(0)
+    {
+        if (_fd) {
+            // we do our own buffering
+            setvbuf(_fd, nullptr, _IONBF, 0);
+            _buffer.reserve(buffer);
+            _write_header();
+        }
+    }
+
+    ~wav_writer_t()
+    {
+        close();
+    }
+
+    bool valid() const
+    {
+        return _fd != nullptr;
+    }
+
+    void write(const int16_t* src, uint32_t samples)
+    {
+        while (samples) {
+            const uint32_t space = uint32_t(_buffer.capacity() - _buffer.size());
+            const uint32_t todo = (samples < space) ? samples : space;
+            _buffer.insert(_buffer.end(), src, src + todo);
+            src += todo;
+            samples -= todo;
+            if (_buffer.size() == _buffer.capacity()) {
+                _flush();
+            }
+        }
+    }
+
+    // flush any buffered samples and finalize the header
+    bool close()
+    {
+        if (!_fd) {
+            return false;
+        }
+        _flush();
+        fseek(_fd, 0, SEEK_SET);
+        _write_header();
+        const bool ok = ferror(_fd) == 0;
+        fclose(_fd);
+        _fd = nullptr;
+        return ok;
+    }
+
+    // total samples written so far
+    uint64_t samples() const
+    {
+        return _written + _buffer.size();
+    }
+
+protected:
+#pragma pack(push, 1)
+    struct header_t {
+        char riff[4];
+        uint32_t riff_size;
+        char wave[4];
+        char fmt[4];
+        uint32_t fmt_size;
+        uint16_t format;
+        uint16_t channels;
+        uint32_t rate;
+        uint32_t byte_rate;
+        uint16_t block_align;
+        uint16_t bits;
+        char data[4];
+        uint32_t data_size;
+    };
+#pragma pack(pop)
+
+    void _write_header()
+    {
+        const uint32_t data_size = uint32_t(_written * sizeof(int16_t));
+        header_t h;
+        memcpy(h.riff, "RIFF", 4);
+        h.riff_size = data_size + sizeof(header_t) - 8;
+        memcpy(h.wave, "WAVE", 4);
+        memcpy(h.fmt, "fmt ", 4);
+        h.fmt_size = 16;
+        h.format = 1; // pcm
+        h.channels = uint16_t(_channels);
+        h.rate = _rate;
+        h.byte_rate = _rate * _channels * sizeof(int16_t);
+        h.block_align = uint16_t(_channels * sizeof(int16_t));
+        h.bits = 16;
+        memcpy(h.data, "data", 4);
+        h.data_size = data_size;
+        fwrite(&h, sizeof(h), 1, _fd);
+    }
+
+    void _flush()
+    {
+        if (!_buffer.empty()) {
+            fwrite(_buffer.data(), sizeof(int16_t), _buffer.size(), _fd);
+            _written += _buffer.size();
+            _buffer.clear();
+        }
+    }
+
+    FILE* _fd;
+    uint32_t _rate;
+    uint32_t _channels;
+    // samples flushed to disk
+    uint64_t _written;
+    // samples waiting to be flushed
+    std::vector<int16_t> _buffer;
+};